@@ -1,4 +1,7 @@
 // GATEMATE v1.0 - Firmware untuk ESP32
+// Gerakan gerbang diatur state machine berbasis millis(): handler HTTP
+// langsung kembali, loop() yang menghentikan motor saat timeout, sehingga
+// /stop dan endpoint lain tetap dilayani selama gerbang bergerak.
 #include <WiFi.h>
 #include <WebServer.h>
 #include <EEPROM.h>
@@ -12,10 +15,30 @@ WebServer server(80);
 #define RELAY_CLOSE 17  // GPIO17 untuk TUTUP
 #define STATUS_LED 2    // GPIO2 (LED built-in)
 
+#define MOTION_TIMEOUT_MS 30000  // Safety timeout 30 detik
+#define RELAY_DEADTIME_MS 500    // Jeda kedua relay mati saat ganti arah
+#define LED_BLINK_MS 500
+#define RESTART_DELAY_MS 2000
+
+enum GateMotion {
+  GATE_IDLE,
+  GATE_SWITCHING,  // Ganti arah: kedua relay mati dulu
+  GATE_OPENING,
+  GATE_CLOSING
+};
+
 String saved_ssid = "";
 String saved_password = "";
 bool gateMoving = false;
 
+GateMotion gateMotion = GATE_IDLE;
+GateMotion pendingMotion = GATE_IDLE;  // Arah setelah GATE_SWITCHING
+unsigned long motionStartedAt = 0;
+unsigned long ledToggledAt = 0;
+bool ledOn = false;
+bool restartPending = false;
+unsigned long restartRequestedAt = 0;
+
 void handleRoot() {
   String html = "<html><body>";
   html += "<h1>GATEMATE Controller</h1>";
@@ -27,28 +50,67 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+void setRelays(bool open, bool close) {
+  digitalWrite(RELAY_OPEN, open ? HIGH : LOW);
+  digitalWrite(RELAY_CLOSE, close ? HIGH : LOW);
+}
+
+void enterMotion(GateMotion motion) {
+  gateMotion = motion;
+  motionStartedAt = millis();
+  gateMoving = motion != GATE_IDLE;
+  setRelays(motion == GATE_OPENING, motion == GATE_CLOSING);
+}
+
+// Bergerak ke arah baru; kalau motor sedang jalan ke arah lain, lewat jeda dulu
+void startMotion(GateMotion direction) {
+  if (gateMotion == direction) {
+    motionStartedAt = millis();  // Perintah ulang: timeout dihitung dari awal
+    return;
+  }
+  if (gateMotion == GATE_IDLE) {
+    enterMotion(direction);
+    return;
+  }
+  pendingMotion = direction;
+  enterMotion(GATE_SWITCHING);
+}
+
+void haltGate() {
+  pendingMotion = GATE_IDLE;
+  enterMotion(GATE_IDLE);
+}
+
+void updateMotion() {
+  unsigned long elapsed = millis() - motionStartedAt;
+  switch (gateMotion) {
+    case GATE_SWITCHING:
+      if (elapsed >= RELAY_DEADTIME_MS) enterMotion(pendingMotion);
+      break;
+    case GATE_OPENING:
+    case GATE_CLOSING:
+      if (elapsed >= MOTION_TIMEOUT_MS) {
+        haltGate();
+        Serial.println("Safety timeout, gerbang berhenti");
+      }
+      break;
+    default:
+      break;
+  }
+}
+
 void openGate() {
-  digitalWrite(RELAY_CLOSE, LOW);
-  digitalWrite(RELAY_OPEN, HIGH);
-  gateMoving = true;
+  startMotion(GATE_OPENING);
   server.send(200, "text/plain", "Gerbang membuka...");
-  delay(30000); // Safety timeout 30 detik
-  stopGate();
 }
 
 void closeGate() {
-  digitalWrite(RELAY_OPEN, LOW);
-  digitalWrite(RELAY_CLOSE, HIGH);
-  gateMoving = true;
+  startMotion(GATE_CLOSING);
   server.send(200, "text/plain", "Gerbang menutup...");
-  delay(30000); // Safety timeout 30 detik
-  stopGate();
 }
 
 void stopGate() {
-  digitalWrite(RELAY_OPEN, LOW);
-  digitalWrite(RELAY_CLOSE, LOW);
-  gateMoving = false;
+  haltGate();
   server.send(200, "text/plain", "Gerbang berhenti");
 }
 
@@ -74,8 +136,18 @@ void saveWiFi() {
   EEPROM.end();
   
   server.send(200, "text/plain", "WiFi tersimpan! Restarting...");
-  delay(2000);
-  ESP.restart();
+  
+  // Restart dari loop() setelah respons terkirim; gerbang dihentikan dulu
+  haltGate();
+  restartPending = true;
+  restartRequestedAt = millis();
+}
+
+void updateStatusLed() {
+  if (millis() - ledToggledAt < LED_BLINK_MS) return;
+  ledToggledAt = millis();
+  ledOn = !ledOn;
+  digitalWrite(STATUS_LED, ledOn ? HIGH : LOW);
 }
 
 void setup() {
@@ -108,8 +180,10 @@ void setup() {
 
 void loop() {
   server.handleClient();
-  digitalWrite(STATUS_LED, HIGH);
-  delay(500);
-  digitalWrite(STATUS_LED, LOW);
-  delay(500);
+  updateMotion();
+  updateStatusLed();
+  
+  if (restartPending && millis() - restartRequestedAt >= RESTART_DELAY_MS) {
+    ESP.restart();
+  }
 }
\ No newline at end of file
@@ -35,6 +35,16 @@ export const config = {
     MQTT_BROKER_URL: process.env.MQTT_BROKER_URL || 'mqtt://localhost:1883',
     MQTT_USERNAME: process.env.MQTT_USERNAME || '',
     MQTT_PASSWORD: process.env.MQTT_PASSWORD || '',
+    // Fixed so the broker keeps the backend's persistent session across restarts
+    MQTT_CLIENT_ID: process.env.MQTT_CLIENT_ID || 'gatemate-backend',
+
+    // Devices run schedules locally in this POSIX TZ (e.g. "CET-1CEST,M3.5.0,M10.5.0/3")
+    DEVICE_TIMEZONE: process.env.DEVICE_TIMEZONE || 'WIB-7',
+
+    // Guest tokens verified offline by devices (per-device keys derive from this)
+    GUEST_TOKEN_SECRET: process.env.GUEST_TOKEN_SECRET || process.env.JWT_SECRET || 'guest-secret-change-in-prod!',
+    // Set while rotating GUEST_TOKEN_SECRET: devices only replace a key with a proof under the old one
+    GUEST_TOKEN_SECRET_PREVIOUS: process.env.GUEST_TOKEN_SECRET_PREVIOUS || '',
 
     // CORS
     CORS_ORIGIN: process.env.CORS_ORIGIN || 'http://localhost:5173',
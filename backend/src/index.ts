@@ -27,6 +27,7 @@ import { requestLogger, logger } from './middleware/logger.middleware.js';
 import { authRouter } from './modules/auth/auth.routes.js';
 import { deviceRouter } from './modules/devices/device.routes.js';
 import { commandRouter } from './modules/commands/command.routes.js';
+import { groupRouter } from './modules/groups/group.routes.js';
 import { scheduleRouter } from './modules/schedules/schedule.routes.js';
 import { guestRouter } from './modules/guest/guest.routes.js';
 import { pairingRouter } from './modules/pairing/pairing.routes.js';
@@ -109,6 +110,9 @@ app.use('/api/v1/devices', deviceRouter);
 // Command routes with command-specific rate limiting
 app.use('/api/v1/commands', commandLimiter, commandRouter);
 
+// Group and broadcast commands (one publish, acks aggregated per request)
+app.use('/api/v1/groups', commandLimiter, groupRouter);
+
 // Schedule management
 app.use('/api/v1/schedules', scheduleRouter);
 
@@ -5,14 +5,22 @@
 import type { Response, NextFunction } from 'express';
 import { PrismaClient } from '@prisma/client';
 import { AuthRequest } from '../../types/auth.types.js';
+import { publishCommand } from '../mqtt/mqtt.service.js';
 
 const prisma = new PrismaClient();
 
-// Note: In production, this would publish to MQTT
-async function sendCommandToDevice(deviceId: string, command: any) {
-    console.log(`Sending command to ${deviceId}:`, command);
-    // TODO: Implement MQTT publish
-    return true;
+// The row is EXECUTING before the publish, so a fast ack (the MQTT service
+// completes the row from /acks) is never overwritten. Marked FAILED when
+// the broker is unreachable.
+async function sendCommandToDevice(deviceId: string, commandId: string, command: object) {
+    if (publishCommand(deviceId, commandId, command)) {
+        return true;
+    }
+    await prisma.command.update({
+        where: { id: commandId },
+        data: { status: 'FAILED', completedAt: new Date() },
+    });
+    return false;
 }
 
 export class CommandController {
@@ -38,18 +46,15 @@ export class CommandController {
                     deviceId,
                     userId: req.user!.userId,
                     type: 'OPEN',
-                    status: 'PENDING',
+                    status: 'EXECUTING',
+                    executedAt: new Date(),
                 },
             });
 
             // Send to device
-            await sendCommandToDevice(device.deviceId, { command: 'open' });
-
-            // Update status
-            await prisma.command.update({
-                where: { id: command.id },
-                data: { status: 'EXECUTING', executedAt: new Date() },
-            });
+            if (!await sendCommandToDevice(device.deviceId, command.id, { command: 'open' })) {
+                return res.status(503).json({ error: 'MQTT broker unavailable' });
+            }
 
             res.json({ message: 'Gate opening', commandId: command.id });
         } catch (error) {
@@ -77,16 +82,14 @@ export class CommandController {
                     deviceId,
                     userId: req.user!.userId,
                     type: 'CLOSE',
-                    status: 'PENDING',
+                    status: 'EXECUTING',
+                    executedAt: new Date(),
                 },
             });
 
-            await sendCommandToDevice(device.deviceId, { command: 'close' });
-
-            await prisma.command.update({
-                where: { id: command.id },
-                data: { status: 'EXECUTING', executedAt: new Date() },
-            });
+            if (!await sendCommandToDevice(device.deviceId, command.id, { command: 'close' })) {
+                return res.status(503).json({ error: 'MQTT broker unavailable' });
+            }
 
             res.json({ message: 'Gate closing', commandId: command.id });
         } catch (error) {
@@ -114,16 +117,14 @@ export class CommandController {
                     deviceId,
                     userId: req.user!.userId,
                     type: 'STOP',
-                    status: 'PENDING',
+                    status: 'EXECUTING',
+                    executedAt: new Date(),
                 },
             });
 
-            await sendCommandToDevice(device.deviceId, { command: 'stop' });
-
-            await prisma.command.update({
-                where: { id: command.id },
-                data: { status: 'COMPLETED', executedAt: new Date(), completedAt: new Date() },
-            });
+            if (!await sendCommandToDevice(device.deviceId, command.id, { command: 'stop' })) {
+                return res.status(503).json({ error: 'MQTT broker unavailable' });
+            }
 
             res.json({ message: 'Gate stopped', commandId: command.id });
         } catch (error) {
@@ -157,16 +158,14 @@ export class CommandController {
                     userId: req.user!.userId,
                     type: 'PARTIAL',
                     payload: { percentage },
-                    status: 'PENDING',
+                    status: 'EXECUTING',
+                    executedAt: new Date(),
                 },
             });
 
-            await sendCommandToDevice(device.deviceId, { command: 'partial', percentage });
-
-            await prisma.command.update({
-                where: { id: command.id },
-                data: { status: 'EXECUTING', executedAt: new Date() },
-            });
+            if (!await sendCommandToDevice(device.deviceId, command.id, { command: 'partial', percentage })) {
+                return res.status(503).json({ error: 'MQTT broker unavailable' });
+            }
 
             res.json({ message: `Moving to ${percentage}%`, commandId: command.id });
         } catch (error) {
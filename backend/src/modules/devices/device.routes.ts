@@ -5,7 +5,7 @@
 import { Router, Request, Response } from 'express';
 import { PrismaClient } from '@prisma/client';
 import { authMiddleware, AuthRequest } from '../../middleware/auth.middleware.js';
-import { validate, asyncHandler, NotFoundError } from '../../middleware/error.middleware.js';
+import { validate, asyncHandler, NotFoundError, ConflictError } from '../../middleware/error.middleware.js';
 import {
     createDeviceSchema,
     updateDeviceSchema,
@@ -15,6 +15,16 @@ import {
 } from '../../utils/validation.js';
 import crypto from 'crypto';
 import { auditLogger } from '../../middleware/logger.middleware.js';
+import {
+    deriveDeviceKey,
+    deriveLanUserKey,
+    lanKeyId,
+    rekeyProof,
+    LAN_SERVICE,
+    LAN_UDP_PORT,
+    LAN_KEYS_MAX,
+} from '../../utils/guestToken.js';
+import { publishGuestSync, lanKeyHolders } from '../mqtt/mqtt.service.js';
 
 const router = Router();
 const prisma = new PrismaClient();
@@ -383,6 +393,144 @@ router.get('/:id/status',
     })
 );
 
+/**
+ * The caller's LAN key for a device, optionally rotated first. The guest
+ * sync is republished so the device lists the key id (and drops the old one
+ * after a rotation). 409 for a user beyond the LAN_KEYS_MAX the device
+ * holds, whose key it would drop.
+ */
+async function issueLanKey(req: Request, res: Response, rotate: boolean) {
+    const userId = (req as AuthRequest).user!.userId;
+    const { id } = req.params;
+
+    let userDevice = await prisma.userDevice.findFirst({
+        where: { deviceId: id, userId },
+        select: {
+            id: true,
+            lanKeySerial: true,
+            device: { select: { deviceId: true, ipAddress: true } },
+        },
+    });
+
+    if (!userDevice) {
+        throw new NotFoundError('Perangkat');
+    }
+
+    const holders = await lanKeyHolders(id);
+    if (!holders.some(h => h.id === userDevice!.id)) {
+        throw new ConflictError(`Perangkat hanya menyimpan ${LAN_KEYS_MAX} kunci LAN`);
+    }
+
+    if (rotate) {
+        userDevice = await prisma.userDevice.update({
+            where: { id: userDevice.id },
+            data: { lanKeySerial: { increment: 1 } },
+            select: {
+                id: true,
+                lanKeySerial: true,
+                device: { select: { deviceId: true, ipAddress: true } },
+            },
+        });
+    }
+
+    const keyId = lanKeyId(userDevice.id, userDevice.lanKeySerial);
+    await publishGuestSync(id);
+
+    auditLogger.log({
+        action: rotate ? 'LAN_KEY_ROTATED' : 'LAN_KEY_ISSUED',
+        resource: 'device',
+        resourceId: id,
+        userId,
+        details: { keyId },
+        success: true,
+    });
+
+    res.json({
+        success: true,
+        data: {
+            keyId,
+            key: deriveLanUserKey(userDevice.device.deviceId, keyId).toString('hex'),
+            service: LAN_SERVICE,
+            port: LAN_UDP_PORT,
+            ip: userDevice.device.ipAddress,
+        },
+    });
+}
+
+/**
+ * GET /api/v1/devices/:id/lan
+ * The user's own key and the address for commands straight to the device
+ * on the same network
+ */
+router.get('/:id/lan',
+    validate({ params: idParamSchema }),
+    asyncHandler(async (req: Request, res: Response) => {
+        await issueLanKey(req, res, false);
+    })
+);
+
+/**
+ * POST /api/v1/devices/:id/lan/rotate
+ * New LAN key for the user, e.g. after losing a phone; the old one stops
+ * working once the device has the guest sync
+ */
+router.post('/:id/lan/rotate',
+    validate({ params: idParamSchema }),
+    asyncHandler(async (req: Request, res: Response) => {
+        await issueLanKey(req, res, true);
+    })
+);
+
+/**
+ * GET /api/v1/devices/:id/guest-key
+ * Guest key for the owner's app to POST to the device (/guest/key) on the
+ * LAN during setup; it is never sent over MQTT. A device that already has a
+ * key answers 409 unless the proof (set while the secret is rotated) comes
+ * with it.
+ */
+router.get('/:id/guest-key',
+    validate({ params: idParamSchema }),
+    asyncHandler(async (req: Request, res: Response) => {
+        const userId = (req as AuthRequest).user!.userId;
+        const { id } = req.params;
+
+        const device = await prisma.device.findFirst({
+            where: {
+                id,
+                users: {
+                    some: { userId, role: 'OWNER' }
+                }
+            },
+            select: {
+                deviceId: true,
+                ipAddress: true,
+            },
+        });
+
+        if (!device) {
+            throw new NotFoundError('Perangkat');
+        }
+
+        auditLogger.log({
+            action: 'GUEST_KEY_ISSUED',
+            resource: 'device',
+            resourceId: id,
+            userId,
+            success: true,
+        });
+
+        res.json({
+            success: true,
+            data: {
+                key: deriveDeviceKey(device.deviceId).toString('hex'),
+                proof: rekeyProof(device.deviceId),
+                path: '/guest/key',
+                ip: device.ipAddress,
+            },
+        });
+    })
+);
+
 /**
  * GET /api/v1/devices/:id/logs
  * Get device activity logs
@@ -0,0 +1,322 @@
+// =============================================================================
+// GATEMATE Backend - Group Command Routes
+// =============================================================================
+//
+// Site-wide actions as one MQTT publish. Devices subscribe to the group
+// topics listed in their configuration and start group commands after a
+// per-device stagger, so hundreds of gates do not draw inrush current at
+// the same instant. Acks are aggregated per request (group.service.ts).
+//
+
+import { Router, Request, Response } from 'express';
+import { PrismaClient, Prisma, CommandType } from '@prisma/client';
+import crypto from 'crypto';
+import { authMiddleware, AuthRequest, requireRole } from '../../middleware/auth.middleware.js';
+import { validate, asyncHandler, NotFoundError, ValidationError } from '../../middleware/error.middleware.js';
+import {
+    deviceGroupsSchema,
+    groupCommandSchema,
+    groupParamSchema,
+    idParamSchema,
+} from '../../utils/validation.js';
+import { auditLogger } from '../../middleware/logger.middleware.js';
+import { publishDeviceConfig, publishGroupCommand } from '../mqtt/mqtt.service.js';
+import { GROUP_ACK_GRACE_MS, getGroupCommand, trackGroupCommand } from './group.service.js';
+
+const router = Router();
+const prisma = new PrismaClient();
+
+// Firmware limits (src/group_command.h)
+const DEVICE_GROUPS_MAX = 4;
+const GROUP_DELAY_MAX_MS = 120000;
+
+interface DeviceGroupConfig {
+    groups?: string[];
+    groupSlot?: number;
+}
+
+// All routes require authentication
+router.use(authMiddleware);
+
+// Group topics are shared by every device on the broker, so each user's
+// group names are prefixed with a scope derived from the user id
+function groupScope(userId: string): string {
+    return crypto.createHash('sha256').update(userId).digest('hex').slice(0, 6);
+}
+
+function scopedGroup(userId: string, name: string): string {
+    return `${groupScope(userId)}-${name}`;
+}
+
+function deviceGroups(config: Prisma.JsonValue): DeviceGroupConfig {
+    return (config && typeof config === 'object' && !Array.isArray(config))
+        ? config as DeviceGroupConfig
+        : {};
+}
+
+/**
+ * Creates the per-device Command rows, publishes once and starts collecting acks
+ * @param topicGroup Scoped group name, or null for broadcast
+ */
+async function sendGroupCommand(
+    req: Request,
+    res: Response,
+    topicGroup: string | null,
+    label: string,
+    members: { id: string; deviceId: string; config: Prisma.JsonValue }[],
+    outsiders: string[],
+) {
+    const userId = (req as AuthRequest).user!.userId;
+    const { command, percentage, staggerMs, jitterMs, targets } = req.body;
+
+    // Targets are given as Device.id; devices match on their hardware id
+    const byId = new Map(members.map(d => [d.id, d]));
+    const only = targets?.devices ? new Set<string>(targets.devices) : null;
+    const excluded = new Set<string>(targets?.exclude ?? []);
+    const addressed = members.filter(d => (!only || only.has(d.id)) && !excluded.has(d.id));
+
+    if (addressed.length === 0) {
+        throw new ValidationError('Tidak ada perangkat yang dituju');
+    }
+
+    const requestId = crypto.randomUUID();
+    const payload = {
+        command,
+        ...(percentage !== undefined && { percentage }),
+        requestId,
+        // Devices ack a command older than COMMAND_MAX_AGE_S "expired"
+        sentAt: Math.floor(Date.now() / 1000),
+        staggerMs,
+        jitterMs,
+        targets: {
+            ...(only && { devices: addressed.map(d => d.deviceId) }),
+            exclude: [
+                ...[...excluded].filter(id => byId.has(id)).map(id => byId.get(id)!.deviceId),
+                ...outsiders,
+            ],
+            ...(targets?.states && { states: targets.states }),
+        },
+    };
+
+    const commands = await prisma.$transaction(addressed.map(device =>
+        prisma.command.create({
+            data: {
+                deviceId: device.id,
+                userId,
+                type: command.toUpperCase() as CommandType,
+                payload: { group: label, requestId, ...(percentage !== undefined && { percentage }) },
+                status: 'EXECUTING',
+                executedAt: new Date(),
+            },
+        })
+    ));
+
+    if (!publishGroupCommand(topicGroup, payload)) {
+        await prisma.command.updateMany({
+            where: { id: { in: commands.map(c => c.id) } },
+            data: { status: 'FAILED', completedAt: new Date() },
+        });
+        return res.status(503).json({
+            success: false,
+            error: 'Broker MQTT tidak tersedia',
+        });
+    }
+
+    // Longest delay any addressed device can pick, plus time to report back
+    const maxSlot = Math.max(...addressed.map(d => deviceGroups(d.config).groupSlot ?? 0));
+    const maxDelayMs = command === 'stop' ? 0 : Math.min(maxSlot * staggerMs + jitterMs, GROUP_DELAY_MAX_MS);
+
+    trackGroupCommand({
+        requestId,
+        group: label,
+        command,
+        userId,
+        members: addressed.map((d, i) => ({ hardwareId: d.deviceId, commandId: commands[i].id })),
+        timeoutMs: maxDelayMs + GROUP_ACK_GRACE_MS,
+    });
+
+    auditLogger.log({
+        action: 'GROUP_COMMAND',
+        resource: 'group',
+        resourceId: requestId,
+        userId,
+        details: { group: label, command, devices: addressed.length },
+        success: true,
+    });
+
+    res.status(202).json({
+        success: true,
+        message: `Perintah ${command} dikirim ke ${addressed.length} perangkat`,
+        data: {
+            requestId,
+            group: label,
+            expected: addressed.length,
+            maxDelayMs,
+        },
+    });
+}
+
+// =============================================================================
+// Membership
+// =============================================================================
+
+/**
+ * GET /api/v1/groups
+ * List the current user's groups and their devices
+ */
+router.get('/',
+    asyncHandler(async (req: Request, res: Response) => {
+        const userId = (req as AuthRequest).user!.userId;
+        const prefix = `${groupScope(userId)}-`;
+
+        const devices = await prisma.device.findMany({
+            where: { users: { some: { userId } } },
+            select: { id: true, name: true, isOnline: true, config: true },
+        });
+
+        const groups = new Map<string, { id: string; name: string; isOnline: boolean; groupSlot: number }[]>();
+        for (const device of devices) {
+            const { groups: names = [], groupSlot = 0 } = deviceGroups(device.config);
+            for (const name of names.filter(n => n.startsWith(prefix))) {
+                const group = name.slice(prefix.length);
+                groups.set(group, [...(groups.get(group) ?? []), {
+                    id: device.id,
+                    name: device.name,
+                    isOnline: device.isOnline,
+                    groupSlot,
+                }]);
+            }
+        }
+
+        res.json({
+            success: true,
+            data: [...groups].map(([name, members]) => ({ name, devices: members })),
+        });
+    })
+);
+
+/**
+ * PUT /api/v1/groups/devices/:id
+ * Set a device's groups and stagger slot; pushed to the device as a config update
+ */
+router.put('/devices/:id',
+    validate({ params: idParamSchema, body: deviceGroupsSchema }),
+    asyncHandler(async (req: Request, res: Response) => {
+        const userId = (req as AuthRequest).user!.userId;
+        const { id } = req.params;
+        const { groups, groupSlot } = req.body;
+
+        const device = await prisma.device.findFirst({
+            where: { id, users: { some: { userId } } },
+        });
+
+        if (!device) {
+            throw new NotFoundError('Perangkat');
+        }
+
+        // Groups of other users sharing the device are kept
+        const prefix = `${groupScope(userId)}-`;
+        const current = deviceGroups(device.config);
+        const merged = [
+            ...(current.groups ?? []).filter(g => !g.startsWith(prefix)),
+            ...[...new Set<string>(groups)].map(g => scopedGroup(userId, g)),
+        ];
+
+        if (merged.length > DEVICE_GROUPS_MAX) {
+            throw new ValidationError(`Perangkat maksimal ${DEVICE_GROUPS_MAX} grup`);
+        }
+
+        const config = {
+            ...current,
+            groups: merged,
+            groupSlot: groupSlot ?? current.groupSlot ?? 0,
+        };
+
+        await prisma.device.update({
+            where: { id },
+            data: { config },
+        });
+
+        const delivered = publishDeviceConfig(device.deviceId, {
+            groups: config.groups,
+            groupSlot: config.groupSlot,
+        });
+
+        res.json({
+            success: true,
+            message: 'Grup perangkat diperbarui',
+            data: { groups, groupSlot: config.groupSlot, delivered },
+        });
+    })
+);
+
+// =============================================================================
+// Commands
+// =============================================================================
+
+/**
+ * GET /api/v1/groups/commands/:requestId
+ * Aggregated acks of a group command
+ */
+router.get('/commands/:requestId',
+    asyncHandler(async (req: Request, res: Response) => {
+        const userId = (req as AuthRequest).user!.userId;
+        const summary = getGroupCommand(req.params.requestId, userId);
+
+        if (!summary) {
+            throw new NotFoundError('Perintah grup');
+        }
+
+        res.json({ success: true, data: summary });
+    })
+);
+
+/**
+ * POST /api/v1/groups/broadcast/commands
+ * Command every device on the broker (e.g. fire access)
+ */
+router.post('/broadcast/commands',
+    requireRole('ADMIN'),
+    validate({ body: groupCommandSchema }),
+    asyncHandler(async (req: Request, res: Response) => {
+        const devices = await prisma.device.findMany({
+            select: { id: true, deviceId: true, config: true },
+        });
+
+        await sendGroupCommand(req, res, null, 'broadcast', devices, []);
+    })
+);
+
+/**
+ * POST /api/v1/groups/:group/commands
+ * Command every device of one of the user's groups
+ */
+router.post('/:group/commands',
+    validate({ params: groupParamSchema, body: groupCommandSchema }),
+    asyncHandler(async (req: Request, res: Response) => {
+        const userId = (req as AuthRequest).user!.userId;
+        const topicGroup = scopedGroup(userId, req.params.group);
+
+        const subscribed = await prisma.device.findMany({
+            where: { config: { path: ['groups'], array_contains: [topicGroup] } },
+            select: {
+                id: true,
+                deviceId: true,
+                config: true,
+                users: { where: { userId }, select: { id: true } },
+            },
+        });
+
+        // Devices still subscribed after the user lost access are excluded
+        const members = subscribed.filter(d => d.users.length > 0);
+        const outsiders = subscribed.filter(d => d.users.length === 0).map(d => d.deviceId);
+
+        if (members.length === 0) {
+            throw new NotFoundError('Grup');
+        }
+
+        await sendGroupCommand(req, res, topicGroup, req.params.group, members, outsiders);
+    })
+);
+
+export { router as groupRouter };
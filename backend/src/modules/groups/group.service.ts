@@ -0,0 +1,184 @@
+// =============================================================================
+// GATEMATE Backend - Group Command Aggregation
+// =============================================================================
+//
+// A group command is one MQTT publish that many devices act on, each after
+// its own stagger delay (firmware src/group_command.h). Every addressed
+// device acknowledges on gatemate/devices/<id>/acks; the acks are collected
+// here per requestId, progress goes to the requesting user's socket room,
+// and the per-device Command rows are settled in one pass when every device
+// has answered or the request times out.
+//
+
+import { Server as SocketIOServer } from 'socket.io';
+import { PrismaClient } from '@prisma/client';
+
+const prisma = new PrismaClient();
+
+let io: SocketIOServer | null = null;
+
+export type GroupAckStatus = 'executed' | 'skipped' | 'superseded' | 'rejected' | 'expired' | 'ignored';
+
+export interface GroupAck {
+    requestId: string;
+    group: string;
+    status: GroupAckStatus;
+    delayMs: number;
+    state: string;
+    percentage: number;
+}
+
+interface GroupMember {
+    hardwareId: string;
+    commandId: string;
+    ack?: GroupAck & { receivedAt: Date };
+}
+
+interface GroupCommandRun {
+    requestId: string;
+    group: string;
+    command: string;
+    userId: string;
+    startedAt: Date;
+    finishedAt?: Date;
+    timedOut: boolean;
+    members: Map<string, GroupMember>;
+    timer?: NodeJS.Timeout;
+    progressTimer?: NodeJS.Timeout;
+}
+
+// Running requests, plus the most recent finished ones for GET
+const runs = new Map<string, GroupCommandRun>();
+const FINISHED_KEPT = 100;
+const PROGRESS_INTERVAL_MS = 500;
+
+// Device acks arrive after their delay; wait this long on top of it
+export const GROUP_ACK_GRACE_MS = 15000;
+
+export function setGroupSocket(socketIO: SocketIOServer) {
+    io = socketIO;
+}
+
+export function trackGroupCommand(options: {
+    requestId: string;
+    group: string;
+    command: string;
+    userId: string;
+    members: { hardwareId: string; commandId: string }[];
+    timeoutMs: number;
+}) {
+    const run: GroupCommandRun = {
+        requestId: options.requestId,
+        group: options.group,
+        command: options.command,
+        userId: options.userId,
+        startedAt: new Date(),
+        timedOut: false,
+        members: new Map(options.members.map(m => [m.hardwareId, { ...m }])),
+    };
+    run.timer = setTimeout(() => void finish(run, true), options.timeoutMs);
+    runs.set(run.requestId, run);
+    pruneFinished();
+}
+
+/**
+ * Records one device's ack; acks for unknown or finished requests are dropped
+ * @param hardwareId Device.deviceId
+ */
+export async function recordGroupAck(hardwareId: string, ack: GroupAck) {
+    const run = runs.get(ack.requestId);
+    const member = run?.members.get(hardwareId);
+    if (!run || run.finishedAt || !member || member.ack) return;
+
+    member.ack = { ...ack, receivedAt: new Date() };
+
+    if ([...run.members.values()].every(m => m.ack)) {
+        await finish(run, false);
+    } else if (!run.progressTimer) {
+        // Hundreds of acks can arrive within a second; coalesce updates
+        run.progressTimer = setTimeout(() => {
+            run.progressTimer = undefined;
+            if (!run.finishedAt) io?.to(`user:${run.userId}`).emit('group:progress', summarize(run));
+        }, PROGRESS_INTERVAL_MS);
+    }
+}
+
+export function getGroupCommand(requestId: string, userId: string) {
+    const run = runs.get(requestId);
+    if (!run || run.userId !== userId) return null;
+    return summarize(run, true);
+}
+
+function summarize(run: GroupCommandRun, withDevices = false) {
+    const counts = { executed: 0, skipped: 0, superseded: 0, rejected: 0, expired: 0, ignored: 0, pending: 0 };
+    let maxDelayMs = 0;
+    for (const member of run.members.values()) {
+        if (member.ack) {
+            counts[member.ack.status] = (counts[member.ack.status] ?? 0) + 1;
+            maxDelayMs = Math.max(maxDelayMs, member.ack.delayMs);
+        } else {
+            counts.pending++;
+        }
+    }
+
+    return {
+        requestId: run.requestId,
+        group: run.group,
+        command: run.command,
+        expected: run.members.size,
+        counts,
+        maxDelayMs,
+        complete: !!run.finishedAt,
+        timedOut: run.timedOut,
+        startedAt: run.startedAt.toISOString(),
+        finishedAt: run.finishedAt?.toISOString(),
+        ...(withDevices && {
+            devices: [...run.members.values()].map(m => ({
+                deviceId: m.hardwareId,
+                commandId: m.commandId,
+                status: m.ack?.status ?? (run.finishedAt ? 'timeout' : 'pending'),
+                delayMs: m.ack?.delayMs,
+                state: m.ack?.state,
+            })),
+        }),
+    };
+}
+
+async function finish(run: GroupCommandRun, timedOut: boolean) {
+    if (run.finishedAt) return;
+    run.finishedAt = new Date();
+    run.timedOut = timedOut;
+    clearTimeout(run.timer);
+    clearTimeout(run.progressTimer);
+
+    // One update per outcome rather than one per device
+    const byOutcome = new Map<string, string[]>();
+    for (const member of run.members.values()) {
+        const outcome = member.ack?.status ?? 'timeout';
+        byOutcome.set(outcome, [...(byOutcome.get(outcome) ?? []), member.commandId]);
+    }
+
+    try {
+        await prisma.$transaction([...byOutcome].map(([outcome, ids]) =>
+            prisma.command.updateMany({
+                where: { id: { in: ids } },
+                data: {
+                    status: outcome === 'executed' ? 'COMPLETED' : outcome === 'timeout' ? 'TIMEOUT' : 'FAILED',
+                    completedAt: run.finishedAt,
+                    result: { requestId: run.requestId, group: run.group, outcome },
+                },
+            })
+        ));
+    } catch (error) {
+        console.error('Failed to settle group command:', error);
+    }
+
+    io?.to(`user:${run.userId}`).emit('group:completed', summarize(run));
+}
+
+function pruneFinished() {
+    const finished = [...runs.values()].filter(r => r.finishedAt);
+    for (const run of finished.slice(0, Math.max(0, finished.length - FINISHED_KEPT))) {
+        runs.delete(run.requestId);
+    }
+}
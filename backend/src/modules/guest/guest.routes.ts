@@ -9,15 +9,25 @@ import { authMiddleware, AuthRequest } from '../../middleware/auth.middleware.js
 import { validate, asyncHandler, NotFoundError, AuthorizationError, ValidationError } from '../../middleware/error.middleware.js';
 import { guestAccessSchema, idParamSchema, paginationSchema } from '../../utils/validation.js';
 import { auditLogger } from '../../middleware/logger.middleware.js';
+import { mintGuestToken } from '../../utils/guestToken.js';
+import { publishGuestSync } from '../mqtt/mqtt.service.js';
 
 const router = Router();
 const prisma = new PrismaClient();
 
+// A revoked pass is kept until it expires, so the guest sync can list it;
+// after that the device refuses it anyway. Pruned every hour.
+setInterval(() => {
+    prisma.guestPass.deleteMany({
+        where: { revoked: true, expiresAt: { lt: new Date() } },
+    }).catch(error => console.error('Failed to prune revoked guest passes:', error));
+}, 60 * 60 * 1000).unref();
 
 
-function generateQRData(code: string): string {
+function generateQRData(code: string, token?: string): string {
     const baseUrl = process.env.GUEST_ACCESS_URL || 'https://gatemate.io/guest';
-    return `${baseUrl}?code=${code}`;
+    // The token lets the app open the gate over the LAN (POST /guest on the device)
+    return token ? `${baseUrl}?code=${code}&t=${token}` : `${baseUrl}?code=${code}`;
 }
 
 // =============================================================================
@@ -26,7 +36,7 @@ function generateQRData(code: string): string {
 
 /**
  * GET /api/v1/guest
- * List all guest access tokens created by user
+ * List the guest access tokens created by user that are not revoked
  */
 router.get('/',
     authMiddleware,
@@ -39,7 +49,7 @@ router.get('/',
 
         const [guests, total] = await Promise.all([
             prisma.guestPass.findMany({
-                where: { createdBy: userId },
+                where: { createdBy: userId, revoked: false },
                 skip,
                 take: limit,
                 orderBy: { createdAt: 'desc' },
@@ -56,7 +66,7 @@ router.get('/',
                 // If I can't trust relation, I can't include.
                 // But let's assume standard Prisma usage implies relation for deviceId.
             }),
-            prisma.guestPass.count({ where: { createdBy: userId } }),
+            prisma.guestPass.count({ where: { createdBy: userId, revoked: false } }),
         ]);
 
         // If relation is missing in schema, we'd need to fetch devices.
@@ -135,6 +145,15 @@ router.post('/',
             }
         });
 
+        // Offline token, verified by the device itself
+        const token = mintGuestToken(device.deviceId, {
+            id: guestPass.id,
+            permissions: guestPass.permissions,
+            maxUses: guestPass.maxUses,
+            notBefore: new Date(guestPass.createdAt.getTime() - 5 * 60 * 1000), // Device clock skew
+            expiresAt: guestPass.expiresAt,
+        });
+
         auditLogger.log({
             action: 'CREATE_GUEST_PASS',
             resource: 'guest_pass',
@@ -144,13 +163,17 @@ router.post('/',
             success: true,
         });
 
+        // Make sure the device holds the current revocation filter
+        await publishGuestSync(device.id);
+
         res.status(201).json({
             success: true,
             message: 'Akses tamu berhasil dibuat',
             data: {
                 ...guestPass,
                 code: guestPass.id, // Use ID as code
-                qrData: generateQRData(guestPass.id),
+                token,
+                qrData: generateQRData(guestPass.id, token),
             },
         });
     })
@@ -175,7 +198,12 @@ router.delete('/:id',
             throw new NotFoundError('Akses tamu');
         }
 
-        await prisma.guestPass.delete({ where: { id } });
+        // Kept until expiry so devices can be told about the revocation
+        await prisma.guestPass.update({
+            where: { id },
+            data: { revoked: true },
+        });
+        await publishGuestSync(existing.deviceId);
 
         auditLogger.log({
             action: 'REVOKE_GUEST_PASS',
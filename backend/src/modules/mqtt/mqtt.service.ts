@@ -3,21 +3,40 @@
 // =============================================================================
 
 import mqtt from 'mqtt';
+import crypto from 'crypto';
 import { Server as SocketIOServer } from 'socket.io';
 import { PrismaClient } from '@prisma/client';
 import { config } from '../../config/env.js';
+import {
+    GUEST_BLOOM_BITS,
+    GUEST_BLOOM_HASHES,
+    LAN_KEYS_MAX,
+    buildRevocationFilter,
+    lanKeyId,
+} from '../../utils/guestToken.js';
+import { GroupAck, recordGroupAck, setGroupSocket } from '../groups/group.service.js';
 
 const prisma = new PrismaClient();
 
 let mqttClient: mqtt.MqttClient | null = null;
 let io: SocketIOServer | null = null;
 
+// Device acks are QoS 0 (PubSubClient cannot publish QoS 1), so one can be
+// lost. Rows still EXECUTING this long after the publish are settled as
+// TIMEOUT: past COMMAND_MAX_AGE_S on the device and the longest group delay.
+const COMMAND_ACK_TIMEOUT_MS = 5 * 60 * 1000;
+const COMMAND_SWEEP_INTERVAL_MS = 60 * 1000;
+
 export async function setupMQTT(socketIO: SocketIOServer) {
     io = socketIO;
+    setGroupSocket(socketIO);
 
+    // Persistent session under a fixed client id: the broker keeps the
+    // subscriptions while the backend restarts. Acks are QoS 0 and not
+    // queued meanwhile (queue_qos0_messages false); the sweep settles them.
     const options: mqtt.IClientOptions = {
-        clientId: `gatemate-backend-${Date.now()}`,
-        clean: true,
+        clientId: config.MQTT_CLIENT_ID,
+        clean: false,
         connectTimeout: 4000,
         reconnectPeriod: 1000,
     };
@@ -36,6 +55,10 @@ export async function setupMQTT(socketIO: SocketIOServer) {
             // Subscribe to all device topics
             mqttClient?.subscribe('gatemate/devices/+/status');
             mqttClient?.subscribe('gatemate/devices/+/sensors');
+            mqttClient?.subscribe('gatemate/devices/+/maintenance');
+            mqttClient?.subscribe('gatemate/devices/+/schedules/run');
+            mqttClient?.subscribe('gatemate/devices/+/guest/used');
+            mqttClient?.subscribe('gatemate/devices/+/acks', { qos: 1 });
         });
 
         mqttClient.on('message', handleMQTTMessage);
@@ -51,6 +74,22 @@ export async function setupMQTT(socketIO: SocketIOServer) {
     } catch (error) {
         console.warn('MQTT broker not available, running in standalone mode');
     }
+
+    setInterval(() => void sweepStaleCommands(), COMMAND_SWEEP_INTERVAL_MS).unref();
+}
+
+async function sweepStaleCommands() {
+    try {
+        await prisma.command.updateMany({
+            where: {
+                status: 'EXECUTING',
+                executedAt: { lt: new Date(Date.now() - COMMAND_ACK_TIMEOUT_MS) },
+            },
+            data: { status: 'TIMEOUT', completedAt: new Date() },
+        });
+    } catch (error) {
+        console.error('Failed to sweep stale commands:', error);
+    }
 }
 
 async function handleMQTTMessage(topic: string, payload: Buffer) {
@@ -66,6 +105,16 @@ async function handleMQTTMessage(topic: string, payload: Buffer) {
             await handleStatusUpdate(deviceId, message);
         } else if (messageType === 'sensors') {
             await handleSensorData(deviceId, message);
+        } else if (messageType === 'maintenance') {
+            handleMaintenanceReport(deviceId, message);
+        } else if (messageType === 'schedules' && parts[4] === 'run') {
+            await handleScheduleRun(deviceId, message);
+        } else if (messageType === 'guest' && parts[4] === 'used') {
+            await handleGuestUse(deviceId, message);
+        } else if (messageType === 'acks' && message.commandId) {
+            await handleCommandAck(deviceId, message as CommandAck);
+        } else if (messageType === 'acks') {
+            await recordGroupAck(deviceId, message as GroupAck);
         }
 
     } catch (error) {
@@ -142,14 +191,274 @@ async function handleSensorData(deviceId: string, sensors: SensorData) {
     }
 }
 
-export function publishCommand(deviceId: string, command: object) {
+interface CommandAck {
+    commandId: string;
+    status: 'executed' | 'rejected' | 'expired';
+    duplicate: boolean;
+    state: string;
+    percentage: number;
+    latencyMs: number;
+}
+
+async function handleCommandAck(deviceId: string, ack: CommandAck) {
+    // A redelivered command is acked again with its first outcome; a late
+    // ack still settles a row the sweep timed out. Only the device the
+    // command was sent to can settle it.
+    const settled = await prisma.command.updateMany({
+        where: {
+            id: ack.commandId,
+            device: { deviceId },
+            status: { in: ['PENDING', 'EXECUTING', 'TIMEOUT'] },
+        },
+        data: {
+            status: ack.status === 'executed' ? 'COMPLETED' : 'FAILED',
+            result: { ...ack },
+            completedAt: new Date(),
+        },
+    });
+
+    if (io && settled.count) {
+        io.to(`device:${deviceId}`).emit('command:ack', {
+            deviceId,
+            ...ack,
+            timestamp: new Date().toISOString(),
+        });
+    }
+}
+
+interface MaintenanceReport {
+    direction: 'open' | 'close';
+    durationMs: number;
+    inrushPeak: number;
+    steadyRms: number;
+    rippleRms: number;
+    rippleFreq: number;
+    harmonics: number;
+    energy: number;
+    operations: number;
+    drift: Record<string, number>;
+    alerts: string[];
+}
+
+function handleMaintenanceReport(deviceId: string, report: MaintenanceReport) {
+    if (report.alerts?.length) {
+        console.warn(`Motor drift on ${deviceId} (${report.direction}):`, report.alerts.join(', '));
+    }
+
+    // Per-operation motor signature from the device's on-board analysis
+    if (io) {
+        io.to(`device:${deviceId}`).emit('gate:maintenance', {
+            deviceId,
+            ...report,
+            timestamp: new Date().toISOString(),
+        });
+    }
+}
+
+interface ScheduleRunReport {
+    scheduleId: string;
+    action: string;
+    executed: boolean;
+    dueAt: number;      // UTC epoch seconds
+    firedAt: number;
+}
+
+async function handleScheduleRun(deviceId: string, run: ScheduleRunReport) {
+    // Runs can be reported late (queued while the device was offline)
+    await prisma.schedule.updateMany({
+        where: { id: run.scheduleId, device: { deviceId } },
+        data: { lastRunAt: new Date(run.dueAt * 1000) },
+    });
+
+    if (io) {
+        io.to(`device:${deviceId}`).emit('schedule:executed', {
+            deviceId,
+            ...run,
+            delaySeconds: run.firedAt - run.dueAt,
+            timestamp: new Date().toISOString(),
+        });
+    }
+}
+
+/**
+ * Pushes the device's complete schedule set (retained) so the device can
+ * run it from its own clock, including while the backend is unreachable.
+ * @param deviceDbId Device.id (not the hardware deviceId)
+ */
+export async function publishSchedules(deviceDbId: string) {
+    if (!mqttClient?.connected) {
+        console.warn('MQTT not connected, schedules not sent');
+        return false;
+    }
+
+    const device = await prisma.device.findUnique({
+        where: { id: deviceDbId },
+        include: { schedules: { where: { enabled: true } } },
+    });
+    if (!device) return false;
+
+    const schedules = device.schedules
+        .filter(s => ['OPEN', 'CLOSE', 'STOP', 'PARTIAL'].includes(s.action))
+        .map(s => ({
+            id: s.id,
+            action: s.action.toLowerCase(),
+            time: s.time,
+            days: s.recurrence ? JSON.parse(s.recurrence) : [],
+            enabled: s.enabled,
+            percentage: (s.payload as { percentage?: number } | null)?.percentage ?? 50,
+        }));
+
+    const payload = {
+        version: Math.floor(Date.now() / 1000),
+        tz: config.DEVICE_TIMEZONE,
+        schedules,
+    };
+
+    const topic = `gatemate/devices/${device.deviceId}/schedules`;
+    mqttClient.publish(topic, JSON.stringify(payload), { qos: 1, retain: true });
+    return true;
+}
+
+interface GuestUseReport {
+    passId: string;
+    action: string;
+    at: number;         // UTC epoch seconds
+}
+
+async function handleGuestUse(deviceId: string, use: GuestUseReport) {
+    // Verified on the device; reports arrive late if the site was offline
+    const guestPass = await prisma.guestPass.findUnique({ where: { id: use.passId } });
+    const device = await prisma.device.findFirst({ where: { deviceId } });
+    if (!guestPass || !device || guestPass.deviceId !== device.id) return;
+
+    await prisma.guestPass.update({
+        where: { id: guestPass.id },
+        data: { usedCount: { increment: 1 } },
+    });
+
+    await prisma.accessLog.create({
+        data: {
+            userId: null,
+            deviceId: device.id,
+            action: use.action,
+            details: JSON.stringify({
+                guestName: guestPass.name,
+                source: 'guest-lan',
+                at: new Date(use.at * 1000).toISOString(),
+            }),
+        },
+    });
+
+    if (io) {
+        io.to(`device:${deviceId}`).emit('guest:used', {
+            deviceId,
+            ...use,
+            guestName: guestPass.name,
+            timestamp: new Date().toISOString(),
+        });
+    }
+}
+
+/**
+ * Users whose LAN key the device accepts: it holds LAN_KEYS_MAX, and the
+ * earliest users keep theirs
+ * @param deviceDbId Device.id (not the hardware deviceId)
+ */
+export function lanKeyHolders(deviceDbId: string) {
+    return prisma.userDevice.findMany({
+        where: { deviceId: deviceDbId },
+        orderBy: { createdAt: 'asc' },
+        take: LAN_KEYS_MAX,
+        select: { id: true, lanKeySerial: true },
+    });
+}
+
+/**
+ * Pushes the bloom filter of revoked passes that have not expired yet and
+ * the LAN key ids of the device's users (retained), so the device can
+ * verify guest tokens and LAN commands offline. Call it again whenever a
+ * user is added, removed or rotates a key. The guest key is not part of
+ * it: the broker is anonymous and retains the message, so the owner's app
+ * provisions the key on the LAN (GET /devices/:id/guest-key).
+ * @param deviceDbId Device.id (not the hardware deviceId)
+ */
+export async function publishGuestSync(deviceDbId: string) {
+    if (!mqttClient?.connected) {
+        console.warn('MQTT not connected, guest filter not sent');
+        return false;
+    }
+
+    const device = await prisma.device.findUnique({ where: { id: deviceDbId } });
+    if (!device) return false;
+
+    const revoked = await prisma.guestPass.findMany({
+        where: { deviceId: device.id, revoked: true, expiresAt: { gt: new Date() } },
+        select: { id: true },
+    });
+
+    const users = await lanKeyHolders(device.id);
+
+    const content = {
+        bits: GUEST_BLOOM_BITS,
+        hashes: GUEST_BLOOM_HASHES,
+        filter: buildRevocationFilter(revoked.map(r => r.id)).toString('base64url'),
+        lan: users.map(u => lanKeyId(u.id, u.lanKeySerial)),
+    };
+
+    // Changes with the content only: the device skips an unchanged sync,
+    // and two changes within one second still both apply
+    const version = crypto.createHash('sha256').update(JSON.stringify(content))
+        .digest().readUInt32LE(0) || 1;
+    const payload = { version, ...content };
+
+    const topic = `gatemate/devices/${device.deviceId}/guest`;
+    mqttClient.publish(topic, JSON.stringify(payload), { qos: 1, retain: true });
+    return true;
+}
+
+/**
+ * QoS 1 with the Command row's id: the broker holds it for an offline
+ * device and may deliver it twice; the device runs it once and answers on
+ * /acks. sentAt lets the device refuse a command that waited too long.
+ */
+export function publishCommand(deviceId: string, commandId: string, command: object) {
     if (!mqttClient?.connected) {
         console.warn('MQTT not connected, command not sent');
         return false;
     }
 
+    const payload = { ...command, commandId, sentAt: Math.floor(Date.now() / 1000) };
     const topic = `gatemate/devices/${deviceId}/commands`;
-    mqttClient.publish(topic, JSON.stringify(command));
+    mqttClient.publish(topic, JSON.stringify(payload), { qos: 1 });
+    return true;
+}
+
+/**
+ * Publishes a configuration patch; the device commits it as one update
+ * @param hardwareId Device.deviceId
+ */
+export function publishDeviceConfig(hardwareId: string, patch: object) {
+    if (!mqttClient?.connected) {
+        console.warn('MQTT not connected, configuration not sent');
+        return false;
+    }
+
+    const topic = `gatemate/devices/${hardwareId}/config`;
+    mqttClient.publish(topic, JSON.stringify(patch), { qos: 1 });
+    return true;
+}
+
+/**
+ * One publish for every device in a group, or every device with group null
+ */
+export function publishGroupCommand(group: string | null, command: object) {
+    if (!mqttClient?.connected) {
+        console.warn('MQTT not connected, group command not sent');
+        return false;
+    }
+
+    const topic = group ? `gatemate/groups/${group}/commands` : 'gatemate/broadcast/commands';
+    mqttClient.publish(topic, JSON.stringify(command), { qos: 1 });
     return true;
 }
 
@@ -8,6 +8,7 @@ import { PrismaClient } from '@prisma/client';
 import { authMiddleware } from '../../middleware/auth.middleware.js';
 import { AuthRequest } from '../../types/auth.types.js';
 import type { Response, NextFunction } from 'express';
+import { publishGuestSync } from '../mqtt/mqtt.service.js';
 
 const router = Router();
 const prisma = new PrismaClient();
@@ -246,6 +247,9 @@ router.delete('/:deviceId', authMiddleware, async (req: AuthRequest, res: Respon
             where: { deviceId },
         });
 
+        // Empties the device's LAN key list while the device row still exists
+        await publishGuestSync(deviceId);
+
         await prisma.device.delete({
             where: { id: deviceId },
         });
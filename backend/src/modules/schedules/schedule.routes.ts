@@ -13,6 +13,7 @@ import {
     paginationSchema,
 } from '../../utils/validation.js';
 import { auditLogger } from '../../middleware/logger.middleware.js';
+import { publishSchedules } from '../mqtt/mqtt.service.js';
 
 const router = Router();
 const prisma = new PrismaClient();
@@ -168,6 +169,9 @@ router.post('/',
             success: true,
         });
 
+        // Devices run schedules locally; push the updated set
+        await publishSchedules(deviceId);
+
         res.status(201).json({
             success: true,
             message: 'Jadwal berhasil dibuat',
@@ -231,6 +235,8 @@ router.put('/:id',
             success: true,
         });
 
+        await publishSchedules(existing.deviceId);
+
         res.json({
             success: true,
             message: 'Jadwal berhasil diperbarui',
@@ -275,6 +281,8 @@ router.delete('/:id',
             success: true,
         });
 
+        await publishSchedules(existing.deviceId);
+
         res.json({
             success: true,
             message: 'Jadwal berhasil dihapus',
@@ -318,6 +326,8 @@ router.patch('/:id/toggle',
             success: true,
         });
 
+        await publishSchedules(existing.deviceId);
+
         res.json({
             success: true,
             message: schedule.enabled ? 'Jadwal diaktifkan' : 'Jadwal dinonaktifkan',
@@ -8,6 +8,7 @@ import { PrismaClient } from '@prisma/client';
 import { authMiddleware } from '../../middleware/auth.middleware.js';
 import { AuthRequest } from '../../types/auth.types.js';
 import type { Response, NextFunction } from 'express';
+import { publishGuestSync } from '../mqtt/mqtt.service.js';
 
 const router = Router();
 const prisma = new PrismaClient();
@@ -244,6 +245,9 @@ router.delete('/users/:deviceId/:userId', authMiddleware, async (req: AuthReques
             where: { deviceId, userId },
         });
 
+        // Takes the user's LAN key id off the device
+        await publishGuestSync(deviceId);
+
         res.json({ message: 'User removed' });
     } catch (error) {
         next(error);
@@ -0,0 +1,154 @@
+// =============================================================================
+// GATEMATE Backend - Offline Guest Tokens
+// =============================================================================
+//
+// Signed guest tokens that the device verifies on its own (firmware
+// src/guest_token.h), plus the revocation bloom filter it checks them
+// against. Layouts and hashing must stay in step with the firmware.
+//
+
+import crypto from 'crypto';
+import { config } from '../config/env.js';
+
+export const GUEST_TOKEN_VERSION = 1;
+export const GUEST_TAG_LEN = 16;
+export const GUEST_ID_MAX = 32;
+export const GUEST_BLOOM_BITS = 4096;
+export const GUEST_BLOOM_HASHES = 7;
+export const LAN_UDP_PORT = 4210;
+export const LAN_SERVICE = '_gatemate._udp';
+export const LAN_KEYS_MAX = 16;
+
+const PERMISSION_BITS: Record<string, number> = {
+    open: 0x01,
+    close: 0x02,
+};
+
+export interface GuestTokenClaims {
+    id: string;
+    permissions: string[];
+    maxUses: number;
+    notBefore: Date;
+    expiresAt: Date;
+}
+
+/**
+ * Per-device HMAC key; a token only verifies on the device it was issued for
+ * @param hardwareId Device.deviceId
+ */
+export function deriveDeviceKey(hardwareId: string, secret: string = config.GUEST_TOKEN_SECRET): Buffer {
+    return crypto
+        .createHmac('sha256', secret)
+        .update(`gatemate-guest:${hardwareId}`)
+        .digest();
+}
+
+/**
+ * Proof that lets a device holding a key replace it (firmware
+ * src/guest_access.h): HMAC(key under GUEST_TOKEN_SECRET_PREVIOUS,
+ * "gatemate-rekey" || current key). Null when no previous secret is set;
+ * a device without a key takes the first one it is given.
+ * @param hardwareId Device.deviceId
+ */
+export function rekeyProof(hardwareId: string): string | null {
+    if (!config.GUEST_TOKEN_SECRET_PREVIOUS) return null;
+    return crypto
+        .createHmac('sha256', deriveDeviceKey(hardwareId, config.GUEST_TOKEN_SECRET_PREVIOUS))
+        .update(Buffer.concat([Buffer.from('gatemate-rekey'), deriveDeviceKey(hardwareId)]))
+        .digest('hex');
+}
+
+/**
+ * Device-wide key for UDP commands on the LAN (firmware src/lan_command.h);
+ * the device derives it from the guest key. Never handed out: users get a
+ * key of their own below.
+ * @param hardwareId Device.deviceId
+ */
+function deriveLanKey(hardwareId: string): Buffer {
+    return crypto
+        .createHmac('sha256', deriveDeviceKey(hardwareId))
+        .update('gatemate-lan')
+        .digest();
+}
+
+/**
+ * 32-bit id of one user's LAN key on one device; a new serial (rotation)
+ * gives a new id, and with it a new key
+ * @param userDeviceId UserDevice.id
+ */
+export function lanKeyId(userDeviceId: string, serial: number): number {
+    return crypto
+        .createHash('sha256')
+        .update(`${userDeviceId}:${serial}`)
+        .digest()
+        .readUInt32LE(0);
+}
+
+/**
+ * One user's LAN key; the device derives the same key from the key id and
+ * only accepts ids listed in the guest sync
+ * @param hardwareId Device.deviceId
+ */
+export function deriveLanUserKey(hardwareId: string, keyId: number): Buffer {
+    const id = Buffer.alloc(4);
+    id.writeUInt32LE(keyId);
+    return crypto
+        .createHmac('sha256', deriveLanKey(hardwareId))
+        .update(id)
+        .digest();
+}
+
+/**
+ * base64url(payload) "." base64url(HMAC-SHA256(key, payload)[0..15])
+ */
+export function mintGuestToken(hardwareId: string, claims: GuestTokenClaims): string {
+    const id = Buffer.from(claims.id, 'utf8');
+    if (id.length === 0 || id.length > GUEST_ID_MAX) {
+        throw new Error('Guest pass id does not fit the token');
+    }
+
+    const permissions = claims.permissions.reduce((bits, p) => bits | (PERMISSION_BITS[p] ?? 0), 0);
+
+    const payload = Buffer.alloc(12 + id.length);
+    payload[0] = GUEST_TOKEN_VERSION;
+    payload[1] = permissions;
+    payload[2] = Math.min(claims.maxUses, 255);
+    payload[3] = id.length;
+    payload.writeUInt32LE(Math.floor(claims.notBefore.getTime() / 1000), 4);
+    payload.writeUInt32LE(Math.floor(claims.expiresAt.getTime() / 1000), 8);
+    id.copy(payload, 12);
+
+    const tag = crypto
+        .createHmac('sha256', deriveDeviceKey(hardwareId))
+        .update(payload)
+        .digest()
+        .subarray(0, GUEST_TAG_LEN);
+
+    return `${payload.toString('base64url')}.${tag.toString('base64url')}`;
+}
+
+function fnv1a64(value: string): bigint {
+    let hash = 0xcbf29ce484222325n;
+    for (const byte of Buffer.from(value, 'utf8')) {
+        hash ^= BigInt(byte);
+        hash = (hash * 0x100000001b3n) & 0xffffffffffffffffn;
+    }
+    return hash;
+}
+
+/**
+ * Bloom filter of revoked pass ids; bit i = (h1 + i * h2) mod m over FNV-1a 64
+ */
+export function buildRevocationFilter(ids: string[]): Buffer {
+    const bits = Buffer.alloc(GUEST_BLOOM_BITS / 8);
+    for (const id of ids) {
+        const hash = fnv1a64(id);
+        const h1 = Number(hash & 0xffffffffn);
+        const h2 = Number(hash >> 32n) | 1;
+        for (let i = 0; i < GUEST_BLOOM_HASHES; i++) {
+            const bit = ((h1 + Math.imul(i, h2)) >>> 0) % GUEST_BLOOM_BITS;
+            bits[bit >> 3] |= 1 << (bit & 7);
+        }
+    }
+    return bits;
+}
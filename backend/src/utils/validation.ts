@@ -193,6 +193,60 @@ export const guestAccessSchema = z.object({
         .default(['open']),
 });
 
+// =============================================================================
+// Group Command Schemas
+// =============================================================================
+
+// Becomes an MQTT topic level on the device (firmware src/group_command.h)
+export const groupNameSchema = z.string()
+    .regex(/^[a-z0-9_-]{1,16}$/, 'Nama grup hanya huruf kecil, angka, - dan _ (maksimal 16)')
+    .refine(val => val !== 'broadcast', 'Nama grup "broadcast" sudah dipakai sistem');
+
+export const groupParamSchema = z.object({
+    group: groupNameSchema,
+});
+
+export const deviceGroupsSchema = z.object({
+    groups: z.array(groupNameSchema)
+        .max(4, 'Maksimal 4 grup per perangkat'),
+
+    groupSlot: z.number()
+        .int('Slot harus bilangan bulat')
+        .min(0, 'Slot tidak boleh negatif')
+        .max(1000, 'Slot maksimal 1000')
+        .optional(),
+});
+
+export const groupCommandSchema = z.object({
+    command: z.enum(['open', 'close', 'stop', 'partial'], {
+        errorMap: () => ({ message: 'Command harus open, close, stop, atau partial' }),
+    }),
+
+    percentage: z.number()
+        .int()
+        .min(0, 'Persentase minimal 0')
+        .max(100, 'Persentase maksimal 100')
+        .optional(),
+
+    staggerMs: z.number()
+        .int()
+        .min(0)
+        .max(10000, 'Jeda antar slot maksimal 10 detik')
+        .default(0),
+
+    jitterMs: z.number()
+        .int()
+        .min(0)
+        .max(60000, 'Jitter maksimal 60 detik')
+        .default(2000),
+
+    targets: z.object({
+        devices: z.array(z.string()).max(500).optional(),
+        exclude: z.array(z.string()).max(500).optional(),
+        states: z.array(z.enum(['closed', 'opening', 'open', 'closing', 'stopped', 'error'])).optional(),
+    }).optional(),
+});
+
 // =============================================================================
 // Pagination Schema
 // =============================================================================
@@ -238,4 +292,6 @@ export type DeviceCommandInput = z.infer<typeof deviceCommandSchema>;
 export type CreateScheduleInput = z.infer<typeof createScheduleSchema>;
 export type UpdateScheduleInput = z.infer<typeof updateScheduleSchema>;
 export type GuestAccessInput = z.infer<typeof guestAccessSchema>;
+export type DeviceGroupsInput = z.infer<typeof deviceGroupsSchema>;
+export type GroupCommandInput = z.infer<typeof groupCommandSchema>;
 export type PaginationInput = z.infer<typeof paginationSchema>;
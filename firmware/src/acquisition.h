@@ -0,0 +1,237 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Sensor Acquisition Scheduler
+// =============================================================================
+//
+// Reads the ADC channels at their own rates. A channel has a conversion
+// period and an oversampling factor: its raw reads are spread evenly over
+// the period and averaged into one conversion, which the ADC calibration
+// then linearizes. Every loop() pass takes at most ACQ_READS_PER_PASS
+// reads, the most overdue channel first, so channels interleave and no
+// pass blocks on a burst. A channel that falls behind by more than one
+// read (a long pass, the idle slices) drops the missed reads instead of
+// catching up.
+//
+// The cost of each channel (reads, conversions, dropped reads and the CPU
+// time of its reads) is counted over one-second windows.
+//
+// Io: uint16_t read(uint8_t pin); uint32_t cycles(); uint32_t cyclesPerUs()
+//
+// No Arduino dependency; see tools/acquisition_check.cpp.
+//
+
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include <stdint.h>
+#include "config.h"
+
+// =============================================================================
+// Calibration
+// =============================================================================
+
+enum AdcCalSource : uint8_t {
+  ADC_CAL_NONE = 0,       // Ideal converter
+  ADC_CAL_DEFAULT_VREF,   // Nominal reference, eFuse not burned
+  ADC_CAL_EFUSE_VREF,     // Reference voltage measured at the factory
+  ADC_CAL_EFUSE_TP,       // Two-point values measured at the factory
+};
+
+inline const char* adcCalSourceName(AdcCalSource source) {
+  switch (source) {
+    case ADC_CAL_DEFAULT_VREF: return "default";
+    case ADC_CAL_EFUSE_VREF: return "efuse_vref";
+    case ADC_CAL_EFUSE_TP: return "efuse_tp";
+    default: return "none";
+  }
+}
+
+#define ADC_CAL_STEP    128     // Raw codes between knots
+#define ADC_CAL_KNOTS   (4096 / ADC_CAL_STEP + 1)
+
+// Raw code to the code an ideal 0-3300 mV converter would give, which is
+// what the sensor conversions (sensor_chain.h) assume. Piecewise linear
+// between knots every ADC_CAL_STEP codes, so the per-chip characterization
+// runs once at boot and a conversion costs one interpolation.
+class AdcCalibration {
+private:
+  uint16_t knots[ADC_CAL_KNOTS];
+  AdcCalSource calSource = ADC_CAL_NONE;
+
+public:
+  AdcCalibration() {
+    for (uint8_t i = 0; i < ADC_CAL_KNOTS; i++) knots[i] = i * ADC_CAL_STEP;
+  }
+
+  // toMilliVolts: raw code -> mV for this chip
+  template <typename ToMilliVolts>
+  void build(ToMilliVolts toMilliVolts, AdcCalSource source) {
+    for (uint8_t i = 0; i < ADC_CAL_KNOTS; i++) {
+      uint16_t raw = i * ADC_CAL_STEP > 4095 ? 4095 : i * ADC_CAL_STEP;
+      int32_t code = ((int32_t)toMilliVolts(raw) * 4095 + 1650) / 3300;
+      knots[i] = code < 0 ? 0 : code > 8191 ? 8191 : (uint16_t)code;
+    }
+    calSource = source;
+  }
+
+  // raw16: raw code in 1/16 LSB, as oversampling gives it. Knots may lie
+  // above full scale; the result is clamped to it.
+  uint16_t apply16(uint32_t raw16) const {
+    uint32_t knot = raw16 / (ADC_CAL_STEP * 16);
+    if (knot >= ADC_CAL_KNOTS - 1) knot = ADC_CAL_KNOTS - 2;
+    int32_t frac = (int32_t)(raw16 - knot * ADC_CAL_STEP * 16);
+    int32_t low = knots[knot];
+    int32_t span = (int32_t)knots[knot + 1] - low;
+    int32_t code = low + (span * frac + ADC_CAL_STEP * 8) / (ADC_CAL_STEP * 16);
+    return code > 4095 ? 4095 : (uint16_t)code;
+  }
+
+  uint16_t apply(uint16_t raw) const { return apply16((uint32_t)raw * 16); }
+  AdcCalSource source() const { return calSource; }
+};
+
+// =============================================================================
+// Scheduler
+// =============================================================================
+
+// Per channel, over the last complete one-second window
+struct AcqChannelStats {
+  uint16_t reads;
+  uint16_t conversions;
+  uint16_t missed;          // Reads dropped by falling behind
+  uint32_t cpuUs;           // Time spent in its reads
+};
+
+template <typename Io, uint8_t Capacity>
+class AcquisitionScheduler {
+  static_assert(Capacity <= 32, "one ready bit per channel");
+
+private:
+  struct Channel {
+    const char* name;
+    uint8_t pin;
+    uint8_t oversample;
+    uint16_t periodMs;
+    uint32_t intervalUs;    // Between raw reads
+    uint32_t dueUs;
+    uint32_t sum;
+    uint8_t taken;
+    uint16_t value;
+    uint32_t windowNs;
+    AcqChannelStats window;
+    AcqChannelStats last;
+  };
+
+  Channel channels[Capacity];
+  Io* io = nullptr;
+  const AdcCalibration* calibration = nullptr;
+  uint8_t count = 0;
+  uint32_t windowStartUs = 0;
+  bool started = false;
+
+  void rollWindow(uint32_t nowUs) {
+    if (nowUs - windowStartUs < 1000000u) return;
+    for (uint8_t i = 0; i < count; i++) {
+      Channel& c = channels[i];
+      c.window.cpuUs = c.windowNs / 1000;
+      c.last = c.window;
+      c.window = {};
+      c.windowNs = 0;
+    }
+    windowStartUs = nowUs;
+  }
+
+  // Most overdue channel, or -1 if none is due
+  int8_t nextDue(uint32_t nowUs) const {
+    int8_t next = -1;
+    int32_t latest = -1;
+    for (uint8_t i = 0; i < count; i++) {
+      int32_t late = (int32_t)(nowUs - channels[i].dueUs);
+      if (late > latest) {
+        latest = late;
+        next = (int8_t)i;
+      }
+    }
+    return next;
+  }
+
+  // One raw read; returns true if it completed a conversion
+  bool read(Channel& c, uint32_t nowUs) {
+    uint32_t start = io->cycles();
+    c.sum += io->read(c.pin);
+    bool done = ++c.taken == c.oversample;
+    if (done) {
+      c.value = calibration->apply16((c.sum * 16 + c.oversample / 2) / c.oversample);
+      c.sum = 0;
+      c.taken = 0;
+      c.window.conversions++;
+    }
+    c.windowNs += (uint32_t)((uint64_t)(io->cycles() - start) * 1000 / io->cyclesPerUs());
+    c.window.reads++;
+
+    c.dueUs += c.intervalUs;
+    int32_t behind = (int32_t)(nowUs - c.dueUs);
+    if (behind >= 0) {
+      c.window.missed += (uint16_t)(behind / c.intervalUs + 1);
+      c.dueUs = nowUs + c.intervalUs;
+    }
+    return done;
+  }
+
+public:
+  void begin(Io& board, const AdcCalibration& cal) {
+    io = &board;
+    calibration = &cal;
+  }
+
+  // Returns the channel index, or -1 when full
+  int8_t add(const char* name, uint8_t pin, uint16_t periodMs, uint8_t oversample) {
+    if (count >= Capacity || !periodMs || !oversample) return -1;
+    Channel& c = channels[count];
+    c = {};
+    c.name = name;
+    c.pin = pin;
+    c.periodMs = periodMs;
+    c.oversample = oversample;
+    c.intervalUs = (uint32_t)periodMs * 1000u / oversample;
+    return (int8_t)count++;
+  }
+
+  // Once per loop() pass. Returns one bit per channel with a new
+  // conversion.
+  uint32_t poll(uint32_t nowUs) {
+    if (!started) {
+      // Staggered first reads, so equal rates do not share passes
+      for (uint8_t i = 0; i < count; i++) {
+        channels[i].dueUs = nowUs + i * channels[i].intervalUs / count;
+      }
+      windowStartUs = nowUs;
+      started = true;
+    }
+    rollWindow(nowUs);
+
+    uint32_t ready = 0;
+    for (uint8_t r = 0; r < ACQ_READS_PER_PASS; r++) {
+      int8_t next = nextDue(nowUs);
+      if (next < 0) break;
+      if (read(channels[next], nowUs)) ready |= 1u << next;
+    }
+    return ready;
+  }
+
+  // Last conversion, calibrated, in 12-bit codes
+  uint16_t value(uint8_t channel) const { return channels[channel].value; }
+
+  uint8_t size() const { return count; }
+  const char* name(uint8_t channel) const { return channels[channel].name; }
+  uint16_t periodMs(uint8_t channel) const { return channels[channel].periodMs; }
+  uint8_t oversample(uint8_t channel) const { return channels[channel].oversample; }
+  const AcqChannelStats& stats(uint8_t channel) const { return channels[channel].last; }
+
+  uint32_t cpuUs() const {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < count; i++) total += channels[i].last.cpuUs;
+    return total;
+  }
+};
+
+#endif // ACQUISITION_H
@@ -0,0 +1,270 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Command Delivery
+// =============================================================================
+//
+// At-least-once gate commands on /commands. The device subscribes at QoS 1
+// with a persistent session, so the broker keeps commands sent while the
+// device is offline and redelivers any it did not see acknowledged. A
+// command carries a commandId:
+//   {"command": "open", "commandId": "...", "sentAt": 1718000000}
+// and every command with an id is answered on /acks:
+//   {"deviceId": "...", "commandId": "...", "status": "executed",
+//    "duplicate": false, "state": "opening", "percentage": 0, "latencyMs": 2}
+//
+// CommandLog remembers the last COMMAND_LOG_SIZE ids with their outcome. A
+// redelivered command is not run again; its original outcome is acked with
+// "duplicate": true. The log lives in RTC memory, so a redelivery after a
+// watchdog or software reset does not actuate twice either. A command
+// older than COMMAND_MAX_AGE_S (device clock set, sentAt given) is not run
+// and acked "expired": a gate must not open minutes after the tap because
+// the device was offline.
+//
+// Acks go out from the callback when the link is up; otherwise they wait
+// in a COMMAND_ACK_QUEUE ring and are flushed after the reconnect.
+// Commands from the LAN (lan_command.h) share the log and are answered by
+// datagram instead.
+//
+// No Arduino dependency; see tools/command_qos_check.cpp.
+//
+
+#ifndef COMMAND_DELIVERY_H
+#define COMMAND_DELIVERY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "gate_motion.h"
+
+#define COMMAND_LOG_MAGIC   0x434D4431u   // "CMD1"
+#define COMMAND_MIN_EPOCH   1700000000u   // Below this the clock is not set
+
+enum CommandAckStatus : uint8_t {
+  CMD_ACK_EXECUTED = 0,
+  CMD_ACK_REJECTED,     // Unknown command
+  CMD_ACK_EXPIRED,      // Older than COMMAND_MAX_AGE_S
+};
+
+inline const char* commandAckStatusName(uint8_t status) {
+  switch (status) {
+    case CMD_ACK_EXECUTED: return "executed";
+    case CMD_ACK_REJECTED: return "rejected";
+    case CMD_ACK_EXPIRED: return "expired";
+    default: return "unknown";
+  }
+}
+
+// Older than COMMAND_MAX_AGE_S; only judged with the device clock set and
+// a sentAt given. Group commands use the same rule.
+inline bool commandExpired(uint32_t sentAt, uint32_t nowEpoch) {
+  return sentAt && nowEpoch >= COMMAND_MIN_EPOCH && nowEpoch > sentAt &&
+         nowEpoch - sentAt > COMMAND_MAX_AGE_S;
+}
+
+inline bool commandIdValid(const char* id) {
+  size_t length = strnlen(id, COMMAND_ID_MAX + 1);
+  if (length == 0 || length > COMMAND_ID_MAX) return false;
+  for (size_t i = 0; i < length; i++) {
+    if (id[i] == '"' || id[i] == '\\' || (uint8_t)id[i] < 0x20) return false;
+  }
+  return true;
+}
+
+// FNV-1a, 64 bits so that 32 entries never collide in practice
+inline uint64_t commandIdHash(const char* id) {
+  uint64_t h = 14695981039346656037ull;
+  for (const char* p = id; *p; p++) h = (h ^ (uint8_t)*p) * 1099511628211ull;
+  return h;
+}
+
+// =============================================================================
+// Idempotency Log
+// =============================================================================
+
+struct CommandLogEntry {
+  uint64_t idHash;      // 0 = empty
+  uint8_t gate;
+  uint8_t status;
+  uint8_t reserved[6];
+};
+
+struct CommandLog {
+  uint32_t magic;
+  uint32_t next;
+  CommandLogEntry entries[COMMAND_LOG_SIZE];
+  uint32_t checksum;    // FNV-1a over next and the entries
+};
+
+inline uint32_t commandLogChecksum(const CommandLog& log) {
+  const uint8_t* p = (const uint8_t*)&log.next;
+  const uint8_t* end = (const uint8_t*)&log.checksum;
+  uint32_t h = 2166136261u;
+  while (p < end) h = (h ^ *p++) * 16777619u;
+  return h;
+}
+
+inline bool commandLogValid(const CommandLog& log) {
+  return log.magic == COMMAND_LOG_MAGIC && log.next < COMMAND_LOG_SIZE &&
+         log.checksum == commandLogChecksum(log);
+}
+
+inline void commandLogReset(CommandLog& log) {
+  memset(&log, 0, sizeof(log));
+  log.magic = COMMAND_LOG_MAGIC;
+  log.checksum = commandLogChecksum(log);
+}
+
+// Entry of an id already seen on this gate, or nullptr
+inline const CommandLogEntry* commandLogFind(const CommandLog& log, uint64_t idHash, uint8_t gate) {
+  for (const CommandLogEntry& entry : log.entries) {
+    if (entry.idHash == idHash && entry.gate == gate) return &entry;
+  }
+  return nullptr;
+}
+
+// Replaces the oldest entry
+inline void commandLogAdd(CommandLog& log, uint64_t idHash, uint8_t gate, uint8_t status) {
+  CommandLogEntry& entry = log.entries[log.next];
+  entry = {};
+  entry.idHash = idHash ? idHash : 1;
+  entry.gate = gate;
+  entry.status = status;
+  log.next = (log.next + 1) % COMMAND_LOG_SIZE;
+  log.checksum = commandLogChecksum(log);
+}
+
+// =============================================================================
+// Acks
+// =============================================================================
+
+struct CommandAck {
+  char commandId[COMMAND_ID_MAX + 1];
+  uint8_t gate;
+  uint8_t status;
+  bool duplicate;
+  uint32_t receivedMs;
+};
+
+inline int formatCommandAck(char* out, size_t size, const char* deviceId, const CommandAck& ack,
+                            GateState state, uint8_t percentage, uint32_t latencyMs) {
+  return snprintf(out, size,
+                  "{\"deviceId\":\"%s\",\"commandId\":\"%s\",\"status\":\"%s\","
+                  "\"duplicate\":%s,\"state\":\"%s\",\"percentage\":%u,\"latencyMs\":%lu}",
+                  deviceId, ack.commandId, commandAckStatusName(ack.status),
+                  ack.duplicate ? "true" : "false", gateStateName(state), percentage,
+                  (unsigned long)latencyMs);
+}
+
+struct CommandStats {
+  uint32_t received = 0;
+  uint32_t duplicates = 0;
+  uint32_t expired = 0;
+  uint32_t rejected = 0;
+  uint32_t acked = 0;
+  uint32_t ackDropped = 0;    // Queue overflow while offline
+  uint32_t ackMaxMs = 0;      // Receipt to ack publish
+  uint32_t ackSumMs = 0;
+};
+
+// =============================================================================
+// Delivery
+// =============================================================================
+
+// What to do with a received command
+struct CommandVerdict {
+  bool run;
+  bool duplicate;
+  uint8_t status;       // For a command not run
+};
+
+class CommandDelivery {
+private:
+  CommandLog* log = nullptr;
+  CommandAck queue[COMMAND_ACK_QUEUE];
+  uint8_t head = 0;
+  uint8_t queued = 0;
+  CommandStats counters;
+
+public:
+  // The log keeps its content across resets when it is still intact
+  void begin(CommandLog& rtcLog) {
+    log = &rtcLog;
+    if (!commandLogValid(*log)) commandLogReset(*log);
+  }
+
+  CommandVerdict accept(uint8_t gate, const char* id, uint32_t sentAt, uint32_t nowEpoch) {
+    counters.received++;
+    const CommandLogEntry* seen = commandLogFind(*log, commandIdHash(id), gate);
+    if (seen) {
+      counters.duplicates++;
+      return {false, true, seen->status};
+    }
+    if (commandExpired(sentAt, nowEpoch)) {
+      counters.expired++;
+      return {false, false, CMD_ACK_EXPIRED};
+    }
+    return {true, false, CMD_ACK_EXECUTED};
+  }
+
+  // Outcome of an id already run on this gate
+  bool seen(uint8_t gate, const char* id, uint8_t& status) const {
+    const CommandLogEntry* entry = commandLogFind(*log, commandIdHash(id), gate);
+    if (entry) status = entry->status;
+    return entry != nullptr;
+  }
+
+  // After the command ran (or was refused): remembers the outcome
+  void record(uint8_t gate, const char* id, const CommandVerdict& verdict, uint8_t status) {
+    if (verdict.duplicate) return;
+    commandLogAdd(*log, commandIdHash(id), gate, status);
+    if (status == CMD_ACK_REJECTED) counters.rejected++;
+  }
+
+  // Ack for /acks, sent by flush()
+  void queueAck(uint8_t gate, const char* id, bool duplicate, uint8_t status, uint32_t nowMs) {
+    if (queued == COMMAND_ACK_QUEUE) {
+      head = (head + 1) % COMMAND_ACK_QUEUE;
+      queued--;
+      counters.ackDropped++;
+    }
+    CommandAck& ack = queue[(head + queued) % COMMAND_ACK_QUEUE];
+    strncpy(ack.commandId, id, COMMAND_ID_MAX);
+    ack.commandId[COMMAND_ID_MAX] = '\0';
+    ack.gate = gate;
+    ack.status = status;
+    ack.duplicate = duplicate;
+    ack.receivedMs = nowMs;
+    queued++;
+  }
+
+  // record() and queueAck() in one step
+  void complete(uint8_t gate, const char* id, const CommandVerdict& verdict, uint8_t status,
+                uint32_t nowMs) {
+    record(gate, id, verdict, status);
+    queueAck(gate, id, verdict.duplicate, status, nowMs);
+  }
+
+  // publish(const CommandAck&, uint32_t latencyMs) returns false while the
+  // link is down; the ack then stays queued. Returns the acks sent.
+  template <typename Publish>
+  uint8_t flush(uint32_t nowMs, Publish publish) {
+    uint8_t sent = 0;
+    while (queued) {
+      const CommandAck& ack = queue[head];
+      uint32_t latency = nowMs - ack.receivedMs;
+      if (!publish(ack, latency)) break;
+      counters.acked++;
+      counters.ackSumMs += latency;
+      if (latency > counters.ackMaxMs) counters.ackMaxMs = latency;
+      head = (head + 1) % COMMAND_ACK_QUEUE;
+      queued--;
+      sent++;
+    }
+    return sent;
+  }
+
+  uint8_t pending() const { return queued; }
+  const CommandStats& stats() const { return counters; }
+};
+
+#endif // COMMAND_DELIVERY_H
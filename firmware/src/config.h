@@ -14,7 +14,7 @@
 // GPIO Pin Definitions
 // =============================================================================
 
-// Relay Control Pins
+// Relay Control Pins (first gate, see Gates below)
 #define RELAY_OPEN          16    // GPIO16 - Open gate relay
 #define RELAY_CLOSE         17    // GPIO17 - Close gate relay
 
@@ -38,6 +38,22 @@
 #define LIMIT_OPEN          25    // GPIO25 - Fully open limit switch
 #define LIMIT_CLOSE         26    // GPIO26 - Fully closed limit switch
 
+// =============================================================================
+// Gates
+// =============================================================================
+
+// Gates driven by this controller, one GateDescriptor each (gate_controller.h):
+//   { id, {relayOpen, relayClose, limitOpen, limitClose, obstacle, currentSensor},
+//     maxCurrent (A), maxOperationTime (ms) }    0 = runtime configuration
+// The first gate has an empty id and reports as DEVICE_NAME; the others as
+// DEVICE_NAME-<id>, each with its own topics and /gates/<n> routes.
+// A double-leaf gate, for example:
+//   -DGATE_DESCRIPTORS='{"", {16, 17, 25, 26, 33, 34}, 0, 0}, {"b", {18, 19, 27, 14, 23, 36}, 0, 0}'
+#ifndef GATE_DESCRIPTORS
+#define GATE_DESCRIPTORS \
+  { "", {RELAY_OPEN, RELAY_CLOSE, LIMIT_OPEN, LIMIT_CLOSE, OBSTACLE_SENSOR, CURRENT_SENSOR}, 0, 0 }
+#endif
+
 // =============================================================================
 // Safety Parameters
 // =============================================================================
@@ -47,6 +63,7 @@
 #define DEBOUNCE_DELAY_MS       50      // Button debounce
 #define WATCHDOG_TIMEOUT_S      60      // Watchdog timer (seconds)
 #define OBSTACLE_CHECK_MS       100     // Obstacle detection interval
+#define OBSTACLE_DEBOUNCE_MS    0       // Obstacle must persist (0 = immediate stop)
 #define SENSOR_READ_INTERVAL    1000    // Sensor reading interval
 
 // Current Limits (Amps)
@@ -58,6 +75,71 @@
 #define TEMP_WARNING            60.0    // Warning temperature
 #define TEMP_SHUTDOWN           75.0    // Emergency shutdown temp
 
+// Safety path execution time (safety_wcet.h): one gate's loop() pass
+#define WCET_SAFETY_BUDGET_US   50      // On the ESP32 at POWER_CPU_MAX_MHZ
+#define WCET_HOST_BUDGET_US     5       // tools/wcet_check.cpp, pio run -t wcet
+#define WCET_BOOT_SAMPLES       64      // Harness passes per branch at boot
+
+// =============================================================================
+// Sensor Conversion & Filtering
+// =============================================================================
+
+#define ACS712_ZERO_MV          2500    // Output at 0 A
+#define ACS712_MV_PER_A         66      // 30A version
+#define VOLTAGE_DIVIDER_RATIO   11      // 10:1 divider
+#define NTC_BETA                3950    // Thermistor Beta (K)
+#define NTC_R25                 10000   // Thermistor resistance at 25 °C
+#define NTC_SERIES_R            10000   // High-side divider resistor
+#define TEMP_KALMAN_Q           100     // Process noise (centi-°C² / conversion)
+#define TEMP_KALMAN_R           160     // Measurement noise (0.5 °C sigma / 16 reads)
+
+// =============================================================================
+// Sensor Acquisition
+// =============================================================================
+
+// Per channel: the conversion period and the ADC reads averaged into one
+// conversion, spread evenly over the period (acquisition.h)
+#define ACQ_CURRENT_PERIOD_MS   10      // Per gate; overcurrent needs ms
+#define ACQ_CURRENT_OVERSAMPLE  4
+#define ACQ_VOLTAGE_PERIOD_MS   100
+#define ACQ_VOLTAGE_OVERSAMPLE  8
+#define ACQ_TEMP_PERIOD_MS      1000    // Changes over minutes
+#define ACQ_TEMP_OVERSAMPLE     16
+#define ACQ_READS_PER_PASS      2       // ADC reads per loop() pass at most
+#define ACQ_DEFAULT_VREF_MV     1100    // Chips without eFuse calibration
+
+// =============================================================================
+// State Persistence
+// =============================================================================
+
+#define STATE_FLUSH_INTERVAL_MS 30000   // Min spacing between flash writes
+
+// =============================================================================
+// Trace Recording
+// =============================================================================
+
+#define TRACE_BUFFER_RECORDS    512     // Records buffered between loop() drains
+#define TRACE_FILE              "/trace.bin"
+#define TRACE_FILE_MAX_BYTES    131072  // LittleFS recording stops here
+
+// =============================================================================
+// Event Log
+// =============================================================================
+
+#define LOG_BUFFER_RECORDS      256     // 32-byte records between producers and the drain task
+#define LOG_DRAIN_MS            20      // Drain task period
+#define LOG_FILE                "/log.bin"
+#define LOG_FILE_OLD            "/log.1.bin"
+#define LOG_FILE_MAX_BYTES      65536   // Rotated to LOG_FILE_OLD here
+#define LOG_FILE_SYNC_MS        1000    // Appended records committed to flash this often
+#define LOG_MQTT_BATCH          32      // Records per /log publish
+#define LOG_MQTT_FLUSH_MS       5000    // A partial batch is published after this long
+
+// Lowest level each sink writes (event_log.h); changed at runtime with POST /log
+#define LOG_SERIAL_LEVEL        LOG_LEVEL_DEBUG
+#define LOG_FILE_LEVEL          LOG_LEVEL_OFF
+#define LOG_MQTT_LEVEL          LOG_LEVEL_WARN
+
 // =============================================================================
 // Network Configuration
 // =============================================================================
@@ -80,13 +162,115 @@
 #define MQTT_PASSWORD       ""
 #define MQTT_CLIENT_ID      DEVICE_NAME
 #define MQTT_RECONNECT_MS   5000
+#define MQTT_TLS_PORT       8883          // With GATEMATE_FEATURE_MQTT_TLS
 
 // MQTT Topics
 #define MQTT_TOPIC_PREFIX       "gatemate/devices/"
 #define MQTT_TOPIC_STATUS       "/status"
 #define MQTT_TOPIC_COMMANDS     "/commands"
 #define MQTT_TOPIC_SENSORS      "/sensors"
-#define MQTT_TOPIC_OTA          "/ota"
+#define MQTT_TOPIC_CONFIG       "/config"
+#define MQTT_TOPIC_CONFIG_STATE "/config/state"
+#define MQTT_TOPIC_MAINTENANCE  "/maintenance"
+#define MQTT_TOPIC_OTA          "/ota"           // {"url": patch, "version"}
+#define MQTT_TOPIC_OTA_STATE    "/ota/state"
+#define MQTT_TOPIC_SCHEDULES       "/schedules"
+#define MQTT_TOPIC_SCHEDULES_STATE "/schedules/state"
+#define MQTT_TOPIC_SCHEDULES_RUN   "/schedules/run"
+#define MQTT_TOPIC_GUEST           "/guest"
+#define MQTT_TOPIC_GUEST_USED      "/guest/used"
+#define MQTT_TOPIC_ACKS            "/acks"
+#define MQTT_TOPIC_LOG             "/log"           // Binary LogHeader + LogRecords
+
+// =============================================================================
+// Time & Schedules
+// =============================================================================
+
+#define NTP_SERVER_1        "pool.ntp.org"
+#define NTP_SERVER_2        "time.nist.gov"
+#define SCHEDULE_DEFAULT_TZ "WIB-7"       // POSIX TZ until the backend sends one
+#define SCHEDULE_TICK_MS    200           // Wheel advance interval
+#define SCHEDULE_RUN_QUEUE  16            // Execution reports held while offline
+
+// =============================================================================
+// Guest Access
+// =============================================================================
+
+#define GUEST_MIN_EPOCH     1700000000    // Tokens need the UTC time
+#define GUEST_PROVISION_WINDOW_MS  600000 // First POST /guest/key accepted after boot
+#define GUEST_REKEY_LABEL   "gatemate-rekey"  // Proof for replacing the key
+#define GUEST_CLOCK_SAVE_S  3600          // Last synced time kept in NVS
+#define GUEST_USAGE_SLOTS   32            // Passes counted locally for maxUses
+#define GUEST_USE_QUEUE     16            // Use reports held while offline
+
+// =============================================================================
+// Group Commands
+// =============================================================================
+
+// Topics, name rules and the delay cap are in group_command.h
+#define GROUP_REQUEST_LOG   8             // requestIds remembered for de-duplication
+
+// =============================================================================
+// Command Delivery
+// =============================================================================
+
+// QoS 1 commands with a persistent session; see command_delivery.h
+#define COMMAND_ID_MAX          36    // A UUID
+#define COMMAND_LOG_SIZE        32    // commandIds remembered across resets
+#define COMMAND_ACK_QUEUE       16    // Acks held while the link is down
+#define COMMAND_MAX_AGE_S       30    // Older commands are acked "expired", not run
+#define MQTT_PACKETS_PER_PASS   8     // Inbound packets handled per loop() pass
+
+// =============================================================================
+// LAN Fast Path
+// =============================================================================
+
+// Authenticated UDP commands from the local network; see lan_command.h
+#define LAN_UDP_PORT            4210
+#define LAN_KEY_LABEL           "gatemate-lan"  // Sub-key of the guest device key
+#define LAN_KEYS_MAX            16    // User keys on the allow list (guest sync)
+#define LAN_CLIENTS             8     // Replay windows, least recently used replaced
+#define LAN_MAX_SKEW_S          30    // Datagram time vs the device clock, once set
+#define LAN_PACKETS_PER_PASS    4     // Datagrams handled per loop() pass
+
+// =============================================================================
+// TLS
+// =============================================================================
+
+// Certificates are PEM files in LittleFS (pio run -t uploadfs)
+#define TLS_CA_FILE             "/tls/ca.pem"     // Broker CA, MQTT over TLS
+#define TLS_CERT_FILE           "/tls/cert.pem"   // Local API certificate and key
+#define TLS_KEY_FILE            "/tls/key.pem"
+#define HTTPS_PORT              443
+#define WEB_LOOPBACK_PORT       8080    // WebServer behind the HTTPS front
+#define TLS_MAX_FRAGMENT        2048    // Record size asked of the broker (512..4096)
+#define TLS_SESSION_MAX         1536    // Serialized session kept in RTC memory
+#define TLS_SESSION_LIFETIME_S  86400   // Session and ticket reuse
+#define TLS_SERVER_CACHE        4       // Local API sessions resumable by id
+#define TLS_HANDSHAKE_TIMEOUT_MS 15000
+#define TLS_IO_TIMEOUT_MS       5000
+#define TLS_BRIDGE_IDLE_MS      15000   // Local API connection without traffic
+
+// =============================================================================
+// Power
+// =============================================================================
+
+// Idle mode (power_policy.h); the listen interval, slice and budgets must
+// keep the worst network command latency within POWER_COMMAND_LATENCY_MS
+#define POWER_COMMAND_LATENCY_MS  500   // MQTT/HTTP command to relay decision
+#define POWER_ACTIVE_HOLD_MS      5000  // Full speed after the last activity
+#define POWER_IDLE_SLICE_MS       100   // Longest idle wait between loop() passes
+#define POWER_LISTEN_INTERVAL     3     // Beacons between radio wakes while idle
+#define POWER_BEACON_MS           103   // Beacon interval (102.4 ms), rounded up
+#define POWER_WAKE_BUDGET_MS      5     // Light sleep exit and clock ramp
+#define POWER_PASS_BUDGET_MS      20    // One loop() pass while idle
+#define POWER_CPU_MAX_MHZ         240   // While active
+#define POWER_CPU_MIN_MHZ         40    // Frequency scaling floor while idle
+#define POWER_CPU_IDLE_MHZ        80    // Fixed idle clock without esp_pm (WiFi minimum)
+#define POWER_MQTT_KEEPALIVE_S    60    // Fewer PINGREQ wakes than the default 15 s
+#define POWER_LOG_DRAIN_MS        200   // Event log drain period while idle
+#define POWER_BLINK_MS            3000  // Status LED blip period while idle
+#define POWER_WINDOW_MS           10000 // Duty cycle / wake latency window
 
 // =============================================================================
 // OTA Update Configuration
@@ -96,6 +280,14 @@
 #define OTA_PASSWORD        ""
 #define OTA_PORT            3232
 
+// Patch updates (ota_update.h); full images still go to ElegantOTA at /update
+#define OTA_PATCH_WINDOW_BITS   14      // Largest decoder window accepted (16 KB RAM)
+#define OTA_STEP_BYTES          4096    // Flash written per step (one sector)
+#define OTA_STALL_MS            30000   // A pull without data this long fails
+#define OTA_CONFIRM_MS          60000   // Uptime online before a new image is kept
+#define OTA_TRIAL_BOOTS         3       // Unconfirmed boots before rolling back
+#define OTA_RESTART_DELAY_MS    1000    // Lets the response and state go out
+
 // =============================================================================
 // API Configuration
 // =============================================================================
@@ -115,13 +307,79 @@
 // Feature Flags
 // =============================================================================
 
-#define ENABLE_MQTT             true
-#define ENABLE_OTA              true
-#define ENABLE_HTTPS            false   // Requires certificate
-#define ENABLE_LOGGING          true
-#define ENABLE_SENSORS          true
-#define ENABLE_OBSTACLE_DETECT  true
-#define ENABLE_CURRENT_MONITOR  true
-#define ENABLE_TEMP_MONITOR     true
+// Each flag can be overridden per build environment, e.g.
+//   build_flags = -DGATEMATE_FEATURE_MQTT=0
+// Disabled subsystems are compiled out together with their libraries
+// (see feature_set.h and the profile environments in platformio.ini).
+
+#ifndef GATEMATE_FEATURE_MQTT
+#define GATEMATE_FEATURE_MQTT             1
+#endif
+#ifndef GATEMATE_FEATURE_OTA
+#define GATEMATE_FEATURE_OTA              1
+#endif
+#ifndef GATEMATE_FEATURE_HTTPS
+#define GATEMATE_FEATURE_HTTPS            0   // Local API over TLS, requires TLS_CERT_FILE
+#endif
+#ifndef GATEMATE_FEATURE_MQTT_TLS
+#define GATEMATE_FEATURE_MQTT_TLS         0   // Requires TLS_CA_FILE
+#endif
+#ifndef GATEMATE_FEATURE_LOGGING
+#define GATEMATE_FEATURE_LOGGING          1
+#endif
+#ifndef GATEMATE_FEATURE_SENSORS
+#define GATEMATE_FEATURE_SENSORS          1
+#endif
+#ifndef GATEMATE_FEATURE_OBSTACLE_DETECT
+#define GATEMATE_FEATURE_OBSTACLE_DETECT  1
+#endif
+#ifndef GATEMATE_FEATURE_CURRENT_MONITOR
+#define GATEMATE_FEATURE_CURRENT_MONITOR  1
+#endif
+#ifndef GATEMATE_FEATURE_TEMP_MONITOR
+#define GATEMATE_FEATURE_TEMP_MONITOR     1
+#endif
+#ifndef GATEMATE_FEATURE_MCSA
+#define GATEMATE_FEATURE_MCSA             1   // Motor current signature analysis
+#endif
+#ifndef GATEMATE_FEATURE_TRACE
+#define GATEMATE_FEATURE_TRACE            1   // Sensor/command trace recording
+#endif
+#ifndef GATEMATE_FEATURE_GUEST
+#define GATEMATE_FEATURE_GUEST            1   // Offline guest tokens
+#endif
+#ifndef GATEMATE_FEATURE_LAN
+#define GATEMATE_FEATURE_LAN              1   // mDNS + UDP commands, requires GUEST, MQTT
+#endif
+#ifndef GATEMATE_FEATURE_POWER_SAVE
+#define GATEMATE_FEATURE_POWER_SAVE       1   // Idle mode between events
+#endif
+#ifndef GATEMATE_LOOP_PROFILE
+#define GATEMATE_LOOP_PROFILE             0   // Measure loop() cost
+#endif
+#ifndef GATEMATE_SAFETY_WCET
+#define GATEMATE_SAFETY_WCET              0   // Time the safety path per branch
+#endif
+
+// Compile-time view of the flags; subsystems are templated on this type
+struct BuildFeatures {
+  static constexpr bool mqtt           = GATEMATE_FEATURE_MQTT;
+  static constexpr bool ota            = GATEMATE_FEATURE_OTA;
+  static constexpr bool https          = GATEMATE_FEATURE_HTTPS;
+  static constexpr bool mqttTls        = GATEMATE_FEATURE_MQTT_TLS && GATEMATE_FEATURE_MQTT;
+  static constexpr bool logging        = GATEMATE_FEATURE_LOGGING;
+  static constexpr bool sensors        = GATEMATE_FEATURE_SENSORS;
+  static constexpr bool obstacleDetect = GATEMATE_FEATURE_OBSTACLE_DETECT;
+  static constexpr bool currentMonitor = GATEMATE_FEATURE_CURRENT_MONITOR && GATEMATE_FEATURE_SENSORS;
+  static constexpr bool tempMonitor    = GATEMATE_FEATURE_TEMP_MONITOR && GATEMATE_FEATURE_SENSORS;
+  static constexpr bool mcsa           = GATEMATE_FEATURE_MCSA && currentMonitor;
+  static constexpr bool trace          = GATEMATE_FEATURE_TRACE;
+  static constexpr bool guestAccess    = GATEMATE_FEATURE_GUEST;
+  static constexpr bool lan            = GATEMATE_FEATURE_LAN && GATEMATE_FEATURE_GUEST &&
+                                         GATEMATE_FEATURE_MQTT;   // Key ids in the guest sync
+  static constexpr bool powerSave      = GATEMATE_FEATURE_POWER_SAVE;
+  static constexpr bool loopProfile    = GATEMATE_LOOP_PROFILE;
+  static constexpr bool safetyWcet     = GATEMATE_SAFETY_WCET;
+};
 
 #endif // CONFIG_H
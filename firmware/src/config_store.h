@@ -0,0 +1,265 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Runtime Configuration Store
+// =============================================================================
+//
+// All runtime tunables live in one versioned, CRC-protected binary blob in
+// NVS. It is loaded once at boot; updates are staged into the inactive half
+// of a double buffer, validated as a whole, persisted with a single flash
+// write and then published by flipping the active index. Readers on the
+// safety path just dereference the active slot - no locks, no NVS access.
+//
+
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <rom/crc.h>
+#include <atomic>
+#include "config.h"
+#include "group_command.h"
+
+// =============================================================================
+// Configuration Blob
+// =============================================================================
+
+// Bump CONFIG_VERSION when the layout changes. Fields may only be appended;
+// older blobs are migrated by copying their prefix over the defaults.
+#define CONFIG_VERSION 2
+
+struct GateConfig {
+  uint16_t version;
+  uint16_t size;
+  uint32_t revision;              // Incremented on every committed update
+
+  // Safety thresholds
+  uint32_t maxOperationTime;      // ms
+  float maxCurrent;               // A, stall / overload stop
+  float currentThresholdOpen;     // A
+  float currentThresholdClose;    // A
+  float maxTemperature;           // °C, emergency stop
+  float warningTemperature;       // °C
+
+  // Timing
+  uint32_t commandCooldown;       // ms
+  uint32_t sensorReadInterval;    // ms
+
+  // Group commands (v2)
+  char groups[GROUP_LIST_MAX];    // Comma-separated group names
+  uint16_t groupSlot;             // Stagger position within the site
+
+  uint32_t crc;                   // Must stay last
+};
+
+// =============================================================================
+// Config Store Class
+// =============================================================================
+
+class ConfigStore {
+private:
+  Preferences preferences;
+
+  GateConfig slots[2];
+  std::atomic<uint8_t> activeIndex{0};
+  uint32_t flashWrites = 0;
+
+  static uint32_t checksum(const GateConfig& cfg) {
+    return crc32_le(0, (const uint8_t*)&cfg, offsetof(GateConfig, crc));
+  }
+
+  static GateConfig defaults() {
+    GateConfig cfg = {};
+    cfg.version = CONFIG_VERSION;
+    cfg.size = sizeof(GateConfig);
+    cfg.revision = 0;
+    cfg.maxOperationTime = GATE_TIMEOUT_MS;
+    cfg.maxCurrent = CURRENT_THRESHOLD_STALL;
+    cfg.currentThresholdOpen = CURRENT_THRESHOLD_OPEN;
+    cfg.currentThresholdClose = CURRENT_THRESHOLD_CLOSE;
+    cfg.maxTemperature = TEMP_SHUTDOWN;
+    cfg.warningTemperature = TEMP_WARNING;
+    cfg.commandCooldown = COMMAND_COOLDOWN_MS;
+    cfg.sensorReadInterval = SENSOR_READ_INTERVAL;
+    return cfg;
+  }
+
+public:
+  // =============================================================================
+  // Load
+  // =============================================================================
+
+  void begin() {
+    GateConfig cfg = defaults();
+
+    preferences.begin("config", true);
+    size_t length = preferences.getBytesLength("blob");
+    uint8_t raw[sizeof(GateConfig) + 64];
+    bool loaded = false;
+
+    if (length >= offsetof(GateConfig, maxOperationTime) && length <= sizeof(raw) &&
+        preferences.getBytes("blob", raw, length) == length) {
+      GateConfig header;
+      memcpy(&header, raw, offsetof(GateConfig, maxOperationTime));
+      uint32_t storedCrc;
+      memcpy(&storedCrc, raw + length - sizeof(uint32_t), sizeof(storedCrc));
+
+      if (header.size == length &&
+          storedCrc == crc32_le(0, raw, length - sizeof(uint32_t))) {
+        // Same or older layout: copy the known prefix over the defaults
+        size_t common = min(length, sizeof(GateConfig)) - sizeof(uint32_t);
+        memcpy(&cfg, raw, common);
+        loaded = true;
+      }
+    }
+    preferences.end();
+
+    cfg.version = CONFIG_VERSION;
+    cfg.size = sizeof(GateConfig);
+    if (!validate(cfg)) {
+      Serial.println("⚠ Stored configuration invalid, using defaults");
+      cfg = defaults();
+    }
+    cfg.crc = checksum(cfg);
+
+    slots[0] = cfg;
+    slots[1] = cfg;
+    activeIndex.store(0, std::memory_order_release);
+
+    Serial.printf("✓ Configuration loaded (rev %lu%s)\n",
+                  (unsigned long)cfg.revision, loaded ? "" : ", defaults");
+  }
+
+  // =============================================================================
+  // Access
+  // =============================================================================
+
+  // Hot path: one index load. The returned slot is never written while it is
+  // active, so a reference taken at the start of a tick stays consistent.
+  const GateConfig& active() const {
+    return slots[activeIndex.load(std::memory_order_acquire)];
+  }
+
+  // Mutable copy of the active configuration to stage changes on
+  GateConfig edit() const {
+    return active();
+  }
+
+  // =============================================================================
+  // Transactional Update
+  // =============================================================================
+
+  // Validates, persists (one flash write) and swaps in the staged config.
+  bool commit(const GateConfig& staged) {
+    if (!validate(staged)) return false;
+
+    uint8_t next = activeIndex.load(std::memory_order_relaxed) ^ 1;
+    GateConfig& slot = slots[next];
+    slot = staged;
+    slot.version = CONFIG_VERSION;
+    slot.size = sizeof(GateConfig);
+    slot.revision = active().revision + 1;
+    slot.crc = checksum(slot);
+
+    preferences.begin("config", false);
+    size_t written = preferences.putBytes("blob", &slot, sizeof(slot));
+    preferences.end();
+    if (written != sizeof(slot)) return false;
+    flashWrites++;
+
+    activeIndex.store(next, std::memory_order_release);
+    return true;
+  }
+
+  static bool validate(const GateConfig& cfg) {
+    if (cfg.maxOperationTime < 1000 || cfg.maxOperationTime > 300000) return false;
+    if (!(cfg.maxCurrent > 0.0f && cfg.maxCurrent <= 30.0f)) return false;
+    if (!(cfg.currentThresholdOpen > 0.0f && cfg.currentThresholdOpen <= cfg.maxCurrent)) return false;
+    if (!(cfg.currentThresholdClose > 0.0f && cfg.currentThresholdClose <= cfg.maxCurrent)) return false;
+    if (!(cfg.maxTemperature > 0.0f && cfg.maxTemperature <= 125.0f)) return false;
+    if (!(cfg.warningTemperature > 0.0f && cfg.warningTemperature < cfg.maxTemperature)) return false;
+    if (cfg.commandCooldown > 60000) return false;
+    if (cfg.sensorReadInterval < 50 || cfg.sensorReadInterval > 60000) return false;
+    if (!groupListValid(cfg.groups)) return false;
+    return true;
+  }
+
+  // =============================================================================
+  // JSON Mapping
+  // =============================================================================
+
+  // Applies the fields present in a JSON object onto a staged config.
+  // Returns the number of fields recognised.
+  static uint8_t applyJson(JsonObjectConst patch, GateConfig& cfg) {
+    uint8_t applied = 0;
+    if (!patch["maxOperationTime"].isNull()) { cfg.maxOperationTime = patch["maxOperationTime"]; applied++; }
+    if (!patch["maxCurrent"].isNull()) { cfg.maxCurrent = patch["maxCurrent"]; applied++; }
+    if (!patch["currentThresholdOpen"].isNull()) { cfg.currentThresholdOpen = patch["currentThresholdOpen"]; applied++; }
+    if (!patch["currentThresholdClose"].isNull()) { cfg.currentThresholdClose = patch["currentThresholdClose"]; applied++; }
+    if (!patch["maxTemperature"].isNull()) { cfg.maxTemperature = patch["maxTemperature"]; applied++; }
+    if (!patch["warningTemperature"].isNull()) { cfg.warningTemperature = patch["warningTemperature"]; applied++; }
+    if (!patch["commandCooldown"].isNull()) { cfg.commandCooldown = patch["commandCooldown"]; applied++; }
+    if (!patch["sensorReadInterval"].isNull()) { cfg.sensorReadInterval = patch["sensorReadInterval"]; applied++; }
+    if (!patch["groups"].isNull()) { applyGroups(patch["groups"], cfg); applied++; }
+    if (!patch["groupSlot"].isNull()) { cfg.groupSlot = patch["groupSlot"]; applied++; }
+    return applied;
+  }
+
+  // "groups" as an array of names or a comma-separated string. A list that
+  // does not fit is left unterminated so validate() rejects it.
+  static void applyGroups(JsonVariantConst value, GateConfig& cfg) {
+    if (value.is<const char*>()) {
+      const char* list = value.as<const char*>();
+      if (strlen(list) < sizeof(cfg.groups)) {
+        strcpy(cfg.groups, list);
+      } else {
+        memset(cfg.groups, ',', sizeof(cfg.groups));
+      }
+      return;
+    }
+
+    size_t used = 0;
+    cfg.groups[0] = '\0';
+    for (JsonVariantConst name : value.as<JsonArrayConst>()) {
+      const char* entry = name | "";
+      size_t length = strlen(entry);
+      if (used + (used ? 1 : 0) + length >= sizeof(cfg.groups)) {
+        memset(cfg.groups, ',', sizeof(cfg.groups));
+        return;
+      }
+      if (used) cfg.groups[used++] = ',';
+      memcpy(cfg.groups + used, entry, length + 1);
+      used += length;
+    }
+  }
+
+  static void toJson(const GateConfig& cfg, JsonObject out) {
+    out["version"] = cfg.version;
+    out["revision"] = cfg.revision;
+    out["maxOperationTime"] = cfg.maxOperationTime;
+    out["maxCurrent"] = cfg.maxCurrent;
+    out["currentThresholdOpen"] = cfg.currentThresholdOpen;
+    out["currentThresholdClose"] = cfg.currentThresholdClose;
+    out["maxTemperature"] = cfg.maxTemperature;
+    out["warningTemperature"] = cfg.warningTemperature;
+    out["commandCooldown"] = cfg.commandCooldown;
+    out["sensorReadInterval"] = cfg.sensorReadInterval;
+
+    JsonArray groups = out["groups"].to<JsonArray>();
+    forEachGroup(cfg.groups, [&](const char* name, size_t length) {
+      char entry[GROUP_NAME_MAX + 1];
+      snprintf(entry, sizeof(entry), "%.*s", (int)length, name);
+      groups.add(entry);
+    });
+    out["groupSlot"] = cfg.groupSlot;
+  }
+
+  // =============================================================================
+  // Getters
+  // =============================================================================
+
+  uint32_t getRevision() const { return active().revision; }
+  uint32_t getFlashWrites() const { return flashWrites; }
+};
+
+#endif // CONFIG_STORE_H
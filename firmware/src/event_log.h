@@ -0,0 +1,562 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Event Log
+// =============================================================================
+//
+// Deferred-format logging for loop() and the safety path. A log call does
+// no formatting and no I/O: it copies a message id and the raw arguments
+// into a 32-byte record in a lock-free ring. A low-priority task in main.cpp
+// drains the ring and does the slow part - text to Serial, binary to a
+// LittleFS file and batches to MQTT - so a burst of messages no longer
+// stalls the gate logic on a 115200 baud UART. When the ring is full the
+// record is dropped and counted, never waited for.
+//
+//   LOG_EVENT(LOG_GATE_STOPPED, gate.getDeviceId(), reason, percentage);
+//
+// Messages are declared once in LOG_MESSAGES; only their id travels, and
+// the formats are compiled into tools/log_decode.cpp as well. Append new
+// messages at the end and never reuse an id: stream headers carry a hash
+// of the table so the decoder can tell a log from another revision.
+//
+// Arguments are checked against the format at compile time. Numbers take
+// four bytes each; a string takes a length byte and is cut to what is left
+// of the payload (LogTail keeps its end instead). Besides %d %i %u %x %X %f
+// and %s, with flags, width and precision, formats know %G, %C and %R for a
+// GateState, GateCommand and StopReason, printed by name.
+//
+// Stream format (little-endian): a LogHeader, then LogRecords. A header may
+// follow at any record boundary (a reboot appending to the same file); its
+// first five bytes mirror a record with id LOG_HEADER_ID.
+//
+// No Arduino dependency. Each program defines logNowUs() and the eventLog
+// instance LOG_EVENT writes to. Not for use from an ISR.
+//
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#include "config.h"
+#include "gate_motion.h"
+#include "history.h"
+
+#define LOG_MAGIC           0x474C4D47u   // "GMLG"
+#define LOG_VERSION         1
+#define LOG_HEADER_ID       0xFF
+#define LOG_PAYLOAD_BYTES   26
+#define LOG_STRING_CUT      0x80          // Length byte flags: end of the string cut,
+#define LOG_STRING_TAIL     0x40          //   or its start (LogTail)
+#define LOG_DEVICE_ID_MAX   32
+#define LOG_RESYNC_US       600000000u    // New header after this long without records
+
+enum LogLevel : uint8_t {
+  LOG_LEVEL_DEBUG = 0,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_WARN,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_OFF                           // Sink threshold only
+};
+
+// =============================================================================
+// Messages
+// =============================================================================
+
+// X(id, level, format)
+#define LOG_MESSAGES(X) \
+  X(LOG_DROPPED,             LOG_LEVEL_WARN,  "%u log records dropped") \
+  X(LOG_MQTT_RECEIVED,       LOG_LEVEL_DEBUG, "MQTT %s (%u bytes)") \
+  X(LOG_CONFIG_REJECTED,     LOG_LEVEL_WARN,  "Config update rejected: %s") \
+  X(LOG_SCHEDULES_REJECTED,  LOG_LEVEL_WARN,  "Schedule update rejected: %s") \
+  X(LOG_GUEST_KEYS_UPDATED,  LOG_LEVEL_INFO,  "Guest key or sync updated") \
+  X(LOG_GUEST_KEYS_REJECTED, LOG_LEVEL_WARN,  "Guest key or sync rejected: %s") \
+  X(LOG_GATE_STARTED,        LOG_LEVEL_INFO,  "Gate %s %G from %u%%") \
+  X(LOG_GATE_STOPPED,        LOG_LEVEL_INFO,  "Gate %s stopped: %R at %u%%") \
+  X(LOG_GATE_SAFETY_STOP,    LOG_LEVEL_WARN,  "Gate %s safety stop: %R at %u%%") \
+  X(LOG_GROUP_INVALID,       LOG_LEVEL_WARN,  "Group command without valid requestId") \
+  X(LOG_GROUP_DELAYED,       LOG_LEVEL_INFO,  "Group %C on %s in %u ms") \
+  X(LOG_GUEST_DENIED,        LOG_LEVEL_WARN,  "Guest access denied: %s") \
+  X(LOG_GUEST_COMMAND,       LOG_LEVEL_INFO,  "Guest %s: %C") \
+  X(LOG_SCHEDULE_RUN,        LOG_LEVEL_INFO,  "Schedule %s: %C") \
+  X(LOG_SAFETY_STARTED,      LOG_LEVEL_DEBUG, "Safety: operation started") \
+  X(LOG_SAFETY_ENDED,        LOG_LEVEL_DEBUG, "Safety: operation ended") \
+  X(LOG_SAFETY_FAILURES,     LOG_LEVEL_ERROR, "Safety: %u consecutive failures") \
+  X(LOG_SAFETY_TEMPERATURE,  LOG_LEVEL_WARN,  "Safety: temperature high (%.1f C)") \
+  X(LOG_SAFETY_LIMIT,        LOG_LEVEL_INFO,  "Safety: %s limit switch triggered") \
+  X(LOG_SAFETY_STOP,         LOG_LEVEL_ERROR, "Safety: EMERGENCY STOP: %s") \
+  X(LOG_SAFE_MODE,           LOG_LEVEL_ERROR, "Safety: entering SAFE MODE") \
+  X(LOG_SAFE_MODE_EXIT,      LOG_LEVEL_INFO,  "Safety: exited safe mode") \
+  X(LOG_OTA_STARTED,         LOG_LEVEL_INFO,  "OTA patch from %s started") \
+  X(LOG_OTA_APPLIED,         LOG_LEVEL_INFO,  "OTA %s patch applied: %u bytes in %u ms") \
+  X(LOG_OTA_FAILED,          LOG_LEVEL_ERROR, "OTA failed: %s after %u bytes") \
+  X(LOG_OTA_REJECTED,        LOG_LEVEL_WARN,  "OTA request rejected: %s") \
+  X(LOG_OTA_CONFIRMED,       LOG_LEVEL_INFO,  "OTA image confirmed") \
+  X(LOG_POWER_MODE,          LOG_LEVEL_DEBUG, "Power: %s") \
+  X(LOG_POWER_LATE,          LOG_LEVEL_WARN,  "Power: idle gap of %u ms over the latency bound") \
+  X(LOG_WCET_OVER,           LOG_LEVEL_WARN,  "Safety path %s took %u us, budget %u us") \
+  X(LOG_COMMAND_INVALID,     LOG_LEVEL_WARN,  "Command on %s without a valid commandId") \
+  X(LOG_COMMAND_DUPLICATE,   LOG_LEVEL_INFO,  "Command %s redelivered, acked as %s") \
+  X(LOG_COMMAND_EXPIRED,     LOG_LEVEL_WARN,  "Command %s expired after %u s") \
+  X(LOG_LAN_REFUSED,         LOG_LEVEL_WARN,  "LAN command %s refused: %s")
+
+#define LOG_ID_ENTRY(id, level, format) id,
+enum LogId : uint8_t { LOG_MESSAGES(LOG_ID_ENTRY) LOG_MESSAGE_COUNT };
+#undef LOG_ID_ENTRY
+
+static_assert(LOG_MESSAGE_COUNT < LOG_HEADER_ID, "too many log messages");
+
+struct LogMessage {
+  LogLevel level;
+  const char* format;
+};
+
+#define LOG_TABLE_ENTRY(id, level, format) {level, format},
+inline constexpr LogMessage LOG_TABLE[] = { LOG_MESSAGES(LOG_TABLE_ENTRY) };
+#undef LOG_TABLE_ENTRY
+
+// FNV-1a over levels and formats, in id order
+constexpr uint32_t logTableHash() {
+  uint32_t h = 2166136261u;
+  for (const LogMessage& message : LOG_TABLE) {
+    h = (h ^ message.level) * 16777619u;
+    for (const char* p = message.format; *p; p++) h = (h ^ (uint8_t)*p) * 16777619u;
+    h = (h ^ 0) * 16777619u;
+  }
+  return h;
+}
+
+inline constexpr uint32_t LOG_TABLE_HASH = logTableHash();
+
+inline const char* logLevelName(uint8_t level) {
+  switch (level) {
+    case LOG_LEVEL_DEBUG: return "debug";
+    case LOG_LEVEL_INFO: return "info";
+    case LOG_LEVEL_WARN: return "warn";
+    case LOG_LEVEL_ERROR: return "error";
+    case LOG_LEVEL_OFF: return "off";
+    default: return "unknown";
+  }
+}
+
+inline bool parseLogLevel(const char* name, uint8_t& level) {
+  for (uint8_t l = LOG_LEVEL_DEBUG; l <= LOG_LEVEL_OFF; l++) {
+    if (strcmp(name, logLevelName(l)) == 0) {
+      level = l;
+      return true;
+    }
+  }
+  return false;
+}
+
+// =============================================================================
+// Records
+// =============================================================================
+
+struct LogRecord {
+  uint32_t timeUs;          // Low 32 bits of the uptime in µs
+  uint8_t id;               // LogId
+  uint8_t reserved;
+  uint8_t payload[LOG_PAYLOAD_BYTES];
+};
+
+struct LogHeader {
+  uint32_t magic;           // In place of a record's timeUs
+  uint8_t marker;           // LOG_HEADER_ID, in place of a record's id
+  uint8_t version;
+  uint8_t recordSize;
+  uint8_t reserved;
+  uint32_t tableHash;
+  uint32_t records;         // Records that follow; 0 = up to the next header or the end
+  uint64_t uptimeUs;        // Time base for the records that follow
+  uint32_t dropped;         // Ring overflows since boot
+  uint32_t sequence;        // Per sink, to spot lost MQTT batches
+  char deviceId[LOG_DEVICE_ID_MAX];
+};
+
+static_assert(sizeof(LogRecord) == 32, "log record layout");
+static_assert(sizeof(LogHeader) == 2 * sizeof(LogRecord), "log header layout");
+
+inline void initLogHeader(LogHeader& header, const char* deviceId, uint64_t uptimeUs,
+                          uint32_t dropped, uint32_t sequence, uint32_t records) {
+  header = {};
+  header.magic = LOG_MAGIC;
+  header.marker = LOG_HEADER_ID;
+  header.version = LOG_VERSION;
+  header.recordSize = sizeof(LogRecord);
+  header.tableHash = LOG_TABLE_HASH;
+  header.records = records;
+  header.uptimeUs = uptimeUs;
+  header.dropped = dropped;
+  header.sequence = sequence;
+  strncpy(header.deviceId, deviceId, sizeof(header.deviceId) - 1);
+}
+
+// Extends record times to the 64-bit uptime. Records may arrive slightly
+// out of order from several producers, and at most ~35 min apart.
+class LogClock {
+private:
+  uint64_t us = 0;
+
+public:
+  void sync(uint64_t uptimeUs) { us = uptimeUs; }
+
+  uint64_t uptimeUs(uint32_t timeUs) {
+    us += (int32_t)(timeUs - (uint32_t)us);
+    return us;
+  }
+};
+
+// =============================================================================
+// Format Checks
+// =============================================================================
+
+enum LogArgKind : uint8_t { LOG_ARG_NUMBER, LOG_ARG_FLOAT, LOG_ARG_STRING };
+
+// Keeps the end of a string that does not fit, e.g. the device and subtopic
+// of an MQTT topic
+struct LogTail {
+  const char* str;
+  explicit LogTail(const char* s) : str(s) {}
+};
+
+constexpr bool logIsSpecChar(char c) {
+  return c == '-' || c == '+' || c == ' ' || c == '#' || c == '.' || (c >= '0' && c <= '9');
+}
+
+// Conversion character of the n-th conversion in format, 0 if there is none
+constexpr char logConversion(const char* format, int n) {
+  int seen = 0;
+  for (int i = 0; format[i]; i++) {
+    if (format[i] != '%') continue;
+    i++;
+    if (format[i] == '%') continue;
+    while (logIsSpecChar(format[i])) i++;
+    if (!format[i]) return 0;
+    if (seen == n) return format[i];
+    seen++;
+  }
+  return 0;
+}
+
+constexpr int logConversionCount(const char* format) {
+  int n = 0;
+  while (logConversion(format, n)) n++;
+  return n;
+}
+
+constexpr bool logConversionMatches(char conversion, LogArgKind kind) {
+  switch (conversion) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'G': case 'C': case 'R':
+      return kind == LOG_ARG_NUMBER;
+    case 'f': return kind == LOG_ARG_FLOAT;
+    case 's': return kind == LOG_ARG_STRING;
+    default: return false;
+  }
+}
+
+template <typename T>
+constexpr LogArgKind logArgKind() {
+  typedef typename std::decay<T>::type U;
+  if (std::is_floating_point<U>::value) return LOG_ARG_FLOAT;
+  if (std::is_same<U, LogTail>::value || std::is_same<U, const char*>::value ||
+      std::is_same<U, char*>::value) {
+    return LOG_ARG_STRING;
+  }
+  return LOG_ARG_NUMBER;
+}
+
+// Payload bytes an argument needs at least
+template <typename T>
+constexpr uint8_t logArgSize() {
+  return logArgKind<T>() == LOG_ARG_STRING ? 1 : 4;
+}
+
+template <typename... Args>
+constexpr uint8_t logArgsSize() {
+  return (0 + ... + logArgSize<Args>());
+}
+
+template <typename... Args>
+constexpr bool logArgsMatch(const char* format) {
+  const LogArgKind kinds[] = {logArgKind<Args>()..., LOG_ARG_NUMBER};
+  if (logConversionCount(format) != (int)sizeof...(Args)) return false;
+  for (int i = 0; i < (int)sizeof...(Args); i++) {
+    if (!logConversionMatches(logConversion(format, i), kinds[i])) return false;
+  }
+  return true;
+}
+
+// =============================================================================
+// Encoding
+// =============================================================================
+
+inline uint8_t logPutWord(LogRecord& record, uint8_t at, uint32_t value) {
+  memcpy(record.payload + at, &value, sizeof(value));
+  return at + sizeof(value);
+}
+
+inline uint8_t logPutString(LogRecord& record, uint8_t at, uint8_t limit, const char* s,
+                            bool tail) {
+  if (!s) s = "";
+  size_t room = limit - at - 1;
+  size_t length = tail ? strlen(s) : strnlen(s, room + 1);
+  uint8_t flag = 0;
+  if (length > room) {
+    if (tail) s += length - room;
+    length = room;
+    flag = tail ? LOG_STRING_TAIL : LOG_STRING_CUT;
+  }
+  record.payload[at] = (uint8_t)length | flag;
+  memcpy(record.payload + at + 1, s, length);
+  return at + 1 + length;
+}
+
+// limit: end of the payload minus what the remaining arguments need
+template <typename T>
+inline uint8_t logPut(LogRecord& record, uint8_t at, uint8_t limit, const T& value) {
+  if constexpr (std::is_floating_point<T>::value) {
+    float f = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return logPutWord(record, at, bits);
+  } else if constexpr (std::is_same<T, LogTail>::value) {
+    return logPutString(record, at, limit, value.str, true);
+  } else if constexpr (std::is_pointer<T>::value) {
+    static_assert(logArgKind<T>() == LOG_ARG_STRING, "only char pointers can be logged");
+    return logPutString(record, at, limit, value, false);
+  } else {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                  "log arguments are numbers, floats or strings");
+    return logPutWord(record, at, (uint32_t)value);
+  }
+}
+
+inline void logEncode(LogRecord&, uint8_t) {}
+
+template <typename T, typename... Rest>
+inline void logEncode(LogRecord& record, uint8_t at, const T& first, const Rest&... rest) {
+  typedef typename std::decay<T>::type D;
+  typedef typename std::conditional<std::is_same<D, char*>::value, const char*, D>::type U;
+  at = logPut<U>(record, at, LOG_PAYLOAD_BYTES - logArgsSize<Rest...>(), first);
+  logEncode(record, at, rest...);
+}
+
+// Fills a record in place; the ring and the drain task's own records use it
+template <LogId ID, typename... Args>
+inline void logEncodeRecord(LogRecord& record, uint32_t timeUs, const Args&... args) {
+  static_assert(ID < LOG_MESSAGE_COUNT, "unknown log message");
+  static_assert(logArgsMatch<Args...>(LOG_TABLE[ID].format),
+                "log arguments do not match the message format");
+  static_assert(logArgsSize<Args...>() <= LOG_PAYLOAD_BYTES, "log arguments too large");
+  record.timeUs = timeUs;
+  record.id = ID;
+  record.reserved = 0;
+  logEncode(record, 0, args...);
+}
+
+// =============================================================================
+// Formatting
+// =============================================================================
+
+// Message text of a record, without time or level; returns its length
+inline size_t formatLogMessage(char* out, size_t size, const LogRecord& record) {
+  if (size == 0) return 0;
+  out[0] = '\0';
+  if (record.id >= LOG_MESSAGE_COUNT) {
+    int n = snprintf(out, size, "unknown message %u", record.id);
+    return n < 0 ? 0 : ((size_t)n < size ? (size_t)n : size - 1);
+  }
+
+  const char* format = LOG_TABLE[record.id].format;
+  size_t pos = 0;
+  uint8_t at = 0;
+  auto append = [&](int n) {
+    if (n > 0) pos += (size_t)n < size - pos ? (size_t)n : size - pos - 1;
+  };
+
+  for (const char* p = format; *p && pos < size - 1; p++) {
+    if (*p != '%') {
+      out[pos++] = *p;
+      out[pos] = '\0';
+      continue;
+    }
+    if (p[1] == '%') {
+      out[pos++] = '%';
+      out[pos] = '\0';
+      p++;
+      continue;
+    }
+
+    // "%<flags/width/precision>l<conversion>" for snprintf
+    char spec[16] = "%";
+    size_t specLength = 1;
+    p++;
+    while (logIsSpecChar(*p)) {
+      if (specLength < sizeof(spec) - 4) spec[specLength++] = *p;
+      p++;
+    }
+    if (!*p) break;
+    char conversion = *p;
+
+    if (conversion == 's') {
+      if (at >= LOG_PAYLOAD_BYTES) break;
+      uint8_t flags = record.payload[at] & (LOG_STRING_CUT | LOG_STRING_TAIL);
+      uint8_t length = record.payload[at] & ~flags;
+      if (length > LOG_PAYLOAD_BYTES - at - 1) break;
+      char text[LOG_PAYLOAD_BYTES + 6];
+      size_t t = 0;
+      if (flags & LOG_STRING_TAIL) {
+        memcpy(text, "\xE2\x80\xA6", 3);           // "…"
+        t += 3;
+      }
+      memcpy(text + t, record.payload + at + 1, length);
+      t += length;
+      if (flags & LOG_STRING_CUT) {
+        memcpy(text + t, "\xE2\x80\xA6", 3);
+        t += 3;
+      }
+      text[t] = '\0';
+      at += 1 + length;
+      spec[specLength++] = 's';
+      spec[specLength] = '\0';
+      append(snprintf(out + pos, size - pos, spec, text));
+      continue;
+    }
+
+    if (at + 4 > LOG_PAYLOAD_BYTES) break;
+    uint32_t word;
+    memcpy(&word, record.payload + at, sizeof(word));
+    at += 4;
+
+    switch (conversion) {
+      case 'd':
+      case 'i':
+        spec[specLength++] = 'l';
+        spec[specLength++] = 'd';
+        spec[specLength] = '\0';
+        append(snprintf(out + pos, size - pos, spec, (long)(int32_t)word));
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+        spec[specLength++] = 'l';
+        spec[specLength++] = conversion;
+        spec[specLength] = '\0';
+        append(snprintf(out + pos, size - pos, spec, (unsigned long)word));
+        break;
+      case 'f': {
+        float f;
+        memcpy(&f, &word, sizeof(f));
+        spec[specLength++] = 'f';
+        spec[specLength] = '\0';
+        append(snprintf(out + pos, size - pos, spec, (double)f));
+        break;
+      }
+      case 'G':
+      case 'C':
+      case 'R': {
+        const char* name = conversion == 'G' ? gateStateName((GateState)word) :
+                           conversion == 'C' ? gateCommandName((uint8_t)word) :
+                           stopReasonName((uint8_t)word);
+        spec[specLength++] = 's';
+        spec[specLength] = '\0';
+        append(snprintf(out + pos, size - pos, spec, name));
+        break;
+      }
+      default:
+        append(snprintf(out + pos, size - pos, "?"));
+        break;
+    }
+  }
+  return pos;
+}
+
+// "  123.456789 W Gate GATEMATE-001 safety stop: obstacle at 35%"
+inline size_t formatLogLine(char* out, size_t size, const LogRecord& record, uint64_t uptimeUs) {
+  static const char levels[] = "DIWE";
+  char level = record.id < LOG_MESSAGE_COUNT ? levels[LOG_TABLE[record.id].level] : '?';
+  int n = snprintf(out, size, "%6lu.%06lu %c ", (unsigned long)(uptimeUs / 1000000),
+                   (unsigned long)(uptimeUs % 1000000), level);
+  if (n < 0 || (size_t)n >= size) return size ? strlen(out) : 0;
+  return n + formatLogMessage(out + n, size - n, record);
+}
+
+// =============================================================================
+// Ring
+// =============================================================================
+
+// Bounded multi-producer / single-consumer queue: each slot carries a
+// sequence number, so producers only contend on the claim of a slot and a
+// record is filled in place. Full means dropped, never blocked.
+template <uint16_t N>
+class LogRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    LogRecord record;
+  };
+
+  Slot slots[N];
+  std::atomic<uint32_t> tail{0};          // Next slot to claim
+  uint32_t head = 0;                      // Next slot to read (consumer only)
+  std::atomic<uint32_t> dropped{0};
+
+public:
+  LogRing() {
+    for (uint32_t i = 0; i < N; i++) slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // Producer side, any task
+  template <LogId ID, typename... Args>
+  bool write(uint32_t timeUs, const Args&... args) {
+    uint32_t pos = tail.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+      slot = &slots[pos & (N - 1)];
+      int32_t lag = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+      if (lag == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (lag < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+    logEncodeRecord<ID>(slot->record, timeUs, args...);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side
+  bool pop(LogRecord& record) {
+    Slot& slot = slots[head & (N - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) return false;
+    record = slot.record;
+    slot.sequence.store(head + N, std::memory_order_release);
+    head++;
+    return true;
+  }
+
+  uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+  static constexpr uint16_t capacity() { return N; }
+};
+
+typedef LogRing<LOG_BUFFER_RECORDS> EventLog;
+
+// Defined by the program: the firmware's is micros()
+uint32_t logNowUs();
+extern EventLog eventLog;
+
+// Compiled out with GATEMATE_FEATURE_LOGGING=0; the arguments are still
+// checked against the format
+#define LOG_EVENT(id, ...) \
+  do { \
+    if constexpr (BuildFeatures::logging) eventLog.write<id>(logNowUs(), ##__VA_ARGS__); \
+  } while (0)
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,319 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Compile-Time Feature Selection
+// =============================================================================
+//
+// Optional subsystems are selected by template specialization on the
+// BuildFeatures flags. A disabled feature resolves to an inline no-op
+// backend, so its library is never included and every call site folds
+// away at compile time.
+//
+
+#ifndef FEATURE_SET_H
+#define FEATURE_SET_H
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include "config.h"
+#include "event_log.h"
+#include "safety_wcet.h"
+
+#if GATEMATE_FEATURE_MQTT
+#include <PubSubClient.h>
+#endif
+
+#if GATEMATE_FEATURE_OTA
+#include <ElegantOTA.h>
+#endif
+
+#if GATEMATE_FEATURE_LAN && GATEMATE_FEATURE_GUEST && GATEMATE_FEATURE_MQTT
+#include <ESPmDNS.h>
+#include <WiFiUdp.h>
+#endif
+
+#if GATEMATE_FEATURE_MQTT_TLS || GATEMATE_FEATURE_HTTPS
+#include "tls_transport.h"
+#endif
+
+// =============================================================================
+// MQTT Backend
+// =============================================================================
+
+// Stand-in with the PubSubClient surface used by the firmware
+class NullMqttClient {
+public:
+  typedef void (*Callback)(char*, uint8_t*, unsigned int);
+
+  explicit NullMqttClient(Client&) {}
+  NullMqttClient& setServer(const char*, uint16_t) { return *this; }
+  NullMqttClient& setCallback(Callback) { return *this; }
+  bool setBufferSize(uint16_t) { return true; }
+  NullMqttClient& setKeepAlive(uint16_t) { return *this; }
+  bool connect(const char*, const char*, const char*) { return false; }
+  bool connect(const char*, const char*, const char*, const char*, uint8_t, bool, const char*,
+               bool) {
+    return false;
+  }
+  bool connected() { return false; }
+  bool subscribe(const char*) { return false; }
+  bool subscribe(const char*, uint8_t) { return false; }
+  bool unsubscribe(const char*) { return false; }
+  bool publish(const char*, const char*) { return false; }
+  bool publish(const char*, const char*, bool) { return false; }
+  bool publish(const char*, const uint8_t*, unsigned int, bool) { return false; }
+  bool loop() { return false; }
+  int state() { return -1; }
+};
+
+template <bool Enabled> struct MqttBackend {
+  typedef NullMqttClient Client;
+};
+
+#if GATEMATE_FEATURE_MQTT
+template <> struct MqttBackend<true> {
+  typedef PubSubClient Client;
+};
+#endif
+
+typedef MqttBackend<BuildFeatures::mqtt>::Client MqttClient;
+
+// Plain TCP on MQTT_PORT, or TLS with session resumption on MQTT_TLS_PORT
+template <bool Tls> struct MqttTransport {
+  typedef WiFiClient Client;
+  static const uint16_t port = MQTT_PORT;
+  static void toJson(Client&, JsonObject) {}
+};
+
+#if GATEMATE_FEATURE_MQTT_TLS
+template <> struct MqttTransport<true> {
+  typedef TlsClient Client;
+  static const uint16_t port = MQTT_TLS_PORT;
+  static void toJson(Client& client, JsonObject out) { client.toJson(out); }
+};
+#endif
+
+typedef MqttTransport<BuildFeatures::mqttTls> MqttLink;
+
+// =============================================================================
+// OTA Backend
+// =============================================================================
+
+template <bool Enabled> struct OtaBackend {
+  static void begin(WebServer*) {}
+  static void loop() {}
+};
+
+#if GATEMATE_FEATURE_OTA
+template <> struct OtaBackend<true> {
+  static void begin(WebServer* server) { ElegantOTA.begin(server); }
+  static void loop() { ElegantOTA.loop(); }
+};
+#endif
+
+typedef OtaBackend<BuildFeatures::ota> Ota;
+
+// =============================================================================
+// LAN Fast Path
+// =============================================================================
+
+// The UDP command socket and the mDNS advertisement
+template <bool Enabled> class LanBackend {
+public:
+  bool begin(uint16_t) { return false; }
+  int receive(uint8_t*, size_t, IPAddress&, uint16_t&) { return 0; }
+  void send(const IPAddress&, uint16_t, const uint8_t*, size_t) {}
+  static bool advertise(const char*, uint16_t, uint16_t, const char*) { return false; }
+};
+
+#if GATEMATE_FEATURE_LAN && GATEMATE_FEATURE_GUEST && GATEMATE_FEATURE_MQTT
+template <> class LanBackend<true> {
+private:
+  WiFiUDP udp;
+
+public:
+  bool begin(uint16_t port) { return udp.begin(port); }
+
+  // Length of the next datagram, 0 if none; at most size bytes are copied
+  int receive(uint8_t* buffer, size_t size, IPAddress& ip, uint16_t& port) {
+    int length = udp.parsePacket();
+    if (length <= 0) return 0;
+    ip = udp.remoteIP();
+    port = udp.remotePort();
+    udp.read(buffer, size);
+    return length;
+  }
+
+  void send(const IPAddress& ip, uint16_t port, const uint8_t* data, size_t length) {
+    udp.beginPacket(ip, port);
+    udp.write(data, length);
+    udp.endPacket();
+  }
+
+  // <host>.local with _gatemate._udp (gate ids in TXT) and the web API
+  static bool advertise(const char* host, uint16_t udpPort, uint16_t httpPort,
+                        const char* gates) {
+    if (!MDNS.begin(host)) return false;
+    MDNS.addService("gatemate", "udp", udpPort);
+    MDNS.addServiceTxt("gatemate", "udp", "v", "1");
+    MDNS.addServiceTxt("gatemate", "udp", "gates", gates);
+    MDNS.addService("http", "tcp", httpPort);
+    return true;
+  }
+};
+#endif
+
+typedef LanBackend<BuildFeatures::lan> LanLink;
+
+// =============================================================================
+// HTTPS Front
+// =============================================================================
+
+// TLS in front of the WebServer, which then only listens on loopback
+template <bool Enabled> class HttpsFrontImpl {
+public:
+  bool begin(uint16_t, uint16_t, uint16_t) { return false; }
+  void toJson(JsonObject) {}
+};
+
+#if GATEMATE_FEATURE_HTTPS
+template <> class HttpsFrontImpl<true> : public TlsFront {};
+#endif
+
+typedef HttpsFrontImpl<BuildFeatures::https> HttpsFront;
+
+// =============================================================================
+// Loop Profiler
+// =============================================================================
+
+// Accumulates loop() cost per window; reported through GET /config
+template <bool Enabled> class LoopProfilerImpl {
+public:
+  void begin() {}
+  void end() {}
+  void toJson(JsonObject) {}
+};
+
+template <> class LoopProfilerImpl<true> {
+private:
+  static const uint32_t WINDOW_MS = 10000;
+
+  uint32_t startUs = 0;
+  uint32_t windowStart = 0;
+  uint32_t sumUs = 0;
+  uint32_t count = 0;
+  uint32_t maxUs = 0;
+  uint32_t lastAvgUs = 0;
+  uint32_t lastMaxUs = 0;
+
+public:
+  void begin() { startUs = micros(); }
+
+  void end() {
+    uint32_t elapsed = micros() - startUs;
+    sumUs += elapsed;
+    count++;
+    if (elapsed > maxUs) maxUs = elapsed;
+
+    if (millis() - windowStart >= WINDOW_MS) {
+      lastAvgUs = count ? sumUs / count : 0;
+      lastMaxUs = maxUs;
+      sumUs = 0;
+      count = 0;
+      maxUs = 0;
+      windowStart = millis();
+    }
+  }
+
+  void toJson(JsonObject out) {
+    out["loopAvgUs"] = lastAvgUs;
+    out["loopMaxUs"] = lastMaxUs;
+  }
+};
+
+typedef LoopProfilerImpl<BuildFeatures::loopProfile> LoopProfiler;
+
+// =============================================================================
+// Safety Path Timer
+// =============================================================================
+
+// Runs a gate's loop() pass; when enabled, times it per branch on the cycle
+// counter after a boot run of the adversarial harness (safety_wcet.h)
+template <bool Enabled> class SafetyTimerImpl {
+public:
+  bool begin() { return true; }
+
+  template <typename Gate>
+  void pass(Gate& gate, uint32_t nowMs, const SafetyLimits& limits, float temperature) {
+    gate.loop(nowMs, limits, temperature);
+  }
+
+  SafetyBranch worstBranch() const { return WCET_IDLE; }
+  float worstUs() const { return 0; }
+  void toJson(JsonObject) {}
+};
+
+template <> class SafetyTimerImpl<true> {
+private:
+  struct CycleClock {
+    typedef uint32_t Ticks;
+    static Ticks now() { return ESP.getCycleCount(); }
+    static uint32_t elapsedNs(Ticks from, Ticks to) {
+      return (uint32_t)((uint64_t)(to - from) * 1000 / getCpuFrequencyMhz());
+    }
+  };
+
+  WcetMeter boot{WCET_SAFETY_BUDGET_US};
+  WcetMeter live{WCET_SAFETY_BUDGET_US};
+  bool covered = false;
+
+  static void meterJson(const WcetMeter& meter, JsonObject out) {
+    for (uint8_t b = 0; b < WCET_BRANCH_COUNT; b++) {
+      const WcetHistogram& h = meter.branch((SafetyBranch)b);
+      if (!h.count()) continue;
+      JsonObject branch = out[safetyBranchName((SafetyBranch)b)].to<JsonObject>();
+      branch["n"] = h.count();
+      branch["p50Us"] = h.percentile(500) / 1000.0f;
+      branch["p99Us"] = h.percentile(990) / 1000.0f;
+      branch["maxUs"] = h.max() / 1000.0f;
+    }
+    out["over"] = meter.overBudget();
+  }
+
+public:
+  // True if the harness took every branch and stayed within the budget
+  bool begin() {
+    SafetyWcetHarness<CycleClock> harness;
+    covered = harness.run(boot, WCET_BOOT_SAMPLES);
+    return covered && boot.overBudget() == 0;
+  }
+
+  // A new high over the budget is logged once
+  template <typename Gate>
+  void pass(Gate& gate, uint32_t nowMs, const SafetyLimits& limits, float temperature) {
+    SafetyPass before = safetyPassOf(gate);
+    uint32_t start = CycleClock::now();
+    gate.loop(nowMs, limits, temperature);
+    uint32_t ns = CycleClock::elapsedNs(start, CycleClock::now());
+    SafetyBranch branch = safetyBranchOf(before, gate);
+    uint32_t high = live.branch(branch).max();
+    if (live.record(branch, ns) && ns > high) {
+      LOG_EVENT(LOG_WCET_OVER, safetyBranchName(branch), ns / 1000, live.budgetUs());
+    }
+  }
+
+  // Slowest branch of the boot run
+  SafetyBranch worstBranch() const { return boot.worst(); }
+  float worstUs() const { return boot.branch(boot.worst()).max() / 1000.0f; }
+
+  void toJson(JsonObject out) {
+    out["budgetUs"] = WCET_SAFETY_BUDGET_US;
+    out["covered"] = covered;
+    meterJson(boot, out["boot"].to<JsonObject>());
+    meterJson(live, out["live"].to<JsonObject>());
+  }
+};
+
+typedef SafetyTimerImpl<BuildFeatures::safetyWcet> SafetyTimer;
+
+#endif // FEATURE_SET_H
@@ -0,0 +1,215 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Streaming Sensor Filters
+// =============================================================================
+//
+// Fixed-point, constant-cost-per-sample filters for the ADC channels, plus
+// the NTC thermistor conversion table generated at compile time. This file
+// has no Arduino dependency so it can be built and benchmarked on the host
+// (see tools/filter_bench.cpp).
+//
+// Units used throughout: mA, mV and centi-degrees Celsius (int32_t).
+//
+
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <stdint.h>
+
+// =============================================================================
+// Moving Median
+// =============================================================================
+
+// Spike rejection over the last N samples. Keeps the window both in arrival
+// order and sorted; each sample costs one removal and one insertion in the
+// sorted copy, i.e. bounded by N (a small compile-time constant).
+template <uint8_t N>
+class MovingMedian {
+  static_assert(N >= 3 && (N & 1), "window must be odd and at least 3");
+
+private:
+  int32_t ring[N] = {};
+  int32_t sorted[N] = {};
+  uint8_t head = 0;
+  uint8_t count = 0;
+
+public:
+  int32_t update(int32_t sample) {
+    uint8_t size = count;
+
+    if (count == N) {
+      // Drop the oldest sample from the sorted window
+      int32_t oldest = ring[head];
+      uint8_t i = 0;
+      while (sorted[i] != oldest) i++;
+      for (; i + 1 < N; i++) sorted[i] = sorted[i + 1];
+      size = N - 1;
+    } else {
+      count++;
+    }
+
+    ring[head] = sample;
+    head = (head + 1) % N;
+
+    // Insert the new sample keeping the order
+    uint8_t j = size;
+    while (j > 0 && sorted[j - 1] > sample) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = sample;
+
+    return sorted[count / 2];
+  }
+
+  void reset() {
+    head = 0;
+    count = 0;
+  }
+};
+
+// =============================================================================
+// Exponential Moving Average
+// =============================================================================
+
+// y += (x - y) / 2^Shift, with 8 fractional bits of state
+template <uint8_t Shift>
+class EmaFilter {
+private:
+  int32_t state = 0;
+  bool primed = false;
+
+public:
+  int32_t update(int32_t sample) {
+    int32_t scaled = sample * 256;
+    if (!primed) {
+      state = scaled;
+      primed = true;
+    } else {
+      state += (scaled - state) >> Shift;
+    }
+    return state / 256;
+  }
+
+  int32_t value() const { return state / 256; }
+  void reset() { primed = false; }
+};
+
+// =============================================================================
+// 1-D Kalman Filter
+// =============================================================================
+
+// Constant-state model: processNoise (Q) is the expected drift variance per
+// sample, measurementNoise (R) the sensor variance, both in unit^2.
+class Kalman1D {
+private:
+  int32_t estimate = 0;
+  int64_t errorVariance = 0;
+  int64_t processNoise;
+  int64_t measurementNoise;
+  bool primed = false;
+
+public:
+  Kalman1D(int32_t q, int32_t r) : processNoise(q), measurementNoise(r) {}
+
+  int32_t update(int32_t measurement) {
+    if (!primed) {
+      estimate = measurement;
+      errorVariance = measurementNoise;
+      primed = true;
+      return estimate;
+    }
+
+    // Predict
+    errorVariance += processNoise;
+
+    // Gain in Q16
+    int64_t gain = (errorVariance << 16) / (errorVariance + measurementNoise);
+
+    // Correct
+    estimate += (int32_t)((gain * (int64_t)(measurement - estimate)) >> 16);
+    errorVariance = ((65536 - gain) * errorVariance) >> 16;
+    if (errorVariance < 1) errorVariance = 1;
+
+    return estimate;
+  }
+
+  int32_t value() const { return estimate; }
+  void reset() { primed = false; }
+};
+
+// =============================================================================
+// NTC Thermistor Conversion
+// =============================================================================
+
+// Divider: VCC -- R_series -- ADC -- NTC -- GND. The table maps the 12-bit
+// ADC reading (in 16-count steps) to centi-degrees using the Beta equation:
+//   1/T = 1/T0 + ln(R/R0) / B
+
+namespace ntc_detail {
+
+constexpr double ln(double x) {
+  // Range-reduce to [1, 2), then ln(m) = 2 * atanh((m - 1) / (m + 1))
+  int exponent = 0;
+  while (x >= 2.0) { x /= 2.0; exponent++; }
+  while (x < 1.0) { x *= 2.0; exponent--; }
+
+  double y = (x - 1.0) / (x + 1.0);
+  double y2 = y * y;
+  double term = y;
+  double sum = 0.0;
+  for (int k = 1; k < 40; k += 2) {
+    sum += term / k;
+    term *= y2;
+  }
+  return 2.0 * sum + exponent * 0.69314718055994530942;
+}
+
+} // namespace ntc_detail
+
+template <uint32_t Beta, uint32_t R25, uint32_t SeriesR>
+struct NtcTable {
+  static constexpr uint16_t ADC_MAX = 4095;
+  static constexpr uint8_t STEP_BITS = 4;
+  static constexpr uint16_t SIZE = (4096 >> STEP_BITS) + 1;
+  static constexpr int32_t MIN_CENTI = -4000;
+  static constexpr int32_t MAX_CENTI = 15000;
+
+  int16_t centi[SIZE] = {};
+
+  constexpr NtcTable() {
+    for (uint16_t i = 0; i < SIZE; i++) {
+      double raw = (double)(i << STEP_BITS);
+      if (raw < 1.0) raw = 1.0;
+      if (raw > ADC_MAX - 1) raw = ADC_MAX - 1;
+
+      double resistance = (double)SeriesR * raw / (ADC_MAX - raw);
+      double inverseT = 1.0 / 298.15 + ntc_detail::ln(resistance / R25) / Beta;
+      double celsius = 1.0 / inverseT - 273.15;
+
+      int32_t value = (int32_t)(celsius * 100.0 + (celsius >= 0 ? 0.5 : -0.5));
+      if (value < MIN_CENTI) value = MIN_CENTI;
+      if (value > MAX_CENTI) value = MAX_CENTI;
+      centi[i] = (int16_t)value;
+    }
+  }
+
+  // Linear interpolation between table entries, integer only
+  constexpr int32_t toCentiCelsius(uint16_t raw) const {
+    if (raw > ADC_MAX) raw = ADC_MAX;
+    uint16_t index = raw >> STEP_BITS;
+    int32_t frac = raw & ((1 << STEP_BITS) - 1);
+    int32_t a = centi[index];
+    int32_t b = centi[index + 1];
+    return a + (((b - a) * frac) >> STEP_BITS);
+  }
+};
+
+// =============================================================================
+// Channel Conversions
+// =============================================================================
+
+inline int32_t adcToMilliVolts(uint16_t raw) {
+  return ((int32_t)raw * 3300 + 2047) / 4095;
+}
+
+#endif // FILTERS_H
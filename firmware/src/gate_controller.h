@@ -0,0 +1,308 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Gate Controller
+// =============================================================================
+//
+// One gate leaf or barrier: its relays, limit switches, obstacle input and
+// current channel (a GateDescriptor), plus everything that used to be
+// global state - position, safety inputs, command cooldown and the
+// operation history. main.cpp runs one instance per entry of
+// GATE_DESCRIPTORS (config.h) behind a single MQTT connection, HTTP server
+// and scheduler, so a double-leaf gate or a barrier-plus-gate lane needs one
+// ESP32 instead of two.
+//
+// Hardware access goes through the Io template parameter:
+//
+//   void write(uint8_t pin, bool level);   // Relay outputs
+//   bool read(uint8_t pin);                // Inputs, LOW = active
+//
+// State changes all go through dispatch() and the table in gate_fsm.h;
+// commands, position steps and the safety rules only raise inputs. The
+// relay interlock does not block: the relays drop at once and the new one
+// is energized GATE_INTERLOCK_MS later from loop(), so one gate reversing
+// does not stall the others. Transitions are reported through takeEvents()
+// for the caller to persist and publish.
+//
+// No Arduino dependency; tools/gate_controller_check.cpp drives four
+// instances on simulated hardware.
+//
+
+#ifndef GATE_CONTROLLER_H
+#define GATE_CONTROLLER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "config.h"
+#include "gate_fsm.h"
+#include "gate_motion.h"
+#include "history.h"
+#include "safety_rules.h"
+
+#define GATE_MAX_COUNT        4
+#define GATE_ID_MAX           12          // Descriptor id, topic level
+#define GATE_DEVICE_ID_MAX    40          // <DEVICE_NAME>-<id>, incl. terminator
+#define GATE_INTERLOCK_MS     50          // Both relays off before reversing
+
+// =============================================================================
+// Descriptor
+// =============================================================================
+
+struct GatePins {
+  uint8_t relayOpen;
+  uint8_t relayClose;
+  uint8_t limitOpen;
+  uint8_t limitClose;
+  uint8_t obstacle;
+  uint8_t currentSensor;      // ADC
+};
+
+// Threshold overrides of 0 use the runtime configuration
+struct GateDescriptor {
+  const char* id;             // "" = the controller's own DEVICE_NAME
+  GatePins pins;
+  float maxCurrent;           // A
+  uint32_t maxOperationTime;  // ms
+};
+
+// The id the gate reports under and is commanded on. A gate without an id
+// keeps the controller's name, so a single-gate build is unchanged.
+inline void formatGateDeviceId(char* out, size_t size, const char* controller, const char* id) {
+  if (!id || !*id) snprintf(out, size, "%s", controller);
+  else snprintf(out, size, "%s-%s", controller, id);
+}
+
+// =============================================================================
+// Events
+// =============================================================================
+
+enum GateEvent : uint8_t {
+  GATE_EVENT_STARTED = 1 << 0,   // Movement began (or reversed)
+  GATE_EVENT_STEPPED = 1 << 1,   // Position changed
+  GATE_EVENT_STOPPED = 1 << 2,   // Movement ended, see lastStop()
+};
+
+struct GateStop {
+  uint32_t timeMs;
+  StopReason reason;
+  uint8_t percentage;
+};
+
+// =============================================================================
+// Gate Controller Class
+// =============================================================================
+
+template <typename Io>
+class GateController {
+private:
+  static const uint8_t NO_RELAY = 0xFF;
+
+  const GateDescriptor* desc = nullptr;
+  Io* io = nullptr;
+  uint8_t slot = 0;
+  char deviceId[GATE_DEVICE_ID_MAX] = "";
+
+  GateState state = GATE_CLOSED;
+  uint8_t percentage = 0;
+  bool obstacle = false;
+  float current = 0.0f;             // A, filtered
+  uint32_t operationStartMs = 0;
+  uint32_t lastStepMs = 0;
+  uint32_t lastCommandMs = 0;
+  uint8_t pendingRelay = NO_RELAY;  // Energized once the interlock has passed
+  uint32_t relayAt = 0;
+
+  DebouncedInput obstacleInput;
+  OperationTracker tracker;
+  HistoryRing<OperationRecord, HISTORY_OPERATIONS> history;
+  GateStop stopped = {};
+  uint8_t events = 0;
+
+  bool active(uint8_t pin) { return io->read(pin) == false; }
+
+  // GateAction bits, in bit order; state is already the new one
+  void run(uint8_t actions, StopReason reason, uint32_t nowMs) {
+    if (actions & GATE_ACT_RELEASE) {
+      pendingRelay = NO_RELAY;
+      io->write(desc->pins.relayOpen, false);
+      io->write(desc->pins.relayClose, false);
+    }
+    if (actions & GATE_ACT_AT_OPEN) percentage = 100;
+    if (actions & GATE_ACT_AT_CLOSED) percentage = 0;
+    if (actions & GATE_ACT_END_OPERATION) {
+      OperationRecord record;
+      if (tracker.end(nowMs, percentage, reason, record)) history.push(record);
+    }
+    if (actions & GATE_ACT_BEGIN_OPERATION) {
+      tracker.begin(nowMs, nowMs / 1000, state == GATE_OPENING ? 0 : 1, percentage);
+      operationStartMs = nowMs;
+      events |= GATE_EVENT_STARTED;
+    }
+    if (actions & (GATE_ACT_DRIVE_OPEN | GATE_ACT_DRIVE_CLOSE)) {
+      // Both relays are off here: from rest, or released by the exit
+      pendingRelay = actions & GATE_ACT_DRIVE_OPEN ? desc->pins.relayOpen : desc->pins.relayClose;
+      relayAt = nowMs + GATE_INTERLOCK_MS;
+    }
+    if (actions & GATE_ACT_REPORT_STOP) {
+      stopped = {nowMs, reason, percentage};
+      events |= GATE_EVENT_STOPPED;
+    }
+  }
+
+public:
+  void begin(const GateDescriptor& descriptor, uint8_t index, Io& board, const char* controller) {
+    desc = &descriptor;
+    io = &board;
+    slot = index;
+    formatGateDeviceId(deviceId, sizeof(deviceId), controller, descriptor.id);
+    io->write(desc->pins.relayOpen, false);
+    io->write(desc->pins.relayClose, false);
+  }
+
+  // Reconciles a persisted state with the limit switches, which are ground
+  // truth. A movement interrupted by a reset has its relays released.
+  void restore(uint8_t savedState, uint8_t savedPercentage) {
+    if (active(desc->pins.limitOpen)) {
+      state = GATE_OPEN;
+      percentage = 100;
+    } else if (active(desc->pins.limitClose)) {
+      state = GATE_CLOSED;
+      percentage = 0;
+    } else {
+      state = (GateState)savedState;
+      percentage = savedPercentage > 100 ? 100 : savedPercentage;
+      if (state == GATE_OPENING || state == GATE_CLOSING) state = GATE_STOPPED;
+    }
+    events |= GATE_EVENT_STEPPED;
+  }
+
+  // =============================================================================
+  // Commands
+  // =============================================================================
+
+  // One input through the state table: exit actions of the old state and
+  // entry actions of the new one. reason is what a stop, or the operation
+  // record a transition closes, reports. Returns false if the input was
+  // ignored in this state or its guard failed.
+  bool dispatch(GateInput input, StopReason reason, uint32_t nowMs) {
+    GateState from = state;
+    GateState to = gateNextState(from, input, percentage);
+    if (to == from) return false;
+    state = to;
+    run(gateTransitionActions(from, to), reason, nowMs);
+    return true;
+  }
+
+  // A reversal closes the running operation as STOP_REVERSED
+  bool open(uint32_t nowMs) { return dispatch(GATE_IN_OPEN, STOP_REVERSED, nowMs); }
+  bool close(uint32_t nowMs) { return dispatch(GATE_IN_CLOSE, STOP_REVERSED, nowMs); }
+
+  // Ends a movement: GATE_OPEN / GATE_CLOSED on arrival, GATE_ERROR on a
+  // fault, GATE_STOPPED otherwise. A stop command at rest is ignored, except
+  // that it clears GATE_ERROR.
+  bool stop(uint32_t nowMs, StopReason reason = STOP_MANUAL) {
+    return dispatch(gateInputFor(reason), reason, nowMs);
+  }
+
+  // No encoder yet: moves towards the target, the step timer does the rest
+  bool moveTo(uint8_t target, uint32_t nowMs) {
+    if (target > percentage) return open(nowMs);
+    if (target < percentage) return close(nowMs);
+    return false;
+  }
+
+  // GATE_OUTCOME_IGNORED when the state machine had no transition for it
+  GateCommandOutcome command(GateCommand command, uint8_t target, uint32_t nowMs) {
+    bool applied;
+    switch (command) {
+      case GATE_CMD_OPEN: applied = open(nowMs); break;
+      case GATE_CMD_CLOSE: applied = close(nowMs); break;
+      case GATE_CMD_STOP: applied = stop(nowMs); break;
+      case GATE_CMD_PARTIAL: applied = moveTo(target > 100 ? 100 : target, nowMs); break;
+      default: return GATE_OUTCOME_INVALID;
+    }
+    return applied ? GATE_OUTCOME_APPLIED : GATE_OUTCOME_IGNORED;
+  }
+
+  // Rate limit for user-facing open/close requests, per gate
+  bool inCooldown(uint32_t nowMs, uint32_t cooldownMs) const {
+    return nowMs - lastCommandMs < cooldownMs;
+  }
+
+  void markCommand(uint32_t nowMs) { lastCommandMs = nowMs; }
+
+  // =============================================================================
+  // Loop
+  // =============================================================================
+
+  // Filtered current of this gate's channel; also feeds the operation record
+  void addSample(uint32_t nowMs, int32_t currentMa, int32_t voltageMv) {
+    current = currentMa / 1000.0f;
+    tracker.addSample(nowMs, currentMa, voltageMv);
+  }
+
+  // Interlock, position steps and the safety rules while moving
+  void loop(uint32_t nowMs, SafetyLimits limits, float temperature) {
+    if (!moving()) return;
+
+    if (pendingRelay != NO_RELAY) {
+      if ((int32_t)(nowMs - relayAt) < 0) return;
+      io->write(pendingRelay, true);
+      pendingRelay = NO_RELAY;
+    }
+
+    // Simulated position (in production, use encoder or timing)
+    if (nowMs - lastStepMs >= GATE_STEP_MS) {
+      lastStepMs = nowMs;
+      events |= GATE_EVENT_STEPPED;
+      if (stepGatePosition(state, percentage)) {
+        stop(nowMs, STOP_COMPLETED);
+        return;
+      }
+    }
+
+    if (desc->maxCurrent > 0) limits.maxCurrent = desc->maxCurrent;
+    if (desc->maxOperationTime > 0) limits.maxOperationTime = desc->maxOperationTime;
+
+    SafetyInputs in;
+    in.nowMs = nowMs;
+    in.operationStartMs = operationStartMs;
+    in.state = state;
+    in.obstacle = BuildFeatures::obstacleDetect &&
+                  obstacleInput.update(active(desc->pins.obstacle), nowMs,
+                                       limits.obstacleDebounceMs);
+    in.limitOpen = active(desc->pins.limitOpen);
+    in.limitClose = active(desc->pins.limitClose);
+    in.current = current;
+    in.temperature = temperature;
+    obstacle = in.obstacle;
+
+    // A limit switch arrives (and sets the position), the rest stop or fault
+    StopReason reason;
+    if (evaluateSafety(limits, in, reason)) stop(nowMs, reason);
+  }
+
+  // Events since the last call
+  uint8_t takeEvents() {
+    uint8_t taken = events;
+    events = 0;
+    return taken;
+  }
+
+  // =============================================================================
+  // Getters
+  // =============================================================================
+
+  const GateDescriptor& descriptor() const { return *desc; }
+  uint8_t index() const { return slot; }
+  const char* getDeviceId() const { return deviceId; }
+  GateState getState() const { return state; }
+  uint8_t getPercentage() const { return percentage; }
+  bool obstacleDetected() const { return obstacle; }
+  bool moving() const { return gateStateMoving(state); }
+  bool relaysSettled() const { return pendingRelay == NO_RELAY; }
+  float getCurrent() const { return current; }
+  uint32_t getLastStepMs() const { return lastStepMs; }
+  const GateStop& lastStop() const { return stopped; }
+  const HistoryRing<OperationRecord, HISTORY_OPERATIONS>& operations() const { return history; }
+};
+
+#endif // GATE_CONTROLLER_H
@@ -0,0 +1,307 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Gate State Machine
+// =============================================================================
+//
+// Every gate state change as one constexpr table: for each state and input
+// the next state and the guard that must hold on the position, plus entry
+// and exit actions per state. GateController::dispatch() looks a transition
+// up and runs its actions; the host mirrors (tools/fleet_sim.cpp,
+// tools/trace_replay.cpp) follow the same table through gateNextState(), so
+// the rules exist once.
+//
+// A lookup is two array reads and one comparison for the guard: each guard
+// is the one position at which it fails. The actions of a transition (exit
+// of the old state | entry of the new one) run in bit order, so the
+// position snaps to an end before the operation record is closed.
+//
+// The static_asserts at the end hold the table to its invariants, among
+// them: a moving gate stops on every stop-type input, arriving ends in the
+// matching end state (a stop never overwrites GATE_OPEN / GATE_CLOSED),
+// faults end in GATE_ERROR, leaving a moving state releases the relays, and
+// every state is reachable from GATE_CLOSED.
+//
+// No Arduino dependency; tools/gate_fsm_check.cpp checks every state, input
+// and position against the rules and times dispatch.
+//
+
+#ifndef GATE_FSM_H
+#define GATE_FSM_H
+
+#include <stdint.h>
+#include "gate_motion.h"
+#include "history.h"
+
+#define GATE_STATE_COUNT    6
+#define GATE_STAY           0xFF      // Next state of an ignored input
+
+// =============================================================================
+// Inputs
+// =============================================================================
+
+enum GateInput : uint8_t {
+  GATE_IN_OPEN = 0,       // Open command, or partial towards open
+  GATE_IN_CLOSE,
+  GATE_IN_STOP,           // Stop command or button
+  GATE_IN_ARRIVED,        // End position: last position step or limit switch
+  GATE_IN_OBSTACLE,
+  GATE_IN_FAULT,          // Timeout, overcurrent, overheat
+  GATE_INPUT_COUNT
+};
+
+inline const char* gateInputName(GateInput input) {
+  switch (input) {
+    case GATE_IN_OPEN: return "open";
+    case GATE_IN_CLOSE: return "close";
+    case GATE_IN_STOP: return "stop";
+    case GATE_IN_ARRIVED: return "arrived";
+    case GATE_IN_OBSTACLE: return "obstacle";
+    case GATE_IN_FAULT: return "fault";
+    default: return "unknown";
+  }
+}
+
+// The input a stop arrives as; STOP_REVERSED is the exit reason of a
+// reversal, not an input of its own
+constexpr GateInput gateInputFor(StopReason reason) {
+  switch (reason) {
+    case STOP_COMPLETED:
+    case STOP_LIMIT: return GATE_IN_ARRIVED;
+    case STOP_OBSTACLE: return GATE_IN_OBSTACLE;
+    case STOP_TIMEOUT:
+    case STOP_OVERCURRENT:
+    case STOP_OVERHEAT: return GATE_IN_FAULT;
+    default: return GATE_IN_STOP;
+  }
+}
+
+// =============================================================================
+// Guards & Actions
+// =============================================================================
+
+enum GateGuard : uint8_t {
+  GATE_GUARD_NONE = 0,
+  GATE_GUARD_NOT_OPEN,    // percentage < 100
+  GATE_GUARD_NOT_CLOSED,  // percentage > 0
+  GATE_GUARD_COUNT
+};
+
+// The position at which each guard fails; 0x100 never does
+constexpr uint16_t GATE_GUARD_FAILS_AT[GATE_GUARD_COUNT] = {0x100, 100, 0};
+
+// Run in this (bit) order
+enum GateAction : uint8_t {
+  GATE_ACT_RELEASE = 1 << 0,          // Both relays off, pending relay dropped
+  GATE_ACT_AT_OPEN = 1 << 1,          // Position is 100 %
+  GATE_ACT_AT_CLOSED = 1 << 2,        // Position is 0 %
+  GATE_ACT_END_OPERATION = 1 << 3,    // Close the operation record
+  GATE_ACT_BEGIN_OPERATION = 1 << 4,  // New record and timeout, GATE_EVENT_STARTED
+  GATE_ACT_DRIVE_OPEN = 1 << 5,       // Open relay after the interlock
+  GATE_ACT_DRIVE_CLOSE = 1 << 6,      // Close relay after the interlock
+  GATE_ACT_REPORT_STOP = 1 << 7,      // lastStop(), GATE_EVENT_STOPPED
+};
+
+struct GateTransition {
+  uint8_t next;           // GateState, or GATE_STAY
+  GateGuard guard;
+};
+
+struct GateStateActions {
+  uint8_t entry;
+  uint8_t exit;
+};
+
+// =============================================================================
+// Table
+// =============================================================================
+
+#define GATE_GO_OPENING   {GATE_OPENING, GATE_GUARD_NOT_OPEN}
+#define GATE_GO_CLOSING   {GATE_CLOSING, GATE_GUARD_NOT_CLOSED}
+#define GATE_GO(state)    {state, GATE_GUARD_NONE}
+#define GATE_IGNORE       {GATE_STAY, GATE_GUARD_NONE}
+
+// Rows in GateState order; columns in GateInput order
+constexpr GateTransition GATE_TRANSITIONS[GATE_STATE_COUNT][GATE_INPUT_COUNT] = {
+  //                open             close            stop                   arrived                obstacle               fault
+  /* closed  */ {GATE_GO_OPENING, GATE_GO_CLOSING, GATE_IGNORE,           GATE_IGNORE,           GATE_IGNORE,           GATE_IGNORE},
+  /* opening */ {GATE_IGNORE,     GATE_GO_CLOSING, GATE_GO(GATE_STOPPED), GATE_GO(GATE_OPEN),    GATE_GO(GATE_STOPPED), GATE_GO(GATE_ERROR)},
+  /* open    */ {GATE_GO_OPENING, GATE_GO_CLOSING, GATE_IGNORE,           GATE_IGNORE,           GATE_IGNORE,           GATE_IGNORE},
+  /* closing */ {GATE_GO_OPENING, GATE_IGNORE,     GATE_GO(GATE_STOPPED), GATE_GO(GATE_CLOSED),  GATE_GO(GATE_STOPPED), GATE_GO(GATE_ERROR)},
+  /* stopped */ {GATE_GO_OPENING, GATE_GO_CLOSING, GATE_IGNORE,           GATE_IGNORE,           GATE_IGNORE,           GATE_IGNORE},
+  /* error   */ {GATE_GO_OPENING, GATE_GO_CLOSING, GATE_GO(GATE_STOPPED), GATE_IGNORE,           GATE_IGNORE,           GATE_IGNORE},
+};
+
+#undef GATE_GO_OPENING
+#undef GATE_GO_CLOSING
+#undef GATE_GO
+#undef GATE_IGNORE
+
+constexpr uint8_t GATE_MOVING_EXIT = GATE_ACT_RELEASE | GATE_ACT_END_OPERATION;
+
+constexpr GateStateActions GATE_STATE_ACTIONS[GATE_STATE_COUNT] = {
+  /* closed  */ {GATE_ACT_AT_CLOSED | GATE_ACT_REPORT_STOP, 0},
+  /* opening */ {GATE_ACT_BEGIN_OPERATION | GATE_ACT_DRIVE_OPEN, GATE_MOVING_EXIT},
+  /* open    */ {GATE_ACT_AT_OPEN | GATE_ACT_REPORT_STOP, 0},
+  /* closing */ {GATE_ACT_BEGIN_OPERATION | GATE_ACT_DRIVE_CLOSE, GATE_MOVING_EXIT},
+  /* stopped */ {GATE_ACT_REPORT_STOP, 0},
+  /* error   */ {GATE_ACT_REPORT_STOP, 0},
+};
+
+// =============================================================================
+// Lookup
+// =============================================================================
+
+constexpr bool gateStateMoving(uint8_t state) {
+  return state == GATE_OPENING || state == GATE_CLOSING;
+}
+
+// The state an input leads to at a position; the state itself when the
+// table ignores the input or the guard fails (there are no self-transitions)
+constexpr GateState gateNextState(GateState state, GateInput input, uint8_t percentage) {
+  const GateTransition& t = GATE_TRANSITIONS[state][input];
+  return t.next != GATE_STAY && percentage != GATE_GUARD_FAILS_AT[t.guard] ? (GateState)t.next
+                                                                         : state;
+}
+
+// Actions of the transition from one state to another
+constexpr uint8_t gateTransitionActions(GateState from, GateState to) {
+  return GATE_STATE_ACTIONS[from].exit | GATE_STATE_ACTIONS[to].entry;
+}
+
+// =============================================================================
+// Invariants
+// =============================================================================
+
+namespace gate_fsm_rules {
+
+constexpr bool isStopInput(uint8_t input) {
+  return input == GATE_IN_STOP || input == GATE_IN_ARRIVED || input == GATE_IN_OBSTACLE ||
+         input == GATE_IN_FAULT;
+}
+
+constexpr bool targetsValid() {
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    for (uint8_t i = 0; i < GATE_INPUT_COUNT; i++) {
+      uint8_t next = GATE_TRANSITIONS[s][i].next;
+      if (next == s) return false;
+      if (next != GATE_STAY && next >= GATE_STATE_COUNT) return false;
+      if (GATE_TRANSITIONS[s][i].guard >= GATE_GUARD_COUNT) return false;
+    }
+  }
+  return true;
+}
+
+// Moving gates stop on every stop-type input, unguarded, into a rest state
+constexpr bool movingAlwaysStops() {
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    if (!gateStateMoving(s)) continue;
+    for (uint8_t i = 0; i < GATE_INPUT_COUNT; i++) {
+      if (!isStopInput(i)) continue;
+      const GateTransition& t = GATE_TRANSITIONS[s][i];
+      if (t.next == GATE_STAY || gateStateMoving(t.next) || t.guard != GATE_GUARD_NONE) return false;
+    }
+  }
+  return true;
+}
+
+// Inputs raised while moving are ignored at rest
+constexpr bool restIgnoresMotionInputs() {
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    if (gateStateMoving(s)) continue;
+    if (GATE_TRANSITIONS[s][GATE_IN_ARRIVED].next != GATE_STAY ||
+        GATE_TRANSITIONS[s][GATE_IN_OBSTACLE].next != GATE_STAY ||
+        GATE_TRANSITIONS[s][GATE_IN_FAULT].next != GATE_STAY) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every transition into a movement is guarded by its end position; nothing
+// else is guarded
+constexpr bool guardsMatchTargets() {
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    for (uint8_t i = 0; i < GATE_INPUT_COUNT; i++) {
+      const GateTransition& t = GATE_TRANSITIONS[s][i];
+      if (t.next == GATE_STAY) continue;
+      GateGuard expected = t.next == GATE_OPENING ? GATE_GUARD_NOT_OPEN :
+                           t.next == GATE_CLOSING ? GATE_GUARD_NOT_CLOSED : GATE_GUARD_NONE;
+      if (t.guard != expected) return false;
+      if (t.next == GATE_OPENING && i != GATE_IN_OPEN) return false;
+      if (t.next == GATE_CLOSING && i != GATE_IN_CLOSE) return false;
+    }
+  }
+  return true;
+}
+
+constexpr bool actionsConsistent() {
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    uint8_t entry = GATE_STATE_ACTIONS[s].entry;
+    uint8_t exit = GATE_STATE_ACTIONS[s].exit;
+    uint8_t drive = entry & (GATE_ACT_DRIVE_OPEN | GATE_ACT_DRIVE_CLOSE);
+    if (gateStateMoving(s)) {
+      uint8_t expected = s == GATE_OPENING ? GATE_ACT_DRIVE_OPEN : GATE_ACT_DRIVE_CLOSE;
+      if (drive != expected || !(entry & GATE_ACT_BEGIN_OPERATION)) return false;
+      if ((exit & GATE_MOVING_EXIT) != GATE_MOVING_EXIT) return false;
+      if (entry & (GATE_ACT_REPORT_STOP | GATE_ACT_AT_OPEN | GATE_ACT_AT_CLOSED)) return false;
+    } else {
+      if (drive || (entry & GATE_ACT_BEGIN_OPERATION) || exit) return false;
+      if (!(entry & GATE_ACT_REPORT_STOP)) return false;
+      if (((entry & GATE_ACT_AT_OPEN) != 0) != (s == GATE_OPEN)) return false;
+      if (((entry & GATE_ACT_AT_CLOSED) != 0) != (s == GATE_CLOSED)) return false;
+    }
+  }
+  return true;
+}
+
+// Arriving reaches the end of the travel; faults end in GATE_ERROR and
+// nothing else does
+constexpr bool endsMatch() {
+  if (GATE_TRANSITIONS[GATE_OPENING][GATE_IN_ARRIVED].next != GATE_OPEN) return false;
+  if (GATE_TRANSITIONS[GATE_CLOSING][GATE_IN_ARRIVED].next != GATE_CLOSED) return false;
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    for (uint8_t i = 0; i < GATE_INPUT_COUNT; i++) {
+      uint8_t next = GATE_TRANSITIONS[s][i].next;
+      if (next == GATE_STAY) continue;
+      if ((i == GATE_IN_FAULT) != (next == GATE_ERROR)) return false;
+      if ((next == GATE_OPEN || next == GATE_CLOSED) && i != GATE_IN_ARRIVED) return false;
+    }
+  }
+  return true;
+}
+
+// Every state reachable from GATE_CLOSED (guards hold at some position),
+// and GATE_OPENING / GATE_CLOSING reachable from every state
+constexpr bool connected() {
+  bool seen[GATE_STATE_COUNT] = {};
+  seen[GATE_CLOSED] = true;
+  for (uint8_t round = 0; round < GATE_STATE_COUNT; round++) {
+    for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+      if (!seen[s]) continue;
+      for (uint8_t i = 0; i < GATE_INPUT_COUNT; i++) {
+        uint8_t next = GATE_TRANSITIONS[s][i].next;
+        if (next != GATE_STAY) seen[next] = true;
+      }
+    }
+  }
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    if (!seen[s]) return false;
+    if (GATE_TRANSITIONS[s][GATE_IN_OPEN].next == GATE_STAY && s != GATE_OPENING) return false;
+    if (GATE_TRANSITIONS[s][GATE_IN_CLOSE].next == GATE_STAY && s != GATE_CLOSING) return false;
+  }
+  return true;
+}
+
+}  // namespace gate_fsm_rules
+
+static_assert(GATE_ERROR + 1 == GATE_STATE_COUNT, "GATE_TRANSITIONS rows follow GateState");
+static_assert(gate_fsm_rules::targetsValid(), "Gate FSM: invalid target or self-transition");
+static_assert(gate_fsm_rules::movingAlwaysStops(), "Gate FSM: a moving gate must stop on every stop input");
+static_assert(gate_fsm_rules::restIgnoresMotionInputs(), "Gate FSM: arrival, obstacle and fault only apply while moving");
+static_assert(gate_fsm_rules::guardsMatchTargets(), "Gate FSM: movements must be guarded by their end position");
+static_assert(gate_fsm_rules::actionsConsistent(), "Gate FSM: relay and record actions inconsistent");
+static_assert(gate_fsm_rules::endsMatch(), "Gate FSM: arrivals and faults must end in their states");
+static_assert(gate_fsm_rules::connected(), "Gate FSM: unreachable state or unmovable gate");
+static_assert(gateNextState(GATE_OPENING, GATE_IN_ARRIVED, 100) == GATE_OPEN, "Gate FSM: lookup");
+static_assert(gateNextState(GATE_CLOSED, GATE_IN_CLOSE, 0) == GATE_CLOSED, "Gate FSM: guard");
+
+#endif // GATE_FSM_H
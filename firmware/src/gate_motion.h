@@ -0,0 +1,141 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Gate Motion & Protocol
+// =============================================================================
+//
+// Gate states, movement rules and the MQTT payload formats, kept free of
+// Arduino dependencies so host tools (tools/fleet_sim.cpp) run exactly the
+// same logic and speak exactly the same protocol as the device.
+//
+
+#ifndef GATE_MOTION_H
+#define GATE_MOTION_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GATE_STEP_MS        300   // Position step interval (no encoder yet)
+#define GATE_STEP_PERCENT   5     // Travel per step
+
+// =============================================================================
+// Gate State
+// =============================================================================
+
+enum GateState {
+  GATE_CLOSED = 0,
+  GATE_OPENING = 1,
+  GATE_OPEN = 2,
+  GATE_CLOSING = 3,
+  GATE_STOPPED = 4,
+  GATE_ERROR = 5
+};
+
+inline const char* gateStateName(GateState state) {
+  switch (state) {
+    case GATE_CLOSED: return "closed";
+    case GATE_OPENING: return "opening";
+    case GATE_OPEN: return "open";
+    case GATE_CLOSING: return "closing";
+    case GATE_STOPPED: return "stopped";
+    case GATE_ERROR: return "error";
+    default: return "unknown";
+  }
+}
+
+// Returns false for unknown names
+inline bool parseGateState(const char* name, GateState& state) {
+  if (!name) return false;
+  for (uint8_t s = GATE_CLOSED; s <= GATE_ERROR; s++) {
+    if (strcmp(name, gateStateName((GateState)s)) == 0) {
+      state = (GateState)s;
+      return true;
+    }
+  }
+  return false;
+}
+
+// =============================================================================
+// Commands
+// =============================================================================
+
+enum GateCommand {
+  GATE_CMD_NONE = 0,
+  GATE_CMD_OPEN,
+  GATE_CMD_CLOSE,
+  GATE_CMD_STOP,
+  GATE_CMD_PARTIAL
+};
+
+// What a command did to the gate
+enum GateCommandOutcome : uint8_t {
+  GATE_OUTCOME_INVALID = 0,                   // GATE_CMD_NONE
+  GATE_OUTCOME_IGNORED,                       // No transition from this state
+  GATE_OUTCOME_APPLIED
+};
+
+inline GateCommand parseGateCommand(const char* name) {
+  if (!name) return GATE_CMD_NONE;
+  if (strcmp(name, "open") == 0) return GATE_CMD_OPEN;
+  if (strcmp(name, "close") == 0) return GATE_CMD_CLOSE;
+  if (strcmp(name, "stop") == 0) return GATE_CMD_STOP;
+  if (strcmp(name, "partial") == 0) return GATE_CMD_PARTIAL;
+  return GATE_CMD_NONE;
+}
+
+inline const char* gateCommandName(uint8_t command) {
+  switch (command) {
+    case GATE_CMD_OPEN: return "open";
+    case GATE_CMD_CLOSE: return "close";
+    case GATE_CMD_STOP: return "stop";
+    case GATE_CMD_PARTIAL: return "partial";
+    default: return "none";
+  }
+}
+
+// =============================================================================
+// Movement
+// =============================================================================
+
+// Advances the position by one step while moving. Returns true when the end
+// position was reached, for the caller to raise GATE_IN_ARRIVED; the state
+// changes themselves are the table in gate_fsm.h.
+inline bool stepGatePosition(GateState state, uint8_t& percentage) {
+  if (state == GATE_OPENING) {
+    percentage = percentage + GATE_STEP_PERCENT >= 100 ? 100 : percentage + GATE_STEP_PERCENT;
+    return percentage == 100;
+  }
+  if (state == GATE_CLOSING) {
+    percentage = percentage <= GATE_STEP_PERCENT ? 0 : percentage - GATE_STEP_PERCENT;
+    return percentage == 0;
+  }
+  return false;
+}
+
+// =============================================================================
+// Payload Formats
+// =============================================================================
+
+// gatemate/devices/<id>/status (retained)
+inline int formatStatusPayload(char* out, size_t size, const char* deviceId,
+                               GateState state, uint8_t percentage, bool online,
+                               bool obstacle, uint32_t timestamp) {
+  return snprintf(out, size,
+    "{\"deviceId\":\"%s\",\"state\":\"%s\",\"percentage\":%u,"
+    "\"online\":%s,\"obstacle\":%s,\"timestamp\":%lu}",
+    deviceId, gateStateName(state), (unsigned)percentage,
+    online ? "true" : "false", obstacle ? "true" : "false",
+    (unsigned long)timestamp);
+}
+
+// gatemate/devices/<id>/sensors
+inline int formatSensorsPayload(char* out, size_t size, const char* deviceId,
+                                float current, float voltage, float temperature,
+                                int wifiSignal, uint32_t timestamp) {
+  return snprintf(out, size,
+    "{\"deviceId\":\"%s\",\"current\":%.3f,\"voltage\":%.2f,"
+    "\"temperature\":%.2f,\"wifiSignal\":%d,\"timestamp\":%lu}",
+    deviceId, current, voltage, temperature, wifiSignal,
+    (unsigned long)timestamp);
+}
+
+#endif // GATE_MOTION_H
@@ -0,0 +1,237 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Group Commands
+// =============================================================================
+//
+// Besides its own /commands topic a device subscribes to
+//
+//   gatemate/groups/<group>/commands   for each configured group
+//   gatemate/broadcast/commands        every device
+//
+// so a site-wide action is one publish instead of one per gate. A group
+// command carries a requestId, optional target filters and a spread:
+//
+//   {"command": "open", "requestId": "...", "sentAt": 1718000000,
+//    "staggerMs": 250, "jitterMs": 2000,
+//    "targets": {"devices": [...], "exclude": [...], "states": ["closed"]}}
+//
+// A command older than COMMAND_MAX_AGE_S when it arrives (a device that was
+// offline) is acked "expired" and not run, as for the device's own topic.
+//
+// Each device delays the command by slot * staggerMs plus a jitter derived
+// from its id and the requestId, so motors do not all draw inrush current
+// at the same instant and the order changes from one request to the next.
+// STOP is never delayed. Every addressed device acknowledges on its own
+// /acks topic; the backend aggregates the acks per request. "executed" means
+// the gate changed state; a command its state had no transition for (open
+// on an open gate) is acked "ignored".
+//
+// No Arduino dependency; tools/fleet_sim.cpp uses the same delay and ack
+// format.
+//
+
+#ifndef GROUP_COMMAND_H
+#define GROUP_COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "gate_motion.h"
+
+#define GROUP_TOPIC_PREFIX      "gatemate/groups/"
+#define GROUP_TOPIC_SUFFIX      "/commands"
+#define GROUP_TOPIC_BROADCAST   "gatemate/broadcast/commands"
+#define GROUP_BROADCAST_NAME    "*"           // Group reported in broadcast acks
+
+#define GROUP_NAME_MAX          24
+#define GROUP_LIST_MAX          64            // Comma-separated, incl. terminator
+#define GROUP_MAX_COUNT         4             // Subscriptions besides broadcast
+#define GROUP_REQUEST_ID_MAX    40
+#define GROUP_DELAY_MAX_MS      120000        // Cap on stagger + jitter
+
+enum GroupAckStatus : uint8_t {
+  GROUP_ACK_EXECUTED = 0,
+  GROUP_ACK_SKIPPED,                          // State filter did not match
+  GROUP_ACK_SUPERSEDED,                       // Replaced while waiting
+  GROUP_ACK_REJECTED,                         // Unknown command
+  GROUP_ACK_EXPIRED,                          // Older than COMMAND_MAX_AGE_S
+  GROUP_ACK_IGNORED                           // No transition from gate state
+};
+
+inline const char* groupAckStatusName(uint8_t status) {
+  switch (status) {
+    case GROUP_ACK_EXECUTED: return "executed";
+    case GROUP_ACK_SKIPPED: return "skipped";
+    case GROUP_ACK_SUPERSEDED: return "superseded";
+    case GROUP_ACK_REJECTED: return "rejected";
+    case GROUP_ACK_EXPIRED: return "expired";
+    case GROUP_ACK_IGNORED: return "ignored";
+    default: return "unknown";
+  }
+}
+
+// =============================================================================
+// Group Lists
+// =============================================================================
+
+// Names become topic levels: lowercase letters, digits, '-' and '_' only
+inline bool groupNameValid(const char* name, size_t length) {
+  if (length == 0 || length > GROUP_NAME_MAX) return false;
+  for (size_t i = 0; i < length; i++) {
+    char c = name[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Calls f(name, length) for each entry of a comma-separated list
+template <typename F>
+void forEachGroup(const char* list, F f) {
+  const char* start = list;
+  while (*start) {
+    const char* end = strchr(start, ',');
+    size_t length = end ? (size_t)(end - start) : strlen(start);
+    f(start, length);
+    if (!end) break;
+    start = end + 1;
+  }
+}
+
+// Empty is valid (no groups). Rejects empty entries, bad names, duplicates
+// and more than GROUP_MAX_COUNT entries. list must be terminated within
+// GROUP_LIST_MAX bytes.
+inline bool groupListValid(const char* list) {
+  if (!memchr(list, '\0', GROUP_LIST_MAX)) return false;
+  if (!*list) return true;
+
+  bool valid = true;
+  uint8_t count = 0;
+  const char* names[GROUP_MAX_COUNT];
+  size_t lengths[GROUP_MAX_COUNT];
+  forEachGroup(list, [&](const char* name, size_t length) {
+    if (!valid) return;
+    if (count >= GROUP_MAX_COUNT || !groupNameValid(name, length)) {
+      valid = false;
+      return;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      if (lengths[i] == length && memcmp(names[i], name, length) == 0) valid = false;
+    }
+    names[count] = name;
+    lengths[count] = length;
+    count++;
+  });
+  return valid && list[strlen(list) - 1] != ',';
+}
+
+inline bool groupListContains(const char* list, const char* name, size_t length) {
+  bool found = false;
+  forEachGroup(list, [&](const char* entry, size_t entryLength) {
+    if (entryLength == length && memcmp(entry, name, length) == 0) found = true;
+  });
+  return found;
+}
+
+// gatemate/groups/<group>/commands or the broadcast topic. The group name
+// is copied to group (GROUP_BROADCAST_NAME for broadcast).
+inline bool parseGroupTopic(const char* topic, char* group, size_t capacity) {
+  if (strcmp(topic, GROUP_TOPIC_BROADCAST) == 0) {
+    snprintf(group, capacity, "%s", GROUP_BROADCAST_NAME);
+    return true;
+  }
+
+  size_t prefixLength = strlen(GROUP_TOPIC_PREFIX);
+  size_t suffixLength = strlen(GROUP_TOPIC_SUFFIX);
+  size_t topicLength = strlen(topic);
+  if (topicLength <= prefixLength + suffixLength ||
+      strncmp(topic, GROUP_TOPIC_PREFIX, prefixLength) != 0 ||
+      strcmp(topic + topicLength - suffixLength, GROUP_TOPIC_SUFFIX) != 0) {
+    return false;
+  }
+
+  size_t length = topicLength - prefixLength - suffixLength;
+  if (!groupNameValid(topic + prefixLength, length) || length >= capacity) return false;
+  memcpy(group, topic + prefixLength, length);
+  group[length] = '\0';
+  return true;
+}
+
+// =============================================================================
+// Spread
+// =============================================================================
+
+inline uint32_t groupHash(uint32_t h, const char* s) {
+  for (const char* p = s; *p; p++) {
+    h ^= (uint8_t)*p;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Start delay for one device: its stagger slot plus a jitter that is stable
+// for a (device, request) pair, so a redelivered command lands at the same
+// time, but differs between requests.
+inline uint32_t groupCommandDelay(const char* deviceId, const char* requestId, uint16_t slot,
+                                  uint32_t staggerMs, uint32_t jitterMs) {
+  uint64_t delay = (uint64_t)slot * staggerMs;
+  if (jitterMs > 0) {
+    uint32_t h = groupHash(groupHash(2166136261u, deviceId) ^ 0x9E3779B9u, requestId);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    delay += h % (jitterMs + 1);
+  }
+  return delay > GROUP_DELAY_MAX_MS ? GROUP_DELAY_MAX_MS : (uint32_t)delay;
+}
+
+// =============================================================================
+// Duplicate Filter
+// =============================================================================
+
+// Recently seen requestIds. A device in two targeted groups, or in a group
+// and the broadcast, receives the same request more than once.
+template <uint8_t N>
+class GroupRequestLog {
+private:
+  uint32_t hashes[N] = {};
+  uint8_t next = 0;
+
+public:
+  // Returns false if the request was already seen
+  bool insert(const char* requestId) {
+    uint32_t h = groupHash(2166136261u, requestId) | 1;
+    for (uint8_t i = 0; i < N; i++) {
+      if (hashes[i] == h) return false;
+    }
+    hashes[next] = h;
+    next = (next + 1) % N;
+    return true;
+  }
+};
+
+inline bool groupRequestIdValid(const char* requestId) {
+  size_t length = strnlen(requestId, GROUP_REQUEST_ID_MAX + 1);
+  if (length == 0 || length > GROUP_REQUEST_ID_MAX) return false;
+  for (size_t i = 0; i < length; i++) {
+    if (requestId[i] == '"' || requestId[i] == '\\' || (uint8_t)requestId[i] < 0x20) return false;
+  }
+  return true;
+}
+
+// =============================================================================
+// Acknowledgement
+// =============================================================================
+
+inline int formatGroupAck(char* out, size_t size, const char* deviceId, const char* requestId,
+                          const char* group, uint8_t status, uint32_t delayMs,
+                          GateState state, uint8_t percentage) {
+  return snprintf(out, size,
+                  "{\"deviceId\":\"%s\",\"requestId\":\"%s\",\"group\":\"%s\","
+                  "\"status\":\"%s\",\"delayMs\":%lu,\"state\":\"%s\",\"percentage\":%u}",
+                  deviceId, requestId, group, groupAckStatusName(status),
+                  (unsigned long)delayMs, gateStateName(state), percentage);
+}
+
+#endif // GROUP_COMMAND_H
@@ -0,0 +1,334 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Guest Access
+// =============================================================================
+//
+// Device side of offline guest passes (see guest_token.h for the format).
+// The owner's app provisions the device key over the LAN (POST /guest/key);
+// it never travels over MQTT. The first key is trusted on first use, within
+// GUEST_PROVISION_WINDOW_MS of boot. After that a new key is only taken
+// with a proof under the current one, HMAC(key, GUEST_REKEY_LABEL || new
+// key), so a restart does not let anyone on the LAN swap in their own key.
+// The backend pushes the revocation filter and the key ids of the LAN
+// users as a retained MQTT message. Key and sync are kept in NVS so guests
+// get in while the site is offline. A guest opens the gate with a single
+// LAN request carrying the token, verified here without the backend.
+//
+// Tokens need the UTC time. Without SNTP (a power cut at a site without
+// internet) the last synced time, saved every GUEST_CLOCK_SAVE_S, plus the
+// uptime is used as a lower bound. notBefore stays strict; a pass that
+// expired during the outage is still accepted until the clock is back, at
+// most for the outage plus GUEST_CLOCK_SAVE_S. A device that never had the
+// time answers no_clock.
+//
+// HMAC-SHA256 runs on mbedTLS, which uses the ESP32 SHA accelerator. The
+// key is set up once and its pads stay in the context; a verification is
+// hmac_reset/update/finish over a payload of at most 44 bytes, i.e. four
+// SHA-256 block compressions and no heap allocation.
+//
+
+#ifndef GUEST_ACCESS_H
+#define GUEST_ACCESS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <rom/crc.h>
+#include <mbedtls/md.h>
+#include "config.h"
+#include "guest_token.h"
+
+// =============================================================================
+// HMAC Backend
+// =============================================================================
+
+class MbedHmacSha256 {
+private:
+  mbedtls_md_context_t ctx;
+  bool ready = false;
+
+public:
+  MbedHmacSha256() { mbedtls_md_init(&ctx); }
+  ~MbedHmacSha256() { mbedtls_md_free(&ctx); }
+
+  bool setKey(const uint8_t* key, size_t length) {
+    if (!ready) {
+      if (mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0) {
+        return false;
+      }
+      ready = true;
+    }
+    return mbedtls_md_hmac_starts(&ctx, key, length) == 0;
+  }
+
+  void compute(const uint8_t* data, size_t length, uint8_t out[32]) {
+    mbedtls_md_hmac_reset(&ctx);
+    mbedtls_md_hmac_update(&ctx, data, length);
+    mbedtls_md_hmac_finish(&ctx, out);
+  }
+};
+
+// =============================================================================
+// Stored Layout
+// =============================================================================
+
+// Provisioned over the LAN, never sent over MQTT
+struct GuestKeyBlob {
+  uint32_t magic;
+  uint8_t key[GUEST_KEY_LEN];
+  uint32_t crc;
+};
+
+// Retained sync from the backend; nothing secret
+struct GuestSyncBlob {
+  uint32_t magic;
+  uint32_t version;           // Backend revision of filter and key ids
+  uint8_t filter[GUEST_BLOOM_BITS / 8];
+  uint32_t lanKeys[LAN_KEYS_MAX];   // Key ids of the users (lan_command.h)
+  uint32_t lanKeyCount;
+  uint32_t crc;
+};
+
+// Last synced UTC time, the lower bound for the clock after a power cut
+struct GuestClockFloor {
+  uint32_t magic;
+  uint32_t epoch;
+  uint32_t crc;
+};
+
+// POST /guest/key outcome
+enum GuestKeyResult : uint8_t {
+  GUEST_KEY_STORED = 0,
+  GUEST_KEY_INVALID,          // Not 64 hex digits
+  GUEST_KEY_WINDOW_CLOSED,    // First key after GUEST_PROVISION_WINDOW_MS
+  GUEST_KEY_CONFLICT,         // A key is set and no valid proof came with the new one
+  GUEST_KEY_STORE_FAILED
+};
+
+inline const char* guestKeyResultName(uint8_t result) {
+  switch (result) {
+    case GUEST_KEY_STORED: return "stored";
+    case GUEST_KEY_INVALID: return "invalid_key";
+    case GUEST_KEY_WINDOW_CLOSED: return "window_closed";
+    case GUEST_KEY_CONFLICT: return "key_set";
+    case GUEST_KEY_STORE_FAILED: return "store_failed";
+    default: return "unknown";
+  }
+}
+
+// =============================================================================
+// Guest Access Class
+// =============================================================================
+
+class GuestAccess {
+private:
+  static const uint32_t KEY_MAGIC = 0x47474B31;   // "GGK1"
+  static const uint32_t SYNC_MAGIC = 0x47475333;  // "GGS3"
+  static const uint32_t CLOCK_MAGIC = 0x47474331; // "GGC1"
+
+  Preferences preferences;
+  MbedHmacSha256 mac;
+  GuestBloom revoked;
+  GuestUsage<GUEST_USAGE_SLOTS> usage;
+  uint32_t version = 0;
+  bool hasKey = false;
+  uint32_t clockFloor = 0;    // Last saved UTC time, 0 if never synced
+  uint32_t lanKeyIds[LAN_KEYS_MAX] = {};
+  uint8_t lanKeyCount = 0;
+
+  // Verification cost (micros), for GET /guest
+  uint32_t verifications = 0;
+  uint32_t totalMicros = 0;
+  uint32_t maxMicros = 0;
+
+  template <typename Blob>
+  static uint32_t checksum(const Blob& blob) {
+    return crc32_le(0, (const uint8_t*)&blob, offsetof(Blob, crc));
+  }
+
+  // Inside preferences.begin("guest")
+  template <typename Blob>
+  bool load(const char* name, Blob& blob, uint32_t magic) {
+    return preferences.getBytes(name, &blob, sizeof(blob)) == sizeof(blob) &&
+           blob.magic == magic && blob.crc == checksum(blob);
+  }
+
+  template <typename Blob>
+  bool store(const char* name, Blob& blob, uint32_t magic) {
+    blob.magic = magic;
+    blob.crc = checksum(blob);
+    preferences.begin("guest", false);
+    size_t written = preferences.putBytes(name, &blob, sizeof(blob));
+    preferences.end();
+    return written == sizeof(blob);
+  }
+
+  static bool decodeHex(const char* hex, uint8_t* out, size_t length) {
+    if (!hex || strlen(hex) != length * 2) return false;
+    for (size_t i = 0; i < length * 2; i++) {
+      char c = hex[i];
+      uint8_t v;
+      if (c >= '0' && c <= '9') v = c - '0';
+      else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+      else return false;
+      out[i / 2] = (i & 1) ? (out[i / 2] | v) : (v << 4);
+    }
+    return true;
+  }
+
+public:
+  void begin() {
+    static GuestKeyBlob key;
+    static GuestSyncBlob sync;
+    GuestClockFloor floor;
+    preferences.begin("guest", false);
+    // Key and filter as one blob, the key pushed over MQTT: not used again
+    if (preferences.isKey("keys")) preferences.remove("keys");
+    bool keyed = load("key", key, KEY_MAGIC);
+    bool synced = load("sync", sync, SYNC_MAGIC);
+    if (load("clock", floor, CLOCK_MAGIC)) clockFloor = floor.epoch;
+    preferences.end();
+
+    if (keyed && mac.setKey(key.key, sizeof(key.key))) hasKey = true;
+    if (synced) {
+      memcpy(revoked.data(), sync.filter, GuestBloom::size());
+      memcpy(lanKeyIds, sync.lanKeys, sizeof(lanKeyIds));
+      lanKeyCount = sync.lanKeyCount < LAN_KEYS_MAX ? sync.lanKeyCount : LAN_KEYS_MAX;
+      version = sync.version;
+    }
+    memset(&key, 0, sizeof(key));
+
+    Serial.printf("✓ Guest access %s (v%lu)\n", hasKey ? "ready" : "waiting for key",
+                  (unsigned long)version);
+  }
+
+  // {"key": hex, "proof": hex} from the owner's app on the LAN. Without a
+  // key yet: trust on first use within GUEST_PROVISION_WINDOW_MS of boot.
+  // With one: only with proof = HMAC(current key, GUEST_REKEY_LABEL || new
+  // key), at any time.
+  GuestKeyResult provisionKey(const char* hex, const char* proofHex, uint32_t uptimeMs) {
+    static GuestKeyBlob blob;
+    memset(&blob, 0, sizeof(blob));
+    if (!decodeHex(hex, blob.key, sizeof(blob.key))) return GUEST_KEY_INVALID;
+
+    if (hasKey) {
+      uint8_t message[sizeof(GUEST_REKEY_LABEL) - 1 + GUEST_KEY_LEN];
+      uint8_t proof[32], expected[32];
+      memcpy(message, GUEST_REKEY_LABEL, sizeof(GUEST_REKEY_LABEL) - 1);
+      memcpy(message + sizeof(GUEST_REKEY_LABEL) - 1, blob.key, GUEST_KEY_LEN);
+      mac.compute(message, sizeof(message), expected);
+      bool proven = decodeHex(proofHex, proof, sizeof(proof)) &&
+                    tagEquals(expected, proof, sizeof(proof));
+      memset(message, 0, sizeof(message));
+      if (!proven) {
+        memset(&blob, 0, sizeof(blob));
+        return GUEST_KEY_CONFLICT;
+      }
+    } else if (uptimeMs > GUEST_PROVISION_WINDOW_MS) {
+      memset(&blob, 0, sizeof(blob));
+      return GUEST_KEY_WINDOW_CLOSED;
+    }
+
+    bool stored = store("key", blob, KEY_MAGIC) && mac.setKey(blob.key, sizeof(blob.key));
+    memset(&blob, 0, sizeof(blob));
+    if (!stored) return GUEST_KEY_STORE_FAILED;
+    hasKey = true;
+    return GUEST_KEY_STORED;
+  }
+
+  // {"version", "bits", "hashes", "filter": base64url, "lan": [key ids]}
+  bool applySync(JsonObjectConst doc, const char*& error) {
+    static GuestSyncBlob blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = doc["version"] | 0;
+
+    if (version && blob.version == version) return true;  // Retained redelivery
+
+    if ((doc["bits"] | 0) != GUEST_BLOOM_BITS || (doc["hashes"] | 0) != GUEST_BLOOM_HASHES) {
+      error = "Filter geometry mismatch";
+      return false;
+    }
+    const char* filter = doc["filter"] | "";
+    if (base64urlDecode(filter, strlen(filter), blob.filter, sizeof(blob.filter)) !=
+        (int)sizeof(blob.filter)) {
+      error = "Invalid filter";
+      return false;
+    }
+    JsonArrayConst lan = doc["lan"];
+    if (lan.size() > LAN_KEYS_MAX) {
+      error = "Too many LAN keys";
+      return false;
+    }
+    for (JsonVariantConst id : lan) blob.lanKeys[blob.lanKeyCount++] = id.as<uint32_t>();
+    if (!store("sync", blob, SYNC_MAGIC)) {
+      error = "Filter store failed";
+      return false;
+    }
+
+    memcpy(revoked.data(), blob.filter, GuestBloom::size());
+    memcpy(lanKeyIds, blob.lanKeys, sizeof(lanKeyIds));
+    lanKeyCount = (uint8_t)blob.lanKeyCount;
+    version = blob.version;
+    return true;
+  }
+
+  const uint32_t* lanKeys(uint8_t& count) const {
+    count = lanKeyCount;
+    return lanKeyIds;
+  }
+
+  // Called with the synced time; saved every GUEST_CLOCK_SAVE_S
+  void noteTime(uint32_t now) {
+    if (now < GUEST_MIN_EPOCH || (clockFloor && now - clockFloor < GUEST_CLOCK_SAVE_S)) return;
+    GuestClockFloor floor = {};
+    floor.epoch = now;
+    if (store("clock", floor, CLOCK_MAGIC)) clockFloor = now;
+  }
+
+  // UTC time for tokens: the synced clock, else the saved time plus the
+  // uptime as a lower bound, else 0
+  uint32_t now(bool synced, uint32_t uptimeS) const {
+    if (synced) return (uint32_t)time(nullptr);
+    return clockFloor ? clockFloor + uptimeS : 0;
+  }
+
+  // Full check for one action; counts the use when granted
+  GuestVerdict authorize(const char* token, uint8_t permission, uint32_t now,
+                         GuestClaims& claims) {
+    if (!hasKey) return GUEST_NO_KEY;
+    if (now < GUEST_MIN_EPOCH) return GUEST_NO_CLOCK;
+
+    unsigned long start = micros();
+    GuestVerdict verdict = verifyGuestToken(mac, token, now, revoked, claims);
+    uint32_t elapsed = micros() - start;
+    verifications++;
+    totalMicros += elapsed;
+    if (elapsed > maxMicros) maxMicros = elapsed;
+
+    if (verdict != GUEST_OK) return verdict;
+    if (!(claims.permissions & permission)) return GUEST_FORBIDDEN;
+    if (claims.maxUses && usage.uses(claims.id) >= claims.maxUses) return GUEST_EXHAUSTED;
+
+    usage.record(claims, now);
+    return GUEST_OK;
+  }
+
+  // Sub-key of the device key for another protocol: HMAC(key, label).
+  // False until the owner's app has provisioned a key (POST /guest/key).
+  bool deriveKey(const char* label, uint8_t out[32]) {
+    if (!hasKey) return false;
+    mac.compute((const uint8_t*)label, strlen(label), out);
+    return true;
+  }
+
+  void toJson(JsonObject out) const {
+    out["ready"] = hasKey;
+    out["version"] = version;
+    out["clockFloor"] = clockFloor;
+    out["verifications"] = verifications;
+    out["meanMicros"] = verifications ? totalMicros / verifications : 0;
+    out["maxMicros"] = maxMicros;
+  }
+};
+
+#endif // GUEST_ACCESS_H
@@ -0,0 +1,330 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Guest Tokens
+// =============================================================================
+//
+// Offline verification of guest passes issued by the backend. A token is
+//
+//   base64url(payload) "." base64url(HMAC-SHA256(deviceKey, payload)[0..15])
+//
+// with a little-endian binary payload:
+//
+//   [0] version  [1] permissions  [2] maxUses (0 = unlimited)  [3] idLen
+//   [4..7] notBefore  [8..11] expiresAt (UTC epoch s)  [12..] pass id
+//
+// The device key is derived per device by the backend, so a token only
+// opens the gate it was issued for. Revoked passes that have not expired
+// yet are sent as a bloom filter; a false positive only denies offline
+// entry, never grants it.
+//
+// The MAC is a template parameter (mbedTLS on the device, see
+// guest_access.h; OpenSSL in tools/guest_bench.cpp). No Arduino dependency.
+//
+
+#ifndef GUEST_TOKEN_H
+#define GUEST_TOKEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GUEST_TOKEN_VERSION   1
+#define GUEST_KEY_LEN         32
+#define GUEST_TAG_LEN         16          // Truncated HMAC-SHA256
+#define GUEST_ID_MAX          32
+#define GUEST_PAYLOAD_HEADER  12
+#define GUEST_PAYLOAD_MAX     (GUEST_PAYLOAD_HEADER + GUEST_ID_MAX)
+#define GUEST_TOKEN_MAX       96          // Encoded length incl. terminator
+#define GUEST_BLOOM_BITS      4096        // ~1% false positives at 400 entries
+#define GUEST_BLOOM_HASHES    7
+
+enum GuestPermission : uint8_t {
+  GUEST_PERM_OPEN  = 0x01,
+  GUEST_PERM_CLOSE = 0x02,
+};
+
+enum GuestVerdict : uint8_t {
+  GUEST_OK = 0,
+  GUEST_MALFORMED,
+  GUEST_BAD_SIGNATURE,
+  GUEST_NOT_YET_VALID,
+  GUEST_EXPIRED,
+  GUEST_REVOKED,
+  GUEST_FORBIDDEN,
+  GUEST_EXHAUSTED,
+  GUEST_NO_CLOCK,
+  GUEST_NO_KEY
+};
+
+inline const char* guestVerdictName(uint8_t verdict) {
+  switch (verdict) {
+    case GUEST_OK: return "ok";
+    case GUEST_MALFORMED: return "malformed";
+    case GUEST_BAD_SIGNATURE: return "bad_signature";
+    case GUEST_NOT_YET_VALID: return "not_yet_valid";
+    case GUEST_EXPIRED: return "expired";
+    case GUEST_REVOKED: return "revoked";
+    case GUEST_FORBIDDEN: return "forbidden";
+    case GUEST_EXHAUSTED: return "exhausted";
+    case GUEST_NO_CLOCK: return "no_clock";
+    case GUEST_NO_KEY: return "no_key";
+    default: return "unknown";
+  }
+}
+
+struct GuestClaims {
+  char id[GUEST_ID_MAX + 1];
+  uint8_t permissions;
+  uint8_t maxUses;
+  uint32_t notBefore;
+  uint32_t expiresAt;
+};
+
+// =============================================================================
+// Encoding
+// =============================================================================
+
+inline int8_t base64urlValue(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '-') return 62;
+  if (c == '_') return 63;
+  return -1;
+}
+
+// Unpadded, canonical base64url. Returns the decoded length or -1.
+inline int base64urlDecode(const char* in, size_t length, uint8_t* out, size_t capacity) {
+  if (length % 4 == 1) return -1;
+  size_t produced = 0;
+  uint32_t acc = 0;
+  uint8_t bits = 0;
+  for (size_t i = 0; i < length; i++) {
+    int8_t v = base64urlValue(in[i]);
+    if (v < 0) return -1;
+    acc = (acc << 6) | (uint32_t)v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (produced >= capacity) return -1;
+      out[produced++] = (uint8_t)(acc >> bits);
+    }
+  }
+  // Leftover bits must be zero, so every byte string has one encoding
+  if (acc & ((1u << bits) - 1)) return -1;
+  return (int)produced;
+}
+
+// Returns the encoded length (without terminator) or -1 if out is too small
+inline int base64urlEncode(const uint8_t* in, size_t length, char* out, size_t capacity) {
+  static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  size_t produced = 0;
+  uint32_t acc = 0;
+  uint8_t bits = 0;
+  for (size_t i = 0; i < length; i++) {
+    acc = (acc << 8) | in[i];
+    bits += 8;
+    while (bits >= 6) {
+      bits -= 6;
+      if (produced + 1 >= capacity) return -1;
+      out[produced++] = alphabet[(acc >> bits) & 0x3F];
+    }
+  }
+  if (bits > 0) {
+    if (produced + 1 >= capacity) return -1;
+    out[produced++] = alphabet[(acc << (6 - bits)) & 0x3F];
+  }
+  out[produced] = '\0';
+  return (int)produced;
+}
+
+inline uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void writeLe32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+// Builds the payload for claims; returns its length. Used by host tools.
+inline size_t encodeGuestPayload(const GuestClaims& claims, uint8_t* out) {
+  size_t idLen = strnlen(claims.id, GUEST_ID_MAX);
+  out[0] = GUEST_TOKEN_VERSION;
+  out[1] = claims.permissions;
+  out[2] = claims.maxUses;
+  out[3] = (uint8_t)idLen;
+  writeLe32(out + 4, claims.notBefore);
+  writeLe32(out + 8, claims.expiresAt);
+  memcpy(out + GUEST_PAYLOAD_HEADER, claims.id, idLen);
+  return GUEST_PAYLOAD_HEADER + idLen;
+}
+
+// Splits and decodes a token without checking the tag
+inline bool parseGuestToken(const char* token, uint8_t* payload, size_t& payloadLength,
+                            uint8_t* tag, GuestClaims& claims) {
+  const char* dot = strchr(token, '.');
+  if (!dot) return false;
+
+  int length = base64urlDecode(token, dot - token, payload, GUEST_PAYLOAD_MAX);
+  if (length < GUEST_PAYLOAD_HEADER) return false;
+  if (base64urlDecode(dot + 1, strlen(dot + 1), tag, GUEST_TAG_LEN) != GUEST_TAG_LEN) return false;
+
+  uint8_t idLen = payload[3];
+  if (payload[0] != GUEST_TOKEN_VERSION || idLen == 0 || idLen > GUEST_ID_MAX ||
+      length != GUEST_PAYLOAD_HEADER + idLen) {
+    return false;
+  }
+
+  claims.permissions = payload[1];
+  claims.maxUses = payload[2];
+  claims.notBefore = readLe32(payload + 4);
+  claims.expiresAt = readLe32(payload + 8);
+  memcpy(claims.id, payload + GUEST_PAYLOAD_HEADER, idLen);
+  claims.id[idLen] = '\0';
+  payloadLength = length;
+  return true;
+}
+
+// Compares without an early exit so timing does not leak the match length
+inline bool tagEquals(const uint8_t* a, const uint8_t* b, size_t length) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < length; i++) diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+// =============================================================================
+// Revocation Filter
+// =============================================================================
+
+// Double hashing over FNV-1a 64: bit i = (h1 + i * h2) mod GUEST_BLOOM_BITS.
+// The backend (utils/guestToken.ts) builds the filter the same way.
+class GuestBloom {
+private:
+  uint8_t bits[GUEST_BLOOM_BITS / 8];
+
+  static void hashes(const char* id, uint32_t& h1, uint32_t& h2) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const char* p = id; *p; p++) {
+      h ^= (uint8_t)*p;
+      h *= 0x100000001b3ULL;
+    }
+    h1 = (uint32_t)h;
+    h2 = (uint32_t)(h >> 32) | 1;
+  }
+
+public:
+  GuestBloom() { clear(); }
+
+  void clear() { memset(bits, 0, sizeof(bits)); }
+
+  void add(const char* id) {
+    uint32_t h1, h2;
+    hashes(id, h1, h2);
+    for (uint8_t i = 0; i < GUEST_BLOOM_HASHES; i++) {
+      uint32_t bit = (h1 + i * h2) % GUEST_BLOOM_BITS;
+      bits[bit >> 3] |= 1 << (bit & 7);
+    }
+  }
+
+  bool contains(const char* id) const {
+    uint32_t h1, h2;
+    hashes(id, h1, h2);
+    for (uint8_t i = 0; i < GUEST_BLOOM_HASHES; i++) {
+      uint32_t bit = (h1 + i * h2) % GUEST_BLOOM_BITS;
+      if (!(bits[bit >> 3] & (1 << (bit & 7)))) return false;
+    }
+    return true;
+  }
+
+  uint8_t* data() { return bits; }
+  const uint8_t* data() const { return bits; }
+  static constexpr size_t size() { return GUEST_BLOOM_BITS / 8; }
+};
+
+// =============================================================================
+// Local Use Counter
+// =============================================================================
+
+// Uses per pass since boot, for maxUses while the backend is unreachable.
+// Slots of expired passes are reused first, then the one expiring soonest.
+template <uint8_t N>
+class GuestUsage {
+private:
+  struct Slot {
+    uint32_t idHash;
+    uint32_t expiresAt;
+    uint8_t uses;
+  };
+  Slot slots[N] = {};
+
+  static uint32_t hashId(const char* id) {
+    uint32_t h = 2166136261u;
+    for (const char* p = id; *p; p++) {
+      h ^= (uint8_t)*p;
+      h *= 16777619u;
+    }
+    return h ? h : 1;
+  }
+
+public:
+  uint8_t uses(const char* id) const {
+    uint32_t h = hashId(id);
+    for (uint8_t i = 0; i < N; i++) {
+      if (slots[i].idHash == h) return slots[i].uses;
+    }
+    return 0;
+  }
+
+  void record(const GuestClaims& claims, uint32_t now) {
+    uint32_t h = hashId(claims.id);
+    for (uint8_t i = 0; i < N; i++) {
+      if (slots[i].idHash == h) {
+        if (slots[i].uses < 0xFF) slots[i].uses++;
+        return;
+      }
+    }
+
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < N; i++) {
+      if (slots[i].idHash == 0 || slots[i].expiresAt <= now) {
+        victim = i;
+        break;
+      }
+      if (slots[i].expiresAt < slots[victim].expiresAt) victim = i;
+    }
+    slots[victim] = {h, claims.expiresAt, 1};
+  }
+};
+
+// =============================================================================
+// Verification
+// =============================================================================
+
+// Checks the tag, validity window and revocation filter. Permissions and
+// use counts are left to the caller. Mac provides
+// compute(const uint8_t* data, size_t length, uint8_t out[32]).
+template <typename Mac>
+GuestVerdict verifyGuestToken(Mac& mac, const char* token, uint32_t now,
+                              const GuestBloom& revoked, GuestClaims& claims) {
+  uint8_t payload[GUEST_PAYLOAD_MAX];
+  uint8_t tag[GUEST_TAG_LEN];
+  size_t payloadLength = 0;
+  if (strnlen(token, GUEST_TOKEN_MAX) >= GUEST_TOKEN_MAX ||
+      !parseGuestToken(token, payload, payloadLength, tag, claims)) {
+    return GUEST_MALFORMED;
+  }
+
+  uint8_t expected[32];
+  mac.compute(payload, payloadLength, expected);
+  if (!tagEquals(expected, tag, GUEST_TAG_LEN)) return GUEST_BAD_SIGNATURE;
+
+  if (now < claims.notBefore) return GUEST_NOT_YET_VALID;
+  if (now >= claims.expiresAt) return GUEST_EXPIRED;
+  if (revoked.contains(claims.id)) return GUEST_REVOKED;
+  return GUEST_OK;
+}
+
+#endif // GUEST_TOKEN_H
@@ -0,0 +1,330 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - On-Device History
+// =============================================================================
+//
+// Fixed-memory history served by GET /history:
+//   - the last HISTORY_OPERATIONS gate operations (direction, duration,
+//     positions, peak/mean current, energy, stop reason)
+//   - sensor min/max/mean buckets at 1 s, 1 min and 1 h resolution, each
+//     level folded incrementally into the next when its bucket closes
+//
+// No Arduino dependency; time is passed in by the caller.
+//
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define HISTORY_OPERATIONS    64      // Operation records kept
+#define HISTORY_SECONDS       300     // 1 s buckets (5 minutes)
+#define HISTORY_MINUTES       720     // 1 min buckets (12 hours)
+#define HISTORY_HOURS         168     // 1 h buckets (7 days)
+
+// =============================================================================
+// Operation Records
+// =============================================================================
+
+enum StopReason {
+  STOP_COMPLETED = 0,   // Reached the end position
+  STOP_MANUAL = 1,      // Stop command or button
+  STOP_REVERSED = 2,    // Superseded by a command in the other direction
+  STOP_TIMEOUT = 3,
+  STOP_OBSTACLE = 4,
+  STOP_OVERCURRENT = 5,
+  STOP_OVERHEAT = 6,
+  STOP_LIMIT = 7,       // Limit switch
+};
+
+struct OperationRecord {
+  uint32_t startedAt;       // s
+  uint32_t durationMs;
+  uint32_t energyMj;
+  uint16_t peakCurrentMa;
+  uint16_t meanCurrentMa;
+  uint8_t direction;        // 0 = open, 1 = close
+  uint8_t startPercentage;
+  uint8_t endPercentage;
+  uint8_t stopReason;
+};
+
+// Accumulates one operation from the filtered sensor samples
+class OperationTracker {
+private:
+  OperationRecord current = {};
+  uint64_t sumMa = 0;
+  uint64_t energyNj = 0;
+  uint32_t samples = 0;
+  uint32_t lastSampleMs = 0;
+  uint32_t startMs = 0;
+  bool active = false;
+
+public:
+  void begin(uint32_t nowMs, uint32_t nowS, uint8_t direction, uint8_t percentage) {
+    current = {};
+    current.startedAt = nowS;
+    current.direction = direction;
+    current.startPercentage = percentage;
+    sumMa = 0;
+    energyNj = 0;
+    samples = 0;
+    startMs = nowMs;
+    lastSampleMs = nowMs;
+    active = true;
+  }
+
+  void addSample(uint32_t nowMs, int32_t currentMa, int32_t voltageMv) {
+    if (!active) return;
+    if (currentMa < 0) currentMa = 0;
+    if (currentMa > 65535) currentMa = 65535;
+    if ((uint16_t)currentMa > current.peakCurrentMa) current.peakCurrentMa = (uint16_t)currentMa;
+    sumMa += (uint32_t)currentMa;
+    samples++;
+
+    // mV * mA * ms = nJ
+    uint32_t dt = nowMs - lastSampleMs;
+    energyNj += (uint64_t)(voltageMv > 0 ? voltageMv : 0) * (uint64_t)currentMa * dt;
+    lastSampleMs = nowMs;
+  }
+
+  // Returns false if no operation was in progress
+  bool end(uint32_t nowMs, uint8_t percentage, StopReason reason, OperationRecord& out) {
+    if (!active) return false;
+    active = false;
+    current.durationMs = nowMs - startMs;
+    current.endPercentage = percentage;
+    current.stopReason = (uint8_t)reason;
+    current.meanCurrentMa = samples ? (uint16_t)(sumMa / samples) : 0;
+    current.energyMj = (uint32_t)(energyNj / 1000000u);
+    out = current;
+    return true;
+  }
+
+  bool isActive() const { return active; }
+};
+
+// =============================================================================
+// Fixed-Capacity Ring
+// =============================================================================
+
+template <typename T, uint16_t N>
+class HistoryRing {
+private:
+  T items[N];
+  uint16_t head = 0;    // Next write position
+  uint16_t count = 0;
+
+public:
+  void push(const T& item) {
+    items[head] = item;
+    head = (head + 1) % N;
+    if (count < N) count++;
+  }
+
+  uint16_t size() const { return count; }
+  static constexpr uint16_t capacity() { return N; }
+
+  // 0 = oldest retained entry
+  const T& at(uint16_t index) const {
+    return items[(head + N - count + index) % N];
+  }
+
+  void clear() {
+    head = 0;
+    count = 0;
+  }
+};
+
+// =============================================================================
+// Multi-Resolution Sensor History
+// =============================================================================
+
+enum HistoryChannel {
+  CHANNEL_CURRENT = 0,    // 10 mA units
+  CHANNEL_VOLTAGE,        // 10 mV units
+  CHANNEL_TEMPERATURE,    // centi-°C
+  CHANNEL_COUNT
+};
+
+struct HistoryBucket {
+  int16_t min[CHANNEL_COUNT];
+  int16_t max[CHANNEL_COUNT];
+  int16_t mean[CHANNEL_COUNT];
+};
+
+// Open bucket being filled
+struct BucketAccumulator {
+  int16_t min[CHANNEL_COUNT];
+  int16_t max[CHANNEL_COUNT];
+  int32_t sum[CHANNEL_COUNT];
+  uint16_t count;
+
+  void reset() {
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+      min[c] = INT16_MAX;
+      max[c] = INT16_MIN;
+      sum[c] = 0;
+    }
+    count = 0;
+  }
+
+  void add(const int16_t* minV, const int16_t* maxV, const int16_t* meanV) {
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+      if (minV[c] < min[c]) min[c] = minV[c];
+      if (maxV[c] > max[c]) max[c] = maxV[c];
+      sum[c] += meanV[c];
+    }
+    count++;
+  }
+
+  HistoryBucket close() const {
+    HistoryBucket bucket;
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+      bucket.min[c] = min[c];
+      bucket.max[c] = max[c];
+      bucket.mean[c] = (int16_t)(sum[c] / count);
+    }
+    return bucket;
+  }
+};
+
+class SensorHistory {
+public:
+  enum Resolution { RES_SECOND = 0, RES_MINUTE, RES_HOUR, RES_COUNT };
+
+private:
+  HistoryRing<HistoryBucket, HISTORY_SECONDS> seconds;
+  HistoryRing<HistoryBucket, HISTORY_MINUTES> minutes;
+  HistoryRing<HistoryBucket, HISTORY_HOURS> hours;
+
+  BucketAccumulator open[RES_COUNT];
+  uint32_t bucketStart[RES_COUNT] = {};   // s, start of the open bucket
+  uint32_t lastClosed[RES_COUNT] = {};    // s, start of the newest closed bucket
+  bool started = false;
+
+  static constexpr uint32_t period(uint8_t level) {
+    return level == RES_SECOND ? 1 : level == RES_MINUTE ? 60 : 3600;
+  }
+
+  static constexpr uint16_t capacity(uint8_t level) {
+    return level == RES_SECOND ? HISTORY_SECONDS : level == RES_MINUTE ? HISTORY_MINUTES : HISTORY_HOURS;
+  }
+
+  void store(uint8_t level, const HistoryBucket& bucket) {
+    switch (level) {
+      case RES_SECOND: seconds.push(bucket); break;
+      case RES_MINUTE: minutes.push(bucket); break;
+      case RES_HOUR: hours.push(bucket); break;
+    }
+  }
+
+  void closeLevel(uint8_t level) {
+    lastClosed[level] = bucketStart[level];
+
+    // A period without samples (e.g. a blocking OTA flash) stays a gap
+    if (open[level].count == 0) {
+      store(level, emptyBucket());
+      return;
+    }
+
+    HistoryBucket bucket = open[level].close();
+    open[level].reset();
+    store(level, bucket);
+
+    // Fold into the next coarser level
+    if (level + 1 < RES_COUNT) {
+      open[level + 1].add(bucket.min, bucket.max, bucket.mean);
+    }
+  }
+
+  void advance(uint32_t nowS) {
+    for (uint8_t level = 0; level < RES_COUNT; level++) {
+      uint32_t start = nowS - nowS % period(level);
+      if (start == bucketStart[level]) continue;
+
+      closeLevel(level);
+
+      // Keep bucket positions aligned to time across skipped periods
+      uint32_t missing = (start - bucketStart[level]) / period(level) - 1;
+      if (missing > capacity(level)) missing = capacity(level);
+      for (uint32_t i = 0; i < missing; i++) {
+        store(level, emptyBucket());
+        lastClosed[level] += period(level);
+      }
+      bucketStart[level] = start;
+    }
+  }
+
+public:
+  SensorHistory() {
+    for (uint8_t level = 0; level < RES_COUNT; level++) open[level].reset();
+  }
+
+  // One filtered sample; values in the HistoryChannel units
+  void addSample(uint32_t nowS, int16_t currentCa, int16_t voltageCv, int16_t temperatureCc) {
+    if (!started) {
+      for (uint8_t level = 0; level < RES_COUNT; level++) {
+        bucketStart[level] = nowS - nowS % period(level);
+      }
+      started = true;
+    } else {
+      advance(nowS);
+    }
+    int16_t values[CHANNEL_COUNT] = {currentCa, voltageCv, temperatureCc};
+    open[RES_SECOND].add(values, values, values);
+  }
+
+  uint16_t size(uint8_t level) const {
+    switch (level) {
+      case RES_SECOND: return seconds.size();
+      case RES_MINUTE: return minutes.size();
+      case RES_HOUR: return hours.size();
+      default: return 0;
+    }
+  }
+
+  // 0 = oldest
+  const HistoryBucket& at(uint8_t level, uint16_t index) const {
+    switch (level) {
+      case RES_SECOND: return seconds.at(index);
+      case RES_MINUTE: return minutes.at(index);
+      default: return hours.at(index);
+    }
+  }
+
+  uint32_t newestStart(uint8_t level) const { return lastClosed[level]; }
+
+  static HistoryBucket emptyBucket() {
+    HistoryBucket bucket;
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++) {
+      bucket.min[c] = INT16_MAX;
+      bucket.max[c] = INT16_MIN;
+      bucket.mean[c] = 0;
+    }
+    return bucket;
+  }
+
+  static bool isEmpty(const HistoryBucket& bucket) { return bucket.min[0] > bucket.max[0]; }
+  static constexpr uint32_t periodOf(uint8_t level) { return period(level); }
+};
+
+// =============================================================================
+// Helpers
+// =============================================================================
+
+inline const char* stopReasonName(uint8_t reason) {
+  switch (reason) {
+    case STOP_COMPLETED: return "completed";
+    case STOP_MANUAL: return "manual";
+    case STOP_REVERSED: return "reversed";
+    case STOP_TIMEOUT: return "timeout";
+    case STOP_OBSTACLE: return "obstacle";
+    case STOP_OVERCURRENT: return "overcurrent";
+    case STOP_OVERHEAT: return "overheat";
+    case STOP_LIMIT: return "limit";
+    default: return "unknown";
+  }
+}
+
+#endif // HISTORY_H
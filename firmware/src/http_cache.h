@@ -0,0 +1,149 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - HTTP Response Cache
+// =============================================================================
+//
+// Rendered JSON bodies kept between requests, with ETags for conditional
+// GETs. A body carries the version of the state it was rendered from and
+// is rendered again only once that version moves: GET / and most of
+// GET /config once per boot (and network change), GET /status and the gate
+// views when a gate or sensor reading changes. A poller that sends the
+// ETag back in If-None-Match gets a 304 without a body, so it costs neither
+// a JsonDocument nor a String.
+//
+// ETags combine a random boot id with the version, so a version count that
+// restarts after a reboot never validates a body from before it. Bodies
+// completed per request with diagnostics (uptime, RSSI, free heap) get a
+// weak ETag (W/"...") over the cached part.
+//
+// StateVersion turns a plain snapshot struct into such a version: it counts
+// the updates that changed the snapshot. Zero-initialize snapshots (= {})
+// so padding compares equal.
+//
+// No Arduino dependency; tools/http_bench.cpp serves from it over loopback.
+//
+
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HTTP_ETAG_MAX   40            // W/"<8 hex>-<16 hex>" + terminator
+
+// =============================================================================
+// ETags
+// =============================================================================
+
+inline size_t formatEtag(char* out, size_t size, uint32_t bootId, uint64_t version, bool weak) {
+  static const char hex[] = "0123456789abcdef";
+  char text[HTTP_ETAG_MAX];
+  size_t n = 0;
+  if (weak) {
+    text[n++] = 'W';
+    text[n++] = '/';
+  }
+  text[n++] = '"';
+  for (int shift = 28; shift >= 0; shift -= 4) text[n++] = hex[(bootId >> shift) & 0xF];
+  text[n++] = '-';
+  int digits = 1;
+  while (digits < 16 && (version >> (4 * digits)) != 0) digits++;
+  for (int i = digits - 1; i >= 0; i--) text[n++] = hex[(version >> (4 * i)) & 0xF];
+  text[n++] = '"';
+  text[n] = '\0';
+
+  if (size == 0) return 0;
+  size_t copied = n < size ? n : size - 1;
+  memcpy(out, text, copied);
+  out[copied] = '\0';
+  return copied;
+}
+
+// If-None-Match against an ETag: a list of tags or "*", weak comparison
+// (RFC 9110 13.1.2), so W/"x" and "x" match
+inline bool etagMatches(const char* header, const char* etag) {
+  if (!header || !etag) return false;
+  if (etag[0] == 'W' && etag[1] == '/') etag += 2;
+  size_t etagLength = strlen(etag);
+
+  const char* p = header;
+  for (;;) {
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    if (!*p) return false;
+    if (*p == '*') return true;
+    if (p[0] == 'W' && p[1] == '/') p += 2;
+    const char* start = p;
+    if (*p == '"') {
+      p++;
+      while (*p && *p != '"') p++;
+      if (*p == '"') p++;
+    } else {
+      while (*p && *p != ',' && *p != ' ') p++;
+    }
+    if ((size_t)(p - start) == etagLength && memcmp(start, etag, etagLength) == 0) return true;
+  }
+}
+
+// =============================================================================
+// State Version
+// =============================================================================
+
+template <typename Snapshot>
+class StateVersion {
+private:
+  Snapshot last = {};
+  uint32_t version = 0;
+
+public:
+  // Returns true if the snapshot differs from the last one
+  bool update(const Snapshot& snapshot) {
+    if (version != 0 && memcmp(&snapshot, &last, sizeof(Snapshot)) == 0) return false;
+    last = snapshot;
+    version++;
+    return true;
+  }
+
+  uint32_t get() const { return version; }
+  const Snapshot& snapshot() const { return last; }
+};
+
+// =============================================================================
+// Cached Body
+// =============================================================================
+
+template <size_t N>
+class CachedBody {
+private:
+  char data[N];
+  size_t length = 0;
+  uint64_t version = 0;
+  bool valid = false;
+  char tag[HTTP_ETAG_MAX] = "";
+
+public:
+  static constexpr size_t capacity() { return N; }
+
+  bool current(uint64_t stateVersion) const { return valid && version == stateVersion; }
+
+  // Render target; commit() the length written
+  char* buffer() { return data; }
+
+  // False (and nothing cached) if the body did not fit
+  bool commit(size_t bodyLength, uint32_t bootId, uint64_t stateVersion, bool weak = false) {
+    valid = bodyLength > 0 && bodyLength < N;
+    if (!valid) return false;
+    length = bodyLength;
+    data[length] = '\0';
+    version = stateVersion;
+    formatEtag(tag, sizeof(tag), bootId, stateVersion, weak);
+    return true;
+  }
+
+  void invalidate() { valid = false; }
+
+  const char* body() const { return data; }
+  size_t size() const { return length; }
+  const char* etag() const { return tag; }
+};
+
+#endif // HTTP_CACHE_H
@@ -0,0 +1,416 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - LAN Command Protocol
+// =============================================================================
+//
+// Gate commands from a phone on the same network, one UDP datagram each way
+// to LAN_UDP_PORT. The device advertises _gatemate._udp over mDNS with the
+// gate ids in its TXT record. Both directions are 40 bytes, little-endian:
+//
+//   command  [0] 'G'  [1] version  [2] 1  [3] gate index
+//            [4] GateCommand  [5] percentage  [6..7] 0
+//            [8..11] key id  [12..15] client id  [16..19] counter
+//            [20..23] sentAt (UTC s)
+//            [24..39] HMAC-SHA256(userKey, [0..23])[0..15]
+//
+//   reply    [0] 'G'  [1] version  [2] 2  [3] gate index
+//            [4] status  [5] flags (bit 0: duplicate)  [6] state  [7] percentage
+//            [8..19] key id, client id and counter of the command
+//            [20..23] device time  [24..39] tag as above
+//
+// Every user of the device has a key of their own:
+//   lanKey  = HMAC-SHA256(deviceKey, LAN_KEY_LABEL), a sub-key of the guest
+//             device key that never leaves the device or the backend
+//   userKey = HMAC-SHA256(lanKey, key id as 4 bytes LE)
+// The backend hands a user their key id and userKey (GET /devices/:id/lan)
+// and lists the key ids of the device's current users in the guest sync
+// (at most LAN_KEYS_MAX). The device derives userKey per datagram and
+// drops any key id not on that list, so removing a user or rotating one
+// phone's key (POST /devices/:id/lan/rotate) revokes it offline too, once
+// the sync has arrived. Datagrams with a wrong tag or layout get no reply.
+//
+// Replay protection:
+//   - A client picks a random 32-bit id per session and counts its commands
+//     from 1. A sliding window of 64 counters per key id and client rejects
+//     a counter that was seen or has fallen behind.
+//   - Once the device clock is set, sentAt must be within LAN_MAX_SKEW_S of
+//     it. A window lost to eviction or a reset therefore reopens at most
+//     the last LAN_MAX_SKEW_S of datagrams. Those are still caught by the
+//     CommandLog below, unless the device lost power. After a power-on and
+//     before the clock is set, only the window protects.
+//   - A retransmission of a command that ran is found in the CommandLog
+//     (command_delivery.h). It is answered with the first outcome and the
+//     duplicate flag, and is not run again.
+// An accepted datagram runs through the same pipeline as an MQTT command,
+// under the commandId "lan-<key id>-<client>-<counter>".
+//
+// The MAC is a template parameter like guest_token.h. No Arduino
+// dependency; see tools/lan_bench.cpp.
+//
+
+#ifndef LAN_COMMAND_H
+#define LAN_COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "command_delivery.h"
+#include "gate_motion.h"
+#include "guest_token.h"
+
+#define LAN_MAGIC           0x47    // 'G'
+#define LAN_VERSION         2
+#define LAN_DATAGRAM_LEN    40
+#define LAN_SIGNED_LEN      24
+#define LAN_TAG_LEN         16
+#define LAN_WINDOW          64      // Counters tracked behind the highest
+
+enum LanType : uint8_t {
+  LAN_TYPE_COMMAND = 1,
+  LAN_TYPE_REPLY = 2,
+};
+
+// Reply status: the CommandAckStatus values, then the refusals
+enum LanStatus : uint8_t {
+  LAN_STATUS_REPLAY = 16,       // Counter seen or too old, outcome unknown
+  LAN_STATUS_STALE,             // sentAt too far from the device clock
+  LAN_STATUS_UNKNOWN_GATE,
+};
+
+inline const char* lanStatusName(uint8_t status) {
+  switch (status) {
+    case LAN_STATUS_REPLAY: return "replay";
+    case LAN_STATUS_STALE: return "stale";
+    case LAN_STATUS_UNKNOWN_GATE: return "unknown_gate";
+    default: return commandAckStatusName(status);
+  }
+}
+
+struct LanRequest {
+  uint8_t gate;
+  uint8_t command;
+  uint8_t percentage;
+  uint32_t keyId;
+  uint32_t client;
+  uint32_t counter;
+  uint32_t sentAt;
+  char commandId[32];           // "lan-" key id "-" client "-" counter, hex
+  uint8_t status;               // Set by decide() or by the pipeline
+  bool duplicate;
+};
+
+struct LanReply {
+  uint8_t gate;
+  uint8_t status;
+  bool duplicate;
+  GateState state;
+  uint8_t percentage;
+  uint32_t keyId;
+  uint32_t client;
+  uint32_t counter;
+  uint32_t deviceTime;
+};
+
+// userKey for keyId, with lanMac keyed with the LAN key
+template <typename Mac>
+inline void deriveLanUserKey(Mac& lanMac, uint32_t keyId, uint8_t out[32]) {
+  uint8_t id[4];
+  writeLe32(id, keyId);
+  lanMac.compute(id, sizeof(id), out);
+}
+
+// =============================================================================
+// Client Side
+// =============================================================================
+
+// The phone's half, also used by tools/lan_bench.cpp; mac is keyed with the
+// user's key
+template <typename Mac>
+inline void encodeLanCommand(Mac& mac, uint32_t keyId, uint8_t gate, GateCommand command,
+                             uint8_t percentage, uint32_t client, uint32_t counter,
+                             uint32_t sentAt, uint8_t out[LAN_DATAGRAM_LEN]) {
+  memset(out, 0, LAN_DATAGRAM_LEN);
+  out[0] = LAN_MAGIC;
+  out[1] = LAN_VERSION;
+  out[2] = LAN_TYPE_COMMAND;
+  out[3] = gate;
+  out[4] = (uint8_t)command;
+  out[5] = percentage;
+  writeLe32(out + 8, keyId);
+  writeLe32(out + 12, client);
+  writeLe32(out + 16, counter);
+  writeLe32(out + 20, sentAt);
+  uint8_t tag[32];
+  mac.compute(out, LAN_SIGNED_LEN, tag);
+  memcpy(out + LAN_SIGNED_LEN, tag, LAN_TAG_LEN);
+}
+
+// False for a reply that is malformed or not signed with the key
+template <typename Mac>
+inline bool parseLanReply(Mac& mac, const uint8_t* in, size_t length, LanReply& reply) {
+  if (length != LAN_DATAGRAM_LEN || in[0] != LAN_MAGIC || in[1] != LAN_VERSION ||
+      in[2] != LAN_TYPE_REPLY) {
+    return false;
+  }
+  uint8_t tag[32];
+  mac.compute(in, LAN_SIGNED_LEN, tag);
+  if (!tagEquals(tag, in + LAN_SIGNED_LEN, LAN_TAG_LEN)) return false;
+  reply.gate = in[3];
+  reply.status = in[4];
+  reply.duplicate = in[5] & 0x01;
+  reply.state = (GateState)in[6];
+  reply.percentage = in[7];
+  reply.keyId = readLe32(in + 8);
+  reply.client = readLe32(in + 12);
+  reply.counter = readLe32(in + 16);
+  reply.deviceTime = readLe32(in + 20);
+  return true;
+}
+
+// =============================================================================
+// Replay Window
+// =============================================================================
+
+enum LanWindowCheck : uint8_t {
+  LAN_WINDOW_NEW = 0,
+  LAN_WINDOW_SEEN,
+  LAN_WINDOW_OLD,             // More than LAN_WINDOW behind the highest
+};
+
+// One 64-counter window per key id and client; the least recently used
+// one is replaced when all slots are taken
+template <uint8_t Clients>
+class LanReplayWindow {
+private:
+  struct Slot {
+    bool used;
+    uint32_t keyId;
+    uint32_t client;
+    uint32_t highest;
+    uint64_t bits;            // Bit n: highest - n seen
+    uint32_t usedMs;
+  };
+
+  Slot slots[Clients] = {};
+
+  int8_t indexOf(uint32_t keyId, uint32_t client) const {
+    for (uint8_t i = 0; i < Clients; i++) {
+      if (slots[i].used && slots[i].keyId == keyId && slots[i].client == client) {
+        return (int8_t)i;
+      }
+    }
+    return -1;
+  }
+
+public:
+  LanWindowCheck check(uint32_t keyId, uint32_t client, uint32_t counter) const {
+    int8_t index = indexOf(keyId, client);
+    if (index < 0) return LAN_WINDOW_NEW;
+    const Slot* slot = &slots[index];
+    if (counter > slot->highest) return LAN_WINDOW_NEW;
+    uint32_t back = slot->highest - counter;
+    if (back >= LAN_WINDOW) return LAN_WINDOW_OLD;
+    return (slot->bits >> back) & 1 ? LAN_WINDOW_SEEN : LAN_WINDOW_NEW;
+  }
+
+  void mark(uint32_t keyId, uint32_t client, uint32_t counter, uint32_t nowMs) {
+    int8_t index = indexOf(keyId, client);
+    Slot* slot = index < 0 ? nullptr : &slots[index];
+    if (!slot) {
+      slot = &slots[0];
+      for (Slot& candidate : slots) {
+        if (!candidate.used) {
+          slot = &candidate;
+          break;
+        }
+        if ((int32_t)(candidate.usedMs - slot->usedMs) < 0) slot = &candidate;
+      }
+      *slot = {true, keyId, client, counter, 1, nowMs};
+      return;
+    }
+    slot->usedMs = nowMs;
+    if (counter > slot->highest) {
+      uint32_t shift = counter - slot->highest;
+      slot->bits = shift >= LAN_WINDOW ? 1 : (slot->bits << shift) | 1;
+      slot->highest = counter;
+    } else {
+      slot->bits |= 1ull << (slot->highest - counter);
+    }
+  }
+};
+
+// =============================================================================
+// Device Side
+// =============================================================================
+
+enum LanDecision : uint8_t {
+  LAN_DROP = 0,               // No reply
+  LAN_RUN,                    // Run through the command pipeline, then reply
+  LAN_ANSWER,                 // Reply with request.status as decided
+};
+
+struct LanStats {
+  uint32_t received = 0;
+  uint32_t dropped = 0;       // Malformed, wrong tag or no key yet
+  uint32_t unknownKeys = 0;   // Key id not on the allow list, no reply
+  uint32_t run = 0;
+  uint32_t duplicates = 0;
+  uint32_t replays = 0;
+  uint32_t stale = 0;
+  uint32_t handled = 0;       // Datagrams answered, for the timing below
+  uint32_t sumUs = 0;         // Receive to reply sent
+  uint32_t maxUs = 0;
+};
+
+template <typename Mac>
+class LanCommandServer {
+private:
+  Mac* lanMac = nullptr;      // Keyed with the LAN key
+  Mac userMac;                // Keyed with the userKey of userKeyId
+  uint32_t userKeyId = 0;
+  bool userKeyed = false;
+  uint32_t allowed[LAN_KEYS_MAX] = {};
+  uint8_t allowedCount = 0;
+  const CommandDelivery* delivery = nullptr;
+  LanReplayWindow<LAN_CLIENTS> window;
+  LanStats counters;
+
+  // nullptr for a key id that is not allowed; a run of datagrams from one
+  // phone derives its key once
+  Mac* keyFor(uint32_t keyId) {
+    if (!lanMac) return nullptr;
+    bool listed = false;
+    for (uint8_t i = 0; i < allowedCount && !listed; i++) listed = allowed[i] == keyId;
+    if (!listed) return nullptr;
+    if (!userKeyed || userKeyId != keyId) {
+      uint8_t key[32];
+      deriveLanUserKey(*lanMac, keyId, key);
+      userKeyed = userMac.setKey(key, sizeof(key));
+      userKeyId = keyId;
+      memset(key, 0, sizeof(key));
+    }
+    return userKeyed ? &userMac : nullptr;
+  }
+
+public:
+  void begin(const CommandDelivery& commands) { delivery = &commands; }
+
+  // nullptr until the device has a key; datagrams are dropped meanwhile
+  void setMac(Mac* keyed) {
+    lanMac = keyed;
+    userKeyed = false;
+  }
+
+  // Key ids of the device's users, from the guest sync
+  void allow(const uint32_t* keyIds, uint8_t count) {
+    allowedCount = count < LAN_KEYS_MAX ? count : LAN_KEYS_MAX;
+    memcpy(allowed, keyIds, allowedCount * sizeof(uint32_t));
+  }
+
+  bool ready() const { return lanMac != nullptr && allowedCount > 0; }
+  uint8_t keys() const { return allowedCount; }
+
+  // nowEpoch is 0 while the device clock is not set
+  LanDecision decide(const uint8_t* in, size_t length, uint32_t nowEpoch, uint32_t nowMs,
+                     uint8_t gateCount, LanRequest& request) {
+    counters.received++;
+    if (!lanMac || length != LAN_DATAGRAM_LEN || in[0] != LAN_MAGIC || in[1] != LAN_VERSION ||
+        in[2] != LAN_TYPE_COMMAND) {
+      counters.dropped++;
+      return LAN_DROP;
+    }
+    Mac* mac = keyFor(readLe32(in + 8));
+    if (!mac) {
+      counters.unknownKeys++;
+      return LAN_DROP;
+    }
+    uint8_t tag[32];
+    mac->compute(in, LAN_SIGNED_LEN, tag);
+    if (!tagEquals(tag, in + LAN_SIGNED_LEN, LAN_TAG_LEN)) {
+      counters.dropped++;
+      return LAN_DROP;
+    }
+
+    request.gate = in[3];
+    request.command = in[4];
+    request.percentage = in[5] > 100 ? 100 : in[5];
+    request.keyId = readLe32(in + 8);
+    request.client = readLe32(in + 12);
+    request.counter = readLe32(in + 16);
+    request.sentAt = readLe32(in + 20);
+    request.duplicate = false;
+    snprintf(request.commandId, sizeof(request.commandId), "lan-%08lx-%08lx-%08lx",
+             (unsigned long)request.keyId, (unsigned long)request.client,
+             (unsigned long)request.counter);
+
+    switch (window.check(request.keyId, request.client, request.counter)) {
+      case LAN_WINDOW_SEEN:
+        // A retransmission is answered from the log, never run again
+        if (delivery->seen(request.gate, request.commandId, request.status)) {
+          request.duplicate = true;
+          counters.duplicates++;
+          return LAN_ANSWER;
+        }
+        counters.replays++;
+        request.status = LAN_STATUS_REPLAY;
+        return LAN_ANSWER;
+      case LAN_WINDOW_OLD:
+        counters.replays++;
+        request.status = LAN_STATUS_REPLAY;
+        return LAN_ANSWER;
+      default:
+        break;
+    }
+
+    if (nowEpoch >= COMMAND_MIN_EPOCH && request.sentAt) {
+      int64_t skew = (int64_t)nowEpoch - (int64_t)request.sentAt;
+      if (skew > LAN_MAX_SKEW_S || skew < -LAN_MAX_SKEW_S) {
+        counters.stale++;
+        request.status = LAN_STATUS_STALE;
+        return LAN_ANSWER;
+      }
+    }
+
+    if (request.gate >= gateCount) {
+      request.status = LAN_STATUS_UNKNOWN_GATE;
+      return LAN_ANSWER;
+    }
+    window.mark(request.keyId, request.client, request.counter, nowMs);
+    counters.run++;
+    return LAN_RUN;
+  }
+
+  // Only after decide() answered LAN_RUN or LAN_ANSWER for request
+  void reply(const LanRequest& request, GateState state, uint8_t percentage, uint32_t nowEpoch,
+             uint8_t out[LAN_DATAGRAM_LEN]) {
+    memset(out, 0, LAN_DATAGRAM_LEN);
+    out[0] = LAN_MAGIC;
+    out[1] = LAN_VERSION;
+    out[2] = LAN_TYPE_REPLY;
+    out[3] = request.gate;
+    out[4] = request.status;
+    out[5] = request.duplicate ? 0x01 : 0;
+    out[6] = (uint8_t)state;
+    out[7] = percentage;
+    writeLe32(out + 8, request.keyId);
+    writeLe32(out + 12, request.client);
+    writeLe32(out + 16, request.counter);
+    writeLe32(out + 20, nowEpoch);
+    Mac* mac = keyFor(request.keyId);
+    if (!mac) return;           // Revoked in between: the client rejects the zero tag
+    uint8_t tag[32];
+    mac->compute(out, LAN_SIGNED_LEN, tag);
+    memcpy(out + LAN_SIGNED_LEN, tag, LAN_TAG_LEN);
+  }
+
+  void addTiming(uint32_t us) {
+    counters.handled++;
+    counters.sumUs += us;
+    if (us > counters.maxUs) counters.maxUs = us;
+  }
+
+  const LanStats& stats() const { return counters; }
+};
+
+#endif // LAN_COMMAND_H
@@ -9,43 +9,89 @@
 #include <ArduinoJson.h>
 #include <EEPROM.h>
 #include <WiFiManager.h>
-#include <PubSubClient.h>
-#include <ElegantOTA.h>
+#include <Preferences.h>
+#include <LittleFS.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <esp_adc_cal.h>
 #include "config.h"
+#include "event_log.h"
+#include "feature_set.h"
+#include "acquisition.h"
+#include "command_delivery.h"
+#include "filters.h"
+#include "gate_controller.h"
+#include "gate_motion.h"
+#include "group_command.h"
+#include "guest_access.h"
+#include "history.h"
+#include "http_cache.h"
+#include "lan_command.h"
+#include "mcsa.h"
+#include "ota_update.h"
+#include "power_manager.h"
+#include "ring_buffer.h"
+#include "safety_rules.h"
+#include "schedule.h"
+#include "sensor_chain.h"
+#include "trace.h"
+#include "config_store.h"
+#include "state_store.h"
+#include "schedule_store.h"
 
 // =============================================================================
 // Global Objects
 // =============================================================================
 
-WebServer server(WEB_SERVER_PORT);
-WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+// Behind the HTTPS front the plain server is only reachable on loopback
+WebServer server(BuildFeatures::https ? IPAddress(127, 0, 0, 1) : IPAddress(),
+                 BuildFeatures::https ? WEB_LOOPBACK_PORT : WEB_SERVER_PORT);
+HttpsFront httpsFront;
+MqttLink::Client mqttLink;
+MqttClient mqttClient(mqttLink);
 WiFiManager wifiManager;
+LoopProfiler loopProfiler;
+SafetyTimer safetyTimer;
+PowerManager power;
+ConfigStore configStore;
+ScheduleStore scheduleStore;
+GuestAccess guestAccess;
+OtaUpdate otaUpdate;
 
 // =============================================================================
-// State Variables
+// Gates
 // =============================================================================
 
-enum GateState {
-  GATE_CLOSED = 0,
-  GATE_OPENING = 1,
-  GATE_OPEN = 2,
-  GATE_CLOSING = 3,
-  GATE_STOPPED = 4,
-  GATE_ERROR = 5
+// GPIO access for the gate controllers; reads go through readInput() so a
+// running trace sees the edges
+struct GpioBoard {
+  void write(uint8_t pin, bool level) { digitalWrite(pin, level ? HIGH : LOW); }
+  bool read(uint8_t pin);
 };
 
+using Gate = GateController<GpioBoard>;
+
+const GateDescriptor gateDescriptors[] = { GATE_DESCRIPTORS };
+constexpr uint8_t GATE_COUNT = sizeof(gateDescriptors) / sizeof(gateDescriptors[0]);
+static_assert(GATE_COUNT <= GATE_MAX_COUNT, "Too many entries in GATE_DESCRIPTORS");
+
+// Gate 0 is the controller's own identity: schedules, guest access, the
+// motor signature and traces act on it
+GpioBoard gpioBoard;
+Gate gates[GATE_COUNT];
+GateStateStore stateStores[GATE_COUNT];
+
+// =============================================================================
+// State Variables
+// =============================================================================
+
 struct DeviceState {
-  GateState gateState = GATE_CLOSED;
-  uint8_t percentage = 0;
   bool isOnline = true;
-  bool obstacleDetected = false;
   unsigned long lastActivity = 0;
-  unsigned long operationStartTime = 0;
 };
 
+// Shared by all gates; motor current is per gate (Gate::getCurrent())
 struct SensorData {
-  float current = 0.0;
   float voltage = 0.0;
   float temperature = 0.0;
   int wifiSignal = 0;
@@ -55,38 +101,243 @@ DeviceState deviceState;
 SensorData sensorData;
 unsigned long lastSensorRead = 0;
 unsigned long lastMqttReconnect = 0;
-unsigned long lastCommandTime = 0;
+
+// Per-channel filter chains (mA, mV, centi-°C); gates after the first
+// have a current channel only
+SensorChain sensorChain;
+CurrentFilter gateCurrent[GATE_COUNT];
+
+// ADC reads for the acquisition scheduler
+struct AdcBoard {
+  uint16_t read(uint8_t pin) { return analogRead(pin); }
+  uint32_t cycles() { return ESP.getCycleCount(); }
+  uint32_t cyclesPerUs() { return getCpuFrequencyMhz(); }
+};
+
+// Channels at their own rates: gate i's current is channel i, then the
+// supply voltage and the temperature
+AdcBoard adcBoard;
+AdcCalibration adcCalibration;
+AcquisitionScheduler<AdcBoard, GATE_COUNT + 2> acquisition;
+int8_t acqVoltage = -1;
+int8_t acqTemperature = -1;
+
+// Motor current signature analysis (sampled at MCSA_SAMPLE_RATE_HZ)
+SpscRing<uint16_t, 256> mcsaSamples;
+std::atomic<bool> mcsaSampling{false};
+TaskHandle_t mcsaTask = nullptr;
+OperationSignature mcsaSignature;
+BaselineTracker mcsaBaseline[2];   // 0 = opening, 1 = closing
+uint8_t mcsaDirection = 0;
+
+// On-device sensor history (fixed memory); operations are kept per gate
+SensorHistory sensorHistory;
+
+// What the status views show, at the resolution they show it: sensor noise
+// below it does not count as a change
+struct StatusSnapshot {
+  uint8_t state[GATE_COUNT];
+  uint8_t percentage[GATE_COUNT];
+  bool obstacle[GATE_COUNT];
+  int16_t currentCa[GATE_COUNT];    // 0.01 A
+  int16_t voltageDv;                // 0.1 V
+  int16_t temperatureDc;            // 0.1 °C
+  int16_t wifiSignal;
+  bool online;
+};
+
+// Rendered HTTP bodies (http_cache.h): root and config by address and
+// config revision, the status views by statusVersion
+StateVersion<StatusSnapshot> statusVersion;
+uint32_t httpBootId = 0;
+CachedBody<512> rootBody;
+CachedBody<768 + GROUP_LIST_MAX> configBody;
+CachedBody<256 + 160 * GATE_COUNT> statusBody;
+CachedBody<64 + 192 * GATE_COUNT> gatesBody;
+CachedBody<256> gateStatusBody[GATE_COUNT];
+
+// Trace recording (LittleFS file or TCP stream)
+TraceRecorder traceRecorder;
+File traceFile;
+WiFiClient traceClient;
+Print* traceSink = nullptr;
+size_t traceBytes = 0;
+
+// Event log: records from any task, formatted and written by a low-priority
+// drain task; MQTT batches are handed to loop(), which owns the client
+enum LogSink : uint8_t { LOG_SINK_SERIAL, LOG_SINK_FILE, LOG_SINK_MQTT, LOG_SINK_COUNT };
+const char* const logSinkNames[LOG_SINK_COUNT] = {"serial", "file", "mqtt"};
+
+struct LogBatch {
+  LogHeader header;
+  LogRecord records[LOG_MQTT_BATCH];
+};
+
+struct LogStats {
+  uint32_t records;         // Drained from the ring
+  uint32_t fileBytes;       // Appended since boot
+  uint32_t mqttBatches;
+  uint32_t mqttDropped;     // Lost while a batch waited for loop()
+  uint32_t pushNs;          // One LOG_EVENT, measured at boot
+};
+
+EventLog eventLog;
+std::atomic<uint8_t> logLevels[LOG_SINK_COUNT] = {LOG_SERIAL_LEVEL, LOG_FILE_LEVEL, LOG_MQTT_LEVEL};
+LogStats logStats = {};
+SemaphoreHandle_t logFileLock = nullptr;
+File logFile;
+LogBatch logBatch;
+uint32_t logBatchStartedAt = 0;
+uint32_t logBatchSequence = 0;
+std::atomic<bool> logBatchReady{false};
+
+// Local schedules (timer wheel on the SNTP clock)
+struct ScheduleRun {
+  char id[SCHEDULE_ID_LEN];
+  uint8_t action;
+  bool executed;
+  uint32_t dueAt;         // UTC epoch seconds
+  uint32_t firedAt;
+};
+
+ScheduleEngine scheduleEngine;
+HistoryRing<ScheduleRun, SCHEDULE_RUN_QUEUE> pendingScheduleRuns;
+unsigned long lastScheduleTick = 0;
+bool clockSynced = false;
+
+// Guest passes used on the LAN, reported to the backend
+struct GuestUse {
+  char passId[GUEST_ID_MAX + 1];
+  uint8_t action;
+  uint32_t at;            // UTC epoch seconds
+};
+
+HistoryRing<GuestUse, GUEST_USE_QUEUE> pendingGuestUses;
+
+// Group / broadcast command waiting out its stagger delay, per gate
+struct GroupCommand {
+  bool pending;
+  GateCommand command;
+  uint8_t percentage;
+  uint8_t stateMask;      // Bit per GateState; 0 = any state
+  char requestId[GROUP_REQUEST_ID_MAX + 1];
+  char group[GROUP_NAME_MAX + 1];
+  uint32_t delayMs;
+  unsigned long receivedAt;
+};
+
+GroupCommand groupCommands[GATE_COUNT] = {};
+GroupRequestLog<GROUP_REQUEST_LOG> seenGroupRequests;
+char subscribedGroups[GROUP_LIST_MAX] = "";
+
+// commandIds already run; survives every reset except power-on
+RTC_NOINIT_ATTR static CommandLog rtcCommandLog;
+CommandDelivery commandDelivery;
+
+// UDP commands from the LAN, keyed by a sub-key of the guest key
+LanLink lanLink;
+MbedHmacSha256 lanMac;
+LanCommandServer<MbedHmacSha256> lanServer;
 
 // =============================================================================
 // Function Prototypes
 // =============================================================================
 
 void setupGPIO();
+void restoreGateState();
 void setupWiFi();
 void setupMQTT();
 void setupWebServer();
 void setupOTA();
 void handleRoot();
 void handleStatus();
-void handleOpen();
-void handleClose();
-void handleStop();
-void handlePartial();
+void handleGates();
+void handleGateStatus(uint8_t gate);
+bool renderRoot(uint32_t ip);
+bool renderConfig(uint64_t version);
+uint32_t refreshStatusVersion();
+void handleGateCommand(uint8_t gate, GateCommand command);
 void handleConfig();
+void handleConfigUpdate();
 void handleFactoryReset();
+void handleHistory();
+void handleOperationHistory();
+void handleTraceStart();
+void handleTraceStop();
+void handleTraceDownload();
+void handleSchedules();
+void handleGuestAccess();
+void handleGuestKey();
+void handleGuestStatus();
 void sendJsonResponse(int code, const char* status, const char* message);
 void mqttCallback(char* topic, byte* payload, unsigned int length);
 void reconnectMQTT();
-void publishStatus();
+void publishStatus(uint8_t gate);
 void publishSensors();
+void publishConfig();
+bool applyConfigUpdate(JsonObjectConst patch, const char*& error);
+GateCommandOutcome dispatchCommand(uint8_t gate, GateCommand command, uint8_t percentage);
+uint8_t runCommand(uint8_t gate, GateCommand command, uint8_t percentage, const char* commandId,
+                   uint32_t sentAt, bool& duplicate);
+void flushCommandAcks();
+void commandsJson(JsonObject out);
+void setupSchedules();
+void applyTimeZone(const char* tz);
+bool applyScheduleUpdate(JsonObjectConst doc, const char*& error);
+void runSchedules();
+void executeSchedule(const ScheduleEntry& entry, time_t dueAt);
+void scheduleStateJson(JsonObject out);
+void publishScheduleState();
+bool publishScheduleRun(const ScheduleRun& run);
+void flushScheduleRuns();
+bool publishGuestUse(const GuestUse& use);
+void flushGuestUses();
+void syncGroupSubscriptions(bool resubscribe);
+void handleGroupCommand(JsonObjectConst doc, const char* group);
+void runGroupCommand(uint8_t gate);
+void cancelGroupCommand(uint8_t gate);
+void publishGroupAck(uint8_t gate, const char* requestId, const char* group, uint8_t status,
+                     uint32_t delayMs);
+void setupAcquisition();
 void readSensors();
-void updateGatePosition();
-void checkSafetyConditions();
-void stopGate();
-void openGate();
-void closeGate();
-void setGatePercentage(uint8_t percent);
-String getStateString(GateState state);
+void acquisitionJson(JsonObject out);
+bool readInput(uint8_t pin);
+void traceCommand(GateCommand command, uint8_t percentage);
+void stopTrace();
+void writeTraceRecords();
+void drainTrace();
+void setupEventLog();
+void logDrainTask(void* param);
+void writeLogRecord(const LogRecord& record, uint64_t uptimeUs);
+void appendLogFile(const LogRecord& record, uint64_t uptimeUs);
+void closeLogFile();
+void batchLogRecord(const LogRecord& record, uint64_t uptimeUs);
+void sealLogBatch();
+void publishLogBatch();
+void handleLog();
+void handleLogUpdate();
+void handleLogDownload();
+bool gatesIdle();
+void handleOtaStatus();
+void handleOtaUpload();
+void handleOtaUploadDone();
+void applyOtaRequest(JsonObjectConst doc);
+void publishOtaState();
+void setupMCSA();
+void beginSignature(uint8_t direction);
+void endSignature();
+void drainSignature();
+void publishMaintenance(uint8_t direction, const MotorFeatures& features,
+                        const float* scores, uint8_t alerts);
+void gateStatusJson(const StatusSnapshot& status, uint8_t gate, JsonObject out);
+void serviceGate(uint8_t gate);
+void setupPower();
+void setupSafetyTimer();
+PowerInputs powerInputs();
+void setupLan();
+void updateLanKey();
+void serviceLan();
+void lanJson(JsonObject out);
 
 // =============================================================================
 // Setup
@@ -101,25 +352,77 @@ void setup() {
   Serial.printf("   Firmware: %s\n", FIRMWARE_VERSION);
   Serial.println("========================================\n");
 
+  // Start draining the event log before anything is logged
+  if constexpr (BuildFeatures::logging) {
+    setupEventLog();
+  }
+  
+  // A new image on trial that keeps resetting goes back to the previous one
+  if constexpr (BuildFeatures::ota) {
+    otaUpdate.begin();
+  }
+  
+  // Load runtime configuration (single versioned blob)
+  configStore.begin();
+  
   // Initialize GPIO
   setupGPIO();
   
+  // ADC calibration and the sensor channels
+  if constexpr (BuildFeatures::sensors) {
+    setupAcquisition();
+  }
+  
+  // Restore gate state from RTC/flash and reconcile with limit switches
+  restoreGateState();
+  
+  // commandIds run before a reset, so redeliveries are not run again
+  commandDelivery.begin(rtcCommandLog);
+  
+  // Start high-rate current sampling for predictive maintenance
+  if constexpr (BuildFeatures::mcsa) {
+    setupMCSA();
+  }
+  
   // Initialize WiFi
   setupWiFi();
   
+  // Load stored schedules and start SNTP in their time zone
+  setupSchedules();
+  
+  // Load the guest key and revocation filter
+  if constexpr (BuildFeatures::guestAccess) {
+    guestAccess.begin();
+  }
+  
   // Initialize MQTT
-  if (ENABLE_MQTT) {
+  if constexpr (BuildFeatures::mqtt) {
     setupMQTT();
   }
   
   // Initialize Web Server
   setupWebServer();
   
+  // mDNS advertisement and the UDP command port
+  if constexpr (BuildFeatures::lan) {
+    setupLan();
+  }
+  
   // Initialize OTA
-  if (ENABLE_OTA) {
+  if constexpr (BuildFeatures::ota) {
     setupOTA();
   }
   
+  // Idle mode between events: wake pins, clock scaling, radio sleep
+  if constexpr (BuildFeatures::powerSave) {
+    setupPower();
+  }
+  
+  // Safety path through every branch, timed against its budget
+  if constexpr (BuildFeatures::safetyWcet) {
+    setupSafetyTimer();
+  }
+  
   // Enable watchdog
   esp_task_wdt_init(WATCHDOG_TIMEOUT_S, true);
   esp_task_wdt_add(NULL);
@@ -133,48 +436,115 @@ void setup() {
 // =============================================================================
 
 void loop() {
+  loopProfiler.begin();
+  
   // Reset watchdog
   esp_task_wdt_reset();
   
   // Handle web server requests
   server.handleClient();
   
-  // Handle OTA updates
-  if (ENABLE_OTA) {
-    ElegantOTA.loop();
+  // Handle OTA updates: full images, pulled patches, trial confirmation
+  if constexpr (BuildFeatures::ota) {
+    Ota::loop();
+    bool online = WiFi.status() == WL_CONNECTED && (!BuildFeatures::mqtt || mqttClient.connected());
+    otaUpdate.loop(gatesIdle(), online);
+    if (otaUpdate.takeChanged()) publishOtaState();
   }
   
   // Handle MQTT
-  if (ENABLE_MQTT) {
+  if constexpr (BuildFeatures::mqtt) {
     if (!mqttClient.connected()) {
       reconnectMQTT();
     }
-    mqttClient.loop();
+    
+    // A burst of queued commands is drained over a few packets per pass,
+    // between the safety passes
+    uint8_t packets = 0;
+    do {
+      mqttClient.loop();
+    } while (++packets < MQTT_PACKETS_PER_PASS && mqttLink.available());
+  }
+  
+  // Commands from the LAN, answered in the same pass
+  if constexpr (BuildFeatures::lan) {
+    serviceLan();
   }
   
-  // Read sensors periodically
-  if (millis() - lastSensorRead >= SENSOR_READ_INTERVAL) {
+  // Sensor channels due in this pass, filtered
+  if constexpr (BuildFeatures::sensors) {
     readSensors();
+  }
+  
+  // Report sensors periodically
+  if (BuildFeatures::sensors &&
+      millis() - lastSensorRead >= configStore.active().sensorReadInterval) {
+    sensorData.wifiSignal = WiFi.RSSI();
     lastSensorRead = millis();
     
     // Publish to MQTT
-    if (ENABLE_MQTT && mqttClient.connected()) {
+    if (BuildFeatures::mqtt && mqttClient.connected()) {
       publishSensors();
     }
   }
   
-  // Update gate position during movement
-  if (deviceState.gateState == GATE_OPENING || deviceState.gateState == GATE_CLOSING) {
-    updateGatePosition();
-    checkSafetyConditions();
+  if constexpr (BuildFeatures::mcsa) {
+    if (gates[0].moving()) drainSignature();
+  }
+  
+  // Relay interlock, position steps and safety rules of every gate
+  const GateConfig& cfg = configStore.active();
+  SafetyLimits limits = {cfg.maxOperationTime, cfg.maxCurrent, cfg.maxTemperature,
+                         OBSTACLE_DEBOUNCE_MS};
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    safetyTimer.pass(gates[i], millis(), limits, sensorData.temperature);
+    
+    // Start a staggered group command once its delay has passed
+    const GroupCommand& pending = groupCommands[i];
+    if (pending.pending && millis() - pending.receivedAt >= pending.delayMs) {
+      runGroupCommand(i);
+    }
+    serviceGate(i);
+  }
+  
+  // Run due schedules from the local clock
+  if (millis() - lastScheduleTick >= SCHEDULE_TICK_MS) {
+    runSchedules();
+    lastScheduleTick = millis();
+  }
+  
+  // Persist gate states (coalesced flash writes while idle)
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    stateStores[i].loop(gates[i].moving());
+  }
+  
+  // Stream recorded trace records
+  if constexpr (BuildFeatures::trace) {
+    drainTrace();
+  }
+  
+  // Publish an event log batch sealed by the drain task
+  if constexpr (BuildFeatures::logging && BuildFeatures::mqtt) {
+    publishLogBatch();
   }
   
-  // Blink status LED based on state
+  // Blink status LED based on state; while idle, one lit pass per period
   static unsigned long lastBlink = 0;
-  if (millis() - lastBlink >= (WiFi.status() == WL_CONNECTED ? 1000 : 200)) {
+  if (BuildFeatures::powerSave && power.mode() == POWER_IDLE) {
+    bool blip = millis() - lastBlink >= POWER_BLINK_MS;
+    digitalWrite(STATUS_LED, blip);
+    if (blip) lastBlink = millis();
+  } else if (millis() - lastBlink >= (WiFi.status() == WL_CONNECTED ? 1000 : 200)) {
     digitalWrite(STATUS_LED, !digitalRead(STATUS_LED));
     lastBlink = millis();
   }
+  
+  loopProfiler.end();
+  
+  // While idle, sleep until a wake pin edge or the end of the slice
+  if constexpr (BuildFeatures::powerSave) {
+    if (power.service(powerInputs())) deviceState.lastActivity = millis();
+  }
 }
 
 // =============================================================================
@@ -182,11 +552,17 @@ void loop() {
 // =============================================================================
 
 void setupGPIO() {
-  // Relay outputs
-  pinMode(RELAY_OPEN, OUTPUT);
-  pinMode(RELAY_CLOSE, OUTPUT);
-  digitalWrite(RELAY_OPEN, LOW);
-  digitalWrite(RELAY_CLOSE, LOW);
+  // Per gate: relay outputs (released), limit switches, obstacle and current
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    const GatePins& pins = gateDescriptors[i].pins;
+    pinMode(pins.relayOpen, OUTPUT);
+    pinMode(pins.relayClose, OUTPUT);
+    pinMode(pins.limitOpen, INPUT_PULLUP);
+    pinMode(pins.limitClose, INPUT_PULLUP);
+    pinMode(pins.obstacle, INPUT);
+    pinMode(pins.currentSensor, INPUT);
+    gates[i].begin(gateDescriptors[i], i, gpioBoard, DEVICE_NAME);
+  }
   
   // Status LED
   pinMode(STATUS_LED, OUTPUT);
@@ -197,17 +573,34 @@ void setupGPIO() {
   pinMode(BUTTON_STOP, INPUT_PULLUP);
   pinMode(BUTTON_RESET, INPUT_PULLUP);
   
-  // Sensor inputs
-  pinMode(CURRENT_SENSOR, INPUT);
+  // Shared sensor inputs
   pinMode(VOLTAGE_SENSOR, INPUT);
   pinMode(TEMP_SENSOR, INPUT);
-  pinMode(OBSTACLE_SENSOR, INPUT);
-  
-  // Limit switches
-  pinMode(LIMIT_OPEN, INPUT_PULLUP);
-  pinMode(LIMIT_CLOSE, INPUT_PULLUP);
   
-  Serial.println("✓ GPIO initialized");
+  Serial.printf("✓ GPIO initialized (%u gates)\n", GATE_COUNT);
+}
+
+// =============================================================================
+// State Restore
+// =============================================================================
+
+void restoreGateState() {
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    unsigned long start = micros();
+    uint8_t state = GATE_CLOSED;
+    uint8_t percentage = 0;
+    bool restored = stateStores[i].restore(i, state, percentage);
+    
+    // Limit switches are ground truth; otherwise trust the snapshot
+    gates[i].restore(state, percentage);
+    gates[i].takeEvents();
+    stateStores[i].record(gates[i].getState(), gates[i].getPercentage());
+    
+    Serial.printf("✓ Gate %s state %s: %s at %d%% (%lu us)\n", gates[i].getDeviceId(),
+                  restored ? "restored" : "defaulted",
+                  gateStateName(gates[i].getState()),
+                  gates[i].getPercentage(), micros() - start);
+  }
 }
 
 // =============================================================================
@@ -234,9 +627,12 @@ void setupWiFi() {
 // =============================================================================
 
 void setupMQTT() {
-  mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
+  mqttClient.setServer(MQTT_SERVER, MqttLink::port);
   mqttClient.setCallback(mqttCallback);
-  mqttClient.setBufferSize(512);
+  mqttClient.setBufferSize(4096);   // Full schedule set in one message
+  if constexpr (BuildFeatures::powerSave) {
+    mqttClient.setKeepAlive(POWER_MQTT_KEEPALIVE_S);
+  }
   Serial.println("✓ MQTT configured");
 }
 
@@ -245,84 +641,425 @@ void reconnectMQTT() {
   lastMqttReconnect = millis();
   
   Serial.print("Connecting to MQTT...");
-  String clientId = String(MQTT_CLIENT_ID) + "-" + String(random(0xffff), HEX);
   
-  if (mqttClient.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD)) {
+  // The broker keeps the session of a stable client id: QoS 1 commands
+  // sent while the device was away are delivered after the reconnect
+  char clientId[48];
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(clientId, sizeof(clientId), "%s-%06lx", MQTT_CLIENT_ID,
+           (unsigned long)((mac >> 24) & 0xffffff));
+  
+  if (mqttClient.connect(clientId, MQTT_USER, MQTT_PASSWORD, nullptr, 0, false, nullptr, false)) {
     Serial.println("connected");
     
-    // Subscribe to command topic
-    String cmdTopic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_COMMANDS;
-    mqttClient.subscribe(cmdTopic.c_str());
+    // Subscribe to each gate's command topic, QoS 1
+    for (uint8_t i = 0; i < GATE_COUNT; i++) {
+      String cmdTopic = String(MQTT_TOPIC_PREFIX) + gates[i].getDeviceId() + MQTT_TOPIC_COMMANDS;
+      mqttClient.subscribe(cmdTopic.c_str(), 1);
+    }
+    
+    // Subscribe to configuration updates
+    String configTopic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_CONFIG;
+    mqttClient.subscribe(configTopic.c_str());
+    
+    // Subscribe to schedule sets (retained by the backend)
+    String schedulesTopic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_SCHEDULES;
+    mqttClient.subscribe(schedulesTopic.c_str());
+    
+    // Subscribe to the guest key and revocation filter (retained)
+    if constexpr (BuildFeatures::guestAccess) {
+      String guestTopic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_GUEST;
+      mqttClient.subscribe(guestTopic.c_str());
+    }
+    
+    // Subscribe to patch update requests
+    if constexpr (BuildFeatures::ota) {
+      String otaTopic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_OTA;
+      mqttClient.subscribe(otaTopic.c_str());
+    }
+    
+    // Subscribe to the broadcast and configured group command topics
+    syncGroupSubscriptions(true);
     
     // Publish online status
-    publishStatus();
+    for (uint8_t i = 0; i < GATE_COUNT; i++) {
+      publishStatus(i);
+    }
+    publishConfig();
+    publishScheduleState();
+    flushScheduleRuns();
+    flushGuestUses();
+    flushCommandAcks();
+    if constexpr (BuildFeatures::ota) {
+      publishOtaState();
+    }
   } else {
     Serial.printf("failed (rc=%d)\n", mqttClient.state());
   }
 }
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  String message;
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
+  LOG_EVENT(LOG_MQTT_RECEIVED, LogTail(topic), length);
+  deviceState.lastActivity = millis();
+  
+  JsonDocument doc;
+  if (deserializeJson(doc, (const char*)payload, length)) return;
+  
+  // Group or broadcast command: filtered and staggered per device
+  char group[GROUP_NAME_MAX + 1];
+  if (parseGroupTopic(topic, group, sizeof(group))) {
+    handleGroupCommand(doc.as<JsonObjectConst>(), group);
+    return;
+  }
+  
+  // Configuration update: one staged commit for all fields
+  size_t topicLen = strlen(topic);
+  size_t configLen = strlen(MQTT_TOPIC_CONFIG);
+  if (topicLen >= configLen && strcmp(topic + topicLen - configLen, MQTT_TOPIC_CONFIG) == 0) {
+    const char* error = nullptr;
+    if (!applyConfigUpdate(doc.as<JsonObjectConst>(), error)) {
+      LOG_EVENT(LOG_CONFIG_REJECTED, error);
+    }
+    return;
   }
   
-  Serial.printf("MQTT: %s -> %s\n", topic, message.c_str());
+  // Schedule set: replaces the stored set as a whole
+  size_t schedulesLen = strlen(MQTT_TOPIC_SCHEDULES);
+  if (topicLen >= schedulesLen &&
+      strcmp(topic + topicLen - schedulesLen, MQTT_TOPIC_SCHEDULES) == 0) {
+    const char* error = nullptr;
+    if (!applyScheduleUpdate(doc.as<JsonObjectConst>(), error)) {
+      LOG_EVENT(LOG_SCHEDULES_REJECTED, error);
+    }
+    return;
+  }
   
-  JsonDocument doc;
-  if (deserializeJson(doc, message)) return;
+  // Guest revocation filter and LAN key ids (the key is provisioned over the LAN)
+  size_t guestLen = strlen(MQTT_TOPIC_GUEST);
+  if (BuildFeatures::guestAccess && topicLen >= guestLen &&
+      strcmp(topic + topicLen - guestLen, MQTT_TOPIC_GUEST) == 0) {
+    const char* error = nullptr;
+    if (guestAccess.applySync(doc.as<JsonObjectConst>(), error)) {
+      LOG_EVENT(LOG_GUEST_KEYS_UPDATED);
+      if constexpr (BuildFeatures::lan) updateLanKey();
+    } else {
+      LOG_EVENT(LOG_GUEST_KEYS_REJECTED, error);
+    }
+    return;
+  }
+  
+  // Patch update: pulled and applied from loop()
+  size_t otaLen = strlen(MQTT_TOPIC_OTA);
+  if (BuildFeatures::ota && topicLen >= otaLen &&
+      strcmp(topic + topicLen - otaLen, MQTT_TOPIC_OTA) == 0) {
+    applyOtaRequest(doc.as<JsonObjectConst>());
+    return;
+  }
   
-  const char* command = doc["command"];
-  if (!command) return;
+  // Gate command: gatemate/devices/<gate id>/commands
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    String cmdTopic = String(MQTT_TOPIC_PREFIX) + gates[i].getDeviceId() + MQTT_TOPIC_COMMANDS;
+    if (cmdTopic != topic) continue;
+    GateCommand command = parseGateCommand(doc["command"]);
+    uint8_t percentage = doc["percentage"] | 50;
+    
+    // Without an id the command is run as before, without an ack
+    if (doc["commandId"].isNull()) {
+      if (dispatchCommand(i, command, percentage) != GATE_OUTCOME_INVALID) {
+        publishStatus(i);
+      }
+      return;
+    }
+    const char* commandId = doc["commandId"] | "";
+    if (!commandIdValid(commandId)) {
+      LOG_EVENT(LOG_COMMAND_INVALID, gates[i].getDeviceId());
+      return;
+    }
+    
+    // Acked every time it arrives. The ack is queued before the callback
+    // returns, so the broker only sees the PUBACK once the outcome is in
+    // the log.
+    bool duplicate = false;
+    uint8_t status = runCommand(i, command, percentage, commandId, doc["sentAt"] | 0u, duplicate);
+    commandDelivery.queueAck(i, commandId, duplicate, status, millis());
+    flushCommandAcks();
+    return;
+  }
+}
+
+// A command with an id, from MQTT or the LAN: run at most once. Returns
+// the outcome, for a duplicate the one of its first run.
+uint8_t runCommand(uint8_t gate, GateCommand command, uint8_t percentage, const char* commandId,
+                   uint32_t sentAt, bool& duplicate) {
+  uint32_t now = clockSynced ? (uint32_t)time(nullptr) : 0;
+  CommandVerdict verdict = commandDelivery.accept(gate, commandId, sentAt, now);
+  uint8_t status = verdict.status;
+  if (verdict.run) {
+    status = dispatchCommand(gate, command, percentage) != GATE_OUTCOME_INVALID
+             ? CMD_ACK_EXECUTED : CMD_ACK_REJECTED;
+    if (status == CMD_ACK_EXECUTED) publishStatus(gate);
+  } else if (verdict.duplicate) {
+    LOG_EVENT(LOG_COMMAND_DUPLICATE, commandId, commandAckStatusName(status));
+  } else {
+    LOG_EVENT(LOG_COMMAND_EXPIRED, commandId, now - sentAt);
+  }
+  commandDelivery.record(gate, commandId, verdict, status);
+  duplicate = verdict.duplicate;
+  return status;
+}
+
+// Sends the queued acks while the link is up
+void flushCommandAcks() {
+  commandDelivery.flush(millis(), [](const CommandAck& ack, uint32_t latencyMs) {
+    if (!mqttClient.connected()) return false;
+    const Gate& g = gates[ack.gate];
+    char output[320];
+    formatCommandAck(output, sizeof(output), g.getDeviceId(), ack, g.getState(),
+                     g.getPercentage(), latencyMs);
+    String topic = String(MQTT_TOPIC_PREFIX) + g.getDeviceId() + MQTT_TOPIC_ACKS;
+    return mqttClient.publish(topic.c_str(), output);
+  });
+}
+
+void commandsJson(JsonObject out) {
+  const CommandStats& stats = commandDelivery.stats();
+  out["received"] = stats.received;
+  out["duplicates"] = stats.duplicates;
+  out["expired"] = stats.expired;
+  out["rejected"] = stats.rejected;
+  out["acked"] = stats.acked;
+  out["ackDropped"] = stats.ackDropped;
+  out["ackPending"] = commandDelivery.pending();
+  out["ackMaxMs"] = stats.ackMaxMs;
+  out["ackAvgMs"] = stats.acked ? stats.ackSumMs / stats.acked : 0;
+}
+
+// Runs a command on one gate from MQTT, the LAN, HTTP, a schedule, a group
+// command or a guest pass. GATE_OUTCOME_INVALID if unknown, IGNORED if the
+// gate's state had no transition for it.
+GateCommandOutcome dispatchCommand(uint8_t gate, GateCommand command, uint8_t percentage) {
+  deviceState.lastActivity = millis();
+  if (gate == 0) {
+    traceCommand(command, percentage);
+  }
   
-  if (strcmp(command, "open") == 0) {
-    openGate();
-  } else if (strcmp(command, "close") == 0) {
-    closeGate();
-  } else if (strcmp(command, "stop") == 0) {
-    stopGate();
-  } else if (strcmp(command, "partial") == 0) {
-    uint8_t percent = doc["percentage"] | 50;
-    setGatePercentage(percent);
+  // A stop command also drops a group command still waiting to start, even
+  // on a gate at rest (where the stop itself changes nothing)
+  if (command == GATE_CMD_STOP) {
+    cancelGroupCommand(gate);
   }
+  GateCommandOutcome outcome = gates[gate].command(command, percentage, millis());
+  if (outcome == GATE_OUTCOME_INVALID) return outcome;
+  serviceGate(gate);
+  return outcome;
+}
+
+void publishStatus(uint8_t gate) {
+  if (!mqttClient.connected()) return;
+  
+  const Gate& g = gates[gate];
+  char output[192];
+  formatStatusPayload(output, sizeof(output), g.getDeviceId(), g.getState(),
+                      g.getPercentage(), deviceState.isOnline,
+                      g.obstacleDetected(), millis());
+  
+  String topic = String(MQTT_TOPIC_PREFIX) + g.getDeviceId() + MQTT_TOPIC_STATUS;
+  mqttClient.publish(topic.c_str(), output, true);
+}
+
+void publishSensors() {
+  if (!mqttClient.connected()) return;
   
-  publishStatus();
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    char output[192];
+    formatSensorsPayload(output, sizeof(output), gates[i].getDeviceId(), gates[i].getCurrent(),
+                         sensorData.voltage, sensorData.temperature,
+                         sensorData.wifiSignal, millis());
+    
+    String topic = String(MQTT_TOPIC_PREFIX) + gates[i].getDeviceId() + MQTT_TOPIC_SENSORS;
+    mqttClient.publish(topic.c_str(), output);
+  }
 }
 
-void publishStatus() {
+void publishConfig() {
   if (!mqttClient.connected()) return;
   
   JsonDocument doc;
   doc["deviceId"] = DEVICE_NAME;
-  doc["state"] = getStateString(deviceState.gateState);
-  doc["percentage"] = deviceState.percentage;
-  doc["online"] = deviceState.isOnline;
-  doc["obstacle"] = deviceState.obstacleDetected;
-  doc["timestamp"] = millis();
+  ConfigStore::toJson(configStore.active(), doc["config"].to<JsonObject>());
   
   String output;
   serializeJson(doc, output);
   
-  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_STATUS;
+  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_CONFIG_STATE;
   mqttClient.publish(topic.c_str(), output.c_str(), true);
 }
 
-void publishSensors() {
+bool applyConfigUpdate(JsonObjectConst patch, const char*& error) {
+  GateConfig staged = configStore.edit();
+  
+  if (ConfigStore::applyJson(patch, staged) == 0) {
+    error = "No configuration fields";
+    return false;
+  }
+  if (!configStore.commit(staged)) {
+    error = "Configuration rejected";
+    return false;
+  }
+  
+  Serial.printf("✓ Configuration updated (rev %lu)\n",
+                (unsigned long)configStore.getRevision());
+  publishConfig();
+  syncGroupSubscriptions(false);
+  return true;
+}
+
+// =============================================================================
+// Group Commands
+// =============================================================================
+
+// Brings the group subscriptions in line with the configured list. After a
+// reconnect every topic is subscribed again; otherwise only the difference.
+void syncGroupSubscriptions(bool resubscribe) {
   if (!mqttClient.connected()) return;
+  const char* groups = configStore.active().groups;
+  if (!resubscribe && strcmp(groups, subscribedGroups) == 0) return;
   
-  JsonDocument doc;
-  doc["deviceId"] = DEVICE_NAME;
-  doc["current"] = sensorData.current;
-  doc["voltage"] = sensorData.voltage;
-  doc["temperature"] = sensorData.temperature;
-  doc["wifiSignal"] = sensorData.wifiSignal;
-  doc["timestamp"] = millis();
+  auto topicFor = [](const char* name, size_t length) {
+    return String(GROUP_TOPIC_PREFIX) + String(name).substring(0, length) + GROUP_TOPIC_SUFFIX;
+  };
   
-  String output;
-  serializeJson(doc, output);
+  if (resubscribe) {
+    mqttClient.subscribe(GROUP_TOPIC_BROADCAST);
+  } else {
+    forEachGroup(subscribedGroups, [&](const char* name, size_t length) {
+      if (!groupListContains(groups, name, length)) {
+        mqttClient.unsubscribe(topicFor(name, length).c_str());
+      }
+    });
+  }
+  forEachGroup(groups, [&](const char* name, size_t length) {
+    if (resubscribe || !groupListContains(subscribedGroups, name, length)) {
+      mqttClient.subscribe(topicFor(name, length).c_str());
+    }
+  });
   
-  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_SENSORS;
-  mqttClient.publish(topic.c_str(), output.c_str());
+  strlcpy(subscribedGroups, groups, sizeof(subscribedGroups));
+  Serial.printf("✓ Groups: %s\n", *groups ? groups : "(none)");
+}
+
+static bool jsonListContains(JsonArrayConst list, const char* value) {
+  for (JsonVariantConst entry : list) {
+    if (strcmp(entry | "", value) == 0) return true;
+  }
+  return false;
+}
+
+// Every gate is addressed, delayed and acknowledged under its own id
+void handleGroupCommand(JsonObjectConst doc, const char* group) {
+  const char* requestId = doc["requestId"] | "";
+  if (!groupRequestIdValid(requestId)) {
+    LOG_EVENT(LOG_GROUP_INVALID);
+    return;
+  }
+  
+  // Same request through another group or the broadcast topic
+  if (!seenGroupRequests.insert(requestId)) return;
+  
+  JsonObjectConst targets = doc["targets"];
+  JsonArrayConst devices = targets["devices"];
+  GateCommand command = parseGateCommand(doc["command"]);
+  bool expired = commandExpired(doc["sentAt"] | 0, clockSynced ? (uint32_t)time(nullptr) : 0);
+  
+  uint8_t stateMask = 0;
+  for (JsonVariantConst name : targets["states"].as<JsonArrayConst>()) {
+    GateState state;
+    if (parseGateState(name | "", state)) stateMask |= 1 << state;
+  }
+  
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    // Gates the request does not address stay silent
+    const char* gateId = gates[i].getDeviceId();
+    if (!devices.isNull() && !jsonListContains(devices, gateId)) continue;
+    if (jsonListContains(targets["exclude"], gateId)) continue;
+    
+    if (command == GATE_CMD_NONE) {
+      publishGroupAck(i, requestId, group, GROUP_ACK_REJECTED, 0);
+      continue;
+    }
+    if (expired) {
+      publishGroupAck(i, requestId, group, GROUP_ACK_EXPIRED, 0);
+      continue;
+    }
+    
+    // A newer request replaces one still waiting
+    cancelGroupCommand(i);
+    
+    GroupCommand& pending = groupCommands[i];
+    pending.pending = true;
+    pending.command = command;
+    pending.percentage = doc["percentage"] | 50;
+    pending.stateMask = stateMask;
+    strlcpy(pending.requestId, requestId, sizeof(pending.requestId));
+    strlcpy(pending.group, group, sizeof(pending.group));
+    pending.receivedAt = millis();
+    
+    // STOP is never delayed. Gates of one controller take consecutive
+    // slots so they do not start on the same supply at once.
+    pending.delayMs = command == GATE_CMD_STOP ? 0 :
+      groupCommandDelay(gateId, requestId, configStore.active().groupSlot + i,
+                        doc["staggerMs"] | 0, doc["jitterMs"] | 0);
+    
+    if (pending.delayMs == 0) {
+      runGroupCommand(i);
+    } else {
+      LOG_EVENT(LOG_GROUP_DELAYED, command, gateId, pending.delayMs);
+    }
+  }
+}
+
+void runGroupCommand(uint8_t gate) {
+  GroupCommand run = groupCommands[gate];
+  groupCommands[gate].pending = false;
+  
+  // State filter is checked when the command starts, not when it arrived
+  if (run.stateMask && !(run.stateMask & (1 << gates[gate].getState()))) {
+    publishGroupAck(gate, run.requestId, run.group, GROUP_ACK_SKIPPED, run.delayMs);
+    return;
+  }
+  
+  // Only a real transition counts as executed, so the backend's per-group
+  // summary does not report e.g. "open" on an already open gate as done
+  GateCommandOutcome outcome = dispatchCommand(gate, run.command, run.percentage);
+  if (outcome != GATE_OUTCOME_APPLIED) {
+    publishGroupAck(gate, run.requestId, run.group,
+                    outcome == GATE_OUTCOME_IGNORED ? GROUP_ACK_IGNORED : GROUP_ACK_REJECTED,
+                    run.delayMs);
+    return;
+  }
+  publishStatus(gate);
+  publishGroupAck(gate, run.requestId, run.group, GROUP_ACK_EXECUTED, run.delayMs);
+}
+
+void cancelGroupCommand(uint8_t gate) {
+  GroupCommand& pending = groupCommands[gate];
+  if (!pending.pending) return;
+  pending.pending = false;
+  publishGroupAck(gate, pending.requestId, pending.group, GROUP_ACK_SUPERSEDED,
+                  pending.delayMs);
+}
+
+void publishGroupAck(uint8_t gate, const char* requestId, const char* group, uint8_t status,
+                     uint32_t delayMs) {
+  if (!mqttClient.connected()) return;
+  
+  const Gate& g = gates[gate];
+  char output[256];
+  formatGroupAck(output, sizeof(output), g.getDeviceId(), requestId, group, status, delayMs,
+                 g.getState(), g.getPercentage());
+  
+  String topic = String(MQTT_TOPIC_PREFIX) + g.getDeviceId() + MQTT_TOPIC_ACKS;
+  mqttClient.publish(topic.c_str(), output);
 }
 
 // =============================================================================
@@ -330,41 +1067,132 @@ void publishSensors() {
 // =============================================================================
 
 void setupWebServer() {
+  // If-None-Match for the cached responses; only collected headers are kept
+  static const char* collectedHeaders[] = {"If-None-Match"};
+  server.collectHeaders(collectedHeaders, 1);
+  
+  // Bodies that only change with the address or config, rendered up front;
+  // a boot id in the ETags keeps them apart from the last boot's
+  httpBootId = esp_random();
+  renderRoot(WiFi.localIP());
+  renderConfig(((uint64_t)(uint32_t)WiFi.localIP() << 32) | configStore.getRevision());
+  
   // API Routes
   server.on("/", HTTP_GET, handleRoot);
   server.on("/status", HTTP_GET, handleStatus);
-  server.on("/open", HTTP_GET, handleOpen);
-  server.on("/open", HTTP_POST, handleOpen);
-  server.on("/close", HTTP_GET, handleClose);
-  server.on("/close", HTTP_POST, handleClose);
-  server.on("/stop", HTTP_GET, handleStop);
-  server.on("/stop", HTTP_POST, handleStop);
-  server.on("/partial", HTTP_POST, handlePartial);
+  server.on("/open", HTTP_GET, [] { handleGateCommand(0, GATE_CMD_OPEN); });
+  server.on("/open", HTTP_POST, [] { handleGateCommand(0, GATE_CMD_OPEN); });
+  server.on("/close", HTTP_GET, [] { handleGateCommand(0, GATE_CMD_CLOSE); });
+  server.on("/close", HTTP_POST, [] { handleGateCommand(0, GATE_CMD_CLOSE); });
+  server.on("/stop", HTTP_GET, [] { handleGateCommand(0, GATE_CMD_STOP); });
+  server.on("/stop", HTTP_POST, [] { handleGateCommand(0, GATE_CMD_STOP); });
+  server.on("/partial", HTTP_POST, [] { handleGateCommand(0, GATE_CMD_PARTIAL); });
+  server.on("/gates", HTTP_GET, handleGates);
+  
+  // The same per gate: /gates/<n>/status, /open, /close, /stop, /partial
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    String base = String("/gates/") + i;
+    server.on(base + "/status", HTTP_GET, [i] { handleGateStatus(i); });
+    server.on(base + "/open", HTTP_POST, [i] { handleGateCommand(i, GATE_CMD_OPEN); });
+    server.on(base + "/close", HTTP_POST, [i] { handleGateCommand(i, GATE_CMD_CLOSE); });
+    server.on(base + "/stop", HTTP_POST, [i] { handleGateCommand(i, GATE_CMD_STOP); });
+    server.on(base + "/partial", HTTP_POST, [i] { handleGateCommand(i, GATE_CMD_PARTIAL); });
+  }
+  
   server.on("/config", HTTP_GET, handleConfig);
+  server.on("/config", HTTP_POST, handleConfigUpdate);
   server.on("/factory-reset", HTTP_POST, handleFactoryReset);
+  server.on("/history", HTTP_GET, handleHistory);
+  server.on("/history/operations", HTTP_GET, handleOperationHistory);
+  server.on("/schedules", HTTP_GET, handleSchedules);
+  if constexpr (BuildFeatures::guestAccess) {
+    server.on("/guest", HTTP_GET, handleGuestStatus);
+    server.on("/guest", HTTP_POST, handleGuestAccess);
+    server.on("/guest/key", HTTP_POST, handleGuestKey);
+  }
+  if constexpr (BuildFeatures::trace) {
+    server.on("/trace", HTTP_GET, handleTraceDownload);
+    server.on("/trace/start", HTTP_POST, handleTraceStart);
+    server.on("/trace/stop", HTTP_POST, handleTraceStop);
+  }
+  if constexpr (BuildFeatures::logging) {
+    server.on("/log", HTTP_GET, handleLog);
+    server.on("/log", HTTP_POST, handleLogUpdate);
+    server.on("/log/file", HTTP_GET, handleLogDownload);
+  }
+  if constexpr (BuildFeatures::ota) {
+    server.on("/ota", HTTP_GET, handleOtaStatus);
+    server.on("/ota", HTTP_POST, handleOtaUploadDone, handleOtaUpload);
+  }
   
   // Enable CORS
   server.enableCORS(true);
   
   server.begin();
   Serial.println("✓ Web server started");
+  
+  if constexpr (BuildFeatures::https) {
+    if (httpsFront.begin(HTTPS_PORT, WEB_SERVER_PORT, WEB_LOOPBACK_PORT)) {
+      Serial.printf("✓ HTTPS on port %u\n", HTTPS_PORT);
+    } else {
+      Serial.println("⚠ HTTPS off: no usable " TLS_CERT_FILE " / " TLS_KEY_FILE ", plain HTTP");
+    }
+  }
 }
 
 void setupOTA() {
-  ElegantOTA.begin(&server);
-  Serial.println("✓ OTA enabled at /update");
+  Ota::begin(&server);
+  Serial.println("✓ OTA enabled at /update (image), /ota (patch)");
 }
 
 // =============================================================================
 // API Handlers
 // =============================================================================
 
-void handleRoot() {
+// Stores a rendered document; false if it does not fit the body
+template <size_t N>
+bool cacheJson(CachedBody<N>& body, JsonDocument& doc, uint64_t version, bool weak = false) {
+  size_t length = measureJson(doc);
+  if (length >= N) {
+    body.invalidate();
+    return false;
+  }
+  serializeJson(doc, body.buffer(), N);
+  return body.commit(length, httpBootId, version, weak);
+}
+
+// 304 if the request's If-None-Match holds the body's ETag
+template <size_t N>
+bool sendNotModified(const CachedBody<N>& body) {
+  server.sendHeader("ETag", body.etag());
+  server.sendHeader("Cache-Control", "no-cache");
+  if (!etagMatches(server.header("If-None-Match").c_str(), body.etag())) return false;
+  server.send(304);
+  return true;
+}
+
+// After sendNotModified(); the fields of tail (a JSON object) are appended
+template <size_t N>
+void sendCached(const CachedBody<N>& body, const char* tail = nullptr) {
+  size_t tailLength = tail ? strlen(tail) : 0;
+  if (tailLength <= 2) {
+    server.send_P(200, "application/json", body.body(), body.size());
+    return;
+  }
+  
+  // The body without its closing brace, a comma, the tail without its opening one
+  server.setContentLength(body.size() + tailLength - 1);
+  server.send(200, "application/json", "");
+  server.sendContent(body.body(), body.size() - 1);
+  server.sendContent(",", 1);
+  server.sendContent(tail + 1, tailLength - 1);
+}
+
+bool renderRoot(uint32_t ip) {
   JsonDocument doc;
   doc["device"] = DEVICE_NAME;
   doc["version"] = FIRMWARE_VERSION;
-  doc["uptime"] = millis() / 1000;
-  doc["ip"] = WiFi.localIP().toString();
+  doc["ip"] = IPAddress(ip).toString();
   
   JsonObject endpoints = doc["endpoints"].to<JsonObject>();
   endpoints["status"] = "/status";
@@ -372,92 +1200,260 @@ void handleRoot() {
   endpoints["close"] = "/close";
   endpoints["stop"] = "/stop";
   endpoints["partial"] = "/partial";
+  endpoints["gates"] = "/gates";
   endpoints["config"] = "/config";
-  endpoints["ota"] = "/update";
-  
-  String output;
-  serializeJson(doc, output);
-  server.send(200, "application/json", output);
-}
-
-void handleStatus() {
-  JsonDocument doc;
-  doc["state"] = getStateString(deviceState.gateState);
-  doc["percentage"] = deviceState.percentage;
-  doc["online"] = deviceState.isOnline;
-  doc["obstacle"] = deviceState.obstacleDetected;
-  
-  JsonObject sensors = doc["sensors"].to<JsonObject>();
-  sensors["current"] = sensorData.current;
-  sensors["voltage"] = sensorData.voltage;
-  sensors["temperature"] = sensorData.temperature;
-  sensors["wifiSignal"] = sensorData.wifiSignal;
+  endpoints["history"] = "/history";
+  endpoints["schedules"] = "/schedules";
+  if constexpr (BuildFeatures::guestAccess) {
+    endpoints["guest"] = "/guest";
+  }
+  if constexpr (BuildFeatures::trace) {
+    endpoints["trace"] = "/trace";
+  }
+  if constexpr (BuildFeatures::ota) {
+    endpoints["ota"] = "/update";
+    endpoints["otaPatch"] = "/ota";
+  }
   
-  String output;
-  serializeJson(doc, output);
-  server.send(200, "application/json", output);
+  return cacheJson(rootBody, doc, ip, true);
 }
 
-void handleOpen() {
-  if (millis() - lastCommandTime < COMMAND_COOLDOWN_MS) {
-    sendJsonResponse(429, "error", "Too many requests");
+// Rendered at boot and when the address changes; uptime is added per request
+void handleRoot() {
+  uint32_t ip = WiFi.localIP();
+  if (!rootBody.current(ip) && !renderRoot(ip)) {
+    sendJsonResponse(500, "error", "Response too large");
     return;
   }
-  lastCommandTime = millis();
+  if (sendNotModified(rootBody)) return;
   
-  openGate();
-  sendJsonResponse(200, "success", "Gate opening");
+  char tail[32];
+  snprintf(tail, sizeof(tail), "{\"uptime\":%lu}", millis() / 1000);
+  sendCached(rootBody, tail);
 }
 
-void handleClose() {
-  if (millis() - lastCommandTime < COMMAND_COOLDOWN_MS) {
-    sendJsonResponse(429, "error", "Too many requests");
-    return;
+// Bumps statusVersion if what the status views show has changed
+uint32_t refreshStatusVersion() {
+  StatusSnapshot status = {};
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    status.state[i] = gates[i].getState();
+    status.percentage[i] = gates[i].getPercentage();
+    status.obstacle[i] = gates[i].obstacleDetected();
+    status.currentCa[i] = (int16_t)lroundf(gates[i].getCurrent() * 100.0f);
   }
-  lastCommandTime = millis();
-  
-  closeGate();
-  sendJsonResponse(200, "success", "Gate closing");
+  status.voltageDv = (int16_t)lroundf(sensorData.voltage * 10.0f);
+  status.temperatureDc = (int16_t)lroundf(sensorData.temperature * 10.0f);
+  status.wifiSignal = (int16_t)sensorData.wifiSignal;
+  status.online = deviceState.isOnline;
+  statusVersion.update(status);
+  return statusVersion.get();
 }
 
-void handleStop() {
-  stopGate();
-  sendJsonResponse(200, "success", "Gate stopped");
+void gateStatusJson(const StatusSnapshot& status, uint8_t gate, JsonObject out) {
+  out["state"] = gateStateName((GateState)status.state[gate]);
+  out["percentage"] = status.percentage[gate];
+  out["online"] = status.online;
+  out["obstacle"] = status.obstacle[gate];
 }
 
-void handlePartial() {
-  if (!server.hasArg("plain")) {
-    sendJsonResponse(400, "error", "Missing body");
-    return;
-  }
-  
-  JsonDocument doc;
-  if (deserializeJson(doc, server.arg("plain"))) {
-    sendJsonResponse(400, "error", "Invalid JSON");
-    return;
+// First gate, plus every gate when the controller drives more than one
+void handleStatus() {
+  uint32_t version = refreshStatusVersion();
+  if (!statusBody.current(version)) {
+    const StatusSnapshot& status = statusVersion.snapshot();
+    JsonDocument doc;
+    gateStatusJson(status, 0, doc.to<JsonObject>());
+    
+    JsonObject sensors = doc["sensors"].to<JsonObject>();
+    sensors["current"] = status.currentCa[0] / 100.0;
+    sensors["voltage"] = status.voltageDv / 10.0;
+    sensors["temperature"] = status.temperatureDc / 10.0;
+    sensors["wifiSignal"] = status.wifiSignal;
+    
+    if (GATE_COUNT > 1) {
+      JsonArray list = doc["gates"].to<JsonArray>();
+      for (uint8_t i = 0; i < GATE_COUNT; i++) {
+        JsonObject item = list.add<JsonObject>();
+        item["deviceId"] = gates[i].getDeviceId();
+        gateStatusJson(status, i, item);
+        item["current"] = status.currentCa[i] / 100.0;
+      }
+    }
+    
+    if (!cacheJson(statusBody, doc, version)) {
+      sendJsonResponse(500, "error", "Response too large");
+      return;
+    }
+  }
+  if (sendNotModified(statusBody)) return;
+  sendCached(statusBody);
+}
+
+void handleGates() {
+  uint32_t version = refreshStatusVersion();
+  if (!gatesBody.current(version)) {
+    const StatusSnapshot& status = statusVersion.snapshot();
+    JsonDocument doc;
+    JsonArray list = doc["gates"].to<JsonArray>();
+    for (uint8_t i = 0; i < GATE_COUNT; i++) {
+      JsonObject item = list.add<JsonObject>();
+      item["index"] = i;
+      item["id"] = gateDescriptors[i].id;
+      item["deviceId"] = gates[i].getDeviceId();
+      item["path"] = String("/gates/") + i;
+      gateStatusJson(status, i, item);
+    }
+    
+    if (!cacheJson(gatesBody, doc, version)) {
+      sendJsonResponse(500, "error", "Response too large");
+      return;
+    }
+  }
+  if (sendNotModified(gatesBody)) return;
+  sendCached(gatesBody);
+}
+
+void handleGateStatus(uint8_t gate) {
+  uint32_t version = refreshStatusVersion();
+  CachedBody<256>& body = gateStatusBody[gate];
+  if (!body.current(version)) {
+    const StatusSnapshot& status = statusVersion.snapshot();
+    JsonDocument doc;
+    doc["deviceId"] = gates[gate].getDeviceId();
+    gateStatusJson(status, gate, doc.as<JsonObject>());
+    
+    JsonObject sensors = doc["sensors"].to<JsonObject>();
+    sensors["current"] = status.currentCa[gate] / 100.0;
+    sensors["voltage"] = status.voltageDv / 10.0;
+    sensors["temperature"] = status.temperatureDc / 10.0;
+    
+    if (!cacheJson(body, doc, version)) {
+      sendJsonResponse(500, "error", "Response too large");
+      return;
+    }
+  }
+  if (sendNotModified(body)) return;
+  sendCached(body);
+}
+
+// Open and close are rate limited per gate; partial takes {"percentage": n}
+void handleGateCommand(uint8_t gate, GateCommand command) {
+  uint8_t percent = command == GATE_CMD_OPEN ? 100 : 0;
+  
+  if (command == GATE_CMD_PARTIAL) {
+    if (!server.hasArg("plain")) {
+      sendJsonResponse(400, "error", "Missing body");
+      return;
+    }
+    
+    JsonDocument doc;
+    if (deserializeJson(doc, server.arg("plain"))) {
+      sendJsonResponse(400, "error", "Invalid JSON");
+      return;
+    }
+    
+    percent = doc["percentage"] | 50;
+    if (percent > 100) percent = 100;
   }
   
-  uint8_t percent = doc["percentage"] | 50;
-  if (percent > 100) percent = 100;
+  if (command == GATE_CMD_OPEN || command == GATE_CMD_CLOSE) {
+    if (gates[gate].inCooldown(millis(), configStore.active().commandCooldown)) {
+      sendJsonResponse(429, "error", "Too many requests");
+      return;
+    }
+    gates[gate].markCommand(millis());
+  }
   
-  setGatePercentage(percent);
-  sendJsonResponse(200, "success", "Moving to position");
+  dispatchCommand(gate, command, percent);
+  
+  switch (command) {
+    case GATE_CMD_OPEN:
+      sendJsonResponse(200, "success", "Gate opening");
+      break;
+    case GATE_CMD_CLOSE:
+      sendJsonResponse(200, "success", "Gate closing");
+      break;
+    case GATE_CMD_STOP:
+      sendJsonResponse(200, "success", "Gate stopped");
+      break;
+    default:
+      sendJsonResponse(200, "success", "Moving to position");
+      break;
+  }
 }
 
-void handleConfig() {
+// Version: address in the high half, config revision in the low one
+bool renderConfig(uint64_t version) {
   JsonDocument doc;
   doc["device"] = DEVICE_NAME;
   doc["version"] = FIRMWARE_VERSION;
   doc["mac"] = WiFi.macAddress();
-  doc["ip"] = WiFi.localIP().toString();
+  doc["ip"] = IPAddress((uint32_t)(version >> 32)).toString();
+  ConfigStore::toJson(configStore.active(), doc["settings"].to<JsonObject>());
+  return cacheJson(configBody, doc, version, true);
+}
+
+// Identity and settings are cached; the link and heap diagnostics are not
+void handleConfig() {
+  uint64_t version = ((uint64_t)(uint32_t)WiFi.localIP() << 32) | configStore.getRevision();
+  if (!configBody.current(version) && !renderConfig(version)) {
+    sendJsonResponse(500, "error", "Response too large");
+    return;
+  }
+  if (sendNotModified(configBody)) return;
+  
+  JsonDocument doc;
   doc["ssid"] = WiFi.SSID();
   doc["rssi"] = WiFi.RSSI();
   doc["freeHeap"] = ESP.getFreeHeap();
   doc["uptime"] = millis() / 1000;
+  loopProfiler.toJson(doc.as<JsonObject>());
+  if constexpr (BuildFeatures::mqtt) {
+    commandsJson(doc["commands"].to<JsonObject>());
+  }
+  if constexpr (BuildFeatures::lan) {
+    lanJson(doc["lan"].to<JsonObject>());
+  }
+  if constexpr (BuildFeatures::sensors) {
+    acquisitionJson(doc["acquisition"].to<JsonObject>());
+  }
+  if constexpr (BuildFeatures::safetyWcet) {
+    safetyTimer.toJson(doc["wcet"].to<JsonObject>());
+  }
+  if constexpr (BuildFeatures::powerSave) {
+    power.toJson(doc["power"].to<JsonObject>());
+  }
+  if constexpr (BuildFeatures::mqttTls) {
+    MqttLink::toJson(mqttLink, doc["tls"]["mqtt"].to<JsonObject>());
+  }
+  if constexpr (BuildFeatures::https) {
+    httpsFront.toJson(doc["tls"]["https"].to<JsonObject>());
+  }
   
-  String output;
-  serializeJson(doc, output);
-  server.send(200, "application/json", output);
+  String tail;
+  serializeJson(doc, tail);
+  sendCached(configBody, tail.c_str());
+}
+
+void handleConfigUpdate() {
+  if (!server.hasArg("plain")) {
+    sendJsonResponse(400, "error", "Missing body");
+    return;
+  }
+  
+  JsonDocument doc;
+  if (deserializeJson(doc, server.arg("plain"))) {
+    sendJsonResponse(400, "error", "Invalid JSON");
+    return;
+  }
+  
+  const char* error = nullptr;
+  if (!applyConfigUpdate(doc.as<JsonObjectConst>(), error)) {
+    sendJsonResponse(400, "error", error);
+    return;
+  }
+  
+  sendJsonResponse(200, "success", "Configuration updated");
 }
 
 void handleFactoryReset() {
@@ -467,6 +1463,259 @@ void handleFactoryReset() {
   ESP.restart();
 }
 
+// Streams buckets as chunked JSON; values are in 0.01 A / V / °C
+void handleHistory() {
+  String res = server.hasArg("res") ? server.arg("res") : String("1m");
+  uint8_t level;
+  if (res == "1s") level = SensorHistory::RES_SECOND;
+  else if (res == "1m") level = SensorHistory::RES_MINUTE;
+  else if (res == "1h") level = SensorHistory::RES_HOUR;
+  else {
+    sendJsonResponse(400, "error", "res must be 1s, 1m or 1h");
+    return;
+  }
+  
+  uint16_t count = sensorHistory.size(level);
+  uint16_t first = 0;
+  if (server.hasArg("limit")) {
+    int limit = server.arg("limit").toInt();
+    if (limit > 0 && limit < count) first = count - limit;
+  }
+  
+  char buffer[1024];
+  size_t used = snprintf(buffer, sizeof(buffer),
+    "{\"res\":\"%s\",\"interval\":%lu,\"now\":%lu,\"end\":%lu,\"scale\":0.01,"
+    "\"fields\":[\"currentMin\",\"currentMax\",\"currentMean\","
+    "\"voltageMin\",\"voltageMax\",\"voltageMean\","
+    "\"temperatureMin\",\"temperatureMax\",\"temperatureMean\"],\"data\":[",
+    res.c_str(), (unsigned long)SensorHistory::periodOf(level),
+    millis() / 1000, (unsigned long)sensorHistory.newestStart(level));
+  
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  
+  for (uint16_t i = first; i < count; i++) {
+    const HistoryBucket& b = sensorHistory.at(level, i);
+    char row[96];
+    int len;
+    if (SensorHistory::isEmpty(b)) {
+      len = snprintf(row, sizeof(row), "%snull", i > first ? "," : "");
+    } else {
+      len = snprintf(row, sizeof(row), "%s[%d,%d,%d,%d,%d,%d,%d,%d,%d]", i > first ? "," : "",
+                     b.min[CHANNEL_CURRENT], b.max[CHANNEL_CURRENT], b.mean[CHANNEL_CURRENT],
+                     b.min[CHANNEL_VOLTAGE], b.max[CHANNEL_VOLTAGE], b.mean[CHANNEL_VOLTAGE],
+                     b.min[CHANNEL_TEMPERATURE], b.max[CHANNEL_TEMPERATURE], b.mean[CHANNEL_TEMPERATURE]);
+    }
+    if (used + len + 3 > sizeof(buffer)) {
+      server.sendContent(buffer, used);
+      used = 0;
+    }
+    memcpy(buffer + used, row, len);
+    used += len;
+  }
+  
+  used += snprintf(buffer + used, sizeof(buffer) - used, "]}");
+  server.sendContent(buffer, used);
+  server.sendContent("");
+}
+
+// ?gate=<n> selects the gate (default 0)
+void handleOperationHistory() {
+  long gate = server.hasArg("gate") ? server.arg("gate").toInt() : 0;
+  if (gate < 0 || gate >= GATE_COUNT) {
+    sendJsonResponse(404, "error", "Unknown gate");
+    return;
+  }
+  
+  JsonDocument doc;
+  doc["deviceId"] = gates[gate].getDeviceId();
+  doc["now"] = millis() / 1000;
+  JsonArray operations = doc["operations"].to<JsonArray>();
+  
+  const auto& history = gates[gate].operations();
+  for (uint16_t i = 0; i < history.size(); i++) {
+    const OperationRecord& r = history.at(i);
+    JsonObject op = operations.add<JsonObject>();
+    op["startedAt"] = r.startedAt;
+    op["direction"] = r.direction == 0 ? "open" : "close";
+    op["durationMs"] = r.durationMs;
+    op["startPercentage"] = r.startPercentage;
+    op["endPercentage"] = r.endPercentage;
+    op["peakCurrent"] = r.peakCurrentMa / 1000.0f;
+    op["meanCurrent"] = r.meanCurrentMa / 1000.0f;
+    op["energy"] = r.energyMj / 1000.0f;
+    op["stopReason"] = stopReasonName(r.stopReason);
+  }
+  
+  String output;
+  serializeJson(doc, output);
+  server.send(200, "application/json", output);
+}
+
+// Body: {"token":"...","action":"open"}. Verified on the device, so a guest
+// gets in with this one request even while the backend is unreachable.
+void handleGuestAccess() {
+  if (!server.hasArg("plain")) {
+    sendJsonResponse(400, "error", "Missing body");
+    return;
+  }
+  
+  JsonDocument doc;
+  if (deserializeJson(doc, server.arg("plain"))) {
+    sendJsonResponse(400, "error", "Invalid JSON");
+    return;
+  }
+  
+  GateCommand command = parseGateCommand(doc["action"] | "open");
+  uint8_t permission = command == GATE_CMD_OPEN ? GUEST_PERM_OPEN :
+                       command == GATE_CMD_CLOSE ? GUEST_PERM_CLOSE : 0;
+  if (!permission) {
+    sendJsonResponse(400, "error", "Invalid action");
+    return;
+  }
+  
+  if (gates[0].inCooldown(millis(), configStore.active().commandCooldown)) {
+    sendJsonResponse(429, "error", "Too many requests");
+    return;
+  }
+  
+  // Saved time plus uptime when SNTP is unreachable (see guest_access.h)
+  uint32_t now = guestAccess.now(clockSynced, millis() / 1000);
+  GuestClaims claims;
+  GuestVerdict verdict = guestAccess.authorize(doc["token"] | "", permission, now, claims);
+  if (verdict != GUEST_OK) {
+    bool unavailable = verdict == GUEST_NO_KEY || verdict == GUEST_NO_CLOCK;
+    LOG_EVENT(LOG_GUEST_DENIED, guestVerdictName(verdict));
+    sendJsonResponse(unavailable ? 503 : 403, "error", guestVerdictName(verdict));
+    return;
+  }
+  gates[0].markCommand(millis());
+  
+  LOG_EVENT(LOG_GUEST_COMMAND, claims.id, command);
+  dispatchCommand(0, command, command == GATE_CMD_OPEN ? 100 : 0);
+  
+  GuestUse use = {};
+  strlcpy(use.passId, claims.id, sizeof(use.passId));
+  use.action = command;
+  use.at = now;
+  if (!publishGuestUse(use)) {
+    pendingGuestUses.push(use);
+  }
+  
+  sendJsonResponse(200, "success", command == GATE_CMD_OPEN ? "Gate opening" : "Gate closing");
+}
+
+// Body: {"key":"<hex>"} from the owner's app during setup, plus
+// "proof":"<hex>" to replace a key (see guest_access.h). The key never
+// travels over MQTT.
+void handleGuestKey() {
+  JsonDocument doc;
+  if (!server.hasArg("plain") || deserializeJson(doc, server.arg("plain"))) {
+    sendJsonResponse(400, "error", "Invalid JSON");
+    return;
+  }
+  
+  GuestKeyResult result = guestAccess.provisionKey(doc["key"] | "", doc["proof"] | "",
+                                                   millis());
+  if (result != GUEST_KEY_STORED) {
+    LOG_EVENT(LOG_GUEST_KEYS_REJECTED, guestKeyResultName(result));
+    int status = result == GUEST_KEY_INVALID ? 400 :
+                 result == GUEST_KEY_CONFLICT ? 409 :
+                 result == GUEST_KEY_WINDOW_CLOSED ? 403 : 500;
+    sendJsonResponse(status, "error", guestKeyResultName(result));
+    return;
+  }
+  LOG_EVENT(LOG_GUEST_KEYS_UPDATED);
+  if constexpr (BuildFeatures::lan) updateLanKey();
+  
+  sendJsonResponse(200, "success", "Guest key stored");
+}
+
+void handleGuestStatus() {
+  JsonDocument doc;
+  guestAccess.toJson(doc.to<JsonObject>());
+  
+  String output;
+  serializeJson(doc, output);
+  server.send(200, "application/json", output);
+}
+
+void handleSchedules() {
+  JsonDocument doc;
+  scheduleStateJson(doc.to<JsonObject>());
+  
+  String output;
+  serializeJson(doc, output);
+  server.send(200, "application/json", output);
+}
+
+// Body (optional): {"sink":"file"} or {"sink":"tcp","host":"...","port":9000}
+void handleTraceStart() {
+  JsonDocument doc;
+  if (server.hasArg("plain") && deserializeJson(doc, server.arg("plain"))) {
+    sendJsonResponse(400, "error", "Invalid JSON");
+    return;
+  }
+  stopTrace();
+  
+  const char* sink = doc["sink"] | "file";
+  if (strcmp(sink, "tcp") == 0) {
+    const char* host = doc["host"] | "";
+    uint16_t port = doc["port"] | 0;
+    if (!*host || port == 0 || !traceClient.connect(host, port)) {
+      sendJsonResponse(502, "error", "Trace collector unreachable");
+      return;
+    }
+    traceSink = &traceClient;
+  } else if (strcmp(sink, "file") == 0) {
+    if (!LittleFS.begin(true) || !(traceFile = LittleFS.open(TRACE_FILE, "w"))) {
+      sendJsonResponse(500, "error", "Filesystem unavailable");
+      return;
+    }
+    traceSink = &traceFile;
+  } else {
+    sendJsonResponse(400, "error", "sink must be file or tcp");
+    return;
+  }
+  
+  // Traces cover the first gate, the one trace_replay models
+  traceRecorder.start(millis(), gates[0].getDeviceId(), gates[0].getState(),
+                      gates[0].getPercentage(), gates[0].getLastStepMs());
+  traceBytes = traceSink->write((const uint8_t*)&traceRecorder.getHeader(), sizeof(TraceHeader));
+  Serial.printf("✓ Trace recording to %s\n", sink);
+  sendJsonResponse(200, "success", "Trace started");
+}
+
+void handleTraceStop() {
+  uint32_t dropped = traceRecorder.getDropped();
+  size_t bytes = traceBytes;
+  stopTrace();
+  
+  JsonDocument doc;
+  doc["status"] = "success";
+  doc["bytes"] = bytes;
+  doc["dropped"] = dropped;
+  
+  String output;
+  serializeJson(doc, output);
+  server.send(200, "application/json", output);
+}
+
+void handleTraceDownload() {
+  if (traceSink == &traceFile) {
+    sendJsonResponse(409, "error", "Trace recording in progress");
+    return;
+  }
+  if (!LittleFS.begin(true) || !LittleFS.exists(TRACE_FILE)) {
+    sendJsonResponse(404, "error", "No trace recorded");
+    return;
+  }
+  
+  File file = LittleFS.open(TRACE_FILE, "r");
+  server.streamFile(file, "application/octet-stream");
+  file.close();
+}
+
 void sendJsonResponse(int code, const char* status, const char* message) {
   JsonDocument doc;
   doc["status"] = status;
@@ -479,168 +1728,929 @@ void sendJsonResponse(int code, const char* status, const char* message) {
 }
 
 // =============================================================================
-// Gate Control Functions
+// Gate Control
 // =============================================================================
 
-void openGate() {
-  if (deviceState.gateState == GATE_OPENING || deviceState.percentage == 100) return;
-  
-  Serial.println(">> Opening gate");
-  deviceState.gateState = GATE_OPENING;
-  deviceState.operationStartTime = millis();
+// Persists and publishes what a gate did since the last call. Gate 0 also
+// drives the motor signature and the trace.
+void serviceGate(uint8_t gate) {
+  Gate& g = gates[gate];
+  uint8_t events = g.takeEvents();
+  if (!events) return;
   deviceState.lastActivity = millis();
   
-  digitalWrite(RELAY_CLOSE, LOW);
-  delay(50); // Interlock delay
-  digitalWrite(RELAY_OPEN, HIGH);
+  if (events & GATE_EVENT_STOPPED) {
+    const GateStop& stop = g.lastStop();
+    bool safety = stop.reason == STOP_TIMEOUT || stop.reason == STOP_OBSTACLE ||
+                  stop.reason == STOP_OVERCURRENT || stop.reason == STOP_OVERHEAT;
+    if (safety) {
+      LOG_EVENT(LOG_GATE_SAFETY_STOP, g.getDeviceId(), stop.reason, stop.percentage);
+    } else {
+      LOG_EVENT(LOG_GATE_STOPPED, g.getDeviceId(), stop.reason, stop.percentage);
+    }
+    
+    if (gate == 0) {
+      traceRecorder.stopDecision(stop.timeMs, stop.reason, stop.percentage);
+      if constexpr (BuildFeatures::mcsa) {
+        endSignature();
+      }
+    }
+  }
+  
+  // Also after a stop in the same pass, if a new movement followed it
+  if ((events & GATE_EVENT_STARTED) && g.moving()) {
+    uint8_t direction = g.getState() == GATE_OPENING ? 0 : 1;
+    LOG_EVENT(LOG_GATE_STARTED, g.getDeviceId(), g.getState(), g.getPercentage());
+    if constexpr (BuildFeatures::mcsa) {
+      if (gate == 0) beginSignature(direction);
+    }
+  }
   
-  publishStatus();
+  stateStores[gate].record(g.getState(), g.getPercentage());
+  if (events & (GATE_EVENT_STARTED | GATE_EVENT_STOPPED)) {
+    publishStatus(gate);
+  }
 }
 
-void closeGate() {
-  if (deviceState.gateState == GATE_CLOSING || deviceState.percentage == 0) return;
+// =============================================================================
+// Sensor Functions
+// =============================================================================
+
+// eFuse characterization of ADC1 at analogRead()'s 11 dB and 12 bits, then
+// one channel per gate current, the supply and the temperature
+void setupAcquisition() {
+  esp_adc_cal_characteristics_t chars;
+  esp_adc_cal_value_t type = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11,
+                                                      ADC_WIDTH_BIT_12, ACQ_DEFAULT_VREF_MV,
+                                                      &chars);
+  AdcCalSource source = type == ESP_ADC_CAL_VAL_EFUSE_TP     ? ADC_CAL_EFUSE_TP
+                        : type == ESP_ADC_CAL_VAL_EFUSE_VREF ? ADC_CAL_EFUSE_VREF
+                                                             : ADC_CAL_DEFAULT_VREF;
+  adcCalibration.build([&chars](uint16_t raw) { return esp_adc_cal_raw_to_voltage(raw, &chars); },
+                       source);
+  acquisition.begin(adcBoard, adcCalibration);
+  
+  static char names[GATE_COUNT][24];
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    const char* id = gateDescriptors[i].id;
+    snprintf(names[i], sizeof(names[i]), "current%s%s", id[0] ? "_" : "", id);
+    acquisition.add(names[i], gateDescriptors[i].pins.currentSensor, ACQ_CURRENT_PERIOD_MS,
+                    ACQ_CURRENT_OVERSAMPLE);
+  }
+  acqVoltage = acquisition.add("voltage", VOLTAGE_SENSOR, ACQ_VOLTAGE_PERIOD_MS,
+                               ACQ_VOLTAGE_OVERSAMPLE);
+  acqTemperature = acquisition.add("temperature", TEMP_SENSOR, ACQ_TEMP_PERIOD_MS,
+                                   ACQ_TEMP_OVERSAMPLE);
+  
+  Serial.printf("%s ADC calibration: %s, %u channels\n",
+                source == ADC_CAL_DEFAULT_VREF ? "⚠" : "✓", adcCalSourceName(source),
+                acquisition.size());
+}
+
+void readSensors() {
+  uint32_t ready = acquisition.poll(micros());
+  if (!ready) return;
+  uint32_t now = millis();
+  
+  // Current (ACS712), supply voltage (divider) and temperature (NTC), the
+  // ones with a new conversion
+  uint8_t channels = 0;
+  if (ready & 1u) channels |= SENSOR_CH_CURRENT;
+  if (ready & (1u << acqVoltage)) channels |= SENSOR_CH_VOLTAGE;
+  if (ready & (1u << acqTemperature)) channels |= SENSOR_CH_TEMPERATURE;
+  if (channels) {
+    uint16_t rawCurrent = acquisition.value(0);
+    uint16_t rawVoltage = acquisition.value(acqVoltage);
+    uint16_t rawTemperature = acquisition.value(acqTemperature);
+    traceRecorder.adc(now, channels, rawCurrent, rawVoltage, rawTemperature);
+    
+    // Median rejects spikes, EMA smooths; Kalman-smoothed temperature
+    SensorReading reading = sensorChain.update(channels, rawCurrent, rawVoltage, rawTemperature);
+    sensorData.voltage = reading.voltageMv / 1000.0f;
+    sensorData.temperature = reading.temperatureCc / 100.0f;
+    if (channels & SENSOR_CH_CURRENT) {
+      gates[0].addSample(now, reading.currentMa, reading.voltageMv);
+      
+      // Feed the on-device history
+      sensorHistory.addSample(now / 1000, (int16_t)(reading.currentMa / 10),
+                              (int16_t)(reading.voltageMv / 10), (int16_t)reading.temperatureCc);
+    }
+  }
   
-  Serial.println(">> Closing gate");
-  deviceState.gateState = GATE_CLOSING;
-  deviceState.operationStartTime = millis();
-  deviceState.lastActivity = millis();
+  // Further gates: motor current only, same filtering
+  for (uint8_t i = 1; i < GATE_COUNT; i++) {
+    if (!(ready & (1u << i))) continue;
+    int32_t currentMa = gateCurrent[i].update(acquisition.value(i));
+    gates[i].addSample(now, currentMa, sensorChain.reading().voltageMv);
+  }
+}
+
+// Rates and the last second's cost per channel
+void acquisitionJson(JsonObject out) {
+  out["calibration"] = adcCalSourceName(adcCalibration.source());
+  out["cpuUsPerS"] = acquisition.cpuUs();
+  JsonArray list = out["channels"].to<JsonArray>();
+  for (uint8_t i = 0; i < acquisition.size(); i++) {
+    const AcqChannelStats& stats = acquisition.stats(i);
+    JsonObject channel = list.add<JsonObject>();
+    channel["name"] = acquisition.name(i);
+    channel["periodMs"] = acquisition.periodMs(i);
+    channel["oversample"] = acquisition.oversample(i);
+    channel["raw"] = acquisition.value(i);
+    channel["reads"] = stats.reads;
+    channel["conversions"] = stats.conversions;
+    channel["missed"] = stats.missed;
+    channel["cpuUs"] = stats.cpuUs;
+  }
+}
+
+// digitalRead() that records edges while a trace is running
+bool readInput(uint8_t pin) {
+  bool level = digitalRead(pin);
+  traceRecorder.gpio(millis(), pin, level);
+  return level;
+}
+
+bool GpioBoard::read(uint8_t pin) {
+  return readInput(pin);
+}
+
+// =============================================================================
+// Local Schedules
+// =============================================================================
+
+void setupSchedules() {
+  ScheduleSet set;
+  bool loaded = scheduleStore.load(set);
+  scheduleEngine.load(set);
   
-  digitalWrite(RELAY_OPEN, LOW);
-  delay(50); // Interlock delay
-  digitalWrite(RELAY_CLOSE, HIGH);
+  // SNTP runs in the background once WiFi is up; until the first sync the
+  // clock reads 1970 and runSchedules() does nothing
+  configTzTime(set.tz, NTP_SERVER_1, NTP_SERVER_2);
   
-  publishStatus();
+  Serial.printf("✓ Schedules %s: %u entries, TZ %s\n", loaded ? "loaded" : "empty",
+                set.count, set.tz);
 }
 
-void stopGate() {
-  Serial.println(">> Stopping gate");
-  deviceState.gateState = GATE_STOPPED;
-  deviceState.lastActivity = millis();
+void applyTimeZone(const char* tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+bool applyScheduleUpdate(JsonObjectConst doc, const char*& error) {
+  static ScheduleSet staged;
+  if (!ScheduleStore::fromJson(doc, staged, error)) return false;
+  
+  // Retained sets are redelivered on every reconnect; skip the flash write
+  const ScheduleSet& current = scheduleEngine.get();
+  if (staged.version != 0 && staged.version == current.version) {
+    publishScheduleState();
+    return true;
+  }
   
-  digitalWrite(RELAY_OPEN, LOW);
-  digitalWrite(RELAY_CLOSE, LOW);
+  if (!scheduleStore.save(staged)) {
+    error = "Flash write failed";
+    return false;
+  }
+  if (strcmp(staged.tz, current.tz) != 0) {
+    applyTimeZone(staged.tz);
+  }
+  scheduleEngine.load(staged);   // Re-armed on the next tick
   
-  publishStatus();
+  Serial.printf("✓ Schedules updated (v%lu, %u entries)\n",
+                (unsigned long)staged.version, staged.count);
+  runSchedules();
+  publishScheduleState();
+  return true;
 }
 
-void setGatePercentage(uint8_t percent) {
-  Serial.printf(">> Setting gate to %d%%\n", percent);
+void runSchedules() {
+  time_t now = time(nullptr);
+  if (now < SCHEDULE_MIN_EPOCH) return;
+  
+  if (!clockSynced) {
+    clockSynced = true;
+    Serial.println("✓ Clock synced, schedules armed");
+    publishScheduleState();
+  }
+  if constexpr (BuildFeatures::guestAccess) guestAccess.noteTime((uint32_t)now);
   
-  if (percent > deviceState.percentage) {
-    openGate();
-  } else if (percent < deviceState.percentage) {
-    closeGate();
+  scheduleEngine.loop(now, executeSchedule);
+}
+
+void executeSchedule(const ScheduleEntry& entry, time_t dueAt) {
+  LOG_EVENT(LOG_SCHEDULE_RUN, entry.id, entry.action);
+  
+  ScheduleRun run = {};
+  strlcpy(run.id, entry.id, sizeof(run.id));
+  run.action = entry.action;
+  run.executed = dispatchCommand(0, (GateCommand)entry.action, entry.percentage)
+                 != GATE_OUTCOME_INVALID;
+  run.dueAt = (uint32_t)dueAt;
+  run.firedAt = (uint32_t)time(nullptr);
+  
+  // Reports wait in RAM while offline (oldest dropped when full)
+  if (!publishScheduleRun(run)) {
+    pendingScheduleRuns.push(run);
+  }
+}
+
+void scheduleStateJson(JsonObject out) {
+  const ScheduleSet& set = scheduleEngine.get();
+  out["deviceId"] = DEVICE_NAME;
+  out["version"] = set.version;
+  out["tz"] = set.tz;
+  out["synced"] = clockSynced;
+  out["now"] = clockSynced ? (uint32_t)time(nullptr) : 0;
+  
+  JsonArray schedules = out["schedules"].to<JsonArray>();
+  for (uint8_t i = 0; i < set.count; i++) {
+    JsonObject item = schedules.add<JsonObject>();
+    item["id"] = set.entries[i].id;
+    item["enabled"] = (set.entries[i].flags & SCHEDULE_ENABLED) != 0;
+    item["nextRun"] = (uint32_t)scheduleEngine.nextRun(i);
   }
+}
+
+void publishScheduleState() {
+  if (!mqttClient.connected()) return;
   
-  // Target percentage stored for updateGatePosition()
-  // In production, use encoder/timer to track actual position
+  JsonDocument doc;
+  scheduleStateJson(doc.to<JsonObject>());
+  
+  String output;
+  serializeJson(doc, output);
+  
+  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_SCHEDULES_STATE;
+  mqttClient.publish(topic.c_str(), output.c_str(), true);
 }
 
-void updateGatePosition() {
-  // Simulate position update (in production, use encoder or timing)
-  static unsigned long lastUpdate = 0;
-  if (millis() - lastUpdate < 300) return;
-  lastUpdate = millis();
+bool publishScheduleRun(const ScheduleRun& run) {
+  if (!mqttClient.connected()) return false;
+  
+  char output[192];
+  snprintf(output, sizeof(output),
+           "{\"deviceId\":\"%s\",\"scheduleId\":\"%s\",\"action\":\"%s\","
+           "\"executed\":%s,\"dueAt\":%lu,\"firedAt\":%lu}",
+           DEVICE_NAME, run.id, gateCommandName(run.action),
+           run.executed ? "true" : "false",
+           (unsigned long)run.dueAt, (unsigned long)run.firedAt);
+  
+  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_SCHEDULES_RUN;
+  return mqttClient.publish(topic.c_str(), output);
+}
+
+void flushScheduleRuns() {
+  for (uint16_t i = 0; i < pendingScheduleRuns.size(); i++) {
+    if (!publishScheduleRun(pendingScheduleRuns.at(i))) return;
+  }
+  pendingScheduleRuns.clear();
+}
+
+bool publishGuestUse(const GuestUse& use) {
+  if (!mqttClient.connected()) return false;
   
-  if (deviceState.gateState == GATE_OPENING) {
-    if (deviceState.percentage < 100) {
-      deviceState.percentage += 5;
-      if (deviceState.percentage >= 100) {
-        deviceState.percentage = 100;
-        deviceState.gateState = GATE_OPEN;
-        stopGate();
-      }
+  char output[160];
+  snprintf(output, sizeof(output),
+           "{\"deviceId\":\"%s\",\"passId\":\"%s\",\"action\":\"%s\",\"at\":%lu}",
+           DEVICE_NAME, use.passId, gateCommandName(use.action), (unsigned long)use.at);
+  
+  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_GUEST_USED;
+  return mqttClient.publish(topic.c_str(), output);
+}
+
+void flushGuestUses() {
+  for (uint16_t i = 0; i < pendingGuestUses.size(); i++) {
+    if (!publishGuestUse(pendingGuestUses.at(i))) return;
+  }
+  pendingGuestUses.clear();
+}
+
+// =============================================================================
+// Trace Recording
+// =============================================================================
+
+void traceCommand(GateCommand command, uint8_t percentage) {
+  if (command != GATE_CMD_NONE) {
+    traceRecorder.command(millis(), command, percentage);
+  }
+}
+
+void writeTraceRecords() {
+  TraceRecord batch[32];
+  uint8_t count = 0;
+  while (traceRecorder.pop(batch[count])) {
+    count++;
+    if (count == 32) {
+      traceBytes += traceSink->write((const uint8_t*)batch, sizeof(batch));
+      count = 0;
     }
-  } else if (deviceState.gateState == GATE_CLOSING) {
-    if (deviceState.percentage > 0) {
-      deviceState.percentage -= 5;
-      if (deviceState.percentage == 0) {
-        deviceState.gateState = GATE_CLOSED;
-        stopGate();
-      }
+  }
+  if (count > 0) {
+    traceBytes += traceSink->write((const uint8_t*)batch, count * sizeof(TraceRecord));
+  }
+}
+
+void drainTrace() {
+  if (!traceSink) return;
+  writeTraceRecords();
+  
+  bool closed = traceSink == &traceClient && !traceClient.connected();
+  bool full = traceSink == &traceFile && traceBytes >= TRACE_FILE_MAX_BYTES;
+  if (closed || full) {
+    Serial.printf("⚠ Trace stopped: %s\n", closed ? "collector disconnected" : "file full");
+    stopTrace();
+  }
+}
+
+void stopTrace() {
+  if (!traceSink) return;
+  traceRecorder.stop();
+  writeTraceRecords();
+  
+  if (traceSink == &traceFile) {
+    traceFile.close();
+  } else {
+    traceClient.stop();
+  }
+  traceSink = nullptr;
+  Serial.printf("✓ Trace stopped (%u bytes, %lu dropped)\n",
+                (unsigned)traceBytes, (unsigned long)traceRecorder.getDropped());
+}
+
+// =============================================================================
+// Event Log
+// =============================================================================
+
+uint32_t logNowUs() {
+  return micros();
+}
+
+void setupEventLog() {
+  logFileLock = xSemaphoreCreateMutex();
+  
+  // Cost of one entry, timestamp included, on a ring of its own
+  static LogRing<16> probe;
+  LogRecord record;
+  uint32_t cycles = 0;
+  for (uint8_t round = 0; round < 4; round++) {
+    uint32_t start = ESP.getCycleCount();
+    for (uint8_t i = 0; i < 16; i++) {
+      probe.write<LOG_GATE_STOPPED>(logNowUs(), DEVICE_NAME, STOP_OBSTACLE, 50);
     }
+    cycles += ESP.getCycleCount() - start;
+    while (probe.pop(record)) {}
   }
+  logStats.pushNs = cycles * 1000 / (64 * ESP.getCpuFreqMHz());
+  
+  xTaskCreatePinnedToCore(logDrainTask, "log", 4096, nullptr, 1, nullptr, 0);
+  Serial.printf("✓ Event log: %u records, %lu ns per entry\n", EventLog::capacity(),
+                (unsigned long)logStats.pushNs);
 }
 
-void checkSafetyConditions() {
-  // Check timeout
-  if (millis() - deviceState.operationStartTime > GATE_TIMEOUT_MS) {
-    Serial.println("⚠ Safety timeout - stopping");
-    stopGate();
-    return;
+// The only place log output is formatted or written
+void logDrainTask(void* param) {
+  LogClock clock;
+  uint32_t reported = 0;
+  uint32_t lastSync = 0;
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(power.mode() == POWER_IDLE ? POWER_LOG_DRAIN_MS
+                                                                    : LOG_DRAIN_MS));
+    clock.sync(esp_timer_get_time());
+    
+    LogRecord record;
+    while (eventLog.pop(record)) {
+      writeLogRecord(record, clock.uptimeUs(record.timeUs));
+    }
+    
+    // Records lost to a full ring, reported after the ones that made it
+    uint32_t dropped = eventLog.getDropped();
+    if (dropped != reported) {
+      logEncodeRecord<LOG_DROPPED>(record, logNowUs(), dropped - reported);
+      writeLogRecord(record, clock.uptimeUs(record.timeUs));
+      reported = dropped;
+    }
+    
+    if (millis() - lastSync >= LOG_FILE_SYNC_MS) {
+      xSemaphoreTake(logFileLock, portMAX_DELAY);
+      if (logFile) logFile.flush();
+      xSemaphoreGive(logFileLock);
+      lastSync = millis();
+    }
+    
+    if (!logBatchReady.load(std::memory_order_acquire) && logBatch.header.records > 0 &&
+        millis() - logBatchStartedAt >= LOG_MQTT_FLUSH_MS) {
+      sealLogBatch();
+    }
+  }
+}
+
+void writeLogRecord(const LogRecord& record, uint64_t uptimeUs) {
+  uint8_t level = record.id < LOG_MESSAGE_COUNT ? LOG_TABLE[record.id].level : LOG_LEVEL_ERROR;
+  logStats.records++;
+  
+  if (level >= logLevels[LOG_SINK_SERIAL].load(std::memory_order_relaxed)) {
+    char line[128];
+    formatLogLine(line, sizeof(line), record, uptimeUs);
+    Serial.println(line);
+  }
+  if (level >= logLevels[LOG_SINK_FILE].load(std::memory_order_relaxed)) {
+    appendLogFile(record, uptimeUs);
+  }
+  if (BuildFeatures::mqtt && level >= logLevels[LOG_SINK_MQTT].load(std::memory_order_relaxed)) {
+    batchLogRecord(record, uptimeUs);
+  }
+}
+
+// LOG_FILE, rotated once to LOG_FILE_OLD. Every opening, and a long
+// silence, starts with a header that carries the time base.
+void appendLogFile(const LogRecord& record, uint64_t uptimeUs) {
+  static uint64_t lastUs = 0;
+  xSemaphoreTake(logFileLock, portMAX_DELAY);
+  
+  if (logFile && logFile.size() >= LOG_FILE_MAX_BYTES) {
+    logFile.close();
+    LittleFS.remove(LOG_FILE_OLD);
+    LittleFS.rename(LOG_FILE, LOG_FILE_OLD);
+  }
+  
+  bool opened = false;
+  if (!logFile && LittleFS.begin(true)) {
+    logFile = LittleFS.open(LOG_FILE, "a");
+    opened = true;
+  }
+  if (logFile) {
+    if (opened || uptimeUs - lastUs >= LOG_RESYNC_US) {
+      LogHeader header;
+      initLogHeader(header, DEVICE_NAME, uptimeUs, eventLog.getDropped(), 0, 0);
+      logStats.fileBytes += logFile.write((const uint8_t*)&header, sizeof(header));
+    }
+    logStats.fileBytes += logFile.write((const uint8_t*)&record, sizeof(record));
+    lastUs = uptimeUs;
   }
   
-  // Check obstacle
-  if (ENABLE_OBSTACLE_DETECT && digitalRead(OBSTACLE_SENSOR) == LOW) {
-    Serial.println("⚠ Obstacle detected - stopping");
-    deviceState.obstacleDetected = true;
-    stopGate();
+  xSemaphoreGive(logFileLock);
+}
+
+void closeLogFile() {
+  xSemaphoreTake(logFileLock, portMAX_DELAY);
+  if (logFile) logFile.close();
+  xSemaphoreGive(logFileLock);
+}
+
+// While loop() has not published the sealed batch, records for MQTT are
+// counted and dropped rather than queued
+void batchLogRecord(const LogRecord& record, uint64_t uptimeUs) {
+  if (logBatchReady.load(std::memory_order_acquire)) {
+    logStats.mqttDropped++;
     return;
+  }
+  
+  LogHeader& header = logBatch.header;
+  if (header.records == 0) {
+    initLogHeader(header, DEVICE_NAME, uptimeUs, eventLog.getDropped(), logBatchSequence++, 0);
+    logBatchStartedAt = millis();
+  }
+  logBatch.records[header.records++] = record;
+  if (header.records == LOG_MQTT_BATCH) {
+    sealLogBatch();
+  }
+}
+
+void sealLogBatch() {
+  logBatchReady.store(true, std::memory_order_release);
+}
+
+// Kept until the broker is back; the drain task counts what it cannot add
+void publishLogBatch() {
+  if (!logBatchReady.load(std::memory_order_acquire) || !mqttClient.connected()) return;
+  
+  uint32_t records = logBatch.header.records;
+  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_LOG;
+  if (mqttClient.publish(topic.c_str(), (const uint8_t*)&logBatch,
+                         sizeof(LogHeader) + records * sizeof(LogRecord), false)) {
+    logStats.mqttBatches++;
   } else {
-    deviceState.obstacleDetected = false;
+    logStats.mqttDropped += records;
+  }
+  
+  logBatch.header.records = 0;
+  logBatchReady.store(false, std::memory_order_release);
+}
+
+void handleLog() {
+  JsonDocument doc;
+  doc["capacity"] = EventLog::capacity();
+  doc["records"] = logStats.records;
+  doc["dropped"] = eventLog.getDropped();
+  doc["pushNs"] = logStats.pushNs;
+  doc["fileBytes"] = logStats.fileBytes;
+  doc["mqttBatches"] = logStats.mqttBatches;
+  doc["mqttDropped"] = logStats.mqttDropped;
+  
+  JsonObject levels = doc["levels"].to<JsonObject>();
+  for (uint8_t i = 0; i < LOG_SINK_COUNT; i++) {
+    levels[logSinkNames[i]] = logLevelName(logLevels[i].load(std::memory_order_relaxed));
+  }
+  
+  String output;
+  serializeJson(doc, output);
+  server.send(200, "application/json", output);
+}
+
+// Body: {"serial":"info","file":"debug","mqtt":"off"}; sinks not named keep
+// their level. Not persisted: a reboot restores the config.h defaults.
+void handleLogUpdate() {
+  JsonDocument doc;
+  if (!server.hasArg("plain") || deserializeJson(doc, server.arg("plain"))) {
+    sendJsonResponse(400, "error", "Invalid JSON");
+    return;
+  }
+  
+  uint8_t levels[LOG_SINK_COUNT];
+  for (uint8_t i = 0; i < LOG_SINK_COUNT; i++) {
+    levels[i] = logLevels[i].load(std::memory_order_relaxed);
+    JsonVariantConst value = doc[logSinkNames[i]];
+    if (!value.isNull() && !parseLogLevel(value | "", levels[i])) {
+      sendJsonResponse(400, "error", "Level must be debug, info, warn, error or off");
+      return;
+    }
+  }
+  for (uint8_t i = 0; i < LOG_SINK_COUNT; i++) {
+    logLevels[i].store(levels[i], std::memory_order_relaxed);
   }
+  if (levels[LOG_SINK_FILE] == LOG_LEVEL_OFF) {
+    closeLogFile();
+  }
+  handleLog();
+}
+
+// Holds the file lock while streaming; the drain task waits and the ring
+// absorbs (or counts) what is logged meanwhile
+void handleLogDownload() {
+  xSemaphoreTake(logFileLock, portMAX_DELAY);
+  if (logFile) logFile.flush();
+  
+  if (!LittleFS.begin(true) || !LittleFS.exists(LOG_FILE)) {
+    xSemaphoreGive(logFileLock);
+    sendJsonResponse(404, "error", "No log file");
+    return;
+  }
+  
+  File file = LittleFS.open(LOG_FILE, "r");
+  server.streamFile(file, "application/octet-stream");
+  file.close();
+  xSemaphoreGive(logFileLock);
+}
+
+// =============================================================================
+// OTA Patch Updates
+// =============================================================================
+
+// Overrides the core's weak default: a new image stays pending until
+// OtaUpdate confirms it, instead of being marked valid before setup()
+bool verifyRollbackLater() {
+  return BuildFeatures::ota;
+}
+
+// Patches are applied only while no gate is moving: flash erases stall the
+// loop for tens of milliseconds
+bool gatesIdle() {
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    if (gates[i].moving()) return false;
+  }
+  return true;
+}
+
+void handleOtaStatus() {
+  JsonDocument doc;
+  otaUpdate.toJson(doc.to<JsonObject>());
   
-  // Check current overload
-  if (ENABLE_CURRENT_MONITOR && sensorData.current > CURRENT_THRESHOLD_STALL) {
-    Serial.println("⚠ Current overload - stopping");
-    stopGate();
+  String output;
+  serializeJson(doc, output);
+  server.send(200, "application/json", output);
+}
+
+// Multipart upload of a patch made by tools/ota_delta.cpp, applied as it
+// arrives
+bool otaUploadAccepted = false;
+
+void handleOtaUpload() {
+  HTTPUpload& upload = server.upload();
+  switch (upload.status) {
+    case UPLOAD_FILE_START:
+      otaUploadAccepted = gatesIdle() && otaUpdate.start(OTA_SOURCE_HTTP);
+      break;
+    case UPLOAD_FILE_WRITE:
+      if (otaUploadAccepted) otaUpdate.write(upload.buf, upload.currentSize);
+      break;
+    case UPLOAD_FILE_END:
+      if (otaUploadAccepted) otaUpdate.finish();
+      break;
+    case UPLOAD_FILE_ABORTED:
+      if (otaUploadAccepted) otaUpdate.abort();
+      break;
+  }
+}
+
+void handleOtaUploadDone() {
+  if (!otaUploadAccepted) {
+    sendJsonResponse(409, "error", gatesIdle() ? "Update in progress" : "Gate moving");
     return;
   }
+  otaUploadAccepted = false;
   
-  // Check temperature
-  if (ENABLE_TEMP_MONITOR && sensorData.temperature > TEMP_SHUTDOWN) {
-    Serial.println("⚠ Overheating - stopping");
-    stopGate();
+  JsonDocument doc;
+  otaUpdate.toJson(doc.to<JsonObject>());
+  bool applied = strcmp(doc["state"] | "", "restarting") == 0;
+  doc["status"] = applied ? "success" : "error";
+  
+  String output;
+  serializeJson(doc, output);
+  server.send(applied ? 200 : 400, "application/json", output);
+}
+
+// {"url": "http://.../patch.gmop", "version": "2.1.0"}; a request for the
+// running version is ignored, so a repeated message does not reinstall
+void applyOtaRequest(JsonObjectConst doc) {
+  const char* version = doc["version"] | "";
+  if (strcmp(version, FIRMWARE_VERSION) == 0) {
+    LOG_EVENT(LOG_OTA_REJECTED, "version already running");
     return;
   }
+  const char* error = nullptr;
+  if (!otaUpdate.download(doc["url"] | "", error)) {
+    LOG_EVENT(LOG_OTA_REJECTED, error);
+    publishOtaState();
+  }
+}
+
+void publishOtaState() {
+  if (!mqttClient.connected()) return;
+  
+  JsonDocument doc;
+  otaUpdate.toJson(doc.to<JsonObject>());
+  doc["deviceId"] = DEVICE_NAME;
+  
+  String output;
+  serializeJson(doc, output);
+  
+  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_OTA_STATE;
+  mqttClient.publish(topic.c_str(), output.c_str(), true);
+}
+
+// =============================================================================
+// Safety Path Timing
+// =============================================================================
+
+// Before any gate moves: the harness on scripted inputs, every branch
+void setupSafetyTimer() {
+  bool ok = safetyTimer.begin();
+  Serial.printf("%s Safety path: worst %s %.1f us, budget %u us\n", ok ? "✓" : "⚠",
+                safetyBranchName(safetyTimer.worstBranch()), safetyTimer.worstUs(),
+                WCET_SAFETY_BUDGET_US);
+}
+
+// =============================================================================
+// Power Management
+// =============================================================================
+
+// Buttons and every gate's limit switches and obstacle input end an idle wait
+void setupPower() {
+  uint8_t pins[POWER_WAKE_PINS_MAX];
+  uint8_t count = 0;
+  for (uint8_t pin : {BUTTON_OPEN, BUTTON_CLOSE, BUTTON_STOP, BUTTON_RESET}) {
+    pins[count++] = pin;
+  }
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    const GatePins& gate = gateDescriptors[i].pins;
+    pins[count++] = gate.limitOpen;
+    pins[count++] = gate.limitClose;
+    pins[count++] = gate.obstacle;
+  }
+  power.begin(pins, count);
   
-  // Check limit switches
-  if (deviceState.gateState == GATE_OPENING && digitalRead(LIMIT_OPEN) == LOW) {
-    deviceState.percentage = 100;
-    deviceState.gateState = GATE_OPEN;
-    stopGate();
+  if (power.scaling()) {
+    Serial.printf("✓ Power: idle scaling and light sleep, %u wake pins, commands <= %u ms\n",
+                  count, POWER_WORST_COMMAND_MS);
+  } else {
+    Serial.printf("⚠ Power: no esp_pm in this core, idle at %u MHz without light sleep\n",
+                  POWER_CPU_IDLE_MHZ);
   }
-  if (deviceState.gateState == GATE_CLOSING && digitalRead(LIMIT_CLOSE) == LOW) {
-    deviceState.percentage = 0;
-    deviceState.gateState = GATE_CLOSED;
-    stopGate();
+}
+
+// Outstanding work keeps full speed: a moving gate, a staggered group
+// command still waiting, a patch being applied
+PowerInputs powerInputs() {
+  PowerInputs in;
+  in.nowMs = millis();
+  in.lastActivityMs = deviceState.lastActivity;
+  in.moving = !gatesIdle();
+  in.busy = BuildFeatures::ota && otaUpdate.busy();
+  for (uint8_t i = 0; i < GATE_COUNT; i++) {
+    in.busy |= groupCommands[i].pending;
   }
+  return in;
 }
 
 // =============================================================================
-// Sensor Functions
+// Motor Current Signature Analysis
 // =============================================================================
 
-void readSensors() {
-  // Read current sensor (ACS712)
-  int rawCurrent = analogRead(CURRENT_SENSOR);
-  sensorData.current = ((rawCurrent * 3.3 / 4095) - 2.5) / 0.066; // 30A version
-  if (sensorData.current < 0) sensorData.current = 0;
+// Parked between movements, so an idle gate does not wake the chip at the
+// sample rate
+void currentSamplerTask(void* param) {
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    if (!mcsaSampling.load(std::memory_order_acquire)) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      wake = xTaskGetTickCount();
+      continue;
+    }
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(1000 / MCSA_SAMPLE_RATE_HZ));
+    if (mcsaSampling.load(std::memory_order_acquire)) {
+      mcsaSamples.push(analogRead(gateDescriptors[0].pins.currentSensor));
+    }
+  }
+}
+
+void setupMCSA() {
+  Preferences prefs;
+  prefs.begin("mcsa", true);
+  const char* keys[2] = {"open", "close"};
+  for (uint8_t dir = 0; dir < 2; dir++) {
+    MotorBaseline stored;
+    if (prefs.getBytes(keys[dir], &stored, sizeof(stored)) == sizeof(stored)) {
+      mcsaBaseline[dir].load(stored);
+    }
+  }
+  prefs.end();
   
-  // Read voltage (voltage divider)
-  int rawVoltage = analogRead(VOLTAGE_SENSOR);
-  sensorData.voltage = (rawVoltage * 3.3 / 4095) * 11.0; // 10:1 divider
+  xTaskCreatePinnedToCore(currentSamplerTask, "mcsa", 2048, nullptr, 2, &mcsaTask, 0);
+  Serial.printf("✓ MCSA sampling at %d Hz\n", MCSA_SAMPLE_RATE_HZ);
+}
+
+void beginSignature(uint8_t direction) {
+  mcsaSampling.store(false, std::memory_order_release);
+  mcsaSamples.clear();
+  mcsaDirection = direction;
+  mcsaSignature.begin();
+  mcsaSignature.setSupplyMilliVolts((int32_t)(sensorData.voltage * 1000));
+  mcsaSampling.store(true, std::memory_order_release);
+  xTaskNotifyGive(mcsaTask);
+}
+
+void drainSignature() {
+  uint16_t raw;
+  while (mcsaSamples.pop(raw)) {
+    mcsaSignature.addSample(currentFromRaw(raw));
+  }
+}
+
+void endSignature() {
+  if (!mcsaSampling.load(std::memory_order_acquire)) return;
+  mcsaSampling.store(false, std::memory_order_release);
+  drainSignature();
+  
+  // Only full travels are comparable with each other
+  uint8_t percentage = gates[0].getPercentage();
+  bool fullTravel = (mcsaDirection == 0 && percentage == 100) ||
+                    (mcsaDirection == 1 && percentage == 0);
+  MotorFeatures features = mcsaSignature.finish();
+  if (!fullTravel || features.spectralBlocks == 0) return;
+  
+  float scores[FEATURE_COUNT];
+  BaselineTracker& baseline = mcsaBaseline[mcsaDirection];
+  uint8_t alerts = baseline.update(features, scores);
+  
+  // Persist every few operations; losing a handful on reset is harmless
+  if (baseline.state().operations % 10 == 0) {
+    Preferences prefs;
+    prefs.begin("mcsa", false);
+    prefs.putBytes(mcsaDirection == 0 ? "open" : "close",
+                   &baseline.state(), sizeof(MotorBaseline));
+    prefs.end();
+  }
   
-  // Read temperature (NTC thermistor approximation)
-  int rawTemp = analogRead(TEMP_SENSOR);
-  sensorData.temperature = (rawTemp * 3.3 / 4095) * 100; // Simplified
+  if (alerts) {
+    Serial.printf("⚠ Motor drift detected (%s): 0x%02x\n",
+                  mcsaDirection == 0 ? "open" : "close", alerts);
+  }
+  publishMaintenance(mcsaDirection, features, scores, alerts);
+}
+
+void publishMaintenance(uint8_t direction, const MotorFeatures& features,
+                        const float* scores, uint8_t alerts) {
+  if (!mqttClient.connected()) return;
   
-  // WiFi signal
-  sensorData.wifiSignal = WiFi.RSSI();
+  JsonDocument doc;
+  doc["deviceId"] = DEVICE_NAME;
+  doc["direction"] = direction == 0 ? "open" : "close";
+  doc["durationMs"] = features.durationMs;
+  doc["inrushPeak"] = features.inrushPeakMa / 1000.0f;
+  doc["steadyRms"] = features.steadyRmsMa / 1000.0f;
+  doc["rippleRms"] = features.rippleRmsMa / 1000.0f;
+  doc["rippleFreq"] = features.rippleFreqHz;
+  doc["harmonics"] = features.harmonicPermille / 1000.0f;
+  doc["energy"] = features.energyMj / 1000.0f;
+  doc["operations"] = mcsaBaseline[direction].state().operations;
+  
+  JsonObject drift = doc["drift"].to<JsonObject>();
+  JsonArray flagged = doc["alerts"].to<JsonArray>();
+  for (uint8_t i = 0; i < FEATURE_COUNT; i++) {
+    drift[BaselineTracker::featureName(i)] = scores[i];
+    if (alerts & (1 << i)) flagged.add(BaselineTracker::featureName(i));
+  }
+  doc["timestamp"] = millis();
+  
+  String output;
+  serializeJson(doc, output);
+  
+  String topic = String(MQTT_TOPIC_PREFIX) + DEVICE_NAME + MQTT_TOPIC_MAINTENANCE;
+  mqttClient.publish(topic.c_str(), output.c_str());
 }
 
 // =============================================================================
-// Utility Functions
+// LAN Fast Path
 // =============================================================================
 
-String getStateString(GateState state) {
-  switch (state) {
-    case GATE_CLOSED: return "closed";
-    case GATE_OPENING: return "opening";
-    case GATE_OPEN: return "open";
-    case GATE_CLOSING: return "closing";
-    case GATE_STOPPED: return "stopped";
-    case GATE_ERROR: return "error";
-    default: return "unknown";
+// <DEVICE_NAME>.local advertises _gatemate._udp with the gate ids; the port
+// stays closed to commands until the guest key and the key ids have arrived
+void setupLan() {
+  lanServer.begin(commandDelivery);
+  updateLanKey();
+  
+  char ids[256] = "";
+  size_t used = 0;
+  for (uint8_t i = 0; i < GATE_COUNT && used < sizeof(ids); i++) {
+    used += snprintf(ids + used, sizeof(ids) - used, "%s%s", i ? "," : "",
+                     gates[i].getDeviceId());
   }
+  bool advertised = LanLink::advertise(DEVICE_NAME, LAN_UDP_PORT,
+                                       BuildFeatures::https ? HTTPS_PORT : WEB_SERVER_PORT, ids);
+  bool listening = lanLink.begin(LAN_UDP_PORT);
+  Serial.printf("%s LAN commands on UDP %u%s, %s\n", listening ? "✓" : "⚠", LAN_UDP_PORT,
+                advertised ? " (mDNS)" : "", lanServer.ready() ? "keyed" : "waiting for key");
+}
+
+// The LAN key follows the guest key, the allowed user keys the guest sync
+void updateLanKey() {
+  uint8_t key[32];
+  if (guestAccess.deriveKey(LAN_KEY_LABEL, key) && lanMac.setKey(key, sizeof(key))) {
+    lanServer.setMac(&lanMac);
+  } else {
+    lanServer.setMac(nullptr);
+  }
+  memset(key, 0, sizeof(key));
+  
+  uint8_t count = 0;
+  const uint32_t* keyIds = guestAccess.lanKeys(count);
+  lanServer.allow(keyIds, count);
+}
+
+// A few datagrams per pass; each accepted one runs through runCommand() and
+// is answered before the next is read
+void serviceLan() {
+  for (uint8_t packets = 0; packets < LAN_PACKETS_PER_PASS; packets++) {
+    uint8_t in[LAN_DATAGRAM_LEN];
+    IPAddress ip;
+    uint16_t port = 0;
+    int length = lanLink.receive(in, sizeof(in), ip, port);
+    if (length <= 0) return;
+    uint32_t startUs = micros();
+    
+    uint32_t now = clockSynced ? (uint32_t)time(nullptr) : 0;
+    LanRequest request;
+    LanDecision decision = lanServer.decide(in, length, now, millis(), GATE_COUNT, request);
+    if (decision == LAN_DROP) continue;
+    if (decision == LAN_RUN) {
+      request.status = runCommand(request.gate, (GateCommand)request.command, request.percentage,
+                                  request.commandId, request.sentAt, request.duplicate);
+    } else if (!request.duplicate) {
+      LOG_EVENT(LOG_LAN_REFUSED, request.commandId, lanStatusName(request.status));
+    }
+    
+    uint8_t gate = request.gate < GATE_COUNT ? request.gate : 0;
+    uint8_t out[LAN_DATAGRAM_LEN];
+    lanServer.reply(request, gates[gate].getState(), gates[gate].getPercentage(), now, out);
+    lanLink.send(ip, port, out, sizeof(out));
+    lanServer.addTiming(micros() - startUs);
+  }
+}
+
+void lanJson(JsonObject out) {
+  const LanStats& stats = lanServer.stats();
+  out["port"] = LAN_UDP_PORT;
+  out["keyed"] = lanServer.ready();
+  out["keys"] = lanServer.keys();
+  out["received"] = stats.received;
+  out["dropped"] = stats.dropped;
+  out["unknownKeys"] = stats.unknownKeys;
+  out["run"] = stats.run;
+  out["duplicates"] = stats.duplicates;
+  out["replays"] = stats.replays;
+  out["stale"] = stats.stale;
+  out["maxUs"] = stats.maxUs;
+  out["avgUs"] = stats.handled ? stats.sumUs / stats.handled : 0;
 }
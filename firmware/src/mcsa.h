@@ -0,0 +1,326 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Motor Current Signature Analysis
+// =============================================================================
+//
+// Per-operation feature extraction from the high-rate current samples taken
+// while the gate moves, and a rolling per-direction baseline that flags slow
+// drift (bearing wear, gearbox damage, binding hinges) long before a stall.
+//
+// Work is incremental: every sample costs a few integer operations, and a
+// 256-point FFT runs once per filled block of steady-state samples. No
+// Arduino dependency; see tools/mcsa_check.cpp for the host check.
+//
+
+#ifndef MCSA_H
+#define MCSA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define MCSA_SAMPLE_RATE_HZ   1000    // Current sampling while moving
+#define MCSA_INRUSH_MS        300     // Start-up window excluded from steady state
+#define MCSA_FFT_SIZE         256     // Samples per spectral block
+#define MCSA_BASELINE_WARMUP  20      // Operations before flags are raised
+#define MCSA_ALERT_SCORE      3.0f    // Drift in baseline standard deviations
+#define MCSA_REFERENCE_ALPHA  (1.0f / 4096.0f)  // Reference tracking rate
+
+// =============================================================================
+// Features
+// =============================================================================
+
+struct MotorFeatures {
+  uint32_t durationMs;
+  int32_t inrushPeakMa;       // Highest current during start-up
+  int32_t steadyRmsMa;        // RMS after the inrush window
+  int32_t rippleRmsMa;        // RMS of the AC part (envelope of the ripple)
+  uint16_t rippleFreqHz;      // Dominant ripple frequency
+  uint16_t harmonicPermille;  // (2nd + 3rd harmonic) / fundamental amplitude
+  uint32_t energyMj;          // Electrical energy of the whole operation
+  uint16_t spectralBlocks;    // FFT blocks averaged
+};
+
+enum MotorFeatureIndex {
+  FEATURE_INRUSH = 0,
+  FEATURE_RMS,
+  FEATURE_RIPPLE,
+  FEATURE_HARMONICS,
+  FEATURE_ENERGY,
+  FEATURE_COUNT
+};
+
+// =============================================================================
+// Operation Signature (incremental extraction)
+// =============================================================================
+
+class OperationSignature {
+private:
+  static const uint16_t BINS = MCSA_FFT_SIZE / 2 + 1;
+
+  // Running sums
+  uint32_t sampleCount = 0;
+  int32_t inrushPeak = 0;
+  uint64_t steadySum = 0;
+  uint64_t steadySumSquares = 0;
+  uint32_t steadyCount = 0;
+  uint64_t energyNj = 0;
+  int32_t supplyMv = 0;
+
+  // Spectral block
+  float block[MCSA_FFT_SIZE];
+  float imag[MCSA_FFT_SIZE];
+  float spectrum[BINS];
+  uint16_t blockFill = 0;
+  uint16_t blocks = 0;
+
+  // Shared tables
+  static float* window() {
+    static float table[MCSA_FFT_SIZE];
+    return table;
+  }
+  static float* cosTable() {
+    static float table[MCSA_FFT_SIZE / 2];
+    return table;
+  }
+  static float* sinTable() {
+    static float table[MCSA_FFT_SIZE / 2];
+    return table;
+  }
+
+  static void initTables() {
+    static bool ready = false;
+    if (ready) return;
+    for (uint16_t i = 0; i < MCSA_FFT_SIZE; i++) {
+      window()[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (MCSA_FFT_SIZE - 1));
+    }
+    for (uint16_t i = 0; i < MCSA_FFT_SIZE / 2; i++) {
+      cosTable()[i] = cosf(2.0f * (float)M_PI * i / MCSA_FFT_SIZE);
+      sinTable()[i] = -sinf(2.0f * (float)M_PI * i / MCSA_FFT_SIZE);
+    }
+    ready = true;
+  }
+
+  // In-place iterative radix-2 FFT on block/imag
+  void fft() {
+    const uint16_t n = MCSA_FFT_SIZE;
+
+    for (uint16_t i = 1, j = 0; i < n; i++) {
+      uint16_t bit = n >> 1;
+      for (; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+      if (i < j) {
+        float t = block[i]; block[i] = block[j]; block[j] = t;
+        t = imag[i]; imag[i] = imag[j]; imag[j] = t;
+      }
+    }
+
+    for (uint16_t len = 2; len <= n; len <<= 1) {
+      uint16_t half = len >> 1;
+      uint16_t step = n / len;
+      for (uint16_t i = 0; i < n; i += len) {
+        for (uint16_t k = 0; k < half; k++) {
+          float wr = cosTable()[k * step];
+          float wi = sinTable()[k * step];
+          float xr = block[i + k + half] * wr - imag[i + k + half] * wi;
+          float xi = block[i + k + half] * wi + imag[i + k + half] * wr;
+          block[i + k + half] = block[i + k] - xr;
+          imag[i + k + half] = imag[i + k] - xi;
+          block[i + k] += xr;
+          imag[i + k] += xi;
+        }
+      }
+    }
+  }
+
+  void processBlock() {
+    // Remove the block mean so DC leakage does not mask the ripple
+    float mean = 0.0f;
+    for (uint16_t i = 0; i < MCSA_FFT_SIZE; i++) mean += block[i];
+    mean /= MCSA_FFT_SIZE;
+
+    for (uint16_t i = 0; i < MCSA_FFT_SIZE; i++) {
+      block[i] = (block[i] - mean) * window()[i];
+      imag[i] = 0.0f;
+    }
+
+    fft();
+
+    for (uint16_t i = 0; i < BINS; i++) {
+      spectrum[i] += block[i] * block[i] + imag[i] * imag[i];
+    }
+    blocks++;
+    blockFill = 0;
+  }
+
+  float binPower(uint16_t bin) const {
+    // Sum the neighbours too: the Hann window spreads a tone over 3 bins
+    float power = 0.0f;
+    for (int16_t b = (int16_t)bin - 1; b <= (int16_t)bin + 1; b++) {
+      if (b > 0 && b < BINS) power += spectrum[b];
+    }
+    return power;
+  }
+
+public:
+  void begin() {
+    initTables();
+    sampleCount = 0;
+    inrushPeak = 0;
+    steadySum = 0;
+    steadySumSquares = 0;
+    steadyCount = 0;
+    energyNj = 0;
+    blockFill = 0;
+    blocks = 0;
+    memset(spectrum, 0, sizeof(spectrum));
+  }
+
+  // Supply voltage for the energy integral; updated from the slow channel
+  void setSupplyMilliVolts(int32_t mv) { supplyMv = mv; }
+
+  // One current sample at MCSA_SAMPLE_RATE_HZ
+  void addSample(int32_t ma) {
+    if (ma < 0) ma = 0;
+    sampleCount++;
+
+    // mV * mA = uW; one sample lasts 1000000 / rate us
+    energyNj += (uint64_t)supplyMv * (uint64_t)ma * 1000u / MCSA_SAMPLE_RATE_HZ;
+
+    uint32_t elapsedMs = sampleCount * 1000u / MCSA_SAMPLE_RATE_HZ;
+    if (elapsedMs <= MCSA_INRUSH_MS) {
+      if (ma > inrushPeak) inrushPeak = ma;
+      return;
+    }
+
+    steadySum += (uint64_t)ma;
+    steadySumSquares += (uint64_t)ma * (uint64_t)ma;
+    steadyCount++;
+
+    block[blockFill++] = (float)ma;
+    if (blockFill == MCSA_FFT_SIZE) {
+      processBlock();
+    }
+  }
+
+  MotorFeatures finish() const {
+    MotorFeatures features = {};
+    features.durationMs = sampleCount * 1000u / MCSA_SAMPLE_RATE_HZ;
+    features.inrushPeakMa = inrushPeak;
+    features.energyMj = (uint32_t)(energyNj / 1000000u);
+    features.spectralBlocks = blocks;
+
+    if (steadyCount > 0) {
+      double mean = (double)steadySum / steadyCount;
+      double meanSquares = (double)steadySumSquares / steadyCount;
+      double variance = meanSquares - mean * mean;
+      features.steadyRmsMa = (int32_t)sqrt(meanSquares);
+      features.rippleRmsMa = (int32_t)sqrt(variance > 0 ? variance : 0);
+    }
+
+    if (blocks > 0) {
+      // Dominant ripple component, ignoring the lowest bins (slow drift)
+      uint16_t peak = 3;
+      for (uint16_t i = 4; i < BINS; i++) {
+        if (spectrum[i] > spectrum[peak]) peak = i;
+      }
+      features.rippleFreqHz = (uint16_t)((uint32_t)peak * MCSA_SAMPLE_RATE_HZ / MCSA_FFT_SIZE);
+
+      float fundamental = binPower(peak);
+      float harmonics = 0.0f;
+      if (2 * peak < BINS) harmonics += binPower(2 * peak);
+      if (3 * peak < BINS) harmonics += binPower(3 * peak);
+      if (fundamental > 0.0f) {
+        float ratio = sqrtf(harmonics / fundamental) * 1000.0f;
+        features.harmonicPermille = (uint16_t)(ratio > 65535.0f ? 65535.0f : ratio);
+      }
+    }
+    return features;
+  }
+
+  uint32_t getSampleCount() const { return sampleCount; }
+};
+
+// =============================================================================
+// Rolling Baseline
+// =============================================================================
+
+// Reference statistics learned over the first operations and then tracked
+// very slowly, compared with a fast average of recent operations. A fault
+// that develops over weeks shows up as a growing gap between the two.
+struct MotorBaseline {
+  uint32_t operations;
+  float referenceMean[FEATURE_COUNT];
+  float referenceVar[FEATURE_COUNT];
+  float recentMean[FEATURE_COUNT];
+};
+
+class BaselineTracker {
+private:
+  MotorBaseline data = {};
+
+  static void extract(const MotorFeatures& f, float out[FEATURE_COUNT]) {
+    out[FEATURE_INRUSH] = (float)f.inrushPeakMa;
+    out[FEATURE_RMS] = (float)f.steadyRmsMa;
+    out[FEATURE_RIPPLE] = (float)f.rippleRmsMa;
+    out[FEATURE_HARMONICS] = (float)f.harmonicPermille;
+    out[FEATURE_ENERGY] = (float)f.energyMj;
+  }
+
+public:
+  void load(const MotorBaseline& stored) { data = stored; }
+  const MotorBaseline& state() const { return data; }
+  void reset() { memset(&data, 0, sizeof(data)); }
+
+  // Folds a completed operation in. Returns a bitmask of drifted features
+  // (1 << MotorFeatureIndex); zero while still warming up.
+  uint8_t update(const MotorFeatures& features, float scores[FEATURE_COUNT]) {
+    float x[FEATURE_COUNT];
+    extract(features, x);
+    data.operations++;
+
+    uint8_t alerts = 0;
+    bool warm = data.operations > MCSA_BASELINE_WARMUP;
+
+    for (uint8_t i = 0; i < FEATURE_COUNT; i++) {
+      if (data.operations == 1) {
+        data.referenceMean[i] = x[i];
+        data.referenceVar[i] = 0.0f;
+        data.recentMean[i] = x[i];
+        scores[i] = 0.0f;
+        continue;
+      }
+
+      // Recent behaviour: fast EWMA over the last few operations
+      data.recentMean[i] += (x[i] - data.recentMean[i]) * 0.25f;
+
+      // Score the recent mean against the reference spread
+      float sigma = sqrtf(data.referenceVar[i]);
+      float minSigma = data.referenceMean[i] * 0.02f + 1.0f;
+      if (sigma < minSigma) sigma = minSigma;
+      scores[i] = (data.recentMean[i] - data.referenceMean[i]) / sigma;
+      if (warm && fabsf(scores[i]) > MCSA_ALERT_SCORE) alerts |= (1 << i);
+
+      // Reference: running stats during warm-up, then an EWMA spanning
+      // thousands of operations so wear over weeks is not absorbed
+      float alpha = warm ? MCSA_REFERENCE_ALPHA : (1.0f / data.operations);
+      float delta = x[i] - data.referenceMean[i];
+      data.referenceMean[i] += alpha * delta;
+      data.referenceVar[i] = (1.0f - alpha) * (data.referenceVar[i] + alpha * delta * delta);
+    }
+
+    return alerts;
+  }
+
+  static const char* featureName(uint8_t index) {
+    switch (index) {
+      case FEATURE_INRUSH: return "inrush";
+      case FEATURE_RMS: return "rms";
+      case FEATURE_RIPPLE: return "ripple";
+      case FEATURE_HARMONICS: return "harmonics";
+      case FEATURE_ENERGY: return "energy";
+      default: return "unknown";
+    }
+  }
+};
+
+#endif // MCSA_H
@@ -0,0 +1,527 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - OTA Patches
+// =============================================================================
+//
+// Compressed full images and binary deltas against the running firmware,
+// applied as a stream straight into the inactive OTA slot. A patch is
+//
+//   OtaPatchHeader (80 bytes) | LZ-compressed op stream
+//
+// and the op stream rebuilds the target image from the running one (the
+// base), keeping a cursor into the base:
+//
+//   COPY n        n base bytes at the cursor; cursor += n
+//   ADD n d[n]    base[cursor + i] + d[i]; cursor += n
+//   INSERT n b[n] n literal bytes
+//   SEEK s        cursor += s (zigzag)
+//
+// Op codes are one byte, lengths LEB128 varints. ADD is what keeps deltas
+// small: code that moved shifts every absolute address behind it, so old
+// and new differ by the same few bytes over long runs and the differences
+// compress to almost nothing. A full image is a single INSERT.
+//
+// Compression is LZ77 in LZ4-style sequences (token, literal length,
+// literals, 16-bit offset, match length). Decoding only looks back
+// 2^windowBits bytes, so RAM is the window plus two OTA_PATCH_IO_BYTES
+// buffers whatever the image size.
+//
+// A delta checks the SHA-256 of the base before anything is written, so a
+// patch made against another build is refused; the SHA-256 of the target
+// is checked by finish() before the caller switches the boot partition.
+// feed() writes at most a given number of bytes per call, so the caller
+// can keep servicing its loop during an update.
+//
+// Flash access and SHA-256 are template parameters (esp_ota and mbedTLS on
+// the device, see ota_update.h; files and OpenSSL in tools/ota_delta.cpp):
+//
+//   bool start(uint32_t targetSize);                          // Open the slot
+//   bool readBase(uint32_t offset, uint8_t* out, size_t length);
+//   bool write(const uint8_t* data, size_t length);
+//
+//   void begin(); void update(const uint8_t*, size_t); void finish(uint8_t[32]);
+//
+// No Arduino dependency.
+//
+
+#ifndef OTA_PATCH_H
+#define OTA_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+
+#define OTA_PATCH_MAGIC           0x504F4D47u   // "GMOP"
+#define OTA_PATCH_VERSION         1
+#define OTA_PATCH_HEADER_BYTES    80
+#define OTA_PATCH_WINDOW_BITS_MIN 8
+#define OTA_PATCH_WINDOW_BITS_MAX 16            // 16-bit match offsets
+#define OTA_PATCH_MIN_MATCH       4
+#define OTA_PATCH_IO_BYTES        512           // Base read and output staging
+
+enum OtaPatchKind : uint8_t {
+  OTA_PATCH_FULL = 0,                     // Compressed image, no base
+  OTA_PATCH_DELTA
+};
+
+enum OtaOp : uint8_t {
+  OTA_OP_COPY = 1,
+  OTA_OP_ADD,
+  OTA_OP_INSERT,
+  OTA_OP_SEEK
+};
+
+enum OtaPatchResult : uint8_t {
+  OTA_PATCH_OK = 0,
+  OTA_PATCH_BAD_HEADER,
+  OTA_PATCH_UNSUPPORTED,                  // Version or window too large
+  OTA_PATCH_BASE_MISMATCH,
+  OTA_PATCH_NO_SPACE,                     // Target larger than the slot
+  OTA_PATCH_NO_MEMORY,
+  OTA_PATCH_CORRUPT,
+  OTA_PATCH_TRUNCATED,
+  OTA_PATCH_HASH_MISMATCH,
+  OTA_PATCH_READ_FAILED,
+  OTA_PATCH_WRITE_FAILED,
+  OTA_PATCH_ABORTED
+};
+
+inline const char* otaPatchResultName(uint8_t result) {
+  switch (result) {
+    case OTA_PATCH_OK: return "ok";
+    case OTA_PATCH_BAD_HEADER: return "bad_header";
+    case OTA_PATCH_UNSUPPORTED: return "unsupported";
+    case OTA_PATCH_BASE_MISMATCH: return "base_mismatch";
+    case OTA_PATCH_NO_SPACE: return "no_space";
+    case OTA_PATCH_NO_MEMORY: return "no_memory";
+    case OTA_PATCH_CORRUPT: return "corrupt";
+    case OTA_PATCH_TRUNCATED: return "truncated";
+    case OTA_PATCH_HASH_MISMATCH: return "hash_mismatch";
+    case OTA_PATCH_READ_FAILED: return "read_failed";
+    case OTA_PATCH_WRITE_FAILED: return "write_failed";
+    case OTA_PATCH_ABORTED: return "aborted";
+    default: return "unknown";
+  }
+}
+
+// =============================================================================
+// Header
+// =============================================================================
+
+// Little-endian, as laid out in memory on the ESP32 and x86 hosts
+struct OtaPatchHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t kind;                           // OtaPatchKind
+  uint8_t windowBits;
+  uint8_t reserved;
+  uint32_t baseSize;                      // 0 for OTA_PATCH_FULL
+  uint32_t targetSize;
+  uint8_t baseSha256[32];
+  uint8_t targetSha256[32];
+};
+
+static_assert(sizeof(OtaPatchHeader) == OTA_PATCH_HEADER_BYTES, "patch header layout");
+
+// =============================================================================
+// OTA Patcher Class
+// =============================================================================
+
+template <typename Target, typename Sha256>
+class OtaPatcher {
+private:
+  enum Stage : uint8_t { STAGE_HEADER, STAGE_BASE, STAGE_BODY, STAGE_DONE, STAGE_FAILED };
+
+  enum LzState : uint8_t {
+    LZ_TOKEN, LZ_LITERAL_LENGTH, LZ_LITERALS, LZ_OFFSET_LOW, LZ_OFFSET_HIGH,
+    LZ_MATCH_LENGTH, LZ_MATCH
+  };
+
+  enum OpState : uint8_t { OP_CODE, OP_ARGUMENT, OP_COPY_RUN, OP_ADD_RUN, OP_INSERT_RUN };
+
+  Target* target = nullptr;
+  Sha256 sha;
+  uint8_t maxWindowBits = OTA_PATCH_WINDOW_BITS_MAX;
+
+  OtaPatchHeader header = {};
+  uint8_t headerBytes = 0;
+  Stage stage = STAGE_FAILED;
+  OtaPatchResult result = OTA_PATCH_ABORTED;
+  uint32_t consumed = 0;                  // Patch bytes
+  uint32_t written = 0;                   // Target bytes
+
+  // LZ decoder; the window holds the last op stream bytes
+  uint8_t* window = nullptr;
+  uint32_t windowMask = 0;
+  uint32_t windowPos = 0;                 // Op stream bytes decoded
+  LzState lz = LZ_TOKEN;
+  uint8_t token = 0;
+  uint32_t literals = 0;
+  uint32_t matchLength = 0;
+  uint32_t offset = 0;
+
+  // Op parser
+  OpState opState = OP_CODE;
+  uint8_t op = 0;
+  uint32_t argument = 0;
+  uint8_t argumentShift = 0;
+  uint32_t remaining = 0;
+  uint32_t cursor = 0;                    // Base offset
+
+  uint8_t out[OTA_PATCH_IO_BYTES];
+  uint16_t outLength = 0;
+  uint8_t base[OTA_PATCH_IO_BYTES];
+  uint32_t baseAt = 0;
+  uint16_t baseLength = 0;
+
+  void fail(OtaPatchResult reason) {
+    if (stage == STAGE_FAILED) return;
+    stage = STAGE_FAILED;
+    result = reason;
+    release();
+  }
+
+  void release() {
+    delete[] window;
+    window = nullptr;
+  }
+
+  bool loadBase(uint32_t at) {
+    uint32_t length = header.baseSize - at;
+    if (length > OTA_PATCH_IO_BYTES) length = OTA_PATCH_IO_BYTES;
+    if (!target->readBase(at, base, length)) {
+      fail(OTA_PATCH_READ_FAILED);
+      return false;
+    }
+    baseAt = at;
+    baseLength = length;
+    return true;
+  }
+
+  bool flush() {
+    if (outLength == 0) return true;
+    sha.update(out, outLength);
+    if (!target->write(out, outLength)) {
+      fail(OTA_PATCH_WRITE_FAILED);
+      return false;
+    }
+    outLength = 0;
+    return true;
+  }
+
+  bool emit(uint8_t byte) {
+    out[outLength++] = byte;
+    written++;
+    return outLength < OTA_PATCH_IO_BYTES || flush();
+  }
+
+  // ---------------------------------------------------------------------------
+  // Stages
+  // ---------------------------------------------------------------------------
+
+  void parseHeader() {
+    if (header.magic != OTA_PATCH_MAGIC || header.kind > OTA_PATCH_DELTA ||
+        (header.kind == OTA_PATCH_FULL && header.baseSize != 0) || header.targetSize == 0) {
+      fail(OTA_PATCH_BAD_HEADER);
+      return;
+    }
+    if (header.version != OTA_PATCH_VERSION || header.windowBits < OTA_PATCH_WINDOW_BITS_MIN ||
+        header.windowBits > maxWindowBits) {
+      fail(OTA_PATCH_UNSUPPORTED);
+      return;
+    }
+    window = new (std::nothrow) uint8_t[1u << header.windowBits];
+    if (!window) {
+      fail(OTA_PATCH_NO_MEMORY);
+      return;
+    }
+    windowMask = (1u << header.windowBits) - 1;
+    if (!target->start(header.targetSize)) {
+      fail(OTA_PATCH_NO_SPACE);
+      return;
+    }
+    sha.begin();
+    cursor = 0;
+    stage = header.kind == OTA_PATCH_DELTA ? STAGE_BASE : STAGE_BODY;
+  }
+
+  // Hashes the base in IO-sized steps; cursor is the progress
+  void checkBase(uint32_t& budget) {
+    while (cursor < header.baseSize && budget > 0) {
+      if (!loadBase(cursor)) return;
+      sha.update(base, baseLength);
+      cursor += baseLength;
+      budget = budget > baseLength ? budget - baseLength : 0;
+    }
+    if (cursor < header.baseSize) return;
+
+    uint8_t digest[32];
+    sha.finish(digest);
+    if (memcmp(digest, header.baseSha256, sizeof(digest)) != 0) {
+      fail(OTA_PATCH_BASE_MISMATCH);
+      return;
+    }
+    sha.begin();
+    cursor = 0;
+    baseLength = 0;
+    stage = STAGE_BODY;
+  }
+
+  // Next op stream byte; false once the input is used up (or corrupt)
+  bool nextByte(const uint8_t*& in, const uint8_t* end, uint8_t& byte) {
+    for (;;) {
+      switch (lz) {
+        case LZ_TOKEN:
+          if (in == end) return false;
+          token = *in++;
+          literals = token >> 4;
+          matchLength = (token & 0x0F) + OTA_PATCH_MIN_MATCH;
+          lz = literals == 15 ? LZ_LITERAL_LENGTH : LZ_LITERALS;
+          break;
+
+        case LZ_LITERAL_LENGTH:
+          if (in == end) return false;
+          literals += *in;
+          if (*in++ != 255) lz = LZ_LITERALS;
+          break;
+
+        case LZ_LITERALS:
+          if (literals == 0) {
+            lz = LZ_OFFSET_LOW;
+            break;
+          }
+          if (in == end) return false;
+          byte = *in++;
+          literals--;
+          window[windowPos++ & windowMask] = byte;
+          return true;
+
+        case LZ_OFFSET_LOW:
+          if (in == end) return false;
+          offset = *in++;
+          lz = LZ_OFFSET_HIGH;
+          break;
+
+        case LZ_OFFSET_HIGH:
+          if (in == end) return false;
+          offset |= (uint32_t)*in++ << 8;
+          if (offset == 0 || offset > windowMask + 1 || offset > windowPos) {
+            fail(OTA_PATCH_CORRUPT);
+            return false;
+          }
+          lz = (token & 0x0F) == 15 ? LZ_MATCH_LENGTH : LZ_MATCH;
+          break;
+
+        case LZ_MATCH_LENGTH:
+          if (in == end) return false;
+          matchLength += *in;
+          if (*in++ != 255) lz = LZ_MATCH;
+          break;
+
+        case LZ_MATCH:
+          if (matchLength == 0) {
+            lz = LZ_TOKEN;
+            break;
+          }
+          byte = window[(windowPos - offset) & windowMask];
+          matchLength--;
+          window[windowPos++ & windowMask] = byte;
+          return true;
+      }
+    }
+  }
+
+  // Bounds of a COPY/ADD/INSERT of argument bytes, then the run itself
+  void startOp() {
+    bool fromBase = op == OTA_OP_COPY || op == OTA_OP_ADD;
+    if (argument > header.targetSize - written ||
+        (fromBase && argument > header.baseSize - cursor)) {
+      fail(OTA_PATCH_CORRUPT);
+      return;
+    }
+    remaining = argument;
+    opState = op == OTA_OP_COPY ? OP_COPY_RUN : op == OTA_OP_ADD ? OP_ADD_RUN : OP_INSERT_RUN;
+  }
+
+  void seek() {
+    int64_t delta = (argument & 1) ? -(int64_t)(argument >> 1) - 1 : (int64_t)(argument >> 1);
+    int64_t to = (int64_t)cursor + delta;
+    if (header.kind != OTA_PATCH_DELTA || to < 0 || to > (int64_t)header.baseSize) {
+      fail(OTA_PATCH_CORRUPT);
+      return;
+    }
+    cursor = (uint32_t)to;
+    opState = OP_CODE;
+  }
+
+  void copyRun(uint32_t& budget) {
+    while (remaining > 0 && budget > 0) {
+      if (cursor < baseAt || cursor >= baseAt + baseLength) {
+        if (!loadBase(cursor)) return;
+      }
+      uint32_t n = baseAt + baseLength - cursor;
+      if (n > remaining) n = remaining;
+      if (n > budget) n = budget;
+      if (n > (uint32_t)(OTA_PATCH_IO_BYTES - outLength)) n = OTA_PATCH_IO_BYTES - outLength;
+      memcpy(out + outLength, base + (cursor - baseAt), n);
+      outLength += n;
+      written += n;
+      cursor += n;
+      remaining -= n;
+      budget -= n;
+      if (outLength == OTA_PATCH_IO_BYTES && !flush()) return;
+    }
+    if (remaining == 0) opState = OP_CODE;
+  }
+
+  void body(const uint8_t*& in, const uint8_t* end, uint32_t& budget) {
+    while (stage == STAGE_BODY) {
+      if (opState == OP_CODE && written == header.targetSize) {
+        // Complete: the op stream must end here too
+        bool pending = (lz == LZ_LITERALS && literals > 0) || (lz == LZ_MATCH && matchLength > 0) ||
+                       lz == LZ_LITERAL_LENGTH || lz == LZ_OFFSET_HIGH || lz == LZ_MATCH_LENGTH;
+        if (in != end || pending) {
+          fail(OTA_PATCH_CORRUPT);
+          return;
+        }
+        stage = STAGE_DONE;
+        return;
+      }
+      if (opState == OP_COPY_RUN) {
+        copyRun(budget);
+        if (opState == OP_COPY_RUN) return;
+        continue;
+      }
+      if (budget == 0 && opState != OP_CODE && opState != OP_ARGUMENT) return;
+
+      uint8_t byte;
+      if (!nextByte(in, end, byte)) return;
+
+      switch (opState) {
+        case OP_CODE:
+          if (byte < OTA_OP_COPY || byte > OTA_OP_SEEK ||
+              (header.kind != OTA_PATCH_DELTA && byte != OTA_OP_INSERT)) {
+            fail(OTA_PATCH_CORRUPT);
+            return;
+          }
+          op = byte;
+          argument = 0;
+          argumentShift = 0;
+          opState = OP_ARGUMENT;
+          break;
+
+        case OP_ARGUMENT:
+          if (argumentShift > 28) {
+            fail(OTA_PATCH_CORRUPT);
+            return;
+          }
+          argument |= (uint32_t)(byte & 0x7F) << argumentShift;
+          argumentShift += 7;
+          if (byte & 0x80) break;
+          if (op == OTA_OP_SEEK) seek();
+          else startOp();
+          break;
+
+        case OP_ADD_RUN:
+          if (cursor < baseAt || cursor >= baseAt + baseLength) {
+            if (!loadBase(cursor)) return;
+          }
+          emit((uint8_t)(base[cursor++ - baseAt] + byte));
+          budget--;
+          if (--remaining == 0) opState = OP_CODE;
+          break;
+
+        case OP_INSERT_RUN:
+          emit(byte);
+          budget--;
+          if (--remaining == 0) opState = OP_CODE;
+          break;
+
+        default:
+          break;
+      }
+    }
+  }
+
+public:
+  ~OtaPatcher() { release(); }
+
+  // Starts a new patch; target must outlive it
+  void begin(Target& flash, uint8_t windowBitsLimit = OTA_PATCH_WINDOW_BITS_MAX) {
+    release();
+    target = &flash;
+    maxWindowBits = windowBitsLimit;
+    headerBytes = 0;
+    stage = STAGE_HEADER;
+    result = OTA_PATCH_OK;
+    consumed = written = 0;
+    windowPos = 0;
+    lz = LZ_TOKEN;
+    literals = matchLength = offset = 0;
+    opState = OP_CODE;
+    cursor = remaining = 0;
+    outLength = 0;
+    baseAt = 0;
+    baseLength = 0;
+  }
+
+  // Consumes patch bytes, writing at most budget target bytes (and reading
+  // about as many base bytes while the base is checked). Returns how many
+  // bytes were consumed: fewer than length means the budget ran out, or
+  // failed() - call again with the rest. A COPY needs no input, so work
+  // may also be left once everything is consumed: feed(nullptr, 0) while
+  // pending().
+  size_t feed(const uint8_t* data, size_t length, uint32_t budget = UINT32_MAX) {
+    const uint8_t* in = data;
+    const uint8_t* end = data + length;
+
+    if (stage == STAGE_HEADER && length > 0) {
+      size_t n = OTA_PATCH_HEADER_BYTES - headerBytes;
+      if (n > length) n = length;
+      memcpy((uint8_t*)&header + headerBytes, in, n);
+      headerBytes += n;
+      in += n;
+      if (headerBytes == OTA_PATCH_HEADER_BYTES) parseHeader();
+    }
+    if (stage == STAGE_BASE) checkBase(budget);
+    if (stage == STAGE_BODY) body(in, end, budget);
+    if (stage == STAGE_DONE && in != end) fail(OTA_PATCH_CORRUPT);
+
+    consumed += in - data;
+    return in - data;
+  }
+
+  // Flushes and verifies the target. OTA_PATCH_OK means the slot holds the
+  // exact target image and may be made bootable.
+  OtaPatchResult finish() {
+    if (stage == STAGE_DONE) {
+      uint8_t digest[32];
+      if (flush()) {
+        sha.finish(digest);
+        release();
+        if (memcmp(digest, header.targetSha256, sizeof(digest)) != 0) fail(OTA_PATCH_HASH_MISMATCH);
+        else result = OTA_PATCH_OK;
+      }
+    } else {
+      fail(stage == STAGE_FAILED ? result : OTA_PATCH_TRUNCATED);
+    }
+    stage = result == OTA_PATCH_OK ? STAGE_DONE : STAGE_FAILED;
+    return result;
+  }
+
+  void abort() { fail(OTA_PATCH_ABORTED); }
+
+  bool failed() const { return stage == STAGE_FAILED; }
+  bool complete() const { return stage == STAGE_DONE; }
+  bool pending() const {
+    return stage == STAGE_BASE || (stage == STAGE_BODY && opState == OP_COPY_RUN);
+  }
+  bool headerReady() const { return headerBytes == OTA_PATCH_HEADER_BYTES; }
+  OtaPatchResult getResult() const { return result; }
+  const OtaPatchHeader& getHeader() const { return header; }
+  uint32_t patchBytes() const { return consumed; }
+  uint32_t targetBytes() const { return written; }
+  uint32_t windowBytes() const { return window ? windowMask + 1 : 0; }
+};
+
+#endif // OTA_PATCH_H
@@ -0,0 +1,377 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - OTA Update
+// =============================================================================
+//
+// Device side of patch updates (see ota_patch.h for the format). A patch
+// arrives either as an upload to POST /ota or is pulled from a URL sent on
+// the MQTT ota topic, and is applied as it streams in: the delta reads the
+// running partition and writes the inactive OTA slot through esp_ota, with
+// sectors erased as they are reached. Nothing is buffered beyond the
+// decoder window, and the boot partition only changes once the image has
+// passed the patch's SHA-256 and esp_ota_end()'s own validation.
+//
+// A pulled patch is applied OTA_STEP_BYTES per loop() pass and pauses while
+// a gate moves, so the gates keep being serviced during the download.
+//
+// A new image starts on trial. It is confirmed once it has been up for
+// OTA_CONFIRM_MS with the network connected; until then a reset rolls back
+// - through the bootloader where rollback is enabled, otherwise after
+// OTA_TRIAL_BOOTS unconfirmed boots, counted in NVS.
+//
+
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+#include <esp_task_wdt.h>
+#include <mbedtls/md.h>
+#include "config.h"
+#include "event_log.h"
+#include "ota_patch.h"
+
+// =============================================================================
+// Backends
+// =============================================================================
+
+class MbedSha256 {
+private:
+  mbedtls_md_context_t ctx;
+  bool ready = false;
+
+public:
+  MbedSha256() { mbedtls_md_init(&ctx); }
+  ~MbedSha256() { mbedtls_md_free(&ctx); }
+
+  void begin() {
+    if (!ready) {
+      ready = mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0) == 0;
+    }
+    mbedtls_md_starts(&ctx);
+  }
+
+  void update(const uint8_t* data, size_t length) { mbedtls_md_update(&ctx, data, length); }
+  void finish(uint8_t out[32]) { mbedtls_md_finish(&ctx, out); }
+};
+
+// Reads the running partition, writes the other OTA slot
+class OtaFlash {
+private:
+  const esp_partition_t* running = nullptr;
+  const esp_partition_t* slot = nullptr;
+  esp_ota_handle_t handle = 0;
+  bool open = false;
+
+public:
+  bool start(uint32_t size) {
+    running = esp_ota_get_running_partition();
+    slot = esp_ota_get_next_update_partition(NULL);
+    if (!running || !slot || size > slot->size) return false;
+    open = esp_ota_begin(slot, OTA_WITH_SEQUENTIAL_WRITES, &handle) == ESP_OK;
+    return open;
+  }
+
+  bool readBase(uint32_t offset, uint8_t* out, size_t length) {
+    if (offset + length > running->size) return false;
+    return esp_partition_read(running, offset, out, length) == ESP_OK;
+  }
+
+  bool write(const uint8_t* data, size_t length) {
+    return esp_ota_write(handle, data, length) == ESP_OK;
+  }
+
+  // Validates the image and makes it the boot partition
+  bool commit() {
+    if (!open) return false;
+    open = false;
+    return esp_ota_end(handle) == ESP_OK && esp_ota_set_boot_partition(slot) == ESP_OK;
+  }
+
+  void abort() {
+    if (open) esp_ota_abort(handle);
+    open = false;
+  }
+
+  const esp_partition_t* target() const { return slot; }
+};
+
+// =============================================================================
+// OTA Update Class
+// =============================================================================
+
+enum OtaSource : uint8_t { OTA_SOURCE_NONE = 0, OTA_SOURCE_HTTP, OTA_SOURCE_MQTT };
+
+class OtaUpdate {
+private:
+  OtaFlash flash;
+  OtaPatcher<OtaFlash, MbedSha256> patcher;
+  Preferences preferences;
+
+  OtaSource source = OTA_SOURCE_NONE;
+  uint32_t startedMs = 0;
+  uint32_t restartAt = 0;
+  bool restartPending = false;
+  bool changed = false;
+
+  // Last finished update, for GET /ota
+  OtaPatchResult lastResult = OTA_PATCH_OK;
+  uint32_t lastPatchBytes = 0;
+  uint32_t lastDurationMs = 0;
+  bool hasResult = false;
+
+  // Pull over HTTP
+  HTTPClient http;
+  WiFiClient* stream = nullptr;
+  int32_t expected = -1;                  // Content-Length, -1 if unknown
+  uint32_t received = 0;
+  uint32_t lastDataMs = 0;
+  uint8_t buffer[1024];
+  uint16_t bufferAt = 0;
+  uint16_t bufferLength = 0;
+
+  // Trial of a new image
+  bool onTrial = false;
+  uint8_t trialBootsLeft = 0;
+
+  static const char* sourceName(OtaSource s) {
+    return s == OTA_SOURCE_HTTP ? "http" : s == OTA_SOURCE_MQTT ? "mqtt" : "none";
+  }
+
+  void complete() {
+    while (patcher.pending() && !patcher.failed()) {
+      patcher.feed(nullptr, 0, OTA_STEP_BYTES);
+      esp_task_wdt_reset();
+    }
+    OtaPatchResult result = patcher.finish();
+    if (result == OTA_PATCH_OK && !flash.commit()) result = OTA_PATCH_WRITE_FAILED;
+
+    if (result == OTA_PATCH_OK) {
+      preferences.begin("ota", false);
+      preferences.putUInt("slot", flash.target()->address);
+      preferences.putUChar("boots", 0);
+      preferences.end();
+      restartPending = true;
+      restartAt = millis() + OTA_RESTART_DELAY_MS;
+      LOG_EVENT(LOG_OTA_APPLIED, patcher.getHeader().kind == OTA_PATCH_DELTA ? "delta" : "full",
+                patcher.patchBytes(), millis() - startedMs);
+    } else {
+      flash.abort();
+      LOG_EVENT(LOG_OTA_FAILED, otaPatchResultName(result), patcher.patchBytes());
+    }
+    end(result);
+  }
+
+  void end(OtaPatchResult result) {
+    lastResult = result;
+    lastPatchBytes = patcher.patchBytes();
+    lastDurationMs = millis() - startedMs;
+    hasResult = true;
+    if (stream) {
+      http.end();
+      stream = nullptr;
+    }
+    source = OTA_SOURCE_NONE;
+    changed = true;
+  }
+
+  // One OTA_STEP_BYTES step of a pulled patch
+  void serviceDownload() {
+    if (bufferAt == bufferLength && !patcher.pending()) {
+      int available = stream->available();
+      if (available > 0) {
+        int n = stream->read(buffer, available < (int)sizeof(buffer) ? available : sizeof(buffer));
+        if (n > 0) {
+          bufferAt = 0;
+          bufferLength = n;
+          received += n;
+          lastDataMs = millis();
+        }
+      } else if ((expected >= 0 && received >= (uint32_t)expected) ||
+                 (expected < 0 && !stream->connected())) {
+        complete();
+        return;
+      } else if (millis() - lastDataMs >= OTA_STALL_MS || !stream->connected()) {
+        patcher.abort();
+        flash.abort();
+        LOG_EVENT(LOG_OTA_FAILED, "download stalled", received);
+        end(OTA_PATCH_TRUNCATED);
+        return;
+      }
+    }
+
+    bufferAt += patcher.feed(buffer + bufferAt, bufferLength - bufferAt, OTA_STEP_BYTES);
+    if (patcher.failed()) {
+      flash.abort();
+      LOG_EVENT(LOG_OTA_FAILED, otaPatchResultName(patcher.getResult()), patcher.patchBytes());
+      end(patcher.getResult());
+    }
+  }
+
+public:
+  // Boot-time trial bookkeeping; may roll back and restart
+  void begin() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    onTrial = esp_ota_get_state_partition(running, &state) == ESP_OK &&
+              state == ESP_OTA_IMG_PENDING_VERIFY;
+
+    // "slot" is the address of an image on trial, "boots" its unconfirmed boots
+    preferences.begin("ota", false);
+    uint32_t trialSlot = preferences.getUInt("slot", 0);
+    if (trialSlot != 0 && trialSlot != running->address) {
+      // The bootloader already went back to the previous image
+      Serial.println("⚠ OTA: new image failed, running the previous one");
+      preferences.putUInt("slot", 0);
+    } else if (trialSlot != 0) {
+      uint8_t boots = preferences.getUChar("boots", 0) + 1;
+      if (boots > OTA_TRIAL_BOOTS && !onTrial) {
+        const esp_partition_t* previous = esp_ota_get_next_update_partition(NULL);
+        esp_app_desc_t desc;
+        if (previous && esp_ota_get_partition_description(previous, &desc) == ESP_OK &&
+            esp_ota_set_boot_partition(previous) == ESP_OK) {
+          Serial.printf("⚠ OTA: image not confirmed in %u boots, rolling back\n", OTA_TRIAL_BOOTS);
+          preferences.putUInt("slot", 0);
+          preferences.end();
+          ESP.restart();
+          return;
+        }
+      }
+      preferences.putUChar("boots", boots);
+      trialBootsLeft = boots < OTA_TRIAL_BOOTS ? OTA_TRIAL_BOOTS - boots : 0;
+      onTrial = true;
+    }
+    preferences.end();
+
+    if (onTrial) {
+      Serial.printf("⚠ OTA: new image on trial, confirmed after %u s online\n", OTA_CONFIRM_MS / 1000);
+    }
+  }
+
+  // Opens the inactive slot for a patch; false while another is in progress
+  bool start(OtaSource from) {
+    if (busy()) return false;
+    patcher.begin(flash, OTA_PATCH_WINDOW_BITS);
+    source = from;
+    startedMs = millis();
+    LOG_EVENT(LOG_OTA_STARTED, sourceName(from));
+    changed = true;
+    return true;
+  }
+
+  // Upload chunk, applied at once (POST /ota runs inside handleClient())
+  void write(const uint8_t* data, size_t length) {
+    if (source != OTA_SOURCE_HTTP) return;
+    size_t used = 0;
+    while (used < length && !patcher.failed()) {
+      used += patcher.feed(data + used, length - used, OTA_STEP_BYTES);
+      esp_task_wdt_reset();
+    }
+  }
+
+  // End of the upload
+  OtaPatchResult finish() {
+    if (source != OTA_SOURCE_HTTP) return lastResult;
+    complete();
+    return lastResult;
+  }
+
+  void abort() {
+    if (source == OTA_SOURCE_NONE) return;
+    patcher.abort();
+    flash.abort();
+    LOG_EVENT(LOG_OTA_FAILED, "aborted", patcher.patchBytes());
+    end(OTA_PATCH_ABORTED);
+  }
+
+  // Starts pulling a patch; applied from loop()
+  bool download(const char* url, const char*& error) {
+    if (!url || strncmp(url, "http", 4) != 0) {
+      error = "url required";
+      return false;
+    }
+    if (busy()) {
+      error = "update in progress";
+      return false;
+    }
+    http.setTimeout(OTA_STALL_MS);
+    if (!http.begin(url) || http.GET() != HTTP_CODE_OK) {
+      http.end();
+      error = "download failed";
+      return false;
+    }
+    stream = http.getStreamPtr();
+    expected = http.getSize();
+    received = 0;
+    bufferAt = bufferLength = 0;
+    lastDataMs = millis();
+    start(OTA_SOURCE_MQTT);
+    return true;
+  }
+
+  // Download steps while the gates are idle, trial confirmation once
+  // healthy, and the restart into a new image
+  void loop(bool idle, bool healthy) {
+    if (source == OTA_SOURCE_MQTT) {
+      if (idle) serviceDownload();
+      else lastDataMs = millis();
+    }
+
+    if (onTrial && healthy && millis() >= OTA_CONFIRM_MS) {
+      esp_ota_mark_app_valid_cancel_rollback();
+      preferences.begin("ota", false);
+      preferences.putUInt("slot", 0);
+      preferences.end();
+      onTrial = false;
+      trialBootsLeft = 0;
+      LOG_EVENT(LOG_OTA_CONFIRMED);
+      changed = true;
+    }
+
+    if (restartPending && (int32_t)(millis() - restartAt) >= 0 && idle) {
+      ESP.restart();
+    }
+  }
+
+  // True once after an update started or ended, or the image was confirmed
+  bool takeChanged() {
+    bool was = changed;
+    changed = false;
+    return was;
+  }
+
+  bool busy() const { return source != OTA_SOURCE_NONE || restartPending; }
+
+  void toJson(JsonObject out) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    out["running"] = running->label;
+    out["version"] = FIRMWARE_VERSION;
+    out["trial"] = onTrial;
+    if (onTrial && trialBootsLeft > 0) out["trialBootsLeft"] = trialBootsLeft;
+    out["state"] = restartPending ? "restarting" : source != OTA_SOURCE_NONE ? "applying" : "idle";
+
+    if (source != OTA_SOURCE_NONE) {
+      out["source"] = sourceName(source);
+      out["patchBytes"] = patcher.patchBytes();
+      if (source == OTA_SOURCE_MQTT && expected >= 0) out["patchSize"] = expected;
+      if (patcher.headerReady()) {
+        const OtaPatchHeader& header = patcher.getHeader();
+        out["kind"] = header.kind == OTA_PATCH_DELTA ? "delta" : "full";
+        out["targetBytes"] = patcher.targetBytes();
+        out["targetSize"] = header.targetSize;
+      }
+      out["elapsedMs"] = millis() - startedMs;
+    }
+
+    if (hasResult) {
+      JsonObject last = out["last"].to<JsonObject>();
+      last["result"] = otaPatchResultName(lastResult);
+      last["patchBytes"] = lastPatchBytes;
+      last["durationMs"] = lastDurationMs;
+    }
+  }
+};
+
+#endif // OTA_UPDATE_H
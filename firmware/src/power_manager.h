@@ -0,0 +1,169 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Power Manager
+// =============================================================================
+//
+// Device side of the idle mode in power_policy.h. Where the core is built
+// with power management (CONFIG_PM_ENABLE, tickless idle), esp_pm scales the
+// clock between POWER_CPU_MIN_MHZ and POWER_CPU_MAX_MHZ and light-sleeps
+// whenever every task is blocked, and a lock holds the maximum while active.
+// Otherwise the clock is set to POWER_CPU_IDLE_MHZ while idle and the chip
+// only modem-sleeps; GET /config reports which ("dfs").
+//
+// The radio listens to every beacon while active and to every
+// POWER_LISTEN_INTERVAL-th while idle. Wake pins are armed for the level
+// opposite to the one last read, so they wake on an edge rather than on a
+// closed limit switch; the interrupt disables itself and notifies the loop
+// task, which ends the wait.
+//
+
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <atomic>
+#include <driver/gpio.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include "config.h"
+#include "event_log.h"
+#include "gate_controller.h"
+#include "power_policy.h"
+
+#define POWER_WAKE_PINS_MAX   (4 + 3 * GATE_MAX_COUNT)   // Buttons, limits and obstacle per gate
+
+class PowerManager {
+private:
+  static inline TaskHandle_t loopTask = nullptr;
+  static inline volatile uint32_t edgeUs = 0;
+
+  uint8_t pins[POWER_WAKE_PINS_MAX];
+  bool levels[POWER_WAKE_PINS_MAX];
+  uint8_t pinCount = 0;
+  bool armed = false;
+
+  esp_pm_lock_handle_t lock = nullptr;
+  bool dfs = false;
+  std::atomic<uint8_t> current{POWER_ACTIVE};
+  PowerMeter meter;
+
+  static void IRAM_ATTR onEdge(void* arg) {
+    gpio_intr_disable((gpio_num_t)(uintptr_t)arg);
+    edgeUs = (uint32_t)esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(loopTask, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  }
+
+  void enter(PowerMode mode) {
+    current.store(mode, std::memory_order_relaxed);
+    if (mode == POWER_ACTIVE) {
+      disarm();
+      if (dfs) esp_pm_lock_acquire(lock);
+      else setCpuFrequencyMhz(POWER_CPU_MAX_MHZ);
+      WiFi.setSleep(WIFI_PS_MIN_MODEM);
+    } else {
+      if (dfs) esp_pm_lock_release(lock);
+      else setCpuFrequencyMhz(POWER_CPU_IDLE_MHZ);
+      WiFi.setSleep(WIFI_PS_MAX_MODEM);
+    }
+    LOG_EVENT(LOG_POWER_MODE, powerModeName(mode));
+  }
+
+  // Returns false if a pin changed since the last wait; that edge may have
+  // come while its interrupt was off, so it gets one more pass first
+  bool arm() {
+    bool settled = true;
+    for (uint8_t i = 0; i < pinCount; i++) {
+      gpio_num_t pin = (gpio_num_t)pins[i];
+      bool level = digitalRead(pins[i]);
+      if (armed && level != levels[i]) settled = false;
+      levels[i] = level;
+      gpio_wakeup_enable(pin, level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+      gpio_intr_enable(pin);
+    }
+    armed = true;
+    return settled;
+  }
+
+  void disarm() {
+    for (uint8_t i = 0; i < pinCount; i++) {
+      gpio_intr_disable((gpio_num_t)pins[i]);
+      gpio_wakeup_disable((gpio_num_t)pins[i]);
+    }
+    armed = false;
+  }
+
+  // Up to one slice; true if a wake pin ended it
+  bool wait() {
+    if (!arm()) return true;
+    uint32_t fromUs = micros();
+    bool edge = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(POWER_IDLE_SLICE_MS)) > 0;
+    uint32_t toUs = micros();
+    meter.waited(fromUs, toUs, edge, edge ? toUs - edgeUs : 0);
+    return edge;
+  }
+
+public:
+  // From setup(), on the loop task, once WiFi is up
+  void begin(const uint8_t* wakePins, uint8_t count) {
+    loopTask = xTaskGetCurrentTaskHandle();
+
+    esp_pm_config_esp32_t config = {POWER_CPU_MAX_MHZ, POWER_CPU_MIN_MHZ, true};
+    dfs = esp_pm_configure(&config) == ESP_OK &&
+          esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "active", &lock) == ESP_OK;
+    if (dfs) esp_pm_lock_acquire(lock);
+
+    // Used from the next association on
+    WiFi.setSleep(WIFI_PS_MIN_MODEM);
+    wifi_config_t wifi;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi) == ESP_OK) {
+      wifi.sta.listen_interval = POWER_LISTEN_INTERVAL;
+      esp_wifi_set_config(WIFI_IF_STA, &wifi);
+    }
+
+    // The core may have installed the ISR service already
+    gpio_install_isr_service(0);
+    pinCount = count < POWER_WAKE_PINS_MAX ? count : POWER_WAKE_PINS_MAX;
+    for (uint8_t i = 0; i < pinCount; i++) {
+      pins[i] = wakePins[i];
+      gpio_isr_handler_add((gpio_num_t)pins[i], onEdge, (void*)(uintptr_t)pins[i]);
+      gpio_intr_disable((gpio_num_t)pins[i]);
+    }
+    esp_sleep_enable_gpio_wakeup();
+  }
+
+  // Once per loop() pass, after the work: picks the mode and, while idle,
+  // waits. Returns true if a wake pin ended the wait.
+  bool service(const PowerInputs& in) {
+    PowerMode mode = powerModeFor(in);
+    if (mode != this->mode()) enter(mode);
+    if (meter.pass(micros(), mode)) {
+      LOG_EVENT(LOG_POWER_LATE, meter.lastGapMs());
+    }
+    return mode == POWER_IDLE && wait();
+  }
+
+  PowerMode mode() const { return (PowerMode)current.load(std::memory_order_relaxed); }
+  bool scaling() const { return dfs; }
+
+  void toJson(JsonObject out) {
+    const PowerStats& stats = meter.stats();
+    out["mode"] = powerModeName(mode());
+    out["dfs"] = dfs;
+    out["dutyPct"] = stats.dutyPermille / 10.0f;
+    out["idlePct"] = stats.idlePermille / 10.0f;
+    out["wakes"] = stats.wakes;
+    out["pinWakes"] = stats.pinWakes;
+    out["wakeAvgUs"] = stats.wakeAvgUs;
+    out["wakeMaxUs"] = stats.wakeMaxUs;
+    out["maxGapMs"] = stats.maxGapMs;
+    out["lateGaps"] = meter.lateGaps();
+    out["boundMs"] = POWER_COMMAND_LATENCY_MS;
+  }
+};
+
+#endif // POWER_MANAGER_H
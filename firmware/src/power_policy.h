@@ -0,0 +1,166 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Power Policy
+// =============================================================================
+//
+// Solar sites spend hours with every gate at rest, and loop() used to poll
+// at full clock the whole time. The policy picks a mode for each loop()
+// pass:
+//
+//   POWER_ACTIVE  full clock, loop() polls without waiting: a gate is moving
+//                 (relay interlock included), a staggered group command or an
+//                 OTA transfer is outstanding, or there was activity - a
+//                 command, MQTT traffic, a gate event, a wake pin edge -
+//                 within POWER_ACTIVE_HOLD_MS
+//   POWER_IDLE    loop() waits up to POWER_IDLE_SLICE_MS for a wake pin edge;
+//                 meanwhile the clock scales down, the radio stays in modem
+//                 sleep and, where the core supports it, the chip light-sleeps
+//
+// Buttons, limit switches and obstacle inputs end the wait at once. Network
+// traffic is buffered by the access point until the station's next listen
+// interval and handled on the next pass, so the slice bounds its latency:
+// the worst case below is checked against POWER_COMMAND_LATENCY_MS at
+// compile time, and PowerMeter counts every idle gap that overran it at run
+// time, next to the duty cycle and the wake latency.
+//
+// No Arduino dependency; tools/power_sim.cpp runs the policy through a
+// simulated day and checks the latency bound and the meter.
+//
+
+#ifndef POWER_POLICY_H
+#define POWER_POLICY_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Longest interval between two idle loop() passes
+#define POWER_IDLE_GAP_MS \
+  (POWER_IDLE_SLICE_MS + POWER_WAKE_BUDGET_MS + POWER_PASS_BUDGET_MS)
+
+// A network command that just missed a pass: buffered until the next listen
+// interval, then up to one gap to the next pass and that pass to handle it
+#define POWER_WORST_COMMAND_MS \
+  (POWER_LISTEN_INTERVAL * POWER_BEACON_MS + POWER_IDLE_GAP_MS + POWER_PASS_BUDGET_MS)
+
+// A wake pin edge during a pass runs one more pass before the wait
+#define POWER_WORST_WAKE_MS   (POWER_WAKE_BUDGET_MS + 2 * POWER_PASS_BUDGET_MS)
+
+static_assert(POWER_WORST_COMMAND_MS <= POWER_COMMAND_LATENCY_MS,
+              "Idle slice and listen interval exceed the command latency bound");
+
+// =============================================================================
+// Policy
+// =============================================================================
+
+enum PowerMode : uint8_t {
+  POWER_ACTIVE = 0,
+  POWER_IDLE,
+};
+
+inline const char* powerModeName(PowerMode mode) {
+  return mode == POWER_IDLE ? "idle" : "active";
+}
+
+struct PowerInputs {
+  uint32_t nowMs;
+  uint32_t lastActivityMs;
+  bool moving;                // Any gate moving or its relay pending
+  bool busy;                  // Work that cannot wait a slice
+};
+
+constexpr PowerMode powerModeFor(const PowerInputs& in) {
+  return in.moving || in.busy || in.nowMs - in.lastActivityMs < POWER_ACTIVE_HOLD_MS
+             ? POWER_ACTIVE
+             : POWER_IDLE;
+}
+
+// =============================================================================
+// Meter
+// =============================================================================
+
+// One closed window
+struct PowerStats {
+  uint16_t dutyPermille;      // Awake share: everything but the idle waits
+  uint16_t idlePermille;      // Share spent in POWER_IDLE
+  uint32_t wakes;             // Idle waits ended
+  uint32_t pinWakes;          // ... by a wake pin
+  uint32_t wakeAvgUs;         // Wake pin edge to loop() running
+  uint32_t wakeMaxUs;
+  uint32_t maxGapMs;          // Longest idle pass-to-pass interval
+};
+
+class PowerMeter {
+private:
+  uint32_t windowStartUs = 0;
+  uint32_t lastPassUs = 0;
+  bool started = false;
+  bool lastIdle = false;
+
+  uint32_t waitUs = 0;
+  uint32_t idleUs = 0;
+  uint32_t wakes = 0;
+  uint32_t pinWakes = 0;
+  uint64_t wakeSumUs = 0;
+  uint32_t wakeMaxUs = 0;
+  uint32_t maxGapUs = 0;
+  uint32_t gapUs = 0;
+
+  PowerStats last = {};
+  uint32_t late = 0;
+
+  static uint16_t permille(uint32_t part, uint32_t total) {
+    if (part > total) part = total;
+    return total ? (uint16_t)((uint64_t)part * 1000 / total) : 0;
+  }
+
+public:
+  // Once per loop() pass, with the mode it picked. Returns true if the idle
+  // gap since the previous pass overran POWER_IDLE_GAP_MS.
+  bool pass(uint32_t nowUs, PowerMode mode, uint32_t windowUs = POWER_WINDOW_MS * 1000u) {
+    bool overran = false;
+    if (!started) {
+      started = true;
+      windowStartUs = nowUs;
+    } else if (lastIdle) {
+      gapUs = nowUs - lastPassUs;
+      idleUs += gapUs;
+      if (gapUs > maxGapUs) maxGapUs = gapUs;
+      if (gapUs > POWER_IDLE_GAP_MS * 1000u) {
+        late++;
+        overran = true;
+      }
+    }
+    lastPassUs = nowUs;
+    lastIdle = mode == POWER_IDLE;
+
+    uint32_t total = nowUs - windowStartUs;
+    if (total >= windowUs) {
+      last.dutyPermille = 1000 - permille(waitUs, total);
+      last.idlePermille = permille(idleUs, total);
+      last.wakes = wakes;
+      last.pinWakes = pinWakes;
+      last.wakeAvgUs = pinWakes ? (uint32_t)(wakeSumUs / pinWakes) : 0;
+      last.wakeMaxUs = wakeMaxUs;
+      last.maxGapMs = maxGapUs / 1000;
+      waitUs = idleUs = wakes = pinWakes = wakeMaxUs = maxGapUs = 0;
+      wakeSumUs = 0;
+      windowStartUs = nowUs;
+    }
+    return overran;
+  }
+
+  // One idle wait; latencyUs is from the pin edge when pin is set
+  void waited(uint32_t fromUs, uint32_t toUs, bool pin, uint32_t latencyUs) {
+    waitUs += toUs - fromUs;
+    wakes++;
+    if (!pin) return;
+    pinWakes++;
+    wakeSumUs += latencyUs;
+    if (latencyUs > wakeMaxUs) wakeMaxUs = latencyUs;
+  }
+
+  const PowerStats& stats() const { return last; }
+  uint32_t lateGaps() const { return late; }
+  uint32_t lastGapMs() const { return gapUs / 1000; }
+};
+
+#endif // POWER_POLICY_H
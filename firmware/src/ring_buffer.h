@@ -0,0 +1,53 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Lock-Free Ring Buffer
+// =============================================================================
+//
+// Single-producer / single-consumer ring for handing samples from a
+// producer task (or ISR) to loop() without locks. One slot is kept free to
+// tell full from empty, so the usable capacity is N - 1.
+//
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint16_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+private:
+  T items[N];
+  std::atomic<uint16_t> head{0};
+  std::atomic<uint16_t> tail{0};
+  std::atomic<uint32_t> dropped{0};
+
+public:
+  // Producer side
+  bool push(const T& item) {
+    uint16_t h = head.load(std::memory_order_relaxed);
+    uint16_t next = (h + 1) & (N - 1);
+    if (next == tail.load(std::memory_order_acquire)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items[h] = item;
+    head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side
+  bool pop(T& item) {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    item = items[t];
+    tail.store((t + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  void clear() { tail.store(head.load(std::memory_order_acquire), std::memory_order_release); }
+  uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+#endif // RING_BUFFER_H
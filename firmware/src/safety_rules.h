@@ -0,0 +1,82 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Safety Rules
+// =============================================================================
+//
+// The stop decisions taken while the gate moves, as a pure function of the
+// inputs. checkSafetyConditions() applies them on the device; the trace
+// replay (tools/trace_replay.cpp) applies them to recorded field traces.
+//
+
+#ifndef SAFETY_RULES_H
+#define SAFETY_RULES_H
+
+#include <stdint.h>
+#include "config.h"
+#include "gate_motion.h"
+#include "history.h"
+
+struct SafetyLimits {
+  uint32_t maxOperationTime;    // ms
+  float maxCurrent;             // A
+  float maxTemperature;         // °C
+  uint32_t obstacleDebounceMs;
+};
+
+struct SafetyInputs {
+  uint32_t nowMs;
+  uint32_t operationStartMs;
+  GateState state;
+  bool obstacle;                // Debounced, true = blocked
+  bool limitOpen;               // Switch closed
+  bool limitClose;
+  float current;                // A, filtered
+  float temperature;            // °C, filtered
+};
+
+// Returns true when the gate must stop, with the reason. Checks run in
+// priority order; the first that trips wins.
+inline bool evaluateSafety(const SafetyLimits& limits, const SafetyInputs& in, StopReason& reason) {
+  if (in.nowMs - in.operationStartMs > limits.maxOperationTime) {
+    reason = STOP_TIMEOUT;
+    return true;
+  }
+  if (BuildFeatures::obstacleDetect && in.obstacle) {
+    reason = STOP_OBSTACLE;
+    return true;
+  }
+  if (BuildFeatures::currentMonitor && in.current > limits.maxCurrent) {
+    reason = STOP_OVERCURRENT;
+    return true;
+  }
+  if (BuildFeatures::tempMonitor && in.temperature > limits.maxTemperature) {
+    reason = STOP_OVERHEAT;
+    return true;
+  }
+  if ((in.state == GATE_OPENING && in.limitOpen) || (in.state == GATE_CLOSING && in.limitClose)) {
+    reason = STOP_LIMIT;
+    return true;
+  }
+  return false;
+}
+
+// A level that must hold for debounceMs before it is reported
+class DebouncedInput {
+private:
+  bool stable = false;
+  bool pending = false;
+  uint32_t since = 0;
+
+public:
+  bool update(bool level, uint32_t nowMs, uint32_t debounceMs) {
+    if (level != pending) {
+      pending = level;
+      since = nowMs;
+    }
+    if (pending != stable && nowMs - since >= debounceMs) stable = pending;
+    return stable;
+  }
+
+  bool value() const { return stable; }
+};
+
+#endif // SAFETY_RULES_H
@@ -0,0 +1,350 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Safety Path Execution Time
+// =============================================================================
+//
+// Measured worst-case execution time of the safety path: one gate's loop()
+// pass in gate_controller.h, from reading the inputs through
+// evaluateSafety() to the relays dropping and the operation record being
+// closed. Each pass is attributed to the branch it took:
+//
+//   idle, interlock, relay       at rest, waiting out or ending the interlock
+//   clear, step                  moving, every check evaluated and passed
+//   arrived, limit               travel ends by position step or limit switch
+//   timeout, obstacle,           a safety stop
+//   overcurrent, overheat
+//
+// WcetMeter keeps a quarter-octave histogram per branch (max and
+// percentiles) and counts passes over the budget. SafetyWcetHarness drives
+// a GateController on scripted inputs through every branch, with
+// adversarial inputs: readings just under their limits, a bouncing
+// obstacle input, a per-gate override, a position step due in the same
+// pass as a stop, and a full operation history.
+//
+// No Arduino dependency; the clock is a template parameter. The device runs
+// the harness at boot on the cycle counter and meters its own loop();
+// tools/wcet_check.cpp runs it on the host (`pio run -t wcet`).
+//
+
+#ifndef SAFETY_WCET_H
+#define SAFETY_WCET_H
+
+#include <stdint.h>
+#include "config.h"
+#include "gate_controller.h"
+
+#define WCET_BUCKETS          64      // Quarter octaves from 16 ns to ~2 ms
+#define WCET_BASE_SHIFT       4
+
+// =============================================================================
+// Branches
+// =============================================================================
+
+enum SafetyBranch : uint8_t {
+  WCET_IDLE = 0,
+  WCET_INTERLOCK,
+  WCET_RELAY,
+  WCET_CLEAR,
+  WCET_STEP,
+  WCET_ARRIVED,
+  WCET_LIMIT,
+  WCET_TIMEOUT,
+  WCET_OBSTACLE,
+  WCET_OVERCURRENT,
+  WCET_OVERHEAT,
+  WCET_BRANCH_COUNT
+};
+
+inline const char* safetyBranchName(SafetyBranch branch) {
+  static const char* const names[WCET_BRANCH_COUNT] = {
+    "idle", "interlock", "relay", "clear", "step", "arrived",
+    "limit", "timeout", "obstacle", "overcurrent", "overheat",
+  };
+  return branch < WCET_BRANCH_COUNT ? names[branch] : "unknown";
+}
+
+// Branches a build can take; disabled checks compile out
+constexpr bool safetyBranchEnabled(SafetyBranch branch) {
+  return branch == WCET_OBSTACLE      ? BuildFeatures::obstacleDetect
+         : branch == WCET_OVERCURRENT ? BuildFeatures::currentMonitor
+         : branch == WCET_OVERHEAT    ? BuildFeatures::tempMonitor
+                                      : true;
+}
+
+// What a pass started from
+struct SafetyPass {
+  bool moving;
+  bool settled;
+  uint32_t lastStepMs;
+};
+
+template <typename Gate>
+SafetyPass safetyPassOf(const Gate& gate) {
+  return {gate.moving(), gate.relaysSettled(), gate.getLastStepMs()};
+}
+
+// The branch a pass took, from the gate before and after it
+template <typename Gate>
+SafetyBranch safetyBranchOf(const SafetyPass& before, const Gate& gate) {
+  if (!before.moving) return WCET_IDLE;
+  if (!gate.moving()) {
+    switch (gate.lastStop().reason) {
+      case STOP_COMPLETED: return WCET_ARRIVED;
+      case STOP_LIMIT: return WCET_LIMIT;
+      case STOP_TIMEOUT: return WCET_TIMEOUT;
+      case STOP_OBSTACLE: return WCET_OBSTACLE;
+      case STOP_OVERCURRENT: return WCET_OVERCURRENT;
+      case STOP_OVERHEAT: return WCET_OVERHEAT;
+      default: return WCET_CLEAR;
+    }
+  }
+  if (!before.settled) return gate.relaysSettled() ? WCET_RELAY : WCET_INTERLOCK;
+  return gate.getLastStepMs() != before.lastStepMs ? WCET_STEP : WCET_CLEAR;
+}
+
+// =============================================================================
+// Meter
+// =============================================================================
+
+class WcetHistogram {
+private:
+  uint32_t counts[WCET_BUCKETS] = {};
+  uint32_t total = 0;
+  uint32_t maxNs = 0;
+
+public:
+  // Four buckets per octave of ns >> WCET_BASE_SHIFT, the last one open
+  static uint8_t bucketOf(uint32_t ns) {
+    uint32_t v = ns >> WCET_BASE_SHIFT;
+    if (v < 4) return (uint8_t)v;
+    uint8_t octave = 31 - __builtin_clz(v);
+    uint32_t bucket = 4u * (octave - 1) + ((v >> (octave - 2)) & 3);
+    return bucket < WCET_BUCKETS ? (uint8_t)bucket : WCET_BUCKETS - 1;
+  }
+
+  // Exclusive upper bound of a bucket in ns
+  static uint32_t bucketTop(uint8_t bucket) {
+    if (bucket < 4) return (uint32_t)(bucket + 1) << WCET_BASE_SHIFT;
+    uint8_t octave = bucket / 4 + 1;
+    return (uint32_t)(4 + bucket % 4 + 1) << (octave - 2 + WCET_BASE_SHIFT);
+  }
+
+  void record(uint32_t ns) {
+    counts[bucketOf(ns)]++;
+    total++;
+    if (ns > maxNs) maxNs = ns;
+  }
+
+  // Upper bound of the permille-th percentile, never above the maximum
+  uint32_t percentile(uint16_t permille) const {
+    if (!total) return 0;
+    uint64_t rank = ((uint64_t)total * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint8_t b = 0; b < WCET_BUCKETS; b++) {
+      seen += counts[b];
+      if (seen >= rank) return bucketTop(b) < maxNs ? bucketTop(b) : maxNs;
+    }
+    return maxNs;
+  }
+
+  uint32_t count() const { return total; }
+  uint32_t max() const { return maxNs; }
+};
+
+class WcetMeter {
+private:
+  WcetHistogram branches[WCET_BRANCH_COUNT];
+  uint32_t budgetNs;
+  uint32_t over = 0;
+
+public:
+  explicit WcetMeter(uint32_t budgetUs) : budgetNs(budgetUs * 1000u) {}
+
+  // Returns true if the pass was over budget
+  bool record(SafetyBranch branch, uint32_t ns) {
+    if (branch >= WCET_BRANCH_COUNT) return false;
+    branches[branch].record(ns);
+    if (ns <= budgetNs) return false;
+    over++;
+    return true;
+  }
+
+  const WcetHistogram& branch(SafetyBranch branch) const { return branches[branch]; }
+  uint32_t budgetUs() const { return budgetNs / 1000; }
+  uint32_t overBudget() const { return over; }
+
+  // Slowest branch by maximum
+  SafetyBranch worst() const {
+    uint8_t worst = 0;
+    for (uint8_t b = 1; b < WCET_BRANCH_COUNT; b++) {
+      if (branches[b].max() > branches[worst].max()) worst = b;
+    }
+    return (SafetyBranch)worst;
+  }
+};
+
+// =============================================================================
+// Harness
+// =============================================================================
+
+// Scripted inputs, pulled up (true = inactive); relays only recorded
+struct WcetBoard {
+  bool levels[64];
+  bool relays[64] = {};
+
+  WcetBoard() {
+    for (bool& level : levels) level = true;
+  }
+
+  void write(uint8_t pin, bool level) { relays[pin & 63] = level; }
+  bool read(uint8_t pin) { return levels[pin & 63]; }
+};
+
+// Clock: typename Ticks; static Ticks now(); static uint32_t elapsedNs(Ticks, Ticks)
+template <typename Clock>
+class SafetyWcetHarness {
+private:
+  typedef GateController<WcetBoard> Gate;
+
+  // Current override equal to the configured limit: the override path runs,
+  // the thresholds stay the same
+  const GateDescriptor descriptor = {"wcet", {16, 17, 25, 26, 33, 34}, 5.0f, 0};
+
+  WcetBoard board;
+  Gate gate;
+  uint32_t now = 1000;
+  uint32_t mismatches = 0;
+  bool bounce = false;
+
+  static SafetyLimits limits() {
+    return {GATE_TIMEOUT_MS, 5.0f, (float)TEMP_SHUTDOWN, 0};
+  }
+
+  // At rest at percentage, then moving towards the far end with the relay
+  // energized and the last position step under GATE_STEP_MS ago
+  void startMoving(uint8_t percentage, bool opening) {
+    if (gate.moving()) gate.stop(now, STOP_MANUAL);
+    gate.restore(GATE_STOPPED, percentage);
+    if (opening) gate.open(now);
+    else gate.close(now);
+    now += GATE_INTERLOCK_MS;
+    gate.addSample(now, 1000, 24000);
+    gate.loop(now, limits(), 20.0f);
+    gate.takeEvents();
+  }
+
+  // Returns the time of one pass with the given inputs and checks the
+  // branch it took
+  uint32_t timed(SafetyBranch expected, const SafetyLimits& passLimits, float temperature) {
+    SafetyPass before = safetyPassOf(gate);
+    typename Clock::Ticks start = Clock::now();
+    gate.loop(now, passLimits, temperature);
+    uint32_t ns = Clock::elapsedNs(start, Clock::now());
+    if (safetyBranchOf(before, gate) != expected) mismatches++;
+    gate.takeEvents();
+    return ns;
+  }
+
+  uint32_t run(SafetyBranch branch) {
+    SafetyLimits passLimits = limits();
+    float temperature = (float)TEMP_SHUTDOWN - 0.1f;
+    const GatePins& pins = descriptor.pins;
+
+    switch (branch) {
+      case WCET_IDLE:
+        if (gate.moving()) gate.stop(now, STOP_MANUAL);
+        return timed(branch, passLimits, temperature);
+
+      case WCET_INTERLOCK:
+      case WCET_RELAY:
+        if (gate.moving()) gate.stop(now, STOP_MANUAL);
+        gate.restore(GATE_STOPPED, 50);
+        gate.open(now);
+        now += branch == WCET_RELAY ? GATE_INTERLOCK_MS : 1;
+        return timed(branch, passLimits, temperature);
+
+      case WCET_ARRIVED:
+        // Step until one short of the end, then the arriving step
+        startMoving(100 - 2 * GATE_STEP_PERCENT, true);
+        while (gate.getPercentage() < 100 - GATE_STEP_PERCENT) {
+          now = gate.getLastStepMs() + GATE_STEP_MS;
+          gate.loop(now, limits(), 20.0f);
+        }
+        gate.takeEvents();
+        now = gate.getLastStepMs() + GATE_STEP_MS;
+        return timed(branch, passLimits, temperature);
+
+      default:
+        break;
+    }
+
+    // Mid-travel; every other branch also takes a position step in the pass
+    startMoving(40, true);
+    now = gate.getLastStepMs() + (branch == WCET_CLEAR ? GATE_STEP_MS - 1 : GATE_STEP_MS);
+    gate.addSample(now, 4990, 24000);   // Just under the current limit
+
+    uint32_t ns;
+    switch (branch) {
+      case WCET_CLEAR:
+      case WCET_STEP:
+        // Obstacle input bouncing inside its debounce time
+        passLimits.obstacleDebounceMs = 1000;
+        bounce = !bounce;
+        board.levels[pins.obstacle] = !bounce;
+        ns = timed(branch, passLimits, temperature);
+        board.levels[pins.obstacle] = true;
+        return ns;
+      case WCET_LIMIT:
+        board.levels[pins.limitOpen] = false;
+        ns = timed(branch, passLimits, temperature);
+        board.levels[pins.limitOpen] = true;
+        return ns;
+      case WCET_TIMEOUT:
+        passLimits.maxOperationTime = 1;
+        return timed(branch, passLimits, temperature);
+      case WCET_OBSTACLE:
+        board.levels[pins.obstacle] = false;
+        ns = timed(branch, passLimits, temperature);
+        board.levels[pins.obstacle] = true;
+        return ns;
+      case WCET_OVERCURRENT:
+        gate.addSample(now, 6000, 24000);
+        return timed(branch, passLimits, temperature);
+      case WCET_OVERHEAT:
+        return timed(branch, passLimits, (float)TEMP_SHUTDOWN + 5.0f);
+      default:
+        return 0;
+    }
+  }
+
+public:
+  SafetyWcetHarness() {
+    gate.begin(descriptor, 0, board, "WCET");
+    gate.restore(GATE_CLOSED, 0);
+    gate.takeEvents();
+    // Fill the operation history so every stop overwrites a record
+    for (uint16_t i = 0; i < HISTORY_OPERATIONS; i++) {
+      startMoving(50, true);
+      gate.stop(now, STOP_MANUAL);
+      now += GATE_STEP_MS;
+    }
+    gate.takeEvents();
+  }
+
+  // Runs every enabled branch samples times, interleaved. Returns false if
+  // a pass took another branch than the one its inputs were set up for.
+  bool run(WcetMeter& meter, uint16_t samples) {
+    for (uint16_t i = 0; i < samples; i++) {
+      for (uint8_t b = 0; b < WCET_BRANCH_COUNT; b++) {
+        SafetyBranch branch = (SafetyBranch)b;
+        if (!safetyBranchEnabled(branch)) continue;
+        meter.record(branch, run(branch));
+        now += GATE_STEP_MS;
+      }
+    }
+    return mismatches == 0;
+  }
+
+  uint32_t branchMismatches() const { return mismatches; }
+};
+
+#endif // SAFETY_WCET_H
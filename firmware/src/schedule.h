@@ -0,0 +1,189 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Local Schedules
+// =============================================================================
+//
+// Weekly schedules pushed by the backend and run on the device itself, so
+// they fire on time even while the site is offline. Each enabled entry has
+// one timer in a TimerWheel keyed on UTC epoch seconds; the next occurrence
+// is computed in local time with the C library's TZ rules (POSIX TZ
+// string, including DST), so a schedule keeps its wall-clock time across
+// DST changes. A wall time skipped by a spring-forward change runs at the
+// shifted time; one repeated by a fall-back change runs once, at its first
+// instance.
+//
+// No Arduino dependency; see tools/schedule_check.cpp for the host check.
+//
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "timer_wheel.h"
+
+#define SCHEDULE_MAX          32
+#define SCHEDULE_ID_LEN       32          // Backend cuid plus terminator
+#define SCHEDULE_TZ_LEN       48
+#define SCHEDULE_MIN_EPOCH    1700000000  // Clock considered synced after this
+#define SCHEDULE_MAX_CATCHUP  3600        // s; larger clock jumps re-arm instead
+
+// =============================================================================
+// Schedule Set
+// =============================================================================
+
+enum ScheduleFlags : uint8_t {
+  SCHEDULE_ENABLED = 0x01,
+};
+
+struct ScheduleEntry {
+  char id[SCHEDULE_ID_LEN];
+  uint8_t action;           // GateCommand
+  uint8_t percentage;       // GATE_CMD_PARTIAL target
+  uint8_t hour;             // Local time
+  uint8_t minute;
+  uint8_t second;
+  uint8_t days;             // Bit n = weekday n (0 = Sunday)
+  uint8_t flags;
+  uint8_t reserved;
+};
+
+struct ScheduleSet {
+  uint32_t version;         // Backend revision
+  char tz[SCHEDULE_TZ_LEN]; // POSIX TZ, e.g. "WIB-7" or "CET-1CEST,M3.5.0,M10.5.0/3"
+  uint8_t count;
+  uint8_t reserved[3];
+  ScheduleEntry entries[SCHEDULE_MAX];
+};
+
+// "HH:MM" or "HH:MM:SS" local time
+inline bool parseScheduleTime(const char* text, uint8_t& hour, uint8_t& minute, uint8_t& second) {
+  if (!text) return false;
+  unsigned h = 0, m = 0, s = 0;
+  char tail = 0;
+  int fields = sscanf(text, "%u:%u:%u%c", &h, &m, &s, &tail);
+  if (fields != 2 && fields != 3) return false;
+  if (h > 23 || m > 59 || s > 59) return false;
+  hour = h;
+  minute = m;
+  second = fields == 3 ? s : 0;
+  return true;
+}
+
+// Earliest instant that shows the given local date and time. A time repeated
+// by a fall-back change resolves to its first instance; one skipped by a
+// spring-forward change to the C library's shifted time.
+inline time_t localToEpoch(const struct tm& wall) {
+  time_t best = 0;
+  for (int dst = 0; dst <= 1; dst++) {
+    struct tm t = wall;
+    t.tm_isdst = dst;
+    time_t at = mktime(&t);
+
+    struct tm check;
+    localtime_r(&at, &check);
+    if (check.tm_year == wall.tm_year && check.tm_mon == wall.tm_mon &&
+        check.tm_mday == wall.tm_mday && check.tm_hour == wall.tm_hour &&
+        check.tm_min == wall.tm_min && check.tm_sec == wall.tm_sec &&
+        (best == 0 || at < best)) {
+      best = at;
+    }
+  }
+  if (best == 0) {
+    struct tm t = wall;
+    t.tm_isdst = -1;
+    best = mktime(&t);
+  }
+  return best;
+}
+
+// Next start of the entry's wall time strictly after `after`, or 0 if the
+// entry never runs. Uses the process time zone (setenv("TZ")/tzset()).
+inline time_t nextOccurrence(const ScheduleEntry& entry, time_t after) {
+  if (!(entry.flags & SCHEDULE_ENABLED) || (entry.days & 0x7F) == 0) return 0;
+
+  struct tm today;
+  localtime_r(&after, &today);
+
+  // Today only if the wall time is still ahead; comparing wall times
+  // rather than instants keeps a repeated (fall-back) hour from running twice
+  uint32_t wallNow = today.tm_hour * 3600u + today.tm_min * 60u + today.tm_sec;
+  uint32_t wallAt = entry.hour * 3600u + entry.minute * 60u + entry.second;
+
+  // Eight days covers the same weekday a week later
+  for (int day = wallNow < wallAt ? 0 : 1; day <= 7; day++) {
+    // Calendar date (normalised at noon, clear of any DST change)
+    struct tm date = {};
+    date.tm_year = today.tm_year;
+    date.tm_mon = today.tm_mon;
+    date.tm_mday = today.tm_mday + day;
+    date.tm_hour = 12;
+    date.tm_isdst = -1;
+    mktime(&date);
+    if (!(entry.days & (1 << date.tm_wday))) continue;
+
+    struct tm wall = date;
+    wall.tm_hour = entry.hour;
+    wall.tm_min = entry.minute;
+    wall.tm_sec = entry.second;
+    time_t at = localToEpoch(wall);
+    if (at > after) return at;
+  }
+  return 0;
+}
+
+// =============================================================================
+// Schedule Engine
+// =============================================================================
+
+class ScheduleEngine {
+private:
+  ScheduleSet set = {};
+  TimerWheel<SCHEDULE_MAX> wheel;
+  bool armed = false;
+
+  void armEntry(uint8_t index, time_t after) {
+    time_t at = nextOccurrence(set.entries[index], after);
+    if (at > 0) wheel.arm(index, (uint32_t)at);
+    else wheel.cancel(index);
+  }
+
+public:
+  void load(const ScheduleSet& schedules) {
+    set = schedules;
+    if (set.count > SCHEDULE_MAX) set.count = SCHEDULE_MAX;
+    armed = false;
+  }
+
+  const ScheduleSet& get() const { return set; }
+
+  // Recomputes every timer, e.g. after a clock step or a time zone change
+  void rearm(time_t now) {
+    wheel.reset((uint32_t)now);
+    for (uint8_t i = 0; i < set.count; i++) armEntry(i, now);
+    armed = true;
+  }
+
+  // Call at least once per second with the current UTC time. fire(entry,
+  // dueAt) runs for every occurrence that fell due, in time order; small
+  // gaps (a blocked loop) are caught up, large clock jumps re-arm.
+  template <typename Fire>
+  void loop(time_t now, Fire fire) {
+    int64_t gap = (int64_t)now - (int64_t)wheel.now();
+    if (!armed || gap < 0 || gap > SCHEDULE_MAX_CATCHUP) {
+      rearm(now);
+      return;
+    }
+    wheel.advance((uint32_t)now, [&](uint8_t index, uint32_t due) {
+      fire(set.entries[index], (time_t)due);
+      armEntry(index, (time_t)due);
+    });
+  }
+
+  time_t nextRun(uint8_t index) const {
+    return armed && wheel.isArmed(index) ? (time_t)wheel.expiresAt(index) : 0;
+  }
+};
+
+#endif // SCHEDULE_H
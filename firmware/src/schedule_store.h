@@ -0,0 +1,147 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Schedule Store
+// =============================================================================
+//
+// Persists the schedule set pushed by the backend as one CRC-protected
+// blob in NVS, so schedules keep running after a reboot without a broker.
+// The set is rewritten only when the backend sends a new version.
+//
+
+#ifndef SCHEDULE_STORE_H
+#define SCHEDULE_STORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <rom/crc.h>
+#include "config.h"
+#include "gate_motion.h"
+#include "schedule.h"
+
+// =============================================================================
+// Stored Layout
+// =============================================================================
+
+struct StoredScheduleSet {
+  uint32_t magic;
+  ScheduleSet set;
+  uint32_t crc;
+};
+
+// =============================================================================
+// Schedule Store Class
+// =============================================================================
+
+class ScheduleStore {
+private:
+  static const uint32_t SCHEDULE_MAGIC = 0x47534331; // "GSC1"
+
+  Preferences preferences;
+  uint32_t flashWrites = 0;
+
+  static uint32_t checksum(const StoredScheduleSet& stored) {
+    return crc32_le(0, (const uint8_t*)&stored, offsetof(StoredScheduleSet, crc));
+  }
+
+public:
+  // Loads the stored set. Returns false (and an empty set in the default
+  // time zone) when nothing valid is stored.
+  bool load(ScheduleSet& set) {
+    static StoredScheduleSet stored;
+    bool loaded = false;
+
+    preferences.begin("schedules", true);
+    if (preferences.getBytes("set", &stored, sizeof(stored)) == sizeof(stored) &&
+        stored.magic == SCHEDULE_MAGIC && stored.crc == checksum(stored)) {
+      set = stored.set;
+      loaded = true;
+    }
+    preferences.end();
+
+    if (!loaded) {
+      memset(&set, 0, sizeof(set));
+      strlcpy(set.tz, SCHEDULE_DEFAULT_TZ, sizeof(set.tz));
+    }
+    return loaded;
+  }
+
+  bool save(const ScheduleSet& set) {
+    static StoredScheduleSet stored;
+    memset(&stored, 0, sizeof(stored));
+    stored.magic = SCHEDULE_MAGIC;
+    stored.set = set;
+    stored.crc = checksum(stored);
+
+    preferences.begin("schedules", false);
+    size_t written = preferences.putBytes("set", &stored, sizeof(stored));
+    preferences.end();
+    if (written != sizeof(stored)) return false;
+    flashWrites++;
+    return true;
+  }
+
+  // =============================================================================
+  // JSON Mapping
+  // =============================================================================
+
+  // Parses {"version", "tz", "schedules": [{"id", "action", "time", "days",
+  // "enabled", "percentage"}]} into a complete set. The whole set is
+  // rejected if any entry is invalid.
+  static bool fromJson(JsonObjectConst doc, ScheduleSet& set, const char*& error) {
+    memset(&set, 0, sizeof(set));
+    set.version = doc["version"] | 0;
+
+    const char* tz = doc["tz"] | SCHEDULE_DEFAULT_TZ;
+    if (strlen(tz) >= sizeof(set.tz)) {
+      error = "Time zone too long";
+      return false;
+    }
+    strlcpy(set.tz, tz, sizeof(set.tz));
+
+    JsonArrayConst schedules = doc["schedules"];
+    for (JsonVariantConst item : schedules) {
+      if (set.count >= SCHEDULE_MAX) {
+        error = "Too many schedules";
+        return false;
+      }
+      ScheduleEntry& entry = set.entries[set.count];
+
+      const char* id = item["id"] | "";
+      if (!id[0] || strlen(id) >= sizeof(entry.id)) {
+        error = "Invalid schedule id";
+        return false;
+      }
+      strlcpy(entry.id, id, sizeof(entry.id));
+
+      GateCommand action = parseGateCommand(item["action"] | "");
+      if (action == GATE_CMD_NONE) {
+        error = "Invalid schedule action";
+        return false;
+      }
+      entry.action = action;
+      entry.percentage = min((int)(item["percentage"] | 50), 100);
+
+      if (!parseScheduleTime(item["time"] | "", entry.hour, entry.minute, entry.second)) {
+        error = "Invalid schedule time";
+        return false;
+      }
+
+      for (JsonVariantConst day : item["days"].as<JsonArrayConst>()) {
+        int weekday = day | -1;
+        if (weekday < 0 || weekday > 6) {
+          error = "Invalid schedule day";
+          return false;
+        }
+        entry.days |= 1 << weekday;
+      }
+
+      if (item["enabled"] | true) entry.flags |= SCHEDULE_ENABLED;
+      set.count++;
+    }
+    return true;
+  }
+
+  uint32_t getFlashWrites() const { return flashWrites; }
+};
+
+#endif // SCHEDULE_STORE_H
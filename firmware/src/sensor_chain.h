@@ -0,0 +1,84 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Sensor Chain
+// =============================================================================
+//
+// Raw ADC readings to filtered engineering values: ACS712 current through a
+// median and EMA, the supply divider through a median and EMA, and the NTC
+// table through a Kalman filter. readSensors() and the trace replay
+// (tools/trace_replay.cpp) both run this chain, so replayed stop decisions
+// see exactly the values the device saw. The channels convert at their own
+// rates (acquisition.h), so an update carries the channels that have a new
+// conversion and the others keep their last value. Gates beyond the first
+// have only their own current channel, filtered the same way
+// (CurrentFilter).
+//
+
+#ifndef SENSOR_CHAIN_H
+#define SENSOR_CHAIN_H
+
+#include <stdint.h>
+#include "config.h"
+#include "filters.h"
+
+inline int32_t currentFromRaw(uint16_t raw) {
+  // ACS712: ACS712_MV_PER_A around the zero-current offset
+  int32_t currentMa = (adcToMilliVolts(raw) - ACS712_ZERO_MV) * 1000 / ACS712_MV_PER_A;
+  return currentMa < 0 ? 0 : currentMa;
+}
+
+inline int32_t voltageFromRaw(uint16_t raw) {
+  return adcToMilliVolts(raw) * VOLTAGE_DIVIDER_RATIO;
+}
+
+// Channels of an update, as a mask
+enum SensorChannel : uint8_t {
+  SENSOR_CH_CURRENT = 1,
+  SENSOR_CH_VOLTAGE = 2,
+  SENSOR_CH_TEMPERATURE = 4,
+  SENSOR_CH_ALL = 7,
+};
+
+struct SensorReading {
+  int32_t currentMa;
+  int32_t voltageMv;
+  int32_t temperatureCc;    // centi-°C
+};
+
+// Motor current of one gate
+class CurrentFilter {
+private:
+  MovingMedian<5> median;
+  EmaFilter<2> ema;
+
+public:
+  int32_t update(uint16_t raw) { return ema.update(median.update(currentFromRaw(raw))); }
+};
+
+class SensorChain {
+private:
+  CurrentFilter current;
+  MovingMedian<5> voltageMedian;
+  EmaFilter<2> voltageEma;
+  Kalman1D temperatureKalman{TEMP_KALMAN_Q, TEMP_KALMAN_R};
+  SensorReading last = {};
+
+public:
+  static constexpr NtcTable<NTC_BETA, NTC_R25, NTC_SERIES_R> ntc{};
+
+  // Raw values of channels not in the mask are ignored
+  SensorReading update(uint8_t channels, uint16_t rawCurrent, uint16_t rawVoltage,
+                       uint16_t rawTemperature) {
+    if (channels & SENSOR_CH_CURRENT) last.currentMa = current.update(rawCurrent);
+    if (channels & SENSOR_CH_VOLTAGE) {
+      last.voltageMv = voltageEma.update(voltageMedian.update(voltageFromRaw(rawVoltage)));
+    }
+    if (channels & SENSOR_CH_TEMPERATURE) {
+      last.temperatureCc = temperatureKalman.update(ntc.toCentiCelsius(rawTemperature));
+    }
+    return last;
+  }
+
+  const SensorReading& reading() const { return last; }
+};
+
+#endif // SENSOR_CHAIN_H
@@ -0,0 +1,171 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Gate State Persistence
+// =============================================================================
+//
+// Two-tier store for the gate state and position:
+//   - RTC slow memory: written on every transition, survives watchdog,
+//     brownout and software resets. Restore is a handful of loads; flash is
+//     only read on a cold boot, or after a warm one on the first flush
+//     check.
+//   - NVS flash: coalesced, written at most every STATE_FLUSH_INTERVAL_MS and
+//     only while the gate is idle, so flash wear stays flat regardless of how
+//     many operations run per day.
+//
+// One store per gate (see gate_controller.h); gate 0 keeps the key of the
+// single-gate firmware, so its state survives the upgrade.
+//
+
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <rom/crc.h>
+#include "config.h"
+#include "gate_controller.h"
+
+// =============================================================================
+// Snapshot Layout
+// =============================================================================
+
+struct GateSnapshot {
+  uint32_t magic;
+  uint16_t sequence;
+  uint8_t state;
+  uint8_t percentage;
+  uint32_t crc;
+};
+
+// Survives every reset except power-on
+RTC_NOINIT_ATTR static GateSnapshot rtcGateSnapshot[GATE_MAX_COUNT];
+
+// =============================================================================
+// Gate State Store Class
+// =============================================================================
+
+class GateStateStore {
+private:
+  static const uint32_t SNAPSHOT_MAGIC = 0x47545331; // "GTS1"
+
+  Preferences preferences;
+  uint8_t slot = 0;
+  char key[8] = "snap";
+
+  GateSnapshot current = {};
+  uint8_t flashedState = 0xFF;
+  uint8_t flashedPercentage = 0xFF;
+  bool flashedKnown = false;
+  bool dirty = false;
+  unsigned long lastFlush = 0;
+  uint32_t flashWrites = 0;
+
+  static uint32_t checksum(const GateSnapshot& snap) {
+    return crc32_le(0, (const uint8_t*)&snap, offsetof(GateSnapshot, crc));
+  }
+
+  static bool isValid(const GateSnapshot& snap) {
+    return snap.magic == SNAPSHOT_MAGIC && snap.crc == checksum(snap);
+  }
+
+  // Reads what the flash holds; false if nothing valid
+  bool loadFlashed(GateSnapshot& stored) {
+    preferences.begin("gatestate", true);
+    bool valid = preferences.getBytes(key, &stored, sizeof(stored)) == sizeof(stored) &&
+                 isValid(stored);
+    preferences.end();
+    if (valid) {
+      flashedState = stored.state;
+      flashedPercentage = stored.percentage;
+    }
+    flashedKnown = true;
+    return valid;
+  }
+
+  bool differsFromFlash() const {
+    return !flashedKnown || current.state != flashedState ||
+           current.percentage != flashedPercentage;
+  }
+
+public:
+  // =============================================================================
+  // Restore
+  // =============================================================================
+
+  // Loads the most recent snapshot of gate index. Returns false on a cold
+  // first boot. A valid RTC snapshot is used without touching flash.
+  bool restore(uint8_t index, uint8_t& state, uint8_t& percentage) {
+    slot = index < GATE_MAX_COUNT ? index : 0;
+    if (slot > 0) snprintf(key, sizeof(key), "snap%u", slot);
+
+    if (isValid(rtcGateSnapshot[slot])) {
+      current = rtcGateSnapshot[slot];
+    } else {
+      GateSnapshot stored;
+      if (!loadFlashed(stored)) return false;
+      current = stored;
+    }
+
+    state = current.state;
+    percentage = current.percentage;
+    dirty = differsFromFlash();
+    return true;
+  }
+
+  // =============================================================================
+  // Recording
+  // =============================================================================
+
+  // Called on every transition and position step. RTC write only.
+  void record(uint8_t state, uint8_t percentage) {
+    if (state == current.state && percentage == current.percentage &&
+        current.magic == SNAPSHOT_MAGIC) {
+      return;
+    }
+
+    current.magic = SNAPSHOT_MAGIC;
+    current.sequence++;
+    current.state = state;
+    current.percentage = percentage;
+    current.crc = checksum(current);
+    rtcGateSnapshot[slot] = current;
+
+    dirty = differsFromFlash();
+  }
+
+  // Flushes to flash when the gate is idle and the coalescing window is over.
+  // After a warm reset the flash content is read here first, so an unchanged
+  // state is not written again.
+  void loop(bool moving) {
+    if (!dirty || moving) return;
+    if (!flashedKnown) {
+      GateSnapshot stored;
+      loadFlashed(stored);
+      dirty = differsFromFlash();
+      if (!dirty) return;
+    }
+    if (flashWrites > 0 && millis() - lastFlush < STATE_FLUSH_INTERVAL_MS) return;
+    flush();
+  }
+
+  void flush() {
+    preferences.begin("gatestate", false);
+    preferences.putBytes(key, &current, sizeof(current));
+    preferences.end();
+
+    flashedState = current.state;
+    flashedPercentage = current.percentage;
+    flashedKnown = true;
+    dirty = false;
+    lastFlush = millis();
+    flashWrites++;
+  }
+
+  // =============================================================================
+  // Getters
+  // =============================================================================
+
+  bool isDirty() { return dirty; }
+  uint32_t getFlashWrites() { return flashWrites; }
+};
+
+#endif // STATE_STORE_H
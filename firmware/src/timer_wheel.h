@@ -0,0 +1,147 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Hierarchical Timer Wheel
+// =============================================================================
+//
+// Fixed-capacity timer wheel at one-second resolution. Three levels of
+// 256 x 1 s, 64 x 256 s and 64 x 16384 s slots span about 12 days; timers
+// further out sit in the last slot and are re-placed as it comes round.
+// Arming, cancelling and firing are O(1); each elapsed second costs one
+// slot visit plus an occasional cascade of one coarser slot.
+//
+// Time is whatever monotonically increasing second count the caller uses
+// (UTC epoch seconds for schedules). No Arduino dependency.
+//
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+template <uint8_t MaxTimers>
+class TimerWheel {
+  static_assert(MaxTimers < 255, "timer index must fit in uint8_t");
+
+private:
+  static const uint16_t LEVEL0 = 256;
+  static const uint16_t LEVEL1 = 64;
+  static const uint16_t LEVEL2 = 64;
+  static const uint16_t SLOTS = LEVEL0 + LEVEL1 + LEVEL2;
+  static const uint8_t NIL = 0xFF;
+
+  struct Node {
+    uint32_t expires;
+    uint16_t slot;
+    uint8_t next;
+    uint8_t prev;
+    bool armed;
+  };
+
+  Node nodes[MaxTimers];
+  uint8_t heads[SLOTS];
+  uint32_t current = 0;   // Last processed second
+
+  void link(uint8_t index, uint16_t slot) {
+    Node& node = nodes[index];
+    node.slot = slot;
+    node.prev = NIL;
+    node.next = heads[slot];
+    if (node.next != NIL) nodes[node.next].prev = index;
+    heads[slot] = index;
+  }
+
+  void unlink(uint8_t index) {
+    Node& node = nodes[index];
+    if (node.prev != NIL) nodes[node.prev].next = node.next;
+    else heads[node.slot] = node.next;
+    if (node.next != NIL) nodes[node.next].prev = node.prev;
+  }
+
+  void place(uint8_t index) {
+    uint32_t expires = nodes[index].expires;
+    uint32_t delta = expires - current;
+    uint16_t slot;
+    if (delta < LEVEL0) {
+      slot = expires & (LEVEL0 - 1);
+    } else if (delta < (uint32_t)LEVEL0 * LEVEL1) {
+      slot = LEVEL0 + ((expires >> 8) & (LEVEL1 - 1));
+    } else if (delta < (uint32_t)LEVEL0 * LEVEL1 * LEVEL2) {
+      slot = LEVEL0 + LEVEL1 + ((expires >> 14) & (LEVEL2 - 1));
+    } else {
+      // Beyond the span: park in the farthest slot, re-placed on cascade
+      slot = LEVEL0 + LEVEL1 + (((current >> 14) + LEVEL2 - 1) & (LEVEL2 - 1));
+    }
+    link(index, slot);
+  }
+
+  // Re-places every timer of a coarse slot relative to the current second
+  void cascade(uint16_t slot) {
+    uint8_t index = heads[slot];
+    heads[slot] = NIL;
+    while (index != NIL) {
+      uint8_t next = nodes[index].next;
+      place(index);
+      index = next;
+    }
+  }
+
+public:
+  TimerWheel() { reset(0); }
+
+  // Drops all timers and restarts the wheel at now
+  void reset(uint32_t now) {
+    current = now;
+    for (uint16_t i = 0; i < SLOTS; i++) heads[i] = NIL;
+    for (uint8_t i = 0; i < MaxTimers; i++) nodes[i].armed = false;
+  }
+
+  // Timers due at or before now fire on the next second
+  void arm(uint8_t index, uint32_t expires) {
+    if (index >= MaxTimers) return;
+    cancel(index);
+    if ((int32_t)(expires - current) <= 0) expires = current + 1;
+    nodes[index].expires = expires;
+    nodes[index].armed = true;
+    place(index);
+  }
+
+  void cancel(uint8_t index) {
+    if (index >= MaxTimers || !nodes[index].armed) return;
+    unlink(index);
+    nodes[index].armed = false;
+  }
+
+  bool isArmed(uint8_t index) const { return index < MaxTimers && nodes[index].armed; }
+  uint32_t expiresAt(uint8_t index) const { return nodes[index].expires; }
+  uint32_t now() const { return current; }
+
+  // Processes every second up to and including now, calling
+  // fire(index, expires) for each timer that falls due. A fired timer is
+  // disarmed before the callback, which may re-arm it.
+  template <typename Fire>
+  void advance(uint32_t now, Fire fire) {
+    while ((int32_t)(now - current) > 0) {
+      current++;
+
+      if ((current & (LEVEL0 - 1)) == 0) {
+        if (((current >> 8) & (LEVEL1 - 1)) == 0) {
+          cascade(LEVEL0 + LEVEL1 + ((current >> 14) & (LEVEL2 - 1)));
+        }
+        cascade(LEVEL0 + ((current >> 8) & (LEVEL1 - 1)));
+      }
+
+      uint16_t slot = current & (LEVEL0 - 1);
+      uint8_t index = heads[slot];
+      while (index != NIL) {
+        uint8_t next = nodes[index].next;
+        if (nodes[index].expires == current) {
+          unlink(index);
+          nodes[index].armed = false;
+          fire(index, current);
+        }
+        index = next;
+      }
+    }
+  }
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,133 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - TLS Session Cache
+// =============================================================================
+//
+// A full TLS handshake costs the ESP32 an ECDHE key exchange and a
+// certificate chain check: seconds of CPU and tens of KB of heap. A
+// reconnect after a WiFi blip resumes the last session instead, with only
+// symmetric crypto and one round trip less. The serialized session,
+// including the server's ticket if it issued one, is kept in a
+// TlsSessionSlot in RTC memory, so it also survives a watchdog or OTA
+// restart. A slot is not offered to another host:port, and not if it is
+// corrupted or older than TLS_SESSION_LIFETIME_S.
+//
+// TlsStats counts full and resumed handshakes with their time and heap
+// cost; tls_transport.h reports them through GET /config.
+//
+// No Arduino dependency; tools/tls_bench.cpp stores and resumes real
+// sessions through a slot against a local TLS broker.
+//
+
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+
+#define TLS_SESSION_MAGIC     0x544C5331u   // "TLS1"
+#define TLS_CLOCK_MIN_EPOCH   1700000000u   // Below this the clock is not set
+
+// =============================================================================
+// Session Slot
+// =============================================================================
+
+struct TlsSessionSlot {
+  uint32_t magic;
+  uint32_t peer;              // tlsPeerHash() of the server
+  uint32_t savedAt;           // Epoch seconds, 0 = clock not set
+  uint32_t length;
+  uint32_t crc;               // Over peer, savedAt, length and the data
+  uint8_t data[TLS_SESSION_MAX];
+};
+
+// FNV-1a over "host:port"
+inline uint32_t tlsPeerHash(const char* host, uint16_t port) {
+  uint32_t hash = 2166136261u;
+  for (const char* p = host; *p; p++) hash = (hash ^ (uint8_t)*p) * 16777619u;
+  hash = (hash ^ ':') * 16777619u;
+  hash = (hash ^ (port & 0xFF)) * 16777619u;
+  return (hash ^ (port >> 8)) * 16777619u;
+}
+
+// CRC-32 (IEEE), same as the ROM's crc32_le(0, ...)
+inline uint32_t tlsCrc32(uint32_t crc, const uint8_t* data, size_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+inline uint32_t tlsSlotCrc(const TlsSessionSlot& slot) {
+  const uint8_t* fields = (const uint8_t*)&slot.peer;
+  uint32_t crc = tlsCrc32(0, fields, offsetof(TlsSessionSlot, crc) - offsetof(TlsSessionSlot, peer));
+  return tlsCrc32(crc, slot.data, slot.length <= TLS_SESSION_MAX ? slot.length : 0);
+}
+
+inline void tlsSessionForget(TlsSessionSlot& slot) { slot.magic = 0; }
+
+// False if the session does not fit; the slot is then cleared
+inline bool tlsSessionStore(TlsSessionSlot& slot, uint32_t peer, const uint8_t* data,
+                            size_t length, uint32_t nowEpoch) {
+  tlsSessionForget(slot);
+  if (length == 0 || length > TLS_SESSION_MAX) return false;
+  slot.peer = peer;
+  slot.savedAt = nowEpoch >= TLS_CLOCK_MIN_EPOCH ? nowEpoch : 0;
+  slot.length = (uint32_t)length;
+  memcpy(slot.data, data, length);
+  slot.crc = tlsSlotCrc(slot);
+  slot.magic = TLS_SESSION_MAGIC;
+  return true;
+}
+
+// Length of the session to offer to peer, or 0. The age is only checked
+// when both clocks were set; a stale session costs a full handshake anyway.
+inline size_t tlsSessionLoad(const TlsSessionSlot& slot, uint32_t peer, uint32_t nowEpoch,
+                             const uint8_t*& data) {
+  if (slot.magic != TLS_SESSION_MAGIC || slot.peer != peer) return 0;
+  if (slot.length == 0 || slot.length > TLS_SESSION_MAX || slot.crc != tlsSlotCrc(slot)) return 0;
+  if (slot.savedAt && nowEpoch >= TLS_CLOCK_MIN_EPOCH &&
+      nowEpoch - slot.savedAt > TLS_SESSION_LIFETIME_S) {
+    return 0;
+  }
+  data = slot.data;
+  return slot.length;
+}
+
+// =============================================================================
+// Handshake Statistics
+// =============================================================================
+
+struct TlsStats {
+  uint32_t full = 0;
+  uint32_t resumed = 0;
+  uint32_t failed = 0;
+  uint32_t fullMsSum = 0;
+  uint32_t resumedMsSum = 0;
+  uint32_t fullMaxMs = 0;
+  uint32_t resumedMaxMs = 0;
+  uint32_t lastMs = 0;
+  uint32_t heapBytes = 0;     // Held by the open session after the handshake
+
+  void record(bool wasResumed, uint32_t ms, uint32_t heap) {
+    if (wasResumed) {
+      resumed++;
+      resumedMsSum += ms;
+      if (ms > resumedMaxMs) resumedMaxMs = ms;
+    } else {
+      full++;
+      fullMsSum += ms;
+      if (ms > fullMaxMs) fullMaxMs = ms;
+    }
+    lastMs = ms;
+    heapBytes = heap;
+  }
+
+  uint32_t fullAvgMs() const { return full ? fullMsSum / full : 0; }
+  uint32_t resumedAvgMs() const { return resumed ? resumedMsSum / resumed : 0; }
+};
+
+#endif // TLS_SESSION_H
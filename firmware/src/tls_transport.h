@@ -0,0 +1,512 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - TLS Transport
+// =============================================================================
+//
+// TLS for the MQTT link and the local API, on the core's mbedtls with its
+// hardware AES, SHA and bignum engines. Both ends use TLS 1.2 with
+// ECDHE and AES-128-GCM on P-256 only, so a handshake never takes the
+// software-only paths. Certificates are parsed once and the configuration
+// is kept for every later connection.
+//
+//   TlsClient  Client for PubSubClient. It offers the session in
+//              rtcTlsSession (tls_session.h), so a reconnect after a WiFi
+//              blip or a restart resumes without a key exchange, and asks
+//              the broker for TLS_MAX_FRAGMENT-byte records.
+//   TlsFront   Terminates TLS for the local API on HTTPS_PORT and relays
+//              each connection to the WebServer, which then only listens
+//              on loopback. Clients resume by session id (TLS_SERVER_CACHE
+//              entries) or ticket (key generated at boot). Without a usable
+//              certificate it relays plain HTTP on WEB_SERVER_PORT instead,
+//              so the API and OTA stay reachable.
+//
+// Handshake time and heap cost of both are reported through GET /config.
+//
+
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Client.h>
+#include <LittleFS.h>
+#include <time.h>
+#include <lwip/sockets.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ssl_cache.h>
+#include <mbedtls/ssl_ticket.h>
+#include <mbedtls/x509_crt.h>
+#include "config.h"
+#include "tls_session.h"
+
+// Survives every reset except power-on
+RTC_NOINIT_ATTR static TlsSessionSlot rtcTlsSession;
+
+// Accelerated on the ESP32: ECDHE on P-256, AES-GCM, SHA-256
+static const int TLS_CIPHERSUITES[] = {
+  MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+  MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+  0,
+};
+
+static const mbedtls_ecp_group_id TLS_CURVES[] = {MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_NONE};
+
+// Reads a PEM file with the terminator mbedtls expects
+inline bool tlsReadPem(const char* path, String& out) {
+  if (!LittleFS.begin(true) || !LittleFS.exists(path)) return false;
+  File file = LittleFS.open(path, "r");
+  if (!file) return false;
+  out = file.readString();
+  file.close();
+  return out.length() > 0;
+}
+
+inline void tlsStatsJson(const TlsStats& stats, JsonObject out) {
+  out["full"] = stats.full;
+  out["resumed"] = stats.resumed;
+  out["failed"] = stats.failed;
+  out["fullAvgMs"] = stats.fullAvgMs();
+  out["fullMaxMs"] = stats.fullMaxMs;
+  out["resumedAvgMs"] = stats.resumedAvgMs();
+  out["resumedMaxMs"] = stats.resumedMaxMs;
+  out["heapBytes"] = stats.heapBytes;
+}
+
+// Shared by client and front: common suites, curves and TLS 1.2
+inline void tlsConfigure(mbedtls_ssl_config& conf, mbedtls_ctr_drbg_context& drbg) {
+  mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+  mbedtls_ssl_conf_ciphersuites(&conf, TLS_CIPHERSUITES);
+  mbedtls_ssl_conf_curves(&conf, TLS_CURVES);
+  mbedtls_ssl_conf_min_version(&conf, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+  mbedtls_ssl_conf_max_version(&conf, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+  mbedtls_ssl_conf_read_timeout(&conf, TLS_IO_TIMEOUT_MS);
+}
+
+// =============================================================================
+// MQTT Client
+// =============================================================================
+
+class TlsClient : public Client {
+private:
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_x509_crt ca;
+  mbedtls_ssl_config conf;
+  bool configured = false;
+
+  mbedtls_net_context net;
+  mbedtls_ssl_context ssl;
+  bool open = false;
+  int peeked = -1;
+  TlsStats stats;
+
+  static uint32_t epoch() { return (uint32_t)time(nullptr); }
+
+  static unsigned char fragmentCode() {
+    switch (TLS_MAX_FRAGMENT) {
+      case 512: return MBEDTLS_SSL_MAX_FRAG_LEN_512;
+      case 1024: return MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+      case 2048: return MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+      default: return MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+    }
+  }
+
+  // Once: seeds the generator, parses the CA and builds the configuration
+  bool configure() {
+    if (configured) return true;
+    String pem;
+    if (!tlsReadPem(TLS_CA_FILE, pem)) return false;
+    if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                              (const unsigned char*)"gatemate-mqtt", 13) != 0 ||
+        mbedtls_x509_crt_parse(&ca, (const unsigned char*)pem.c_str(), pem.length() + 1) != 0 ||
+        mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+      return false;
+    }
+    tlsConfigure(conf, drbg);
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf, &ca, nullptr);
+    mbedtls_ssl_conf_max_frag_len(&conf, fragmentCode());
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    configured = true;
+    return true;
+  }
+
+  // Offers the cached session; true if the slot held one for this peer
+  bool offer(uint32_t peer, mbedtls_ssl_session& offered) {
+    const uint8_t* data;
+    size_t length = tlsSessionLoad(rtcTlsSession, peer, epoch(), data);
+    return length && mbedtls_ssl_session_load(&offered, data, length) == 0 &&
+           mbedtls_ssl_set_session(&ssl, &offered) == 0;
+  }
+
+  // A resumed session keeps the master secret of the one offered, whether
+  // the server found it by id or by ticket
+  bool keep(uint32_t peer, const mbedtls_ssl_session* offered) {
+    mbedtls_ssl_session fresh;
+    mbedtls_ssl_session_init(&fresh);
+    bool resumed = false;
+    if (mbedtls_ssl_get_session(&ssl, &fresh) == 0) {
+      resumed = offered && memcmp(fresh.master, offered->master, sizeof(fresh.master)) == 0;
+      static uint8_t buffer[TLS_SESSION_MAX];
+      size_t length = 0;
+      if (mbedtls_ssl_session_save(&fresh, buffer, sizeof(buffer), &length) != 0 ||
+          !tlsSessionStore(rtcTlsSession, peer, buffer, length, epoch())) {
+        tlsSessionForget(rtcTlsSession);
+      }
+    }
+    mbedtls_ssl_session_free(&fresh);
+    return resumed;
+  }
+
+  void release() {
+    mbedtls_ssl_free(&ssl);
+    mbedtls_net_free(&net);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_net_init(&net);
+    open = false;
+    peeked = -1;
+  }
+
+public:
+  TlsClient() {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_net_init(&net);
+    mbedtls_ssl_init(&ssl);
+  }
+
+  int connect(const char* host, uint16_t port) override {
+    stop();
+    if (!configure()) {
+      stats.failed++;
+      return 0;
+    }
+    uint32_t heap = ESP.getFreeHeap();
+    uint32_t start = millis();
+    char service[6];
+    snprintf(service, sizeof(service), "%u", port);
+    if (mbedtls_net_connect(&net, host, service, MBEDTLS_NET_PROTO_TCP) != 0 ||
+        mbedtls_ssl_setup(&ssl, &conf) != 0 || mbedtls_ssl_set_hostname(&ssl, host) != 0) {
+      stats.failed++;
+      release();
+      return 0;
+    }
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, nullptr, mbedtls_net_recv_timeout);
+
+    uint32_t peer = tlsPeerHash(host, port);
+    mbedtls_ssl_session offered;
+    mbedtls_ssl_session_init(&offered);
+    bool offering = offer(peer, offered);
+
+    int rc;
+    while ((rc = mbedtls_ssl_handshake(&ssl)) != 0) {
+      if (rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) break;
+      if (millis() - start > TLS_HANDSHAKE_TIMEOUT_MS) break;
+    }
+    if (rc != 0) {
+      // A rejected session must not fail the next attempt too
+      if (offering) tlsSessionForget(rtcTlsSession);
+      mbedtls_ssl_session_free(&offered);
+      stats.failed++;
+      release();
+      return 0;
+    }
+
+    bool resumed = keep(peer, offering ? &offered : nullptr);
+    mbedtls_ssl_session_free(&offered);
+    // From here on reads must not block loop(); see available()
+    mbedtls_net_set_nonblock(&net);
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, nullptr);
+    open = true;
+    stats.record(resumed, millis() - start, heap - ESP.getFreeHeap());
+    return 1;
+  }
+
+  int connect(IPAddress ip, uint16_t port) override {
+    return connect(ip.toString().c_str(), port);
+  }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    size_t sent = 0;
+    uint32_t start = millis();
+    while (open && sent < size) {
+      int rc = mbedtls_ssl_write(&ssl, buffer + sent, size - sent);
+      if (rc > 0) {
+        sent += rc;
+      } else if ((rc == MBEDTLS_ERR_SSL_WANT_WRITE || rc == MBEDTLS_ERR_SSL_WANT_READ) &&
+                 millis() - start < TLS_IO_TIMEOUT_MS) {
+        delay(1);
+      } else {
+        stop();
+      }
+    }
+    return sent;
+  }
+
+  size_t write(uint8_t byte) override { return write(&byte, 1); }
+
+  int available() override {
+    if (!open) return 0;
+    size_t pending = mbedtls_ssl_get_bytes_avail(&ssl);
+    if (pending == 0) {
+      // Processes whatever arrived without blocking; EOF and alerts close
+      int rc = mbedtls_ssl_read(&ssl, nullptr, 0);
+      if (rc < 0 && rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        stop();
+        return peeked >= 0 ? 1 : 0;
+      }
+      pending = mbedtls_ssl_get_bytes_avail(&ssl);
+    }
+    return (int)pending + (peeked >= 0 ? 1 : 0);
+  }
+
+  int read(uint8_t* buffer, size_t size) override {
+    if (size == 0 || available() == 0) return -1;
+    size_t got = 0;
+    if (peeked >= 0) {
+      buffer[got++] = (uint8_t)peeked;
+      peeked = -1;
+    }
+    if (got < size && open) {
+      int rc = mbedtls_ssl_read(&ssl, buffer + got, size - got);
+      if (rc > 0) got += rc;
+      else if (rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) stop();
+    }
+    return got ? (int)got : -1;
+  }
+
+  int read() override {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+  }
+
+  int peek() override {
+    if (peeked < 0 && available() > 0) {
+      uint8_t byte;
+      if (mbedtls_ssl_read(&ssl, &byte, 1) == 1) peeked = byte;
+    }
+    return peeked;
+  }
+
+  void flush() override {}
+
+  void stop() override {
+    if (open) mbedtls_ssl_close_notify(&ssl);
+    release();
+  }
+
+  uint8_t connected() override { return open || peeked >= 0; }
+  operator bool() override { return open; }
+
+  void toJson(JsonObject out) {
+    tlsStatsJson(stats, out);
+    out["cached"] = rtcTlsSession.magic == TLS_SESSION_MAGIC;
+  }
+};
+
+// =============================================================================
+// Local API Front
+// =============================================================================
+
+class TlsFront {
+private:
+  static const size_t CHUNK = 1024;
+
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_x509_crt cert;
+  mbedtls_pk_context key;
+  mbedtls_ssl_config conf;
+  mbedtls_ssl_cache_context cache;
+  mbedtls_ssl_ticket_context tickets;
+  mbedtls_net_context listener;
+  uint16_t upstreamPort = 0;
+  bool tls = false;           // Plain relay without a certificate
+  bool resuming = false;      // Set by the cache and ticket lookups below
+  TlsStats stats;
+
+  static int cacheGet(void* self, mbedtls_ssl_session* session) {
+    TlsFront* front = (TlsFront*)self;
+    int rc = mbedtls_ssl_cache_get(&front->cache, session);
+    if (rc == 0) front->resuming = true;
+    return rc;
+  }
+
+  static int cacheSet(void* self, const mbedtls_ssl_session* session) {
+    return mbedtls_ssl_cache_set(&((TlsFront*)self)->cache, session);
+  }
+
+  static int ticketParse(void* self, mbedtls_ssl_session* session, unsigned char* buffer,
+                         size_t length) {
+    TlsFront* front = (TlsFront*)self;
+    int rc = mbedtls_ssl_ticket_parse(&front->tickets, session, buffer, length);
+    if (rc == 0) front->resuming = true;
+    return rc;
+  }
+
+  static int ticketWrite(void* self, const mbedtls_ssl_session* session, unsigned char* start,
+                         const unsigned char* end, size_t* length, uint32_t* lifetime) {
+    return mbedtls_ssl_ticket_write(&((TlsFront*)self)->tickets, session, start, end, length,
+                                    lifetime);
+  }
+
+  // Certificate, key, ticket key and the server configuration
+  bool setup() {
+    String certPem, keyPem;
+    if (!tlsReadPem(TLS_CERT_FILE, certPem) || !tlsReadPem(TLS_KEY_FILE, keyPem)) return false;
+    if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                              (const unsigned char*)"gatemate-https", 14) != 0 ||
+        mbedtls_x509_crt_parse(&cert, (const unsigned char*)certPem.c_str(),
+                               certPem.length() + 1) != 0 ||
+        mbedtls_pk_parse_key(&key, (const unsigned char*)keyPem.c_str(), keyPem.length() + 1,
+                             nullptr, 0) != 0 ||
+        mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+        mbedtls_ssl_conf_own_cert(&conf, &cert, &key) != 0 ||
+        mbedtls_ssl_ticket_setup(&tickets, mbedtls_ctr_drbg_random, &drbg,
+                                 MBEDTLS_CIPHER_AES_128_GCM, TLS_SESSION_LIFETIME_S) != 0) {
+      return false;
+    }
+    tlsConfigure(conf, drbg);
+    mbedtls_ssl_cache_set_max_entries(&cache, TLS_SERVER_CACHE);
+    mbedtls_ssl_cache_set_timeout(&cache, TLS_SESSION_LIFETIME_S);
+    mbedtls_ssl_conf_session_cache(&conf, this, cacheGet, cacheSet);
+    mbedtls_ssl_conf_session_tickets_cb(&conf, ticketWrite, ticketParse, this);
+    return true;
+  }
+
+  static void task(void* self) {
+    TlsFront* front = (TlsFront*)self;
+    for (;;) front->serveOne();
+  }
+
+  // The client's end of a relayed connection; ssl is null for plain HTTP
+  struct Peer {
+    mbedtls_net_context* net;
+    mbedtls_ssl_context* ssl;
+  };
+
+  static int receive(Peer& peer, uint8_t* buffer, size_t length) {
+    return peer.ssl ? mbedtls_ssl_read(peer.ssl, buffer, length)
+                    : mbedtls_net_recv(peer.net, buffer, length);
+  }
+
+  static bool sendAll(Peer& peer, const uint8_t* data, size_t length) {
+    while (length) {
+      int rc = peer.ssl ? mbedtls_ssl_write(peer.ssl, data, length)
+                        : mbedtls_net_send(peer.net, data, length);
+      if (rc == MBEDTLS_ERR_SSL_WANT_WRITE || rc == MBEDTLS_ERR_SSL_WANT_READ) continue;
+      if (rc <= 0) return false;
+      data += rc;
+      length -= rc;
+    }
+    return true;
+  }
+
+  // Both directions until either side closes or nothing moves for a while
+  void relay(Peer client, mbedtls_net_context& upstreamNet) {
+    Peer upstream = {&upstreamNet, nullptr};
+    uint8_t buffer[CHUNK];
+    uint32_t last = millis();
+    while (millis() - last < TLS_BRIDGE_IDLE_MS) {
+      bool fromClient = client.ssl && mbedtls_ssl_get_bytes_avail(client.ssl) > 0;
+      if (!fromClient) {
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(client.net->fd, &ready);
+        FD_SET(upstreamNet.fd, &ready);
+        timeval wait = {0, 100000};
+        int maxFd = client.net->fd > upstreamNet.fd ? client.net->fd : upstreamNet.fd;
+        if (select(maxFd + 1, &ready, nullptr, nullptr, &wait) <= 0) continue;
+        if (FD_ISSET(upstreamNet.fd, &ready)) {
+          int got = receive(upstream, buffer, sizeof(buffer));
+          if (got <= 0 || !sendAll(client, buffer, got)) return;
+          last = millis();
+        }
+        fromClient = FD_ISSET(client.net->fd, &ready);
+      }
+      if (!fromClient) continue;
+      int got = receive(client, buffer, sizeof(buffer));
+      if (got == MBEDTLS_ERR_SSL_WANT_READ || got == MBEDTLS_ERR_SSL_WANT_WRITE ||
+          got == MBEDTLS_ERR_SSL_TIMEOUT) {
+        continue;
+      }
+      if (got <= 0 || !sendAll(upstream, buffer, got)) return;
+      last = millis();
+    }
+  }
+
+  void serveOne() {
+    mbedtls_net_context client;
+    mbedtls_net_init(&client);
+    if (mbedtls_net_accept(&listener, &client, nullptr, 0, nullptr) != 0) return;
+
+    uint32_t heap = ESP.getFreeHeap();
+    uint32_t start = millis();
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_init(&ssl);
+    resuming = false;
+    int rc = 0;
+    if (tls && (rc = mbedtls_ssl_setup(&ssl, &conf)) == 0) {
+      mbedtls_ssl_set_bio(&ssl, &client, mbedtls_net_send, nullptr, mbedtls_net_recv_timeout);
+      while ((rc = mbedtls_ssl_handshake(&ssl)) == MBEDTLS_ERR_SSL_WANT_READ ||
+             rc == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        if (millis() - start > TLS_HANDSHAKE_TIMEOUT_MS) break;
+      }
+    }
+
+    if (rc == 0) {
+      if (tls) stats.record(resuming, millis() - start, heap - ESP.getFreeHeap());
+      mbedtls_net_context upstream;
+      mbedtls_net_init(&upstream);
+      char service[6];
+      snprintf(service, sizeof(service), "%u", upstreamPort);
+      if (mbedtls_net_connect(&upstream, "127.0.0.1", service, MBEDTLS_NET_PROTO_TCP) == 0) {
+        relay({&client, tls ? &ssl : nullptr}, upstream);
+      }
+      mbedtls_net_free(&upstream);
+      if (tls) mbedtls_ssl_close_notify(&ssl);
+    } else {
+      stats.failed++;
+    }
+    mbedtls_ssl_free(&ssl);
+    mbedtls_net_free(&client);
+  }
+
+public:
+  TlsFront() {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&cert);
+    mbedtls_pk_init(&key);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_cache_init(&cache);
+    mbedtls_ssl_ticket_init(&tickets);
+    mbedtls_net_init(&listener);
+  }
+
+  // Relays to the WebServer on loopbackPort: TLS on tlsPort, or plain HTTP
+  // on plainPort if the certificate or key is missing or bad. Returns
+  // whether TLS is up.
+  bool begin(uint16_t tlsPort, uint16_t plainPort, uint16_t loopbackPort) {
+    upstreamPort = loopbackPort;
+    tls = setup();
+    char service[6];
+    snprintf(service, sizeof(service), "%u", tls ? tlsPort : plainPort);
+    if (mbedtls_net_bind(&listener, nullptr, service, MBEDTLS_NET_PROTO_TCP) != 0) return false;
+    xTaskCreatePinnedToCore(task, "https", 8192, this, 1, nullptr, 0);
+    return tls;
+  }
+
+  void toJson(JsonObject out) {
+    out["tls"] = tls;
+    tlsStatsJson(stats, out);
+  }
+};
+
+#endif // TLS_TRANSPORT_H
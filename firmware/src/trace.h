@@ -0,0 +1,122 @@
+// =============================================================================
+// GATEMATE ESP32 Firmware - Trace Recording
+// =============================================================================
+//
+// Timestamped inputs of the gate logic (raw ADC samples, GPIO edges and
+// incoming commands) plus the stop decisions taken, in a compact binary
+// format. The recorder buffers records in a lock-free ring; loop() drains
+// it to a LittleFS file or a TCP stream. tools/trace_replay.cpp feeds the
+// traces back through the same sensor chain and safety rules.
+//
+// Format (little-endian): one TraceHeader, then TraceRecords in time order.
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "ring_buffer.h"
+
+#define TRACE_MAGIC     0x52544D47u   // "GMTR"
+#define TRACE_VERSION   2       // 1: TRACE_ADC without a channel mask
+
+enum TraceRecordType : uint8_t {
+  TRACE_ADC = 1,        // arg = SensorChannel mask (0: all), value[] = raw
+                        // current, voltage, temperature
+  TRACE_GPIO = 2,       // arg = pin, value[0] = level
+  TRACE_COMMAND = 3,    // arg = GateCommand, value[0] = percentage
+  TRACE_STOP = 4,       // arg = StopReason, value[0] = percentage
+};
+
+struct TraceHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t startMs;
+  uint32_t lastStepMs;      // Phase of the position steps
+  uint8_t state;            // Gate state at start
+  uint8_t percentage;
+  uint8_t reserved[2];
+  char deviceId[24];
+};
+
+struct TraceRecord {
+  uint32_t timeMs;
+  uint8_t type;
+  uint8_t arg;
+  uint16_t value[3];
+};
+
+static_assert(sizeof(TraceHeader) == 44, "trace header layout");
+static_assert(sizeof(TraceRecord) == 12, "trace record layout");
+
+class TraceRecorder {
+private:
+  SpscRing<TraceRecord, TRACE_BUFFER_RECORDS> ring;
+  TraceHeader header = {};
+  uint64_t pinsKnown = 0;
+  uint64_t pinLevels = 0;
+  uint32_t droppedAtStart = 0;
+  bool active = false;
+
+  void push(uint32_t nowMs, uint8_t type, uint8_t arg, uint16_t a, uint16_t b = 0, uint16_t c = 0) {
+    TraceRecord record = {nowMs, type, arg, {a, b, c}};
+    ring.push(record);
+  }
+
+public:
+  void start(uint32_t nowMs, const char* deviceId, uint8_t state, uint8_t percentage,
+             uint32_t lastStepMs) {
+    header = {};
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    header.startMs = nowMs;
+    header.lastStepMs = lastStepMs;
+    header.state = state;
+    header.percentage = percentage;
+    strncpy(header.deviceId, deviceId, sizeof(header.deviceId) - 1);
+    ring.clear();
+    droppedAtStart = ring.getDropped();
+    pinsKnown = 0;
+    pinLevels = 0;
+    active = true;
+  }
+
+  void stop() { active = false; }
+  bool isActive() const { return active; }
+  const TraceHeader& getHeader() const { return header; }
+  uint32_t getDropped() const { return ring.getDropped() - droppedAtStart; }
+
+  // Producer side (loop() context)
+  // channels: the values that are new conversions (SensorChannel mask)
+  void adc(uint32_t nowMs, uint8_t channels, uint16_t current, uint16_t voltage,
+           uint16_t temperature) {
+    if (active) push(nowMs, TRACE_ADC, channels, current, voltage, temperature);
+  }
+
+  // Records edges only; the first read of each pin records its level
+  void gpio(uint32_t nowMs, uint8_t pin, bool level) {
+    if (!active || pin >= 64) return;
+    uint64_t bit = 1ull << pin;
+    if ((pinsKnown & bit) && ((pinLevels & bit) != 0) == level) return;
+    pinsKnown |= bit;
+    pinLevels = level ? (pinLevels | bit) : (pinLevels & ~bit);
+    push(nowMs, TRACE_GPIO, pin, level);
+  }
+
+  void command(uint32_t nowMs, uint8_t command, uint8_t percentage) {
+    if (active) push(nowMs, TRACE_COMMAND, command, percentage);
+  }
+
+  void stopDecision(uint32_t nowMs, uint8_t reason, uint8_t percentage) {
+    if (active) push(nowMs, TRACE_STOP, reason, percentage);
+  }
+
+  // Consumer side
+  bool pop(TraceRecord& record) { return ring.pop(record); }
+};
+
+#endif // TRACE_H
@@ -0,0 +1,202 @@
+// =============================================================================
+// GATEMATE Host Tool - Sensor Acquisition Check
+// =============================================================================
+//
+// Runs the acquisition scheduler (src/acquisition.h) with the firmware's
+// channel set on a simulated ADC - a constant level per pin plus Gaussian
+// noise, 10 us per read - and checks that
+//   - a loop() pass never takes more than ACQ_READS_PER_PASS reads
+//   - each channel converts at its own rate, without dropped reads while
+//     passes come faster than its reads are due
+//   - oversampling by K cuts the noise by about sqrt(K)
+//   - the calibration table follows a nonlinear chip curve to within two
+//     codes (the chip curve comes in whole mV, 1.24 codes each) and is
+//     exact at its knots
+//   - idle-length passes drop reads instead of bursting to catch up
+//   - the per-channel CPU time adds up to the reads taken
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/acquisition_check.cpp -o acquisition_check
+//
+// Usage:
+//   ./acquisition_check
+//
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "acquisition.h"
+#include "check.h"
+
+#define CHECK_GATES     2
+#define READ_US         10
+
+struct SimAdc {
+  std::mt19937 rng{1};
+  std::normal_distribution<double> noise{0.0, 6.0};
+  double level[64] = {};
+  uint32_t cycleCount = 0;
+  uint32_t readsThisPass = 0;
+
+  uint16_t read(uint8_t pin) {
+    cycleCount += READ_US * 240;
+    readsThisPass++;
+    long raw = lround(level[pin & 63] + noise(rng));
+    return (uint16_t)(raw < 0 ? 0 : raw > 4095 ? 4095 : raw);
+  }
+  uint32_t cycles() { return cycleCount; }
+  uint32_t cyclesPerUs() { return 240; }
+};
+
+typedef AcquisitionScheduler<SimAdc, CHECK_GATES + 2> Scheduler;
+
+static const uint8_t currentPins[CHECK_GATES] = {34, 36};
+
+static void addChannels(Scheduler& acq) {
+  acq.add("current", currentPins[0], ACQ_CURRENT_PERIOD_MS, ACQ_CURRENT_OVERSAMPLE);
+  acq.add("current_b", currentPins[1], ACQ_CURRENT_PERIOD_MS, ACQ_CURRENT_OVERSAMPLE);
+  acq.add("voltage", 35, ACQ_VOLTAGE_PERIOD_MS, ACQ_VOLTAGE_OVERSAMPLE);
+  acq.add("temperature", 32, ACQ_TEMP_PERIOD_MS, ACQ_TEMP_OVERSAMPLE);
+}
+
+// Standard deviation of a channel's conversions over a run
+struct Spread {
+  double sum = 0, sumSq = 0;
+  uint32_t n = 0;
+  void add(double v) {
+    sum += v;
+    sumSq += v * v;
+    n++;
+  }
+  double sigma() const {
+    double mean = sum / n;
+    return sqrt(sumSq / n - mean * mean);
+  }
+};
+
+// =============================================================================
+// Calibration
+// =============================================================================
+
+// A chip that reads low with a bend near the top, like 11 dB attenuation
+static uint32_t chipMilliVolts(uint16_t raw) {
+  double x = raw / 4095.0;
+  return (uint32_t)lround(75.0 + 3000.0 * x + 250.0 * x * x * x);
+}
+
+static void checkCalibration() {
+  AdcCalibration identity;
+  bool exact = true;
+  for (uint16_t raw = 0; raw < 4096; raw++) exact &= identity.apply(raw) == raw;
+  expect(exact && identity.source() == ADC_CAL_NONE, "uncalibrated table is the identity");
+
+  AdcCalibration cal;
+  cal.build(chipMilliVolts, ADC_CAL_EFUSE_TP);
+  int32_t worst = 0;
+  bool monotonic = true;
+  bool knots = true;
+  uint16_t previous = 0;
+  for (uint16_t raw = 0; raw < 4096; raw++) {
+    int32_t ideal = (int32_t)lround(chipMilliVolts(raw) * 4095.0 / 3300.0);
+    if (ideal > 4095) ideal = 4095;
+    int32_t error = abs((int32_t)cal.apply(raw) - ideal);
+    if (error > worst) worst = error;
+    if (raw % ADC_CAL_STEP == 0 && error > 0) knots = false;
+    if (cal.apply(raw) < previous) monotonic = false;
+    previous = cal.apply(raw);
+  }
+  printf("Calibration: worst error %d code(s) over %u knots\n", worst, ADC_CAL_KNOTS);
+  expect(worst <= 2, "calibration within two codes of the chip curve");
+  expect(knots, "calibration exact at the knots");
+  expect(monotonic, "calibration monotonic");
+  uint16_t half = cal.apply16(1000 * 16 + 8);
+  expect(half >= cal.apply(1000) && half <= cal.apply(1001), "fractional codes interpolate");
+}
+
+// =============================================================================
+// Scheduling
+// =============================================================================
+
+struct RunResult {
+  uint32_t maxReadsPerPass = 0;
+  uint32_t conversions[CHECK_GATES + 2] = {};
+  Spread spread[CHECK_GATES + 2];
+};
+
+// passUs between loop() passes for seconds of simulated time from now
+static RunResult run(Scheduler& acq, SimAdc& adc, uint32_t& now, uint32_t passUs,
+                     uint32_t seconds) {
+  RunResult result;
+  std::uniform_int_distribution<uint32_t> jitter(0, passUs / 4);
+  for (uint32_t end = now + seconds * 1000000u; now < end; now += passUs + jitter(adc.rng)) {
+    adc.readsThisPass = 0;
+    uint32_t ready = acq.poll(now);
+    if (adc.readsThisPass > result.maxReadsPerPass) result.maxReadsPerPass = adc.readsThisPass;
+    for (uint8_t i = 0; i < acq.size(); i++) {
+      if (!(ready & (1u << i))) continue;
+      result.conversions[i]++;
+      result.spread[i].add(acq.value(i));
+    }
+  }
+  return result;
+}
+
+static void checkScheduling() {
+  SimAdc adc;
+  adc.level[currentPins[0]] = 3200;
+  adc.level[currentPins[1]] = 3300;
+  adc.level[35] = 2000;
+  adc.level[32] = 1500;
+  AdcCalibration cal;
+  Scheduler acq;
+  acq.begin(adc, cal);
+  addChannels(acq);
+
+  // Busy loop: a pass every ~500 us
+  const uint32_t seconds = 20;
+  uint32_t now = 5000;
+  RunResult busy = run(acq, adc, now, 500, seconds);
+  printf("Busy loop (500 us passes), %u s:\n", seconds);
+  printf("  channel       period  K  conv/s  reads/s  missed/s  cpu us/s  sigma  expected\n");
+  bool rates = true;
+  bool noDrops = true;
+  bool noise = true;
+  bool cost = true;
+  for (uint8_t i = 0; i < acq.size(); i++) {
+    const AcqChannelStats& stats = acq.stats(i);
+    double expectedSigma = 6.0 / sqrt((double)acq.oversample(i));
+    double sigma = busy.spread[i].sigma();
+    printf("  %-12s %5u ms %2u  %6u  %7u  %8u  %8u  %5.2f  %5.2f\n", acq.name(i),
+           acq.periodMs(i), acq.oversample(i), stats.conversions, stats.reads, stats.missed,
+           stats.cpuUs, sigma, expectedSigma);
+    uint32_t expected = seconds * 1000 / acq.periodMs(i);
+    rates &= busy.conversions[i] + 2 >= expected && busy.conversions[i] <= expected + 2;
+    noDrops &= stats.missed == 0;
+    noise &= sigma < expectedSigma * 1.3 && sigma > expectedSigma * 0.7;
+    cost &= stats.cpuUs == (uint32_t)stats.reads * READ_US;
+  }
+  printf("  %u reads per pass at most, %u us/s total\n", busy.maxReadsPerPass, acq.cpuUs());
+  expect(busy.maxReadsPerPass <= ACQ_READS_PER_PASS, "reads per pass capped");
+  expect(rates, "each channel converts at its own rate");
+  expect(noDrops, "no dropped reads while passes are faster than the reads");
+  expect(noise, "oversampling by K cuts the noise by sqrt(K)");
+  expect(cost, "CPU time adds up to the reads taken");
+
+  // Idle: a pass every ~100 ms drops reads instead of bursting
+  RunResult idle = run(acq, adc, now, 100000, 5);
+  uint32_t missed = 0;
+  for (uint8_t i = 0; i < acq.size(); i++) missed += acq.stats(i).missed;
+  printf("Idle loop (100 ms passes): %u reads per pass at most, %u dropped/s\n",
+         idle.maxReadsPerPass, missed);
+  expect(idle.maxReadsPerPass <= ACQ_READS_PER_PASS, "no catch-up burst after a long pass");
+  expect(missed > 0, "reads missed by long passes are counted");
+  expect(idle.conversions[0] > 0, "current still converts while idle");
+}
+
+int main() {
+  checkCalibration();
+  checkScheduling();
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
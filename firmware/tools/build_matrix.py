@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# =============================================================================
+# GATEMATE ESP32 Firmware - Feature Profile Build Matrix
+# =============================================================================
+#
+# Builds every feature profile and reports flash/RAM footprint. With --probe,
+# also reads loop() cost from a device running a build made with
+# -DGATEMATE_LOOP_PROFILE=1 (GET /config -> loopAvgUs / loopMaxUs), and
+# from a build with -DGATEMATE_SAFETY_WCET=1 the safety path's measured
+# worst case; exits 1 if the device saw a pass over WCET_SAFETY_BUDGET_US.
+#
+# Usage (from firmware/):
+#   python tools/build_matrix.py
+#   python tools/build_matrix.py --env esp32 --env esp32-lean
+#   python tools/build_matrix.py --loop-profile --probe 192.168.1.50
+#
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import urllib.request
+
+PROFILES = ["esp32", "esp32-local", "esp32-tls", "esp32-lean"]
+
+SIZE_RE = re.compile(r"^(RAM|Flash):.*used (\d+) bytes from (\d+) bytes", re.M)
+
+
+def build(env, loop_profile):
+    cmd = ["pio", "run", "-e", env]
+    environ = dict(os.environ)
+    if loop_profile:
+        environ["PLATFORMIO_BUILD_FLAGS"] = "-DGATEMATE_LOOP_PROFILE=1"
+    result = subprocess.run(cmd, capture_output=True, text=True, env=environ)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout[-2000:] + result.stderr[-2000:])
+        raise SystemExit(f"build failed: {env}")
+
+    sizes = {}
+    for kind, used, total in SIZE_RE.findall(result.stdout):
+        sizes[kind] = (int(used), int(total))
+    return sizes
+
+
+def probe(host):
+    with urllib.request.urlopen(f"http://{host}/config", timeout=5) as resp:
+        doc = json.load(resp)
+    return doc.get("loopAvgUs"), doc.get("loopMaxUs"), doc.get("wcet")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build feature profiles and report footprint")
+    parser.add_argument("--env", action="append", help="profile(s) to build")
+    parser.add_argument("--loop-profile", action="store_true",
+                        help="build with loop() cost instrumentation")
+    parser.add_argument("--probe", metavar="HOST",
+                        help="read loop cost from a flashed device")
+    args = parser.parse_args()
+
+    envs = args.env or PROFILES
+    print(f"{'profile':<16}{'flash (bytes)':>16}{'flash %':>9}{'ram (bytes)':>14}{'ram %':>8}")
+    baseline = None
+    for env in envs:
+        sizes = build(env, args.loop_profile)
+        flash, flash_total = sizes.get("Flash", (0, 1))
+        ram, ram_total = sizes.get("RAM", (0, 1))
+        delta = ""
+        if baseline is None:
+            baseline = flash
+        elif flash:
+            delta = f"  ({flash - baseline:+d} flash vs {envs[0]})"
+        print(f"{env:<16}{flash:>16}{100.0 * flash / flash_total:>8.1f}%"
+              f"{ram:>14}{100.0 * ram / ram_total:>7.1f}%{delta}")
+
+    if args.probe:
+        avg, peak, wcet = probe(args.probe)
+        if avg is None:
+            print(f"{args.probe}: loop profiling not enabled in this build")
+        else:
+            print(f"{args.probe}: loop avg {avg} us, max {peak} us")
+        if wcet:
+            over = 0
+            for run in ("boot", "live"):
+                meter = wcet.get(run, {})
+                branches = [(n, b) for n, b in meter.items() if isinstance(b, dict)]
+                if branches:
+                    name, worst = max(branches, key=lambda nb: nb[1].get("maxUs", 0))
+                    print(f"{args.probe}: safety path {run} worst {worst.get('maxUs')} us "
+                          f"({name}), budget {wcet.get('budgetUs')} us")
+                over += meter.get("over", 0)
+            if over or not wcet.get("covered", True):
+                raise SystemExit(f"{args.probe}: safety path over budget or branches missed")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,24 @@
+// =============================================================================
+// GATEMATE Host Tools - Check Helper
+// =============================================================================
+//
+// Failure counter shared by the host checks: expect() prints what did not
+// hold and counts it, and a tool's main() ends with OK or FAIL and exits
+// non-zero on any failure. Each tool is a single translation unit.
+//
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+static void expect(bool condition, const char* what) {
+  if (!condition) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+#endif // CHECK_H
@@ -0,0 +1,629 @@
+// =============================================================================
+// GATEMATE Host Tool - Command Delivery Check
+// =============================================================================
+//
+// Runs the device side of QoS 1 command delivery (src/command_delivery.h)
+// against a broker while injecting disconnects, and checks that
+//   - every command is acked, including commands sent while the device is
+//     away
+//   - no command actuates twice. This covers a redelivery, a link drop
+//     between the actuation and the PUBACK, and a reset at that point.
+//   - commands older than COMMAND_MAX_AGE_S are acked "expired" and do not
+//     run; unknown commands are acked "rejected"
+//   - while the link holds, a burst is acked within the loop() passes it
+//     needs at MQTT_PACKETS_PER_PASS packets per pass, plus slack
+//   - the idempotency log survives a reset and forgets its oldest id first
+//   - a corrupted log starts empty
+//   - a full ack queue drops its oldest ack
+//
+// The device model takes one loop() pass per millisecond. Like PubSubClient
+// it sends the PUBACK after the callback. Faults are injected inside the
+// callback:
+//   - the link drops before the command runs
+//   - the link drops after the command runs
+//   - the device resets after the command runs; the CommandLog keeps its
+//     RTC memory, the ack queue is lost
+// Random link drops and one long outage are added on top.
+//
+// The broker is built in by default (tools/mqtt_broker.h). Like mosquitto
+// with docker/mosquitto/config, it keeps persistent sessions, allows
+// BROKER_INFLIGHT QoS 1 messages in flight per client, and redelivers with
+// DUP on reconnect. --host/--port runs the same phases against an external
+// broker instead, e.g. a local mosquitto.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/command_qos_check.cpp -o command_qos_check -pthread
+//
+// Usage:
+//   ./command_qos_check [--bursts 20] [--burst 40] [--fault-rate 0.01]
+//                       [--host 127.0.0.1 --port 1883] [--seed 1]
+//
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "command_delivery.h"
+#include "mqtt_broker.h"
+
+#define PASS_US             1000    // One device loop() pass
+#define RECONNECT_MS        100     // MQTT_RECONNECT_MS, scaled down
+#define OUTAGE_MS           1000    // The long outage of the fault phase
+#define ACK_SLACK_MS        50      // Scheduling noise on top of the passes
+#define PHASE_TIMEOUT_MS    20000
+
+// =============================================================================
+// Device
+// =============================================================================
+
+enum Fault : uint8_t { FAULT_NONE, FAULT_BEFORE_RUN, FAULT_AFTER_RUN, FAULT_RESET };
+
+// The firmware's command path over a socket, one pass per PASS_US
+class DeviceModel {
+private:
+  const char* host;
+  uint16_t port;
+  std::string clientId;
+  std::string gateIds[2];
+  std::string commandTopics[2];
+  uint8_t packetsPerPass;
+  double faultRate;
+  double dropPerPass;
+  std::mt19937 rng;
+
+  int fd = -1;
+  std::string buffer;
+  uint32_t reconnectAt = 0;
+  GateState states[2] = {GATE_CLOSED, GATE_CLOSED};
+
+  void drop(uint32_t awayMs) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+    buffer.clear();
+    reconnectAt = nowMs() + awayMs;
+    drops++;
+  }
+
+  void connectLink() {
+    fd = mqttConnect(host, port, clientId, false, buffer);
+    if (fd < 0) {
+      reconnectAt = nowMs() + RECONNECT_MS;
+      return;
+    }
+    std::string out;
+    for (uint8_t i = 0; i < 2; i++) mqtt::subscribe(out, i + 1, commandTopics[i], 1);
+    sendAll(fd, out);
+    flushAcks();
+  }
+
+  void flushAcks() {
+    delivery.flush(nowMs(), [this](const CommandAck& ack, uint32_t latencyMs) {
+      if (fd < 0) return false;
+      char payload[320];
+      formatCommandAck(payload, sizeof(payload), gateIds[ack.gate].c_str(), ack,
+                       states[ack.gate], 0, latencyMs);
+      std::string out;
+      mqtt::publish(out, MQTT_TOPIC_PREFIX + gateIds[ack.gate] + MQTT_TOPIC_ACKS, payload);
+      return sendAll(fd, out);
+    });
+  }
+
+  Fault pickFault() {
+    double r = std::uniform_real_distribution<double>(0, 1)(rng);
+    if (r >= faultRate) return FAULT_NONE;
+    return (Fault)(FAULT_BEFORE_RUN + (int)(r / faultRate * 3));
+  }
+
+  // mqttCallback() and runCommand(); false when the link went down
+  bool handlePublish(const mqtt::Packet& packet) {
+    uint8_t gate = packet.topic == commandTopics[0] ? 0 : packet.topic == commandTopics[1] ? 1 : 2;
+    Fault fault = gate < 2 ? pickFault() : FAULT_NONE;
+    if (fault == FAULT_BEFORE_RUN) {
+      faults[fault]++;
+      drop(RECONNECT_MS);
+      return false;
+    }
+
+    std::string id = mqtt::jsonString(packet.payload, "commandId");
+    if (gate < 2 && commandIdValid(id.c_str())) {
+      GateCommand command = parseGateCommand(mqtt::jsonString(packet.payload, "command").c_str());
+      uint32_t sentAt = (uint32_t)mqtt::jsonNumber(packet.payload, "sentAt", 0);
+      CommandVerdict verdict = delivery.accept(gate, id.c_str(), sentAt, (uint32_t)time(nullptr));
+      uint8_t status = verdict.status;
+      if (verdict.run) {
+        status = command == GATE_CMD_NONE ? CMD_ACK_REJECTED : CMD_ACK_EXECUTED;
+        if (status == CMD_ACK_EXECUTED) {
+          actuations[id]++;
+          states[gate] = command == GATE_CMD_CLOSE ? GATE_CLOSING :
+                         command == GATE_CMD_STOP ? GATE_STOPPED : GATE_OPENING;
+        }
+      }
+      delivery.complete(gate, id.c_str(), verdict, status, nowMs());
+
+      if (fault == FAULT_AFTER_RUN) {
+        faults[fault]++;
+        drop(RECONNECT_MS);
+        return false;
+      }
+      if (fault == FAULT_RESET) {
+        // RAM is lost, RTC memory is not
+        faults[fault]++;
+        drop(RECONNECT_MS);
+        delivery = CommandDelivery();
+        delivery.begin(rtcLog);
+        return false;
+      }
+      flushAcks();
+    }
+
+    if (((packet.flags >> 1) & 0x03) == 1) {
+      std::string out;
+      mqtt::puback(out, packet.packetId);
+      if (!sendAll(fd, out)) {
+        drop(RECONNECT_MS);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void pass() {
+    if (fd < 0) {
+      if (nowMs() >= reconnectAt) connectLink();
+      return;
+    }
+    if (outageAt && nowMs() >= outageAt) {
+      outageAt = 0;
+      drop(OUTAGE_MS);
+      return;
+    }
+    if (std::uniform_real_distribution<double>(0, 1)(rng) < dropPerPass) {
+      drop(RECONNECT_MS);
+      return;
+    }
+
+    char chunk[4096];
+    for (;;) {
+      ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+      if (n > 0) {
+        buffer.append(chunk, (size_t)n);
+        continue;
+      }
+      if (n == 0) {
+        drop(RECONNECT_MS);
+        return;
+      }
+      break;
+    }
+
+    for (uint8_t i = 0; i < packetsPerPass; i++) {
+      mqtt::Packet packet;
+      int parsed = mqtt::parse(buffer, packet);
+      if (parsed == 0) break;
+      if (parsed < 0) {
+        drop(RECONNECT_MS);
+        return;
+      }
+      if (packet.type == mqtt::SUBACK) subscribed = true;
+      if (packet.type == mqtt::PUBLISH && !handlePublish(packet)) return;
+    }
+  }
+
+public:
+  CommandLog& rtcLog;
+  CommandDelivery delivery;
+  std::map<std::string, uint32_t> actuations;
+  uint32_t faults[4] = {};
+  uint32_t drops = 0;
+  std::atomic<uint32_t> outageAt{0};
+  std::atomic<bool> subscribed{false};
+  std::atomic<bool> running{true};
+
+  DeviceModel(const char* host, uint16_t port, const std::string& tag, CommandLog& log,
+              uint8_t packetsPerPass, double faultRate, double dropsPerSecond, uint32_t seed)
+      : host(host), port(port), clientId("gatemate-" + tag), packetsPerPass(packetsPerPass),
+        faultRate(faultRate), dropPerPass(dropsPerSecond * PASS_US / 1e6), rng(seed),
+        rtcLog(log) {
+    for (uint8_t i = 0; i < 2; i++) {
+      gateIds[i] = tag + (i ? "-b" : "-a");
+      commandTopics[i] = MQTT_TOPIC_PREFIX + gateIds[i] + MQTT_TOPIC_COMMANDS;
+    }
+    delivery.begin(rtcLog);
+  }
+
+  const std::string& gateId(uint8_t gate) const { return gateIds[gate]; }
+  const std::string& client() const { return clientId; }
+
+  void run() {
+    while (running) {
+      pass();
+      std::this_thread::sleep_for(std::chrono::microseconds(PASS_US));
+    }
+    if (fd >= 0) close(fd);
+  }
+};
+
+// =============================================================================
+// Backend
+// =============================================================================
+
+enum Expect : uint8_t { EXPECT_EXECUTED, EXPECT_REJECTED, EXPECT_EXPIRED };
+
+struct SentCommand {
+  uint8_t expect;
+  uint32_t sentMs;
+  uint32_t acks = 0;
+  uint32_t duplicates = 0;
+  uint32_t firstAckMs = 0;
+  std::string status;
+  bool duringOutage = false;
+};
+
+// mqtt.service.ts: QoS 1 commands with an id, acks over a persistent session
+class BackendModel {
+private:
+  int fd = -1;
+  std::string buffer;
+
+public:
+  std::map<std::string, SentCommand> sent;
+  std::string clientId;
+
+  bool begin(const char* host, uint16_t port, const std::string& tag) {
+    clientId = "gatemate-" + tag + "-backend";
+    fd = mqttConnect(host, port, clientId, false, buffer);
+    if (fd < 0) return false;
+    std::string out;
+    mqtt::subscribe(out, 1, std::string(MQTT_TOPIC_PREFIX) + "+" + MQTT_TOPIC_ACKS, 1);
+    return sendAll(fd, out);
+  }
+
+  void publish(const std::string& gateId, const std::string& id, const char* command,
+               uint32_t sentAt, uint8_t expect, uint16_t packetId) {
+    char payload[160];
+    snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"commandId\":\"%s\",\"sentAt\":%u}",
+             command, id.c_str(), sentAt);
+    std::string out;
+    mqtt::publish(out, MQTT_TOPIC_PREFIX + gateId + MQTT_TOPIC_COMMANDS, payload, false, 1,
+                  packetId ? packetId : 1);
+    SentCommand& entry = sent[id];
+    entry.expect = expect;
+    entry.sentMs = nowMs();
+    sendAll(fd, out);
+  }
+
+  void poll(int timeoutMs) {
+    pollfd p = {fd, POLLIN, 0};
+    if (::poll(&p, 1, timeoutMs) <= 0) return;
+    char chunk[8192];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) return;
+    buffer.append(chunk, (size_t)n);
+    mqtt::Packet packet;
+    while (mqtt::parse(buffer, packet) == 1) {
+      if (packet.type != mqtt::PUBLISH) continue;
+      if (((packet.flags >> 1) & 0x03) == 1) {
+        std::string out;
+        mqtt::puback(out, packet.packetId);
+        sendAll(fd, out);
+      }
+      auto entry = sent.find(mqtt::jsonString(packet.payload, "commandId"));
+      if (entry == sent.end()) continue;
+      SentCommand& command = entry->second;
+      if (command.acks++ == 0) {
+        command.firstAckMs = nowMs();
+        command.status = mqtt::jsonString(packet.payload, "status");
+      }
+      if (packet.payload.find("\"duplicate\":true") != std::string::npos) command.duplicates++;
+    }
+  }
+
+  bool allAcked() const {
+    for (const auto& entry : sent) {
+      if (!entry.second.acks) return false;
+    }
+    return true;
+  }
+
+  void end() {
+    if (fd >= 0) close(fd);
+  }
+};
+
+// =============================================================================
+// Phases
+// =============================================================================
+
+struct PhaseConfig {
+  const char* name;
+  uint8_t packetsPerPass;
+  uint32_t bursts;
+  uint32_t burst;
+  uint32_t gapMs;
+  double faultRate;
+  double dropsPerSecond;
+  bool outage;
+  bool checkLatency;
+};
+
+static const char* commandNames[] = {"open", "close", "stop", "partial"};
+
+static void runPhase(const char* host, uint16_t port, const PhaseConfig& config, uint32_t seed,
+                     const std::string& runTag) {
+  std::string tag = runTag + "-" + config.name;
+  static CommandLog rtcLog;
+  memset(&rtcLog, 0xA5, sizeof(rtcLog));   // Power-on garbage
+
+  DeviceModel device(host, port, tag, rtcLog, config.packetsPerPass, config.faultRate,
+                     config.dropsPerSecond, seed);
+  BackendModel backend;
+  if (!backend.begin(host, port, tag)) {
+    printf("FAIL: backend cannot connect to %s:%u\n", host, port);
+    failures++;
+    return;
+  }
+  std::thread deviceThread([&] { device.run(); });
+
+  // From here on the broker keeps the device's commands while it is away
+  uint32_t waitUntil = nowMs() + 2000;
+  while (!device.subscribed && nowMs() < waitUntil) backend.poll(1);
+
+  std::mt19937 rng(seed * 7 + 1);
+  uint32_t start = nowMs();
+  uint32_t sequence = 0;
+  uint16_t packetId = 0;
+  uint32_t outageStart = 0;
+  for (uint32_t b = 0; b < config.bursts; b++) {
+    while (nowMs() < start + b * config.gapMs) backend.poll(1);
+    if (config.outage && b == config.bursts / 2) {
+      outageStart = nowMs();
+      device.outageAt = outageStart;
+    }
+    uint32_t epoch = (uint32_t)time(nullptr);
+    for (uint32_t i = 0; i < config.burst; i++) {
+      char id[COMMAND_ID_MAX + 1];
+      snprintf(id, sizeof(id), "%s-%05u", config.name, sequence++);
+      uint8_t gate = rng() & 1;
+      if (++packetId == 0) packetId = 1;
+      if (i == config.burst - 1) {
+        backend.publish(device.gateId(gate), id, "open", epoch - 4 * COMMAND_MAX_AGE_S,
+                        EXPECT_EXPIRED, packetId);
+      } else if (i == config.burst - 2) {
+        backend.publish(device.gateId(gate), id, "dance", epoch, EXPECT_REJECTED, packetId);
+      } else {
+        backend.publish(device.gateId(gate), id, commandNames[rng() % 4], epoch,
+                        EXPECT_EXECUTED, packetId);
+      }
+      if (outageStart && nowMs() < outageStart + OUTAGE_MS) backend.sent[id].duringOutage = true;
+    }
+  }
+  while (!backend.allAcked() && nowMs() < start + PHASE_TIMEOUT_MS) backend.poll(1);
+
+  // Late redeliveries and their duplicate acks
+  uint32_t settle = nowMs() + 300;
+  while (nowMs() < settle) backend.poll(1);
+  device.running = false;
+  deviceThread.join();
+  backend.end();
+  discardSession(host, port, device.client());
+  discardSession(host, port, backend.clientId);
+
+  // Acks and actuations per command
+  uint32_t unacked = 0, twice = 0, missed = 0, wrongStatus = 0, duplicates = 0;
+  std::vector<uint32_t> latencies;
+  uint32_t outageMax = 0;
+  static const char* expectedStatus[] = {"executed", "rejected", "expired"};
+  for (const auto& entry : backend.sent) {
+    const SentCommand& command = entry.second;
+    auto actuated = device.actuations.find(entry.first);
+    uint32_t runs = actuated == device.actuations.end() ? 0 : actuated->second;
+    if (!command.acks) {
+      unacked++;
+      continue;
+    }
+    if (runs > 1) twice++;
+    if (command.expect == EXPECT_EXECUTED ? runs != 1 : runs != 0) missed++;
+    if (command.status != expectedStatus[command.expect]) wrongStatus++;
+    duplicates += command.duplicates;
+    uint32_t latency = command.firstAckMs - command.sentMs;
+    if (command.duringOutage) {
+      outageMax = std::max(outageMax, latency);
+    } else {
+      latencies.push_back(latency);
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies.empty() ? 0 : latencies[(size_t)(p * (latencies.size() - 1))];
+  };
+
+  const CommandStats& stats = device.delivery.stats();
+  uint32_t passesPerBurst = (config.burst + config.packetsPerPass - 1) / config.packetsPerPass;
+  uint32_t boundMs = ACK_SLACK_MS + 2 * passesPerBurst * PASS_US / 1000;
+  printf("%s: %u commands in %u bursts of %u, %u packet(s)/pass\n", config.name,
+         (unsigned)backend.sent.size(), config.bursts, config.burst, config.packetsPerPass);
+  printf("  ack latency p50 %u ms, p99 %u ms, max %u ms", percentile(0.5), percentile(0.99),
+         percentile(1.0));
+  if (config.checkLatency) printf(" (bound %u ms)", boundMs);
+  if (config.outage) printf(", %u ms for commands sent during the outage", outageMax);
+  printf("\n");
+  printf("  faults: %u before run, %u after run, %u resets; %u link drops\n",
+         device.faults[FAULT_BEFORE_RUN], device.faults[FAULT_AFTER_RUN],
+         device.faults[FAULT_RESET], device.drops);
+  printf("  unacked %u, actuated twice %u, wrong actuation %u, wrong status %u, "
+         "duplicate acks %u\n", unacked, twice, missed, wrongStatus, duplicates);
+  printf("  device (since last reset): received %u, duplicates %u, expired %u, rejected %u\n",
+         stats.received, stats.duplicates, stats.expired, stats.rejected);
+
+  expect(unacked == 0, "every command acked");
+  expect(twice == 0, "no command actuates twice");
+  expect(missed == 0, "each command actuates once, expired and rejected ones never");
+  expect(wrongStatus == 0, "ack status matches the command");
+  if (config.checkLatency) {
+    expect(percentile(1.0) <= boundMs, "bursts acked within the bound");
+  }
+  if (config.faultRate == 0 && config.dropsPerSecond == 0 && !config.outage) {
+    expect(duplicates == 0, "no duplicate acks without faults");
+  }
+  if (config.outage) {
+    expect(outageMax >= OUTAGE_MS / 2, "commands sent during the outage waited for it");
+  }
+}
+
+// =============================================================================
+// Idempotency Log and Ack Queue
+// =============================================================================
+
+static void checkLog() {
+  const uint32_t epoch = 1750000000;
+  CommandLog rtc;
+  memset(&rtc, 0x5A, sizeof(rtc));
+
+  CommandDelivery delivery;
+  delivery.begin(rtc);
+  CommandVerdict verdict = delivery.accept(0, "first", epoch, epoch);
+  expect(verdict.run && !verdict.duplicate, "garbage log starts empty");
+  delivery.complete(0, "first", verdict, CMD_ACK_REJECTED, 0);
+
+  // Reset: a new instance over the same RTC memory
+  CommandDelivery afterReset;
+  afterReset.begin(rtc);
+  verdict = afterReset.accept(0, "first", epoch, epoch);
+  expect(!verdict.run && verdict.duplicate && verdict.status == CMD_ACK_REJECTED,
+         "log survives a reset with the first outcome");
+  expect(afterReset.accept(1, "first", epoch, epoch).run, "same id on another gate runs");
+
+  // Corruption: the log starts over
+  ((uint8_t*)&rtc.entries[3])[2] ^= 0x10;
+  CommandDelivery afterCorruption;
+  afterCorruption.begin(rtc);
+  expect(afterCorruption.accept(0, "first", epoch, epoch).run, "corrupted log starts empty");
+
+  // Eviction: the oldest id goes first
+  char id[16];
+  for (uint32_t i = 0; i <= COMMAND_LOG_SIZE; i++) {
+    snprintf(id, sizeof(id), "id-%u", i);
+    CommandVerdict v = afterCorruption.accept(0, id, 0, 0);
+    afterCorruption.complete(0, id, v, CMD_ACK_EXECUTED, 0);
+  }
+  expect(afterCorruption.accept(0, "id-0", 0, 0).run, "oldest id forgotten");
+  snprintf(id, sizeof(id), "id-%u", COMMAND_LOG_SIZE);
+  expect(afterCorruption.accept(0, id, 0, 0).duplicate, "newest id remembered");
+  expect(afterCorruption.accept(0, "id-1", 0, 0).duplicate, "log holds COMMAND_LOG_SIZE ids");
+
+  // Expiry needs a set clock and a sentAt
+  CommandDelivery fresh;
+  fresh.begin(rtc);
+  verdict = fresh.accept(0, "old", epoch - COMMAND_MAX_AGE_S - 1, epoch);
+  expect(!verdict.run && verdict.status == CMD_ACK_EXPIRED, "old command expires");
+  expect(fresh.accept(0, "edge", epoch - COMMAND_MAX_AGE_S, epoch).run, "command at the age limit runs");
+  expect(fresh.accept(0, "unsynced", 1, 0).run, "no expiry before the clock is set");
+  expect(fresh.accept(0, "future", epoch + 60, epoch).run, "backend clock ahead runs");
+  expect(fresh.accept(0, "no-sent-at", 0, epoch).run, "no expiry without sentAt");
+
+  // Ack queue: the oldest ack is dropped when full, order is kept
+  CommandDelivery queue;
+  queue.begin(rtc);
+  for (uint32_t i = 0; i < COMMAND_ACK_QUEUE + 3; i++) {
+    snprintf(id, sizeof(id), "ack-%u", i);
+    CommandVerdict v = queue.accept(0, id, 0, 0);
+    queue.complete(0, id, v, CMD_ACK_EXECUTED, i);
+  }
+  expect(queue.flush(100, [](const CommandAck&, uint32_t) { return false; }) == 0,
+         "acks stay queued while offline");
+  expect(queue.pending() == COMMAND_ACK_QUEUE && queue.stats().ackDropped == 3,
+         "full ack queue drops the oldest");
+  std::string first;
+  uint32_t firstLatency = 0;
+  uint8_t sent = queue.flush(100, [&](const CommandAck& ack, uint32_t latency) {
+    if (first.empty()) {
+      first = ack.commandId;
+      firstLatency = latency;
+    }
+    return true;
+  });
+  expect(sent == COMMAND_ACK_QUEUE && first == "ack-3" && firstLatency == 97,
+         "queued acks flush oldest first with their latency");
+
+  CommandAck ack = {};
+  strcpy(ack.commandId, "cm0abc");
+  ack.status = CMD_ACK_EXPIRED;
+  ack.duplicate = true;
+  char payload[320];
+  formatCommandAck(payload, sizeof(payload), "gate-1", ack, GATE_OPEN, 100, 12);
+  expect(strcmp(payload, "{\"deviceId\":\"gate-1\",\"commandId\":\"cm0abc\",\"status\":\"expired\","
+                         "\"duplicate\":true,\"state\":\"open\",\"percentage\":100,"
+                         "\"latencyMs\":12}") == 0, "ack payload format");
+  expect(!commandIdValid("") && !commandIdValid("a\"b") &&
+         !commandIdValid("0123456789012345678901234567890123456") &&
+         commandIdValid("cm0abc"), "commandId rules");
+}
+
+int main(int argc, char** argv) {
+  const char* host = "127.0.0.1";
+  uint16_t port = 0;
+  uint32_t bursts = 20;
+  uint32_t burst = 40;
+  double faultRate = 0.01;
+  uint32_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--host") host = argv[i + 1];
+    else if (arg == "--port") port = (uint16_t)atoi(argv[i + 1]);
+    else if (arg == "--bursts") bursts = (uint32_t)atoi(argv[i + 1]);
+    else if (arg == "--burst") burst = (uint32_t)atoi(argv[i + 1]);
+    else if (arg == "--fault-rate") faultRate = atof(argv[i + 1]);
+    else if (arg == "--seed") seed = (uint32_t)atoi(argv[i + 1]);
+  }
+  if (burst < 3 || burst > BROKER_INFLIGHT * 4) {
+    printf("--burst must be 3..%u\n", BROKER_INFLIGHT * 4);
+    return 1;
+  }
+
+  checkLog();
+
+  Broker broker;
+  if (!port) {
+    if (!broker.start()) {
+      printf("FAIL: broker cannot listen\n");
+      return 1;
+    }
+    port = broker.port();
+  }
+  printf("Broker %s:%u%s\n", host, port, port == broker.port() ? " (built in)" : "");
+
+  std::string runTag = "qos-" + std::to_string(getpid()) + "-" + std::to_string(time(nullptr));
+  const PhaseConfig phases[] = {
+    // PubSubClient's one packet per loop(), for comparison
+    {"single", 1, bursts / 2, burst, 250, 0, 0, false, false},
+    {"burst", MQTT_PACKETS_PER_PASS, bursts / 2, burst, 250, 0, 0, false, true},
+    {"faults", MQTT_PACKETS_PER_PASS, bursts, burst, 250, faultRate, 0.5, true, false},
+  };
+  for (const PhaseConfig& phase : phases) runPhase(host, port, phase, seed, runTag);
+
+  if (port == broker.port()) {
+    broker.stop();
+    printf("Broker redelivered %u message(s) with DUP\n", broker.redelivered);
+  }
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
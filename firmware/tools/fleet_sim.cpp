@@ -0,0 +1,1077 @@
+// =============================================================================
+// GATEMATE Host Tool - Fleet Simulator
+// =============================================================================
+//
+// Runs thousands of virtual GATEMATE devices against a real MQTT broker to
+// capacity-plan the broker and the backend's mqtt.service.ts. Each virtual
+// gate uses src/gate_motion.h and the state table in src/gate_fsm.h, so
+// states, movement steps and the /status and /sensors payloads are exactly
+// the firmware's. Like the firmware it
+// subscribes to /commands and /config, publishes a retained status on
+// connect and after every command, and publishes sensors periodically.
+//
+// A controller connection plays the backend: it subscribes to every
+// device's status and publishes commands at a configured rate, measuring
+// command -> status round-trip time. Outages (random per-device drops) and
+// reconnect storms (every device dropped at once, reconnecting with jitter)
+// can be injected.
+//
+// With --groups the fleet is split into command groups (src/group_command.h)
+// and the controller periodically publishes one command per group instead
+// of one per gate. Each gate delays it by its stagger slot and jitter like
+// the firmware and acknowledges on /acks; the report aggregates the acks per
+// request and shows how many motors started within one inrush window.
+//
+// Single-threaded epoll loop with non-blocking sockets and a timer heap.
+// Linux only.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/fleet_sim.cpp -o fleet_sim
+//
+// Example (local mosquitto, 20000 gates, 200 commands/s, storm at 60 s):
+//   ./fleet_sim --devices 20000 --sources 4 --command-rate 200
+//               --storm-at 60 --storm-jitter 10 --duration 120
+//
+// Group commands (10 groups, 2 s jitter, 50 ms stagger per slot):
+//   ./fleet_sim --devices 2000 --command-rate 0 --groups 10 --group-every 5
+//               --jitter-ms 2000 --stagger-ms 50
+//
+// One source address allows roughly 28000 connections to a single broker
+// port; --sources binds devices round-robin to 127.1.0.1.. for a local broker.
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "gate_fsm.h"
+#include "gate_motion.h"
+#include "group_command.h"
+#include "mqtt_wire.h"
+
+// =============================================================================
+// Options
+// =============================================================================
+
+struct Options {
+  const char* host = "127.0.0.1";
+  uint16_t port = MQTT_PORT;
+  uint32_t devices = 1000;
+  const char* prefix = "sim-gate-";
+  uint32_t sources = 0;             // Extra loopback source addresses
+  uint32_t connectRate = 2000;      // Initial connections per second
+  uint32_t sensorIntervalMs = SENSOR_READ_INTERVAL * 5;
+  uint16_t keepAliveS = 15;         // PubSubClient default
+  double commandRate = 50.0;        // Commands per second (whole fleet)
+  uint32_t commandTimeoutMs = 5000;
+  double outageRate = 0.0;          // Per-device drop probability per second
+  uint32_t outageMs = 10000;
+  double stormAt = -1.0;            // s; < 0 disables
+  double stormJitter = 5.0;         // s
+  uint32_t groups = 0;              // Command groups; 0 disables
+  double groupEvery = 10.0;         // s between group commands
+  uint32_t staggerMs = 0;
+  uint32_t jitterMs = 2000;
+  double duration = 60.0;           // s
+  bool quiet = false;
+};
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  --broker HOST[:PORT]     Broker address (127.0.0.1:%d)\n"
+    "  --devices N              Virtual gates (1000)\n"
+    "  --prefix STR             Device id prefix (sim-gate-)\n"
+    "  --sources N              Bind devices to N loopback source addresses\n"
+    "  --connect-rate N         Initial connections per second (2000)\n"
+    "  --sensor-interval MS     Sensor publish interval per device (5000)\n"
+    "  --keepalive S            MQTT keep-alive (15)\n"
+    "  --command-rate R         Commands per second across the fleet (50)\n"
+    "  --command-timeout MS     Command counted lost after (5000)\n"
+    "  --outage-rate P          Per-device drop probability per second (0)\n"
+    "  --outage-ms MS           Offline time after a drop (10000)\n"
+    "  --storm-at S             Drop every device at S seconds\n"
+    "  --storm-jitter S         Reconnect spread after a storm (5)\n"
+    "  --groups N               Split the fleet into N command groups (0)\n"
+    "  --group-every S          One group command every S seconds (10)\n"
+    "  --stagger-ms MS          Group command stagger per slot (0)\n"
+    "  --jitter-ms MS           Group command jitter per device (2000)\n"
+    "  --duration S             Run time (60)\n"
+    "  --quiet                  Final report only\n",
+    argv0, MQTT_PORT);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+  static const option longOptions[] = {
+    {"broker", required_argument, nullptr, 'b'},
+    {"devices", required_argument, nullptr, 'n'},
+    {"prefix", required_argument, nullptr, 'p'},
+    {"sources", required_argument, nullptr, 'S'},
+    {"connect-rate", required_argument, nullptr, 'c'},
+    {"sensor-interval", required_argument, nullptr, 'i'},
+    {"keepalive", required_argument, nullptr, 'k'},
+    {"command-rate", required_argument, nullptr, 'r'},
+    {"command-timeout", required_argument, nullptr, 't'},
+    {"outage-rate", required_argument, nullptr, 'o'},
+    {"outage-ms", required_argument, nullptr, 'O'},
+    {"storm-at", required_argument, nullptr, 's'},
+    {"storm-jitter", required_argument, nullptr, 'j'},
+    {"groups", required_argument, nullptr, 'g'},
+    {"group-every", required_argument, nullptr, 'G'},
+    {"stagger-ms", required_argument, nullptr, 'T'},
+    {"jitter-ms", required_argument, nullptr, 'J'},
+    {"duration", required_argument, nullptr, 'd'},
+    {"quiet", no_argument, nullptr, 'q'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0},
+  };
+
+  static std::string host;
+  int c;
+  while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+    switch (c) {
+      case 'b': {
+        host = optarg;
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos) {
+          opt.port = (uint16_t)atoi(host.c_str() + colon + 1);
+          host.resize(colon);
+        }
+        opt.host = host.c_str();
+        break;
+      }
+      case 'n': opt.devices = (uint32_t)atoi(optarg); break;
+      case 'p': opt.prefix = optarg; break;
+      case 'S': opt.sources = (uint32_t)atoi(optarg); break;
+      case 'c': opt.connectRate = (uint32_t)std::max(1, atoi(optarg)); break;
+      case 'i': opt.sensorIntervalMs = (uint32_t)std::max(10, atoi(optarg)); break;
+      case 'k': opt.keepAliveS = (uint16_t)atoi(optarg); break;
+      case 'r': opt.commandRate = atof(optarg); break;
+      case 't': opt.commandTimeoutMs = (uint32_t)atoi(optarg); break;
+      case 'o': opt.outageRate = atof(optarg); break;
+      case 'O': opt.outageMs = (uint32_t)atoi(optarg); break;
+      case 's': opt.stormAt = atof(optarg); break;
+      case 'j': opt.stormJitter = atof(optarg); break;
+      case 'g': opt.groups = (uint32_t)atoi(optarg); break;
+      case 'G': opt.groupEvery = std::max(0.1, atof(optarg)); break;
+      case 'T': opt.staggerMs = (uint32_t)atoi(optarg); break;
+      case 'J': opt.jitterMs = (uint32_t)atoi(optarg); break;
+      case 'd': opt.duration = atof(optarg); break;
+      case 'q': opt.quiet = true; break;
+      default: return false;
+    }
+  }
+  return opt.devices > 0;
+}
+
+// =============================================================================
+// Time & Randomness
+// =============================================================================
+
+static uint64_t nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint64_t nextRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 7;
+  rngState ^= rngState << 17;
+  return rngState;
+}
+
+static double uniform() { return (nextRandom() >> 11) * (1.0 / 9007199254740992.0); }
+
+// =============================================================================
+// Connections
+// =============================================================================
+
+static const uint32_t CONTROLLER = UINT32_MAX;
+
+struct Connection {
+  int fd = -1;
+  bool connecting = false;    // TCP handshake in progress
+  bool ready = false;         // CONNACK received
+  bool pollingOut = false;
+  uint32_t generation = 0;    // Invalidates timers of earlier sessions
+  uint64_t lastSendUs = 0;
+  std::string rx;
+  std::string tx;
+};
+
+struct VirtualGate {
+  Connection conn;
+  std::string id;
+  std::string statusTopic;
+  std::string sensorsTopic;
+  std::string commandsTopic;
+  std::string configTopic;
+  std::string acksTopic;
+  std::string groupTopic;       // Empty without --groups
+  std::string group;
+  uint16_t groupSlot = 0;
+  GateState state = GATE_CLOSED;
+  uint8_t percentage = 0;
+  uint64_t bootUs = 0;
+  uint64_t commandSentUs = 0;   // Pending controller command, 0 if none
+  bool stepping = false;
+
+  // Group command waiting out its delay (GroupCommand in main.cpp)
+  GroupRequestLog<GROUP_REQUEST_LOG> seenRequests;
+  bool groupPending = false;
+  GateCommand groupCommand = GATE_CMD_NONE;
+  uint8_t groupPercentage = 0;
+  std::string groupRequest;
+  uint32_t groupDelayMs = 0;
+  uint64_t groupDueUs = 0;
+};
+
+// One group command as seen by the controller
+struct GroupRequest {
+  uint64_t sentUs;
+  uint32_t expected = 0;        // Connected members at publish time
+  uint32_t acked = 0;
+  std::vector<uint32_t> startMs;    // Executed acks, ms after publish
+};
+
+enum TimerKind : uint8_t {
+  TIMER_CONNECT,
+  TIMER_SENSORS,
+  TIMER_STEP,
+  TIMER_PING,
+  TIMER_COMMANDS,
+  TIMER_CHAOS,
+  TIMER_STORM,
+  TIMER_REPORT,
+  TIMER_GROUP_COMMAND,          // Controller publishes a group command
+  TIMER_GROUP_START,            // Gate starts its delayed group command
+};
+
+struct Timer {
+  uint64_t when;
+  uint32_t target;
+  uint32_t generation;
+  TimerKind kind;
+  bool operator>(const Timer& other) const { return when > other.when; }
+};
+
+struct Counters {
+  uint64_t published = 0;
+  uint64_t received = 0;
+  uint64_t bytesOut = 0;
+  uint64_t bytesIn = 0;
+  uint64_t connects = 0;
+  uint64_t failures = 0;
+  uint64_t drops = 0;
+  uint64_t commands = 0;
+  uint64_t acked = 0;
+  uint64_t lost = 0;
+};
+
+// =============================================================================
+// Simulator
+// =============================================================================
+
+class FleetSim {
+private:
+  Options opt;
+  int epollFd = -1;
+  sockaddr_in broker = {};
+  std::vector<VirtualGate> gates;
+  Connection controller;
+  std::unordered_map<std::string, uint32_t> byId;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+  std::deque<std::pair<uint64_t, uint32_t>> pending;   // (sentUs, gate)
+  std::vector<uint32_t> rttUs;
+  Counters total;
+  Counters second;
+  uint32_t connected = 0;
+  uint64_t startUs = 0;
+  double commandCredit = 0.0;
+  uint16_t packetId = 0;
+  std::unordered_map<std::string, GroupRequest> groupRequests;
+  std::vector<std::string> groupOrder;
+  uint32_t groupSequence = 0;
+
+  Connection& connOf(uint32_t target) {
+    return target == CONTROLLER ? controller : gates[target].conn;
+  }
+
+  void schedule(uint64_t when, uint32_t target, TimerKind kind) {
+    uint32_t generation = target == CONTROLLER ? controller.generation : gates[target].conn.generation;
+    timers.push({when, target, generation, kind});
+  }
+
+  // ---------------------------------------------------------------------------
+  // Socket plumbing
+  // ---------------------------------------------------------------------------
+
+  void updatePolling(uint32_t target, Connection& conn) {
+    bool wantOut = conn.connecting || !conn.tx.empty();
+    if (wantOut == conn.pollingOut) return;
+    epoll_event ev = {};
+    ev.events = wantOut ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.u32 = target;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.pollingOut = wantOut;
+  }
+
+  void open(uint32_t target) {
+    Connection& conn = connOf(target);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      perror("socket");
+      fail(target);
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (opt.sources > 0 && target != CONTROLLER) {
+      sockaddr_in local = {};
+      local.sin_family = AF_INET;
+      local.sin_addr.s_addr = htonl(0x7F010001u + target % opt.sources);
+      bind(fd, (sockaddr*)&local, sizeof(local));
+    }
+
+    if (connect(fd, (sockaddr*)&broker, sizeof(broker)) < 0 && errno != EINPROGRESS) {
+      close(fd);
+      fail(target);
+      return;
+    }
+
+    conn.fd = fd;
+    conn.connecting = true;
+    conn.pollingOut = true;
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.u32 = target;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  void closeConnection(Connection& conn) {
+    if (conn.fd >= 0) {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+      close(conn.fd);
+    }
+    if (conn.ready) connected--;
+    conn.fd = -1;
+    conn.connecting = false;
+    conn.ready = false;
+    conn.pollingOut = false;
+    conn.generation++;
+    conn.rx.clear();
+    conn.tx.clear();
+  }
+
+  // Connection refused or lost: retry like reconnectMQTT() does
+  void fail(uint32_t target) {
+    total.failures++;
+    second.failures++;
+    closeConnection(connOf(target));
+    schedule(nowUs() + MQTT_RECONNECT_MS * 1000ull, target, TIMER_CONNECT);
+  }
+
+  // Deliberate drop (outage or storm); reconnect after offlineUs
+  void drop(uint32_t target, uint64_t offlineUs) {
+    Connection& conn = connOf(target);
+    if (conn.fd < 0) return;
+    total.drops++;
+    second.drops++;
+    closeConnection(conn);
+    schedule(nowUs() + offlineUs, target, TIMER_CONNECT);
+  }
+
+  void flush(uint32_t target) {
+    Connection& conn = connOf(target);
+    if (conn.fd < 0 || conn.connecting) return;
+    while (!conn.tx.empty()) {
+      ssize_t n = send(conn.fd, conn.tx.data(), conn.tx.size(), MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        fail(target);
+        return;
+      }
+      total.bytesOut += n;
+      second.bytesOut += n;
+      conn.tx.erase(0, n);
+    }
+    conn.lastSendUs = nowUs();
+    updatePolling(target, conn);
+  }
+
+  void publish(uint32_t target, const std::string& topic, const char* payload, bool retain) {
+    Connection& conn = connOf(target);
+    if (!conn.ready) return;
+    mqtt::publish(conn.tx, topic, payload, retain);
+    total.published++;
+    second.published++;
+    flush(target);
+  }
+
+  void onWritable(uint32_t target) {
+    Connection& conn = connOf(target);
+    if (conn.connecting) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+      if (error != 0) {
+        fail(target);
+        return;
+      }
+      conn.connecting = false;
+      std::string clientId = target == CONTROLLER
+        ? std::string(opt.prefix) + "controller"
+        : gates[target].id;
+      mqtt::connect(conn.tx, clientId, opt.keepAliveS);
+    }
+    flush(target);
+  }
+
+  void onReadable(uint32_t target) {
+    Connection& conn = connOf(target);
+    char buffer[16384];
+    for (;;) {
+      ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+      if (n > 0) {
+        total.bytesIn += n;
+        second.bytesIn += n;
+        conn.rx.append(buffer, n);
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      fail(target);
+      return;
+    }
+
+    mqtt::Packet packet;
+    uint32_t generation = conn.generation;
+    int result;
+    while ((result = mqtt::parse(conn.rx, packet)) == 1) {
+      onPacket(target, packet);
+      if (connOf(target).generation != generation) return;   // Dropped meanwhile
+    }
+    if (result < 0) fail(target);
+  }
+
+  // ---------------------------------------------------------------------------
+  // MQTT sessions
+  // ---------------------------------------------------------------------------
+
+  void onPacket(uint32_t target, const mqtt::Packet& packet) {
+    Connection& conn = connOf(target);
+    if (packet.type == mqtt::CONNACK) {
+      if (packet.returnCode != 0) {
+        fail(target);
+        return;
+      }
+      conn.ready = true;
+      connected++;
+      total.connects++;
+      second.connects++;
+      if (target == CONTROLLER) {
+        onControllerConnected();
+      } else {
+        onGateConnected(target);
+      }
+      schedule(nowUs() + opt.keepAliveS * 1000000ull, target, TIMER_PING);
+      return;
+    }
+
+    if (packet.type != mqtt::PUBLISH) return;
+    total.received++;
+    second.received++;
+    if (target == CONTROLLER) {
+      if (endsWith(packet.topic, MQTT_TOPIC_ACKS)) {
+        onGroupAck(packet);
+      } else {
+        onStatus(packet);
+      }
+    } else if (packet.topic == gates[target].groupTopic || packet.topic == GROUP_TOPIC_BROADCAST) {
+      onGroupCommand(target, packet);
+    } else {
+      onCommand(target, packet);
+    }
+  }
+
+  // Mirrors reconnectMQTT() in main.cpp
+  void onGateConnected(uint32_t index) {
+    VirtualGate& gate = gates[index];
+    mqtt::subscribe(gate.conn.tx, 1, gate.commandsTopic);
+    mqtt::subscribe(gate.conn.tx, 2, gate.configTopic);
+    if (!gate.groupTopic.empty()) {
+      mqtt::subscribe(gate.conn.tx, 3, GROUP_TOPIC_BROADCAST);
+      mqtt::subscribe(gate.conn.tx, 4, gate.groupTopic);
+    }
+    publishStatus(index);
+
+    uint64_t phase = nextRandom() % (opt.sensorIntervalMs * 1000ull);
+    schedule(nowUs() + phase, index, TIMER_SENSORS);
+    if (gate.stepping) schedule(nowUs() + GATE_STEP_MS * 1000ull, index, TIMER_STEP);
+  }
+
+  void onControllerConnected() {
+    mqtt::subscribe(controller.tx, ++packetId, std::string(MQTT_TOPIC_PREFIX) + "+" + MQTT_TOPIC_STATUS);
+    if (opt.groups > 0) {
+      mqtt::subscribe(controller.tx, ++packetId, std::string(MQTT_TOPIC_PREFIX) + "+" + MQTT_TOPIC_ACKS);
+      schedule(nowUs() + (uint64_t)(opt.groupEvery * 1000000.0), CONTROLLER, TIMER_GROUP_COMMAND);
+    }
+    flush(CONTROLLER);
+    schedule(nowUs() + 10000, CONTROLLER, TIMER_COMMANDS);
+
+    // Devices start once the controller sees their status
+    uint64_t now = nowUs();
+    for (uint32_t i = 0; i < gates.size(); i++) {
+      if (gates[i].conn.fd >= 0 || gates[i].bootUs != 0) continue;
+      gates[i].bootUs = now;
+      schedule(now + (uint64_t)i * 1000000ull / opt.connectRate, i, TIMER_CONNECT);
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Virtual gate (same rules as main.cpp)
+  // ---------------------------------------------------------------------------
+
+  void publishStatus(uint32_t index) {
+    VirtualGate& gate = gates[index];
+    char output[192];
+    formatStatusPayload(output, sizeof(output), gate.id.c_str(), gate.state, gate.percentage,
+                        true, false, (uint32_t)((nowUs() - gate.bootUs) / 1000));
+    publish(index, gate.statusTopic, output, true);
+  }
+
+  void publishSensors(uint32_t index) {
+    VirtualGate& gate = gates[index];
+    bool moving = gate.state == GATE_OPENING || gate.state == GATE_CLOSING;
+    float current = moving ? 2.4f + (float)(uniform() * 0.4 - 0.2) : (float)(uniform() * 0.05);
+    float voltage = 24.0f + (float)(uniform() * 0.4 - 0.2);
+    float temperature = 30.0f + (float)(uniform() * 2.0);
+    int wifiSignal = -50 - (int)(nextRandom() % 30);
+    char output[192];
+    formatSensorsPayload(output, sizeof(output), gate.id.c_str(), current, voltage,
+                         temperature, wifiSignal, (uint32_t)((nowUs() - gate.bootUs) / 1000));
+    publish(index, gate.sensorsTopic, output, false);
+  }
+
+  // GateController::dispatch() on the same table (gate_fsm.h)
+  void dispatch(uint32_t index, GateInput input) {
+    VirtualGate& gate = gates[index];
+    GateState from = gate.state;
+    gate.state = gateNextState(from, input, gate.percentage);
+    if (gate.state == from) return;
+
+    uint8_t actions = gateTransitionActions(from, gate.state);
+    if (actions & GATE_ACT_AT_OPEN) gate.percentage = 100;
+    if (actions & GATE_ACT_AT_CLOSED) gate.percentage = 0;
+    publishStatus(index);
+    if (!gateStateMoving(gate.state)) {
+      gate.stepping = false;
+    } else if (!gate.stepping) {
+      gate.stepping = true;
+      schedule(nowUs() + GATE_STEP_MS * 1000ull, index, TIMER_STEP);
+    }
+  }
+
+  void onCommand(uint32_t index, const mqtt::Packet& packet) {
+    VirtualGate& gate = gates[index];
+    if (packet.topic != gate.commandsTopic) return;   // /config is accepted silently
+
+    std::string name = mqtt::jsonString(packet.payload, "command");
+    if (execute(index, parseGateCommand(name.c_str()),
+                (uint8_t)mqtt::jsonNumber(packet.payload, "percentage", 50))) {
+      publishStatus(index);
+    }
+  }
+
+  // dispatchCommand() in main.cpp
+  bool execute(uint32_t index, GateCommand command, uint8_t percent) {
+    VirtualGate& gate = gates[index];
+    switch (command) {
+      case GATE_CMD_OPEN:
+        dispatch(index, GATE_IN_OPEN);
+        break;
+      case GATE_CMD_CLOSE:
+        dispatch(index, GATE_IN_CLOSE);
+        break;
+      case GATE_CMD_STOP:
+        cancelGroupCommand(index);
+        dispatch(index, GATE_IN_STOP);
+        break;
+      case GATE_CMD_PARTIAL: {
+        if (percent > gate.percentage) {
+          dispatch(index, GATE_IN_OPEN);
+        } else if (percent < gate.percentage) {
+          dispatch(index, GATE_IN_CLOSE);
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+    return true;
+  }
+
+  // handleGroupCommand() in main.cpp, without target filters
+  void onGroupCommand(uint32_t index, const mqtt::Packet& packet) {
+    VirtualGate& gate = gates[index];
+    std::string requestId = mqtt::jsonString(packet.payload, "requestId");
+    if (!groupRequestIdValid(requestId.c_str())) return;
+    if (!gate.seenRequests.insert(requestId.c_str())) return;
+
+    std::string name = mqtt::jsonString(packet.payload, "command");
+    GateCommand command = parseGateCommand(name.c_str());
+    if (command == GATE_CMD_NONE) {
+      publishGroupAck(index, requestId, GROUP_ACK_REJECTED, 0);
+      return;
+    }
+
+    cancelGroupCommand(index);
+    gate.groupPending = true;
+    gate.groupCommand = command;
+    gate.groupPercentage = (uint8_t)mqtt::jsonNumber(packet.payload, "percentage", 50);
+    gate.groupRequest = requestId;
+    gate.groupDelayMs = command == GATE_CMD_STOP ? 0 :
+      groupCommandDelay(gate.id.c_str(), requestId.c_str(), gate.groupSlot,
+                        (uint32_t)mqtt::jsonNumber(packet.payload, "staggerMs", 0),
+                        (uint32_t)mqtt::jsonNumber(packet.payload, "jitterMs", 0));
+    gate.groupDueUs = nowUs() + gate.groupDelayMs * 1000ull;
+    if (gate.groupDelayMs == 0) {
+      startGroupCommand(index);
+    } else {
+      schedule(gate.groupDueUs, index, TIMER_GROUP_START);
+    }
+  }
+
+  void startGroupCommand(uint32_t index) {
+    VirtualGate& gate = gates[index];
+    gate.groupPending = false;
+    execute(index, gate.groupCommand, gate.groupPercentage);
+    publishStatus(index);
+    publishGroupAck(index, gate.groupRequest, GROUP_ACK_EXECUTED, gate.groupDelayMs);
+  }
+
+  void cancelGroupCommand(uint32_t index) {
+    VirtualGate& gate = gates[index];
+    if (!gate.groupPending) return;
+    gate.groupPending = false;
+    publishGroupAck(index, gate.groupRequest, GROUP_ACK_SUPERSEDED, gate.groupDelayMs);
+  }
+
+  void publishGroupAck(uint32_t index, const std::string& requestId, uint8_t status,
+                       uint32_t delayMs) {
+    VirtualGate& gate = gates[index];
+    char output[256];
+    formatGroupAck(output, sizeof(output), gate.id.c_str(), requestId.c_str(), gate.group.c_str(),
+                   status, delayMs, gate.state, gate.percentage);
+    publish(index, gate.acksTopic, output, false);
+  }
+
+  void step(uint32_t index) {
+    VirtualGate& gate = gates[index];
+    if (!gate.stepping) return;
+    if (stepGatePosition(gate.state, gate.percentage)) {
+      dispatch(index, GATE_IN_ARRIVED);
+      return;
+    }
+    schedule(nowUs() + GATE_STEP_MS * 1000ull, index, TIMER_STEP);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Controller (plays the backend)
+  // ---------------------------------------------------------------------------
+
+  void sendCommand(uint64_t now) {
+    // A few attempts at finding an idle, connected gate
+    for (int attempt = 0; attempt < 8; attempt++) {
+      uint32_t index = (uint32_t)(nextRandom() % gates.size());
+      VirtualGate& gate = gates[index];
+      if (!gate.conn.ready || gate.commandSentUs != 0) continue;
+
+      const char* command;
+      double roll = uniform();
+      if (roll < 0.05) {
+        command = "stop";
+      } else if (gate.percentage < 100 && gate.state != GATE_OPENING) {
+        command = "open";
+      } else {
+        command = "close";
+      }
+
+      char payload[96];
+      snprintf(payload, sizeof(payload), "{\"command\":\"%s\",\"source\":\"fleet-sim\"}", command);
+      gate.commandSentUs = now;
+      pending.emplace_back(now, index);
+      publish(CONTROLLER, gate.commandsTopic, payload, false);
+      total.commands++;
+      second.commands++;
+      return;
+    }
+  }
+
+  static bool endsWith(const std::string& s, const char* suffix) {
+    size_t length = strlen(suffix);
+    return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+  }
+
+  static std::string groupName(uint32_t group) {
+    return "sim-" + std::to_string(group);
+  }
+
+  // Rotates through the groups, alternating open and close per group
+  void sendGroupCommand(uint64_t now) {
+    uint32_t group = groupSequence % opt.groups;
+    bool open = (groupSequence / opt.groups) % 2 == 0;
+    std::string requestId = "sim-" + std::to_string(groupSequence++);
+
+    GroupRequest request;
+    request.sentUs = now;
+    for (uint32_t i = group; i < gates.size(); i += opt.groups) {
+      if (gates[i].conn.ready) request.expected++;
+    }
+    groupRequests.emplace(requestId, std::move(request));
+    groupOrder.push_back(requestId);
+
+    char payload[192];
+    snprintf(payload, sizeof(payload),
+             "{\"command\":\"%s\",\"requestId\":\"%s\",\"staggerMs\":%u,\"jitterMs\":%u}",
+             open ? "open" : "close", requestId.c_str(), opt.staggerMs, opt.jitterMs);
+    publish(CONTROLLER, GROUP_TOPIC_PREFIX + groupName(group) + GROUP_TOPIC_SUFFIX, payload, false);
+  }
+
+  void onGroupAck(const mqtt::Packet& packet) {
+    auto found = groupRequests.find(mqtt::jsonString(packet.payload, "requestId"));
+    if (found == groupRequests.end()) return;
+    GroupRequest& request = found->second;
+    request.acked++;
+    if (mqtt::jsonString(packet.payload, "status") == "executed") {
+      request.startMs.push_back((uint32_t)((nowUs() - request.sentUs) / 1000));
+    }
+  }
+
+  void onStatus(const mqtt::Packet& packet) {
+    // gatemate/devices/<id>/status
+    size_t prefixLength = strlen(MQTT_TOPIC_PREFIX);
+    size_t suffixLength = strlen(MQTT_TOPIC_STATUS);
+    if (packet.topic.size() <= prefixLength + suffixLength) return;
+    std::string id = packet.topic.substr(prefixLength, packet.topic.size() - prefixLength - suffixLength);
+    auto found = byId.find(id);
+    if (found == byId.end()) return;
+
+    VirtualGate& gate = gates[found->second];
+    if (gate.commandSentUs == 0) return;
+    rttUs.push_back((uint32_t)std::min<uint64_t>(nowUs() - gate.commandSentUs, UINT32_MAX));
+    gate.commandSentUs = 0;
+    total.acked++;
+    second.acked++;
+  }
+
+  void expireCommands(uint64_t now) {
+    uint64_t timeoutUs = opt.commandTimeoutMs * 1000ull;
+    while (!pending.empty() && pending.front().first + timeoutUs <= now) {
+      VirtualGate& gate = gates[pending.front().second];
+      if (gate.commandSentUs == pending.front().first) {
+        gate.commandSentUs = 0;
+        total.lost++;
+        second.lost++;
+      }
+      pending.pop_front();
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Timers
+  // ---------------------------------------------------------------------------
+
+  void onTimer(const Timer& timer, uint64_t now) {
+    if (timer.kind == TIMER_REPORT) {
+      report(now);
+      schedule(now + 1000000, CONTROLLER, TIMER_REPORT);
+      return;
+    }
+    if (timer.kind == TIMER_CHAOS) {
+      for (uint32_t i = 0; i < gates.size(); i++) {
+        if (gates[i].conn.ready && uniform() < opt.outageRate) drop(i, opt.outageMs * 1000ull);
+      }
+      schedule(now + 1000000, CONTROLLER, TIMER_CHAOS);
+      return;
+    }
+    if (timer.kind == TIMER_GROUP_COMMAND) {
+      sendGroupCommand(now);
+      schedule(now + (uint64_t)(opt.groupEvery * 1000000.0), CONTROLLER, TIMER_GROUP_COMMAND);
+      return;
+    }
+    if (timer.kind == TIMER_STORM) {
+      if (!opt.quiet) printf("# reconnect storm: dropping %u gates\n", connected);
+      for (uint32_t i = 0; i < gates.size(); i++) {
+        drop(i, (uint64_t)(uniform() * opt.stormJitter * 1000000.0));
+      }
+      return;
+    }
+
+    if (timer.generation != connOf(timer.target).generation) return;   // Stale session
+
+    switch (timer.kind) {
+      case TIMER_CONNECT:
+        open(timer.target);
+        break;
+      case TIMER_SENSORS:
+        publishSensors(timer.target);
+        schedule(now + opt.sensorIntervalMs * 1000ull, timer.target, TIMER_SENSORS);
+        break;
+      case TIMER_STEP:
+        step(timer.target);
+        break;
+      case TIMER_GROUP_START: {
+        VirtualGate& gate = gates[timer.target];
+        if (gate.groupPending && gate.groupDueUs == timer.when) startGroupCommand(timer.target);
+        break;
+      }
+      case TIMER_PING: {
+        Connection& conn = connOf(timer.target);
+        if (now - conn.lastSendUs >= opt.keepAliveS * 500000ull) {
+          mqtt::pingreq(conn.tx);
+          flush(timer.target);
+        }
+        schedule(now + opt.keepAliveS * 500000ull, timer.target, TIMER_PING);
+        break;
+      }
+      case TIMER_COMMANDS:
+        expireCommands(now);
+        commandCredit += opt.commandRate / 100.0;
+        while (commandCredit >= 1.0) {
+          sendCommand(now);
+          commandCredit -= 1.0;
+        }
+        schedule(now + 10000, CONTROLLER, TIMER_COMMANDS);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Reporting
+  // ---------------------------------------------------------------------------
+
+  void report(uint64_t now) {
+    if (!opt.quiet) {
+      printf("%6.1f  conn %6u  pub %7llu/s  rx %7llu/s  out %7.2f MB/s  cmd %5llu  ack %5llu"
+             "  lost %4llu  new %5llu  drop %5llu  fail %4llu\n",
+             (now - startUs) / 1e6, connected,
+             (unsigned long long)second.published, (unsigned long long)second.received,
+             second.bytesOut / 1e6,
+             (unsigned long long)second.commands, (unsigned long long)second.acked,
+             (unsigned long long)second.lost, (unsigned long long)second.connects,
+             (unsigned long long)second.drops, (unsigned long long)second.failures);
+      fflush(stdout);
+    }
+    second = Counters();
+  }
+
+  static double percentile(std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index] / 1000.0;
+  }
+
+  void finalReport(uint64_t now) {
+    double seconds = (now - startUs) / 1e6;
+    std::sort(rttUs.begin(), rttUs.end());
+
+    printf("\n=== Fleet simulation: %u gates, %.1f s ===\n", (unsigned)gates.size(), seconds);
+    printf("Connected at end:   %u\n", connected);
+    printf("Sessions:           %llu connects, %llu drops, %llu failures\n",
+           (unsigned long long)total.connects, (unsigned long long)total.drops,
+           (unsigned long long)total.failures);
+    printf("Published:          %llu (%.0f msg/s), %.2f MB\n",
+           (unsigned long long)total.published, total.published / seconds, total.bytesOut / 1e6);
+    printf("Received:           %llu (%.0f msg/s), %.2f MB\n",
+           (unsigned long long)total.received, total.received / seconds, total.bytesIn / 1e6);
+    printf("Commands:           %llu sent, %llu acked, %llu lost\n",
+           (unsigned long long)total.commands, (unsigned long long)total.acked,
+           (unsigned long long)total.lost);
+    printf("Command RTT (ms):   p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+           percentile(rttUs, 0.50), percentile(rttUs, 0.90), percentile(rttUs, 0.99),
+           rttUs.empty() ? 0.0 : rttUs.back() / 1000.0);
+    if (opt.groups > 0) groupReport(now);
+  }
+
+  // Acks per request and the worst overlap of motor starts: the most
+  // executed acks of one request inside any INRUSH_WINDOW_MS window.
+  // Requests whose delays had not run out by the end are left out.
+  void groupReport(uint64_t now) {
+    static const uint32_t INRUSH_WINDOW_MS = 500;
+    uint64_t settleMs = (uint64_t)opt.staggerMs * (opt.devices / opt.groups) + opt.jitterMs;
+    settleMs = std::min<uint64_t>(settleMs, GROUP_DELAY_MAX_MS) + opt.commandTimeoutMs;
+    uint64_t expected = 0, acked = 0;
+    size_t settled = 0, members = 0, peak = 0;
+    std::vector<uint32_t> spread;
+    for (const std::string& id : groupOrder) {
+      GroupRequest& request = groupRequests[id];
+      if (now - request.sentUs < settleMs * 1000) continue;
+      settled++;
+      expected += request.expected;
+      acked += std::min(request.acked, request.expected);
+      std::vector<uint32_t>& starts = request.startMs;
+      if (starts.empty()) continue;
+      std::sort(starts.begin(), starts.end());
+      for (size_t first = 0, last = 0; last < starts.size(); last++) {
+        while (starts[last] - starts[first] > INRUSH_WINDOW_MS) first++;
+        peak = std::max(peak, last - first + 1);
+      }
+      members = std::max<size_t>(members, request.expected);
+      spread.push_back(starts.back() - starts.front());
+    }
+    std::sort(spread.begin(), spread.end());
+
+    printf("Group commands:     %zu sent, %zu settled, %llu/%llu acked (%.1f%%)\n",
+           groupOrder.size(), settled, (unsigned long long)acked, (unsigned long long)expected,
+           expected ? 100.0 * acked / expected : 0.0);
+    printf("Start spread (ms):  p50 %u  max %u\n",
+           spread.empty() ? 0 : spread[spread.size() / 2], spread.empty() ? 0 : spread.back());
+    printf("Inrush overlap:     at most %zu of %zu gates started within %u ms\n", peak, members,
+           INRUSH_WINDOW_MS);
+  }
+
+public:
+  explicit FleetSim(const Options& options) : opt(options) {}
+
+  bool begin() {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(opt.host, nullptr, &hints, &result) != 0 || !result) {
+      fprintf(stderr, "Cannot resolve %s\n", opt.host);
+      return false;
+    }
+    broker = *(sockaddr_in*)result->ai_addr;
+    broker.sin_port = htons(opt.port);
+    freeaddrinfo(result);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+      perror("epoll_create1");
+      return false;
+    }
+
+    gates.resize(opt.devices);
+    byId.reserve(opt.devices);
+    for (uint32_t i = 0; i < opt.devices; i++) {
+      VirtualGate& gate = gates[i];
+      gate.id = opt.prefix + std::to_string(i);
+      std::string base = std::string(MQTT_TOPIC_PREFIX) + gate.id;
+      gate.statusTopic = base + MQTT_TOPIC_STATUS;
+      gate.sensorsTopic = base + MQTT_TOPIC_SENSORS;
+      gate.commandsTopic = base + MQTT_TOPIC_COMMANDS;
+      gate.configTopic = base + MQTT_TOPIC_CONFIG;
+      gate.acksTopic = base + MQTT_TOPIC_ACKS;
+      if (opt.groups > 0) {
+        gate.group = groupName(i % opt.groups);
+        gate.groupSlot = (uint16_t)(i / opt.groups);
+        gate.groupTopic = GROUP_TOPIC_PREFIX + gate.group + GROUP_TOPIC_SUFFIX;
+      }
+      byId.emplace(gate.id, i);
+    }
+    rttUs.reserve(1 << 16);
+    return true;
+  }
+
+  void run() {
+    startUs = nowUs();
+    uint64_t endUs = startUs + (uint64_t)(opt.duration * 1000000.0);
+
+    open(CONTROLLER);
+    schedule(startUs + 1000000, CONTROLLER, TIMER_REPORT);
+    if (opt.outageRate > 0.0) schedule(startUs + 1000000, CONTROLLER, TIMER_CHAOS);
+    if (opt.stormAt >= 0.0) {
+      schedule(startUs + (uint64_t)(opt.stormAt * 1000000.0), CONTROLLER, TIMER_STORM);
+    }
+
+    std::vector<epoll_event> events(4096);
+    for (;;) {
+      uint64_t now = nowUs();
+      if (now >= endUs) break;
+
+      int timeoutMs = 100;
+      if (!timers.empty()) {
+        uint64_t next = timers.top().when;
+        timeoutMs = next <= now ? 0 : (int)std::min<uint64_t>((next - now + 999) / 1000, 100);
+      }
+
+      int count = epoll_wait(epollFd, events.data(), (int)events.size(), timeoutMs);
+      for (int i = 0; i < count; i++) {
+        uint32_t target = events[i].data.u32;
+        if (connOf(target).fd < 0) continue;
+        if (events[i].events & EPOLLOUT) onWritable(target);
+        if (connOf(target).fd < 0) continue;
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) onReadable(target);
+      }
+
+      now = nowUs();
+      while (!timers.empty() && timers.top().when <= now) {
+        Timer timer = timers.top();
+        timers.pop();
+        onTimer(timer, now);
+      }
+    }
+
+    finalReport(nowUs());
+  }
+};
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // One socket per virtual gate
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    rlim_t wanted = (rlim_t)opt.devices + 64;
+    if (limit.rlim_cur < wanted) {
+      limit.rlim_cur = std::min(wanted, limit.rlim_max);
+      setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (limit.rlim_cur < wanted) {
+      fprintf(stderr, "⚠ File descriptor limit %llu is below %llu; raise ulimit -n\n",
+              (unsigned long long)limit.rlim_cur, (unsigned long long)wanted);
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  FleetSim sim(opt);
+  if (!sim.begin()) return 1;
+  printf("Simulating %u gates against %s:%u for %.0f s\n", opt.devices, opt.host, opt.port, opt.duration);
+  sim.run();
+  return 0;
+}
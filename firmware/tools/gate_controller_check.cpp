@@ -0,0 +1,239 @@
+// =============================================================================
+// GATEMATE Host Tool - Gate Controller Check
+// =============================================================================
+//
+// Drives four GateController instances (src/gate_controller.h) on simulated
+// hardware at 1 ms resolution, the way main.cpp drives them from one loop():
+// all four open in the same millisecond, then one leaf hits an obstacle,
+// one trips its own current override, one its own timeout override, and the
+// last completes its travel. Checks that
+//   - the relay interlocks run concurrently (no gate waits for another)
+//   - no gate ever has both relays energized
+//   - each stop stays on its own gate, with the expected reason and state
+//     (arrival keeps GATE_OPEN, faults leave GATE_ERROR)
+//   - a reversal drops the running relay at once and energizes the other
+//     only after GATE_INTERLOCK_MS
+//   - cooldowns, operation records and device ids are per gate
+// and times one loop pass over four moving gates.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/gate_controller_check.cpp -o gate_controller_check
+//
+// Usage:
+//   ./gate_controller_check
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "check.h"
+#include "gate_controller.h"
+
+// =============================================================================
+// Simulated Hardware
+// =============================================================================
+
+struct SimBoard {
+  bool levels[64];            // Inputs, pulled up (true = inactive)
+  bool relays[64] = {};
+  uint32_t onAt[64] = {};     // When each relay was last energized
+  uint32_t now = 0;
+  int shootThrough = 0;
+
+  SimBoard() {
+    for (bool& level : levels) level = true;
+  }
+
+  void write(uint8_t pin, bool level) {
+    if (level && !relays[pin]) onAt[pin] = now;
+    relays[pin] = level;
+  }
+
+  bool read(uint8_t pin) { return levels[pin]; }
+};
+
+using Gate = GateController<SimBoard>;
+
+// Four gates, distinct pins; gate 2 and 3 override current and timeout
+static const GateDescriptor descriptors[] = {
+  {"", {16, 17, 25, 26, 33, 34}, 0, 0},
+  {"b", {18, 19, 27, 14, 23, 35}, 0, 0},
+  {"barrier", {21, 22, 4, 5, 13, 36}, 3.0f, 0},
+  {"d", {2, 15, 12, 0, 32, 39}, 0, 4000},
+};
+static const uint8_t GATES = sizeof(descriptors) / sizeof(descriptors[0]);
+
+// Leaf travel while a relay is energized: same speed as the position steps
+struct Leaf {
+  float position = 0.0f;      // %
+
+  void update(SimBoard& board, const GatePins& pins) {
+    bool opening = board.relays[pins.relayOpen];
+    bool closing = board.relays[pins.relayClose];
+    if (opening && closing) board.shootThrough++;
+    float speed = (float)GATE_STEP_PERCENT / GATE_STEP_MS;
+    if (opening && !closing) position += speed;
+    if (closing && !opening) position -= speed;
+    if (position > 100.0f) position = 100.0f;
+    if (position < 0.0f) position = 0.0f;
+    board.levels[pins.limitOpen] = position < 100.0f;
+    board.levels[pins.limitClose] = position > 0.0f;
+  }
+};
+
+int main() {
+  SimBoard board;
+  Gate gates[GATES];
+  Leaf leaves[GATES];
+  SafetyLimits limits = {GATE_TIMEOUT_MS, 5.0f, 75.0f, OBSTACLE_DEBOUNCE_MS};
+  const float temperature = 30.0f;
+
+  for (uint8_t i = 0; i < GATES; i++) {
+    gates[i].begin(descriptors[i], i, board, "GATEMATE-001");
+    leaves[i].update(board, descriptors[i].pins);
+    gates[i].restore(GATE_CLOSED, 0);
+    gates[i].takeEvents();
+  }
+
+  expect(strcmp(gates[0].getDeviceId(), "GATEMATE-001") == 0, "first gate keeps the controller id");
+  expect(strcmp(gates[2].getDeviceId(), "GATEMATE-001-barrier") == 0, "gate id is controller-id");
+
+  // One loop() pass at board.now
+  int32_t currentMa[GATES] = {};
+  auto tick = [&]() {
+    for (uint8_t i = 0; i < GATES; i++) {
+      leaves[i].update(board, descriptors[i].pins);
+      gates[i].addSample(board.now, currentMa[i], 24000);
+      gates[i].loop(board.now, limits, temperature);
+    }
+    board.now++;
+  };
+
+  // ---------------------------------------------------------------------------
+  // All four open in the same millisecond
+  // ---------------------------------------------------------------------------
+
+  board.now = 1000;
+  const uint32_t start = board.now;
+  for (uint8_t i = 0; i < GATES; i++) {
+    gates[i].markCommand(board.now);
+    gates[i].open(board.now);
+  }
+  expect(gates[0].inCooldown(board.now + 10, COMMAND_COOLDOWN_MS), "cooldown holds on gate 0");
+  expect(!gates[1].inCooldown(board.now + COMMAND_COOLDOWN_MS, COMMAND_COOLDOWN_MS),
+         "cooldown expires on gate 1");
+
+  for (uint8_t i = 0; i < GATES; i++) {
+    expect(gates[i].getState() == GATE_OPENING, "all gates opening");
+    expect((gates[i].takeEvents() & GATE_EVENT_STARTED) != 0, "start event");
+    expect(!board.relays[descriptors[i].pins.relayOpen], "relay waits for the interlock");
+  }
+
+  // Gate 1 gets an obstacle at 2 s, gates 0 and 2 draw 4 A from 3 s
+  uint32_t obstacleAt = start + 2000;
+  uint32_t loadAt = start + 3000;
+  while (board.now < start + 10000) {
+    if (board.now == obstacleAt) board.levels[descriptors[1].pins.obstacle] = false;
+    if (board.now == loadAt) currentMa[0] = currentMa[2] = 4000;
+    tick();
+  }
+
+  bool together = true;
+  for (uint8_t i = 0; i < GATES; i++) {
+    together &= board.onAt[descriptors[i].pins.relayOpen] == start + GATE_INTERLOCK_MS;
+  }
+  expect(together, "all relays energized after one interlock period");
+  expect(board.shootThrough == 0, "no gate had both relays on");
+
+  struct Expected {
+    StopReason reason;
+    GateState state;
+    uint32_t at;              // 0 = not checked
+    uint8_t percentage;       // 0xFF = not checked
+  } expected[GATES] = {
+    {STOP_COMPLETED, GATE_OPEN, 0, 100},              // Within the config limit
+    {STOP_OBSTACLE, GATE_STOPPED, obstacleAt, 0xFF},
+    {STOP_OVERCURRENT, GATE_ERROR, loadAt, 0xFF},     // 3 A override
+    {STOP_TIMEOUT, GATE_ERROR, start + 4001, 0xFF},   // 4 s override
+  };
+
+  for (uint8_t i = 0; i < GATES; i++) {
+    const GateStop& stop = gates[i].lastStop();
+    char what[96];
+    snprintf(what, sizeof(what), "gate %u stopped by %s at %u ms (expected %s)", i,
+             stopReasonName(stop.reason), stop.timeMs - start, stopReasonName(expected[i].reason));
+    printf("%-22s %-8s %-12s after %5u ms at %3u%%\n", gates[i].getDeviceId(),
+           gateStateName(gates[i].getState()), stopReasonName(stop.reason),
+           stop.timeMs - start, stop.percentage);
+    expect(stop.reason == expected[i].reason, what);
+    expect(gates[i].getState() == expected[i].state, "state after the stop");
+    if (expected[i].at) expect(stop.timeMs - expected[i].at <= 1, what);
+    if (expected[i].percentage != 0xFF) expect(stop.percentage == expected[i].percentage, what);
+    expect(!board.relays[descriptors[i].pins.relayOpen] &&
+           !board.relays[descriptors[i].pins.relayClose], "relays released after the stop");
+    expect(gates[i].operations().size() == 1 &&
+           gates[i].operations().at(0).stopReason == expected[i].reason,
+           "one operation record per gate");
+  }
+
+  // ---------------------------------------------------------------------------
+  // Reversal on gate 1 while the others keep moving
+  // ---------------------------------------------------------------------------
+
+  board.levels[descriptors[1].pins.obstacle] = true;
+  currentMa[0] = currentMa[2] = 0;
+  for (uint8_t i = 0; i < GATES; i++) gates[i].takeEvents();
+
+  gates[1].open(board.now);
+  gates[3].close(board.now);
+  for (int i = 0; i < 500; i++) tick();
+
+  uint32_t reverseAt = board.now;
+  gates[1].close(board.now);
+  expect(!board.relays[descriptors[1].pins.relayOpen], "open relay dropped at once");
+  expect(!board.relays[descriptors[1].pins.relayClose], "close relay waits for the interlock");
+  for (int i = 0; i < 200; i++) tick();
+  expect(board.onAt[descriptors[1].pins.relayClose] == reverseAt + GATE_INTERLOCK_MS,
+         "close relay energized after the interlock");
+  expect(gates[3].getState() == GATE_CLOSING, "gate 3 unaffected by the reversal");
+  expect(board.shootThrough == 0, "no shoot-through on reversal");
+
+  const auto& history = gates[1].operations();
+  expect(history.size() == 2 && history.at(1).stopReason == STOP_REVERSED,
+         "reversal ends the running operation");
+
+  // ---------------------------------------------------------------------------
+  // Cost of one loop pass over four moving gates
+  // ---------------------------------------------------------------------------
+
+  for (uint8_t i = 0; i < GATES; i++) {
+    board.levels[descriptors[i].pins.limitOpen] = true;
+    board.levels[descriptors[i].pins.limitClose] = true;
+  }
+  const int repeats = 100;
+  const int rounds = 2000;      // Within one travel from 50 %
+  double ns = 0;
+  for (int k = 0; k < repeats; k++) {
+    for (uint8_t i = 0; i < GATES; i++) {
+      gates[i].restore(GATE_STOPPED, 50);
+      gates[i].open(board.now);
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      for (uint8_t i = 0; i < GATES; i++) {
+        gates[i].loop(board.now, limits, temperature);
+        gates[i].takeEvents();
+      }
+      board.now++;
+    }
+    ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    for (uint8_t i = 0; i < GATES; i++) {
+      expect(gates[i].moving(), "gates still moving during the timing run");
+    }
+  }
+  printf("loop pass, %u moving gates: %.0f ns\n", GATES, ns / (repeats * rounds));
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
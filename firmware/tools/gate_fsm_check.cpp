@@ -0,0 +1,343 @@
+// =============================================================================
+// GATEMATE Host Tool - Gate State Machine Check
+// =============================================================================
+//
+// Checks the gate state table (src/gate_fsm.h) and GateController's
+// dispatch of it:
+//   - gateNextState() against the rules spelled out as plain conditions,
+//     for every state, input and position 0..100
+//   - every state, input and position class on a GateController: the new
+//     state, relays, events, stop report and operation record of each
+//     transition, and that ignored inputs change nothing
+//   - a long random walk of commands, steps and safety inputs: never both
+//     relays on, no relay at rest, GATE_ERROR only after a fault
+// and times a table lookup against the same rules as branches, and a full
+// dispatch with its actions.
+//
+// The static_asserts in gate_fsm.h already hold the table to its structural
+// invariants at compile time; this checks the behaviour.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/gate_fsm_check.cpp -o gate_fsm_check
+//
+// Usage:
+//   ./gate_fsm_check
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "gate_controller.h"
+#include "gate_fsm.h"
+
+// =============================================================================
+// Rules
+// =============================================================================
+
+// The behaviour the table encodes, written as conditions
+static GateState rule(GateState state, GateInput input, uint8_t percentage) {
+  bool moving = state == GATE_OPENING || state == GATE_CLOSING;
+  switch (input) {
+    case GATE_IN_OPEN: return state != GATE_OPENING && percentage < 100 ? GATE_OPENING : state;
+    case GATE_IN_CLOSE: return state != GATE_CLOSING && percentage > 0 ? GATE_CLOSING : state;
+    case GATE_IN_STOP: return moving || state == GATE_ERROR ? GATE_STOPPED : state;
+    case GATE_IN_ARRIVED:
+      return state == GATE_OPENING ? GATE_OPEN : state == GATE_CLOSING ? GATE_CLOSED : state;
+    case GATE_IN_OBSTACLE: return moving ? GATE_STOPPED : state;
+    case GATE_IN_FAULT: return moving ? GATE_ERROR : state;
+    default: return state;
+  }
+}
+
+// The stop reason each input is raised with
+static StopReason reasonFor(GateInput input) {
+  switch (input) {
+    case GATE_IN_STOP: return STOP_MANUAL;
+    case GATE_IN_ARRIVED: return STOP_COMPLETED;
+    case GATE_IN_OBSTACLE: return STOP_OBSTACLE;
+    case GATE_IN_FAULT: return STOP_OVERCURRENT;
+    default: return STOP_REVERSED;
+  }
+}
+
+// =============================================================================
+// Simulated Hardware
+// =============================================================================
+
+struct SimBoard {
+  bool levels[64];            // Inputs, pulled up (true = inactive)
+  bool relays[64] = {};
+  int shootThrough = 0;
+
+  SimBoard() {
+    for (bool& level : levels) level = true;
+  }
+
+  void write(uint8_t pin, bool level) {
+    relays[pin] = level;
+    if (relays[16] && relays[17]) shootThrough++;
+  }
+
+  bool read(uint8_t pin) { return levels[pin]; }
+};
+
+using Gate = GateController<SimBoard>;
+
+static const GateDescriptor descriptor = {"", {16, 17, 25, 26, 33, 34}, 0, 0};
+static const SafetyLimits limits = {GATE_TIMEOUT_MS, 5.0f, 75.0f, OBSTACLE_DEBOUNCE_MS};
+
+// A fresh gate in state at percentage; false if no command sequence gets there
+static bool reach(Gate& gate, SimBoard& board, GateState state, uint8_t percentage,
+                  uint32_t nowMs) {
+  gate.begin(descriptor, 0, board, "GATEMATE-001");
+  bool moving = gateStateMoving(state);
+  gate.restore(moving ? GATE_STOPPED : state, percentage);
+  if (state == GATE_OPENING) gate.open(nowMs);
+  if (state == GATE_CLOSING) gate.close(nowMs);
+  gate.takeEvents();
+  return gate.getState() == state && gate.getPercentage() == percentage;
+}
+
+// =============================================================================
+// Checks
+// =============================================================================
+
+static void checkTable() {
+  int cases = 0;
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    for (uint8_t i = 0; i < GATE_INPUT_COUNT; i++) {
+      for (int p = 0; p <= 100; p++) {
+        GateState state = (GateState)s;
+        GateInput input = (GateInput)i;
+        GateState want = rule(state, input, (uint8_t)p);
+        GateState got = gateNextState(state, input, (uint8_t)p);
+        if (got != want) {
+          printf("FAIL: %s + %s at %d%% -> %s, expected %s\n", gateStateName(state),
+                 gateInputName(input), p, gateStateName(got), gateStateName(want));
+          failures++;
+        }
+        cases++;
+      }
+    }
+  }
+  printf("table: %d state/input/position cases\n", cases);
+
+  expect(gateInputFor(STOP_LIMIT) == GATE_IN_ARRIVED, "limit switch arrives");
+  expect(gateInputFor(STOP_TIMEOUT) == GATE_IN_FAULT && gateInputFor(STOP_OVERHEAT) == GATE_IN_FAULT,
+         "timeout and overheat are faults");
+  expect(gateInputFor(STOP_OBSTACLE) == GATE_IN_OBSTACLE, "obstacle is not a fault");
+}
+
+static void checkController() {
+  static const uint8_t positions[] = {0, 5, 50, 95, 100};
+  int cases = 0;
+  char what[128];
+
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) {
+    for (uint8_t i = 0; i < GATE_INPUT_COUNT; i++) {
+      for (uint8_t p : positions) {
+        GateState from = (GateState)s;
+        GateInput input = (GateInput)i;
+        SimBoard board;
+        Gate gate;
+        const uint32_t t0 = 1000;
+        if (!reach(gate, board, from, p, t0)) continue;
+        cases++;
+        snprintf(what, sizeof(what), "%s + %s at %u%%", gateStateName(from), gateInputName(input), p);
+
+        size_t records = gate.operations().size();
+        bool settled = gate.relaysSettled();
+        const uint32_t now = t0 + 10;
+        StopReason reason = reasonFor(input);
+        bool changed = gate.dispatch(input, reason, now);
+        GateState to = gate.getState();
+        uint8_t events = gate.takeEvents();
+
+        expect(to == rule(from, input, p), what);
+        expect(changed == (to != from), what);
+        expect(board.shootThrough == 0, what);
+
+        if (!changed) {
+          expect(events == 0 && gate.operations().size() == records &&
+                 gate.relaysSettled() == settled && gate.getPercentage() == p, what);
+          continue;
+        }
+
+        // Leaving a movement closes its record with the reason
+        if (gateStateMoving(from)) {
+          expect(gate.operations().size() == records + 1 &&
+                 gate.operations().at(records).stopReason == reason, what);
+        }
+
+        if (gateStateMoving(to)) {
+          expect(events == GATE_EVENT_STARTED, what);
+          expect(!board.relays[descriptor.pins.relayOpen] &&
+                 !board.relays[descriptor.pins.relayClose] && !gate.relaysSettled(), what);
+          // Near the end the same pass may step into the end position
+          gate.loop(now + GATE_INTERLOCK_MS, limits, 30.0f);
+          if (!gate.moving()) continue;
+          uint8_t driven = to == GATE_OPENING ? descriptor.pins.relayOpen : descriptor.pins.relayClose;
+          uint8_t other = to == GATE_OPENING ? descriptor.pins.relayClose : descriptor.pins.relayOpen;
+          expect(board.relays[driven] && !board.relays[other], what);
+        } else {
+          expect(events == GATE_EVENT_STOPPED, what);
+          expect(!board.relays[descriptor.pins.relayOpen] &&
+                 !board.relays[descriptor.pins.relayClose] && gate.relaysSettled(), what);
+          const GateStop& stop = gate.lastStop();
+          expect(stop.reason == reason && stop.timeMs == now && stop.percentage == gate.getPercentage(),
+                 what);
+          if (to == GATE_OPEN) expect(gate.getPercentage() == 100, what);
+          if (to == GATE_CLOSED) expect(gate.getPercentage() == 0, what);
+        }
+      }
+    }
+  }
+  printf("controller: %d reachable state/input/position cases\n", cases);
+
+  // Regressions: a completed travel or a limit switch stays GATE_OPEN /
+  // GATE_CLOSED instead of being overwritten with GATE_STOPPED
+  SimBoard board;
+  Gate gate;
+  reach(gate, board, GATE_OPENING, 95, 0);
+  gate.loop(GATE_INTERLOCK_MS, limits, 30.0f);
+  gate.loop(GATE_STEP_MS + GATE_INTERLOCK_MS, limits, 30.0f);
+  expect(gate.getState() == GATE_OPEN && gate.getPercentage() == 100 &&
+         gate.lastStop().reason == STOP_COMPLETED, "completed travel ends open");
+
+  reach(gate, board, GATE_CLOSING, 50, 0);
+  gate.loop(GATE_INTERLOCK_MS, limits, 30.0f);
+  board.levels[descriptor.pins.limitClose] = false;
+  gate.loop(GATE_INTERLOCK_MS + 1, limits, 30.0f);
+  board.levels[descriptor.pins.limitClose] = true;
+  expect(gate.getState() == GATE_CLOSED && gate.getPercentage() == 0 &&
+         gate.lastStop().reason == STOP_LIMIT &&
+         gate.operations().at(gate.operations().size() - 1).endPercentage == 0,
+         "limit switch ends closed at 0 %");
+
+  // Overheat enters GATE_ERROR; a stop clears it, an open leaves it
+  reach(gate, board, GATE_OPENING, 20, 0);
+  gate.loop(GATE_INTERLOCK_MS, limits, 90.0f);
+  expect(gate.getState() == GATE_ERROR && gate.lastStop().reason == STOP_OVERHEAT, "overheat is an error");
+  gate.stop(GATE_INTERLOCK_MS + 1);
+  expect(gate.getState() == GATE_STOPPED, "stop clears the error");
+  reach(gate, board, GATE_ERROR, 20, 0);
+  gate.open(1);
+  expect(gate.getState() == GATE_OPENING, "open leaves the error");
+}
+
+// Random commands, steps, obstacles, load and heat on one gate
+static void checkRandomWalk() {
+  std::mt19937 rng(42);
+  SimBoard board;
+  Gate gate;
+  gate.begin(descriptor, 0, board, "GATEMATE-001");
+  gate.restore(GATE_CLOSED, 0);
+
+  uint32_t now = 0;
+  int32_t currentMa = 0;
+  float temperature = 30.0f;
+  bool faultSeen = false;
+  int violations = 0;
+  int visits[GATE_STATE_COUNT] = {};
+
+  for (int step = 0; step < 1000000; step++) {
+    now += 1 + rng() % 20;
+    switch (rng() % 64) {
+      case 0: gate.open(now); break;
+      case 1: gate.close(now); break;
+      case 2: gate.stop(now); break;
+      case 3: gate.moveTo((uint8_t)(rng() % 101), now); break;
+      case 4: board.levels[descriptor.pins.obstacle] = !board.levels[descriptor.pins.obstacle]; break;
+      case 5: currentMa = rng() % 8 == 0 ? 6000 : 1500; break;
+      case 6: temperature = rng() % 16 == 0 ? 90.0f : 30.0f; break;
+      default: break;
+    }
+    gate.addSample(now, currentMa, 24000);
+    gate.loop(now, limits, temperature);
+
+    uint8_t events = gate.takeEvents();
+    GateState state = gate.getState();
+    visits[state]++;
+    if ((events & GATE_EVENT_STOPPED) && state == GATE_ERROR) {
+      StopReason r = gate.lastStop().reason;
+      faultSeen = true;
+      if (r != STOP_TIMEOUT && r != STOP_OVERCURRENT && r != STOP_OVERHEAT) violations++;
+    }
+    bool anyRelay = board.relays[descriptor.pins.relayOpen] || board.relays[descriptor.pins.relayClose];
+    if (!gateStateMoving(state) && (anyRelay || !gate.relaysSettled())) violations++;
+    if (gate.moving() != gateStateMoving(state)) violations++;
+    if (state == GATE_OPEN && gate.getPercentage() != 100) violations++;
+    if (state == GATE_CLOSED && gate.getPercentage() != 0) violations++;
+  }
+
+  printf("random walk: closed %d, opening %d, open %d, closing %d, stopped %d, error %d\n",
+         visits[GATE_CLOSED], visits[GATE_OPENING], visits[GATE_OPEN], visits[GATE_CLOSING],
+         visits[GATE_STOPPED], visits[GATE_ERROR]);
+  expect(violations == 0, "random walk invariants");
+  expect(board.shootThrough == 0, "random walk never energized both relays");
+  expect(faultSeen, "random walk reached GATE_ERROR");
+  for (uint8_t s = 0; s < GATE_STATE_COUNT; s++) expect(visits[s] > 0, "random walk visits every state");
+}
+
+// =============================================================================
+// Timing
+// =============================================================================
+
+template <typename F>
+static double nsPerCall(int rounds, F body) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) body(i);
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+}
+
+static void timeDispatch() {
+  // Random state/input/position triples, so branches cannot be learned
+  const int count = 1 << 16;
+  std::mt19937 rng(7);
+  std::vector<uint8_t> states(count), inputs(count), positions(count);
+  for (int i = 0; i < count; i++) {
+    states[i] = rng() % GATE_STATE_COUNT;
+    inputs[i] = rng() % GATE_INPUT_COUNT;
+    positions[i] = rng() % 3 == 0 ? (rng() % 2) * 100 : rng() % 101;
+  }
+
+  const int rounds = 20000000;
+  volatile uint32_t sink = 0;
+  double tableNs = nsPerCall(rounds, [&](int i) {
+    int k = i & (count - 1);
+    sink += gateNextState((GateState)states[k], (GateInput)inputs[k], positions[k]);
+  });
+  double branchNs = nsPerCall(rounds, [&](int i) {
+    int k = i & (count - 1);
+    sink += rule((GateState)states[k], (GateInput)inputs[k], positions[k]);
+  });
+
+  // Whole dispatch with actions: open, reverse, stop, repeated
+  SimBoard board;
+  Gate gate;
+  gate.begin(descriptor, 0, board, "GATEMATE-001");
+  gate.restore(GATE_STOPPED, 50);
+  static const GateInput cycle[] = {GATE_IN_OPEN, GATE_IN_CLOSE, GATE_IN_STOP, GATE_IN_STOP};
+  double dispatchNs = nsPerCall(rounds / 4, [&](int i) {
+    sink += gate.dispatch(cycle[i & 3], reasonFor(cycle[i & 3]), (uint32_t)i);
+    gate.takeEvents();
+  });
+
+  printf("next-state lookup, table:    %5.2f ns\n", tableNs);
+  printf("next-state lookup, branches: %5.2f ns\n", branchNs);
+  printf("dispatch with actions:       %5.2f ns\n", dispatchNs);
+}
+
+int main() {
+  checkTable();
+  checkController();
+  checkRandomWalk();
+  timeDispatch();
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
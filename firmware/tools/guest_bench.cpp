@@ -0,0 +1,287 @@
+// =============================================================================
+// GATEMATE Host Tool - Guest Token Benchmark
+// =============================================================================
+//
+// Checks and times the offline guest token path (src/guest_token.h) on the
+// host, with OpenSSL standing in for mbedTLS: a keyed HMAC context reused
+// across verifications (what GuestAccess does on the device) against a
+// one-shot HMAC that re-processes the key, the full verification, and the
+// revocation filter lookup. Also rejects tampered, expired, premature and
+// revoked tokens, and measures the filter's false-positive rate at its
+// design load. The device reports its own verification cost at GET /guest.
+//
+// Can also mint and verify tokens against a device key, e.g. to exercise
+// POST /guest on a test device or to cross-check the backend.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/guest_bench.cpp -o guest_bench -lcrypto
+//
+// Usage:
+//   ./guest_bench
+//   ./guest_bench --mint --key <hex> --id <passId> [--perm open,close]
+//                 [--max-uses N] [--valid SECONDS]
+//   ./guest_bench --verify <token> --key <hex> [--filter <base64url>] [--now EPOCH]
+//
+
+#define OPENSSL_API_COMPAT 0x10100000L
+#include <openssl/hmac.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+
+#include "guest_token.h"
+
+// Key processed once; each compute() reuses the pads
+class KeyedHmac {
+private:
+  HMAC_CTX* ctx;
+
+public:
+  explicit KeyedHmac(const uint8_t* key) : ctx(HMAC_CTX_new()) {
+    HMAC_Init_ex(ctx, key, GUEST_KEY_LEN, EVP_sha256(), nullptr);
+  }
+  ~KeyedHmac() { HMAC_CTX_free(ctx); }
+
+  void compute(const uint8_t* data, size_t length, uint8_t out[32]) {
+    unsigned int outLength = 32;
+    HMAC_Init_ex(ctx, nullptr, 0, nullptr, nullptr);
+    HMAC_Update(ctx, data, length);
+    HMAC_Final(ctx, out, &outLength);
+  }
+};
+
+// Key processed on every call
+class OneShotHmac {
+private:
+  const uint8_t* key;
+
+public:
+  explicit OneShotHmac(const uint8_t* key) : key(key) {}
+
+  void compute(const uint8_t* data, size_t length, uint8_t out[32]) {
+    unsigned int outLength = 32;
+    HMAC(EVP_sha256(), key, GUEST_KEY_LEN, data, length, out, &outLength);
+  }
+};
+
+template <typename Mac>
+static std::string mint(Mac& mac, const GuestClaims& claims) {
+  uint8_t payload[GUEST_PAYLOAD_MAX];
+  size_t length = encodeGuestPayload(claims, payload);
+  uint8_t tag[32];
+  mac.compute(payload, length, tag);
+
+  char token[GUEST_TOKEN_MAX];
+  int used = base64urlEncode(payload, length, token, sizeof(token));
+  token[used++] = '.';
+  base64urlEncode(tag, GUEST_TAG_LEN, token + used, sizeof(token) - used);
+  return token;
+}
+
+static bool parseHexKey(const char* hex, uint8_t* key) {
+  if (!hex || strlen(hex) != GUEST_KEY_LEN * 2) return false;
+  for (int i = 0; i < GUEST_KEY_LEN; i++) {
+    unsigned value;
+    if (sscanf(hex + 2 * i, "%2x", &value) != 1) return false;
+    key[i] = (uint8_t)value;
+  }
+  return true;
+}
+
+template <typename F>
+static double nsPerCall(int rounds, F body) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) body(i);
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+}
+
+static int selfTest() {
+  uint8_t key[GUEST_KEY_LEN];
+  std::mt19937 rng(5);
+  for (auto& b : key) b = (uint8_t)rng();
+  KeyedHmac keyed(key);
+  OneShotHmac oneShot(key);
+
+  const uint32_t now = 1780000000;
+  GuestClaims claims = {};
+  strcpy(claims.id, "cm3x9k2ab0001qz8r5t7y6w4e");
+  claims.permissions = GUEST_PERM_OPEN;
+  claims.maxUses = 3;
+  claims.notBefore = now - 60;
+  claims.expiresAt = now + 86400;
+  std::string token = mint(keyed, claims);
+  printf("token (%zu chars): %s\n", token.size(), token.c_str());
+
+  GuestBloom revoked;
+  GuestClaims out;
+  int failures = 0;
+  auto expect = [&](const char* what, const std::string& t, uint32_t at, GuestVerdict want) {
+    GuestVerdict got = verifyGuestToken(keyed, t.c_str(), at, revoked, out);
+    if (got != want) {
+      printf("FAIL: %s: %s, expected %s\n", what, guestVerdictName(got), guestVerdictName(want));
+      failures++;
+    }
+  };
+
+  expect("valid", token, now, GUEST_OK);
+  if (strcmp(out.id, claims.id) != 0 || out.maxUses != 3 || out.permissions != GUEST_PERM_OPEN) {
+    printf("FAIL: claims not recovered\n");
+    failures++;
+  }
+  expect("premature", token, now - 120, GUEST_NOT_YET_VALID);
+  expect("expired", token, now + 86400, GUEST_EXPIRED);
+
+  // Every single-character change must be rejected
+  const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_.";
+  int accepted = 0;
+  for (size_t i = 0; i < token.size(); i++) {
+    for (const char* c = alphabet; *c; c++) {
+      if (*c == token[i]) continue;
+      std::string tampered = token;
+      tampered[i] = *c;
+      if (verifyGuestToken(keyed, tampered.c_str(), now, revoked, out) == GUEST_OK) accepted++;
+    }
+  }
+  if (accepted) {
+    printf("FAIL: %d tampered tokens accepted\n", accepted);
+    failures++;
+  }
+  expect("truncated", token.substr(0, token.size() - 3), now, GUEST_MALFORMED);
+  expect("garbage", "not-a-token", now, GUEST_MALFORMED);
+
+  uint8_t otherKey[GUEST_KEY_LEN] = {1};
+  KeyedHmac other(otherKey);
+  expect("other device", mint(other, claims), now, GUEST_BAD_SIGNATURE);
+
+  revoked.add(claims.id);
+  expect("revoked", token, now, GUEST_REVOKED);
+  revoked.clear();
+
+  // Local use counting
+  GuestUsage<4> usage;
+  for (int i = 0; i < 3; i++) usage.record(claims, now);
+  if (usage.uses(claims.id) != 3) {
+    printf("FAIL: use count %u, expected 3\n", usage.uses(claims.id));
+    failures++;
+  }
+
+  // False positives at 400 revoked passes
+  char id[GUEST_ID_MAX + 1];
+  for (int i = 0; i < 400; i++) {
+    snprintf(id, sizeof(id), "revoked-%08x", (unsigned)rng());
+    revoked.add(id);
+  }
+  int positives = 0;
+  const int probes = 200000;
+  for (int i = 0; i < probes; i++) {
+    snprintf(id, sizeof(id), "valid-%08x-%d", (unsigned)rng(), i);
+    if (revoked.contains(id)) positives++;
+  }
+  printf("bloom: %d bits, %d hashes, 400 entries -> %.2f%% false positives\n",
+         GUEST_BLOOM_BITS, GUEST_BLOOM_HASHES, 100.0 * positives / probes);
+  if (positives > probes / 50) {
+    printf("FAIL: false-positive rate above 2%%\n");
+    failures++;
+  }
+  revoked.clear();
+
+  // Timings
+  uint8_t payload[GUEST_PAYLOAD_MAX];
+  uint8_t tag[GUEST_TAG_LEN];
+  uint8_t digest[32];
+  size_t payloadLength = encodeGuestPayload(claims, payload);
+  const int rounds = 500000;
+  volatile uint32_t sink = 0;
+
+  double keyedNs = nsPerCall(rounds, [&](int) { keyed.compute(payload, payloadLength, digest); sink += digest[0]; });
+  double oneShotNs = nsPerCall(rounds, [&](int) { oneShot.compute(payload, payloadLength, digest); sink += digest[0]; });
+  double parseNs = nsPerCall(rounds, [&](int) {
+    size_t length;
+    sink += parseGuestToken(token.c_str(), payload, length, tag, out);
+  });
+  double bloomNs = nsPerCall(rounds, [&](int) { sink += revoked.contains(claims.id); });
+  double verifyNs = nsPerCall(rounds, [&](int) {
+    sink += verifyGuestToken(keyed, token.c_str(), now, revoked, out);
+  });
+
+  printf("hmac keyed context: %7.0f ns\n", keyedNs);
+  printf("hmac one-shot:      %7.0f ns\n", oneShotNs);
+  printf("parse:              %7.0f ns\n", parseNs);
+  printf("bloom lookup:       %7.0f ns\n", bloomNs);
+  printf("full verification:  %7.0f ns\n", verifyNs);
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  bool doMint = false;
+  const char* verifyToken = nullptr;
+  const char* keyHex = nullptr;
+  const char* filter = nullptr;
+  GuestClaims claims = {};
+  claims.permissions = GUEST_PERM_OPEN;
+  uint32_t valid = 86400;
+  uint32_t now = (uint32_t)time(nullptr);
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--mint") doMint = true;
+    else if (arg == "--verify" && hasValue) verifyToken = argv[++i];
+    else if (arg == "--key" && hasValue) keyHex = argv[++i];
+    else if (arg == "--filter" && hasValue) filter = argv[++i];
+    else if (arg == "--id" && hasValue) strncpy(claims.id, argv[++i], GUEST_ID_MAX);
+    else if (arg == "--max-uses" && hasValue) claims.maxUses = (uint8_t)atoi(argv[++i]);
+    else if (arg == "--valid" && hasValue) valid = (uint32_t)atol(argv[++i]);
+    else if (arg == "--now" && hasValue) now = (uint32_t)atol(argv[++i]);
+    else if (arg == "--perm" && hasValue) {
+      std::string perms = argv[++i];
+      claims.permissions = (perms.find("open") != std::string::npos ? GUEST_PERM_OPEN : 0) |
+                           (perms.find("close") != std::string::npos ? GUEST_PERM_CLOSE : 0);
+    } else {
+      fprintf(stderr, "usage: %s [--mint --key HEX --id ID [--perm open,close] [--max-uses N] "
+                      "[--valid S] | --verify TOKEN --key HEX [--filter B64] [--now EPOCH]]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  if (!doMint && !verifyToken) return selfTest();
+
+  uint8_t key[GUEST_KEY_LEN];
+  if (!parseHexKey(keyHex, key)) {
+    fprintf(stderr, "--key must be %d hex characters\n", GUEST_KEY_LEN * 2);
+    return 2;
+  }
+  KeyedHmac mac(key);
+
+  if (doMint) {
+    if (!claims.id[0]) {
+      fprintf(stderr, "--id is required\n");
+      return 2;
+    }
+    claims.notBefore = now;
+    claims.expiresAt = now + valid;
+    printf("%s\n", mint(mac, claims).c_str());
+    return 0;
+  }
+
+  GuestBloom revoked;
+  if (filter && base64urlDecode(filter, strlen(filter), revoked.data(), GuestBloom::size()) !=
+                    (int)GuestBloom::size()) {
+    fprintf(stderr, "--filter must decode to %zu bytes\n", GuestBloom::size());
+    return 2;
+  }
+  GuestClaims out = {};
+  GuestVerdict verdict = verifyGuestToken(mac, verifyToken, now, revoked, out);
+  printf("%s id=%s permissions=0x%02x maxUses=%u notBefore=%u expiresAt=%u\n",
+         guestVerdictName(verdict), out.id, out.permissions, out.maxUses, out.notBefore,
+         out.expiresAt);
+  return verdict == GUEST_OK ? 0 : 1;
+}
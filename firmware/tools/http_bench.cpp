@@ -0,0 +1,546 @@
+// =============================================================================
+// GATEMATE Host Tool - HTTP Response Cache Benchmark
+// =============================================================================
+//
+// Serves a GET /status like the device's over loopback, from the response
+// cache in src/http_cache.h, and reports requests/s and per-request handler
+// cost for:
+//   render    - document built and serialized on every request (before)
+//   cached    - body kept between requests, 200 with the stored bytes
+//   304       - poller sending If-None-Match, no body
+//   polling   - If-None-Match while a gate moves (state changes every
+//               10th request), the mix a dashboard sees
+//
+// ArduinoJson is not available on the host; the render path stands in for
+// it with a heap-allocated node list serialized into a growing string, which
+// allocates less than JsonDocument + String do on the device, so the gap
+// shown is a lower bound. Loopback figures include the socket round trip
+// and the kernel, which dominate on a PC; the handler figures are the part
+// the cache removes.
+//
+// Also checks ETag formatting and If-None-Match matching, and that cached
+// and conditional responses carry the same bytes and tags as rendered ones.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/http_bench.cpp -o http_bench -pthread
+//
+// Usage:
+//   ./http_bench [--requests N]
+//
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "http_cache.h"
+
+// Heap allocations, counted for the per-request figures
+static std::atomic<unsigned long> allocations{0};
+
+void* operator new(size_t size) {
+  allocations++;
+  if (void* p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// =============================================================================
+// Device Model
+// =============================================================================
+
+#define BENCH_GATES 2
+
+static const char* const stateNames[] = {"closed", "opening", "open", "closing", "stopped"};
+
+// As StatusSnapshot in main.cpp
+struct StatusSnapshot {
+  uint8_t state[BENCH_GATES];
+  uint8_t percentage[BENCH_GATES];
+  bool obstacle[BENCH_GATES];
+  int16_t currentCa[BENCH_GATES];
+  int16_t voltageDv;
+  int16_t temperatureDc;
+  int16_t wifiSignal;
+  bool online;
+};
+
+struct Device {
+  uint8_t state[BENCH_GATES] = {0, 0};
+  uint8_t percentage[BENCH_GATES] = {0, 0};
+  float current[BENCH_GATES] = {0.013f, 0.021f};
+  float voltage = 12.27f;
+  float temperature = 31.4f;
+  int wifiSignal = -61;
+
+  // One step of a gate opening: position, motor current and a little noise
+  void step(int i) {
+    state[0] = 1;
+    percentage[0] = (uint8_t)(i % 101);
+    current[0] = 2.1f + 0.004f * (i % 7);
+    voltage = 12.1f + 0.001f * (i % 5);
+  }
+};
+
+static StatusSnapshot snapshot(const Device& device) {
+  StatusSnapshot status = {};
+  for (int i = 0; i < BENCH_GATES; i++) {
+    status.state[i] = device.state[i];
+    status.percentage[i] = device.percentage[i];
+    status.currentCa[i] = (int16_t)lroundf(device.current[i] * 100.0f);
+  }
+  status.voltageDv = (int16_t)lroundf(device.voltage * 10.0f);
+  status.temperatureDc = (int16_t)lroundf(device.temperature * 10.0f);
+  status.wifiSignal = (int16_t)device.wifiSignal;
+  status.online = true;
+  return status;
+}
+
+// =============================================================================
+// Document Stand-In
+// =============================================================================
+
+// Keys and values as heap nodes, serialized into a growing string
+class Document {
+private:
+  struct Node {
+    std::string key;
+    std::string value;     // Already JSON-encoded; "{" / "[" open, "}" / "]" close
+  };
+  std::vector<Node> nodes;
+
+  static std::string number(double value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%.15g", value);
+    return text;
+  }
+
+public:
+  void open(const char* key, char bracket) { nodes.push_back({key ? key : "", std::string(1, bracket)}); }
+  void close(char bracket) { nodes.push_back({"", std::string(1, bracket)}); }
+  void add(const char* key, const char* value) { nodes.push_back({key, std::string("\"") + value + "\""}); }
+  void add(const char* key, double value) { nodes.push_back({key, number(value)}); }
+  void add(const char* key, bool value) { nodes.push_back({key, value ? "true" : "false"}); }
+
+  std::string serialize() const {
+    std::string out;
+    bool first = true;
+    for (const Node& node : nodes) {
+      char c = node.value[0];
+      if (c == '}' || c == ']') {
+        out += c;
+        first = false;
+        continue;
+      }
+      if (!first) out += ',';
+      if (!node.key.empty()) out += "\"" + node.key + "\":";
+      out += node.value;
+      first = c == '{' || c == '[';
+    }
+    return out;
+  }
+};
+
+static void gateStatus(Document& doc, const StatusSnapshot& status, int gate) {
+  doc.add("state", stateNames[status.state[gate]]);
+  doc.add("percentage", (double)status.percentage[gate]);
+  doc.add("online", status.online);
+  doc.add("obstacle", status.obstacle[gate]);
+}
+
+// As handleStatus() builds it
+static std::string renderStatus(const StatusSnapshot& status) {
+  Document doc;
+  doc.open(nullptr, '{');
+  gateStatus(doc, status, 0);
+  doc.open("sensors", '{');
+  doc.add("current", status.currentCa[0] / 100.0);
+  doc.add("voltage", status.voltageDv / 10.0);
+  doc.add("temperature", status.temperatureDc / 10.0);
+  doc.add("wifiSignal", (double)status.wifiSignal);
+  doc.close('}');
+  doc.open("gates", '[');
+  for (int i = 0; i < BENCH_GATES; i++) {
+    char deviceId[24];
+    snprintf(deviceId, sizeof(deviceId), "gatemate-00%d", i);
+    doc.open(nullptr, '{');
+    doc.add("deviceId", deviceId);
+    gateStatus(doc, status, i);
+    doc.add("current", status.currentCa[i] / 100.0);
+    doc.close('}');
+  }
+  doc.close(']');
+  doc.close('}');
+  return doc.serialize();
+}
+
+// =============================================================================
+// Handlers
+// =============================================================================
+
+struct Request {
+  bool render = false;                // GET /render: no cache
+  char ifNoneMatch[96] = "";
+};
+
+struct Response {
+  int code = 200;
+  char etag[HTTP_ETAG_MAX] = "";
+  std::string owned;                  // Rendered body
+  const char* body = nullptr;
+  size_t length = 0;
+};
+
+class StatusServer {
+private:
+  StateVersion<StatusSnapshot> version;
+  CachedBody<1024> body;
+  uint32_t bootId;
+
+public:
+  Device device;
+  unsigned long renders = 0;
+
+  explicit StatusServer(uint32_t bootId) : bootId(bootId) {}
+
+  // As handleStatus(), or the handler before it for /render
+  void handle(const Request& request, Response& response) {
+    version.update(snapshot(device));
+    response.code = 200;
+    response.etag[0] = '\0';
+
+    if (request.render) {
+      renders++;
+      response.owned = renderStatus(version.snapshot());
+      response.body = response.owned.data();
+      response.length = response.owned.size();
+      return;
+    }
+
+    if (!body.current(version.get())) {
+      renders++;
+      std::string rendered = renderStatus(version.snapshot());
+      memcpy(body.buffer(), rendered.data(), std::min(rendered.size(), body.capacity()));
+      body.commit(rendered.size(), bootId, version.get());
+    }
+    strcpy(response.etag, body.etag());
+    if (etagMatches(request.ifNoneMatch, body.etag())) {
+      response.code = 304;
+      response.body = nullptr;
+      response.length = 0;
+      return;
+    }
+    response.body = body.body();
+    response.length = body.size();
+  }
+};
+
+// =============================================================================
+// Loopback HTTP
+// =============================================================================
+
+static bool sendAll(int fd, const char* data, size_t length) {
+  while (length) {
+    ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+// Reads one message: headers, then Content-Length bytes of body
+static bool readMessage(int fd, std::string& buffer, std::string& head, std::string& body) {
+  size_t end;
+  while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    char chunk[4096];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) return false;
+    buffer.append(chunk, n);
+  }
+  head.assign(buffer, 0, end + 2);
+  size_t length = 0;
+  size_t field = head.find("Content-Length: ");
+  if (field != std::string::npos) length = strtoul(head.c_str() + field + 16, nullptr, 10);
+  while (buffer.size() < end + 4 + length) {
+    char chunk[4096];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) return false;
+    buffer.append(chunk, n);
+  }
+  body.assign(buffer, end + 4, length);
+  buffer.erase(0, end + 4 + length);
+  return true;
+}
+
+static std::string headerValue(const std::string& head, const char* name) {
+  size_t field = head.find(std::string("\r\n") + name + ": ");
+  if (field == std::string::npos) return "";
+  size_t start = field + strlen(name) + 4;
+  return head.substr(start, head.find("\r\n", start) - start);
+}
+
+// Keep-alive server for one connection at a time
+static void serve(int listener, StatusServer& server, std::atomic<bool>& stop) {
+  std::string buffer, head, ignored;
+  Request request;
+  Response response;
+  char header[256];
+
+  while (!stop) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) continue;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    buffer.clear();
+
+    while (readMessage(fd, buffer, head, ignored)) {
+      request.render = head.compare(0, 12, "GET /render ") == 0;
+      std::string tag = headerValue(head, "If-None-Match");
+      snprintf(request.ifNoneMatch, sizeof(request.ifNoneMatch), "%s", tag.c_str());
+
+      server.handle(request, response);
+      int used;
+      if (response.code == 304) {
+        used = snprintf(header, sizeof(header),
+                        "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nCache-Control: no-cache\r\n\r\n",
+                        response.etag);
+      } else if (response.etag[0]) {
+        used = snprintf(header, sizeof(header),
+                        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n"
+                        "ETag: %s\r\nCache-Control: no-cache\r\n\r\n",
+                        response.length, response.etag);
+      } else {
+        used = snprintf(header, sizeof(header),
+                        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n",
+                        response.length);
+      }
+      if (!sendAll(fd, header, used) || !sendAll(fd, response.body, response.length)) break;
+    }
+    close(fd);
+  }
+}
+
+class Client {
+private:
+  int fd = -1;
+  std::string buffer;
+
+public:
+  std::string head, body;
+
+  bool connect(uint16_t port) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+  }
+  ~Client() {
+    if (fd >= 0) close(fd);
+  }
+
+  // Status code of the response, 0 on a broken connection
+  int get(const char* path, const std::string& ifNoneMatch) {
+    char request[256];
+    int used = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: gate\r\n%s%s%s\r\n", path,
+                        ifNoneMatch.empty() ? "" : "If-None-Match: ", ifNoneMatch.c_str(),
+                        ifNoneMatch.empty() ? "" : "\r\n");
+    if (!sendAll(fd, request, used) || !readMessage(fd, buffer, head, body)) return 0;
+    return atoi(head.c_str() + 9);
+  }
+};
+
+// =============================================================================
+// Checks
+// =============================================================================
+
+static void checkEtags() {
+  char tag[HTTP_ETAG_MAX];
+  formatEtag(tag, sizeof(tag), 0x1a2b3c4d, 0x2a, false);
+  expect(strcmp(tag, "\"1a2b3c4d-2a\"") == 0, "strong ETag format");
+  formatEtag(tag, sizeof(tag), 0x1a2b3c4d, 0xc0a80117000000ffULL, true);
+  expect(strcmp(tag, "W/\"1a2b3c4d-c0a80117000000ff\"") == 0, "weak ETag with 64-bit version");
+  formatEtag(tag, 8, 1, 1, false);
+  expect(strlen(tag) == 7, "ETag truncated to the buffer");
+
+  const char* etag = "\"1a2b3c4d-2a\"";
+  expect(etagMatches("\"1a2b3c4d-2a\"", etag), "exact match");
+  expect(etagMatches("W/\"1a2b3c4d-2a\"", etag), "weak comparison of a weak tag");
+  expect(etagMatches("\"1a2b3c4d-2a\"", "W/\"1a2b3c4d-2a\""), "weak comparison against a weak ETag");
+  expect(etagMatches("\"x\", \"1a2b3c4d-2a\"", etag), "match in a list");
+  expect(etagMatches("\"x\",W/\"1a2b3c4d-2a\"", etag), "weak match in a list without spaces");
+  expect(etagMatches("*", etag), "wildcard");
+  expect(!etagMatches("\"1a2b3c4d-2b\"", etag), "other version");
+  expect(!etagMatches("\"0a2b3c4d-2a\"", etag), "other boot");
+  expect(!etagMatches("\"1a2b3c4d-2a", etag), "unterminated tag");
+  expect(!etagMatches("", etag), "empty header");
+  expect(!etagMatches(nullptr, etag), "no header");
+
+  StateVersion<StatusSnapshot> version;
+  Device device;
+  expect(version.update(snapshot(device)) && version.get() == 1, "first snapshot counts");
+  expect(!version.update(snapshot(device)) && version.get() == 1, "same snapshot does not bump");
+  device.current[0] += 0.001f;
+  expect(!version.update(snapshot(device)), "change below the resolution does not bump");
+  device.percentage[0] = 5;
+  expect(version.update(snapshot(device)) && version.get() == 2, "change bumps");
+
+  CachedBody<16> small;
+  expect(!small.commit(16, 1, 1) && !small.current(1), "body that does not fit is not cached");
+  memcpy(small.buffer(), "{\"a\":1}", 7);
+  expect(small.commit(7, 1, 3) && small.current(3) && !small.current(4), "cached body tracks version");
+}
+
+static void checkLoopback(uint16_t port, StatusServer& server) {
+  Client client;
+  expect(client.connect(port), "connect");
+
+  expect(client.get("/render", "") == 200, "render 200");
+  std::string rendered = client.body;
+  expect(headerValue(client.head, "ETag").empty(), "render path has no ETag");
+
+  expect(client.get("/status", "") == 200, "cached 200");
+  std::string etag = headerValue(client.head, "ETag");
+  expect(client.body == rendered, "cached body equals rendered body");
+  expect(!etag.empty(), "cached response has an ETag");
+
+  expect(client.get("/status", etag) == 304, "If-None-Match gives 304");
+  expect(client.body.empty(), "304 has no body");
+  expect(headerValue(client.head, "ETag") == etag, "304 repeats the ETag");
+
+  server.device.step(37);
+  expect(client.get("/status", etag) == 200, "changed state gives 200");
+  expect(headerValue(client.head, "ETag") != etag, "changed state gives a new ETag");
+  expect(client.body != rendered && client.body.find("\"percentage\":37") != std::string::npos,
+         "changed state is in the body");
+
+  // A reboot restarts the version count; the boot id keeps old tags stale
+  StatusServer rebooted(0x0badcafe);
+  Request request;
+  Response response;
+  snprintf(request.ifNoneMatch, sizeof(request.ifNoneMatch), "%s", etag.c_str());
+  rebooted.handle(request, response);
+  expect(response.code == 200, "tag from another boot does not validate");
+}
+
+// =============================================================================
+// Benchmark
+// =============================================================================
+
+struct Scenario {
+  const char* name;
+  const char* path;
+  bool conditional;
+  int changeEvery;                    // 0: state never changes
+};
+
+static const Scenario scenarios[] = {
+  {"render", "/render", false, 0},
+  {"cached", "/status", false, 0},
+  {"304", "/status", true, 0},
+  {"polling", "/status", true, 10},
+};
+
+static void runScenario(const Scenario& s, uint16_t port, StatusServer& server, int requests) {
+  Request request;
+  Response response;
+  request.render = strcmp(s.path, "/render") == 0;
+
+  // Handler only, as the device runs it
+  const int rounds = 200000;
+  unsigned long rendersBefore = server.renders;
+  unsigned long allocsBefore = allocations;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    if (s.changeEvery && i % s.changeEvery == 0) server.device.step(i / s.changeEvery);
+    server.handle(request, response);
+    if (s.conditional) strcpy(request.ifNoneMatch, response.etag);
+  }
+  double handlerNs =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+  double allocsPer = (double)(allocations - allocsBefore) / rounds;
+  double rendersPer = (double)(server.renders - rendersBefore) / rounds;
+
+  // Over loopback, keep-alive
+  Client client;
+  client.connect(port);
+  std::string etag;
+  int notModified = 0;
+  t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < requests; i++) {
+    if (s.changeEvery && i % s.changeEvery == 0) server.device.step(i / s.changeEvery);
+    int code = client.get(s.path, s.conditional ? etag : std::string());
+    if (code == 304) notModified++;
+    else if (s.conditional) etag = headerValue(client.head, "ETag");
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  printf("%-8s %10.0f req/s %9.0f ns/handler %6.2f allocs %6.3f renders %5.1f%% 304\n", s.name,
+         requests / seconds, handlerNs, allocsPer, rendersPer, 100.0 * notModified / requests);
+}
+
+int main(int argc, char** argv) {
+  int requests = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+      requests = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--requests N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  checkEtags();
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrLength = sizeof(addr);
+  if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0 ||
+      getsockname(listener, (sockaddr*)&addr, &addrLength) != 0) {
+    perror("listen");
+    return 1;
+  }
+  uint16_t port = ntohs(addr.sin_port);
+
+  StatusServer server(0x1a2b3c4d);
+  std::atomic<bool> stop{false};
+  std::thread thread(serve, listener, std::ref(server), std::ref(stop));
+
+  checkLoopback(port, server);
+  for (const Scenario& s : scenarios) runScenario(s, port, server, requests);
+
+  // Wake accept() with a last connection
+  stop = true;
+  {
+    Client last;
+    last.connect(port);
+  }
+  thread.join();
+  close(listener);
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,798 @@
+// =============================================================================
+// GATEMATE Host Tool - LAN Command Benchmark
+// =============================================================================
+//
+// Compares the LAN fast path (src/lan_command.h) with the MQTT command path
+// on the host, and checks the UDP protocol:
+//   - a command is answered in one datagram each way, through the same
+//     pipeline (CommandDelivery) as an MQTT command
+//   - a retransmission after a lost reply is answered with the first
+//     outcome and the duplicate flag, and the gate actuates once
+//   - a captured datagram sent again later is refused as a replay, also
+//     after its id has left the CommandLog
+//   - a datagram with a wrong tag, key or layout gets no reply, nor does
+//     anything before the device has a key
+//   - a key id that is not on the allow list gets no reply, also with the
+//     right user key, so a removed user or rotated phone key is locked out;
+//     one user's key does not sign for another key id
+//   - a sentAt outside LAN_MAX_SKEW_S is refused as stale; an unknown
+//     gate is refused and does not use up the counter
+//   - a reply signed with another key or altered is rejected by the client
+//   - a client evicted from the replay windows cannot run its commands
+//     again while they are in the CommandLog
+//
+// The device model takes one loop() pass per millisecond, like
+// command_qos_check: up to MQTT_PACKETS_PER_PASS MQTT packets, then up to
+// LAN_PACKETS_PER_PASS datagrams. The MQTT path is backend -> broker ->
+// device -> broker -> backend over the built-in broker (tools/mqtt_broker.h),
+// timed from the command publish to its ack. The LAN path is timed from the
+// datagram sent to the reply verified. Commands start at a random point of
+// a pass. On loopback both paths are dominated by the wait for the next
+// pass and the broker hops add little; --wan-ms adds a one-way delay for
+// each of the four cloud hops of the MQTT path (phone to backend, broker to
+// device and back, backend to phone) to the figures it prints.
+//
+// OpenSSL stands in for mbedTLS, as in guest_bench. Can also send one
+// command to a device with a user's LAN key (GET /devices/:id/lan).
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/lan_bench.cpp -o lan_bench -pthread -lcrypto
+//
+// Usage:
+//   ./lan_bench [--commands 500] [--loss 0.2] [--wan-ms 40] [--seed 1]
+//   ./lan_bench --send open --device 192.168.1.50 --key-id <n> --key <hex>
+//               [--gate 0] [--percentage 50]
+//
+
+#define OPENSSL_API_COMPAT 0x10100000L
+#include <openssl/hmac.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "lan_command.h"
+#include "mqtt_broker.h"
+
+#define PASS_US             1000    // One device loop() pass
+#define GATES               2
+#define RETRANSMIT_MS       20      // Client wait for a reply before resending
+#define RETRIES_MAX         50      // Sends of one command under --loss
+#define SILENCE_MS          50      // How long "no reply" is waited for
+#define ACK_TIMEOUT_MS      2000
+#define SLACK_MS            50      // Scheduling noise on top of the passes
+
+static uint64_t nowUs() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Key processed once; each compute() reuses the pads
+class KeyedHmac {
+private:
+  HMAC_CTX* ctx;
+
+public:
+  KeyedHmac() : ctx(HMAC_CTX_new()) {}
+  explicit KeyedHmac(const uint8_t* key) : KeyedHmac() { setKey(key, 32); }
+  ~KeyedHmac() { HMAC_CTX_free(ctx); }
+  KeyedHmac(const KeyedHmac&) = delete;
+  KeyedHmac& operator=(const KeyedHmac&) = delete;
+
+  bool setKey(const uint8_t* key, size_t length) {
+    return HMAC_Init_ex(ctx, key, (int)length, EVP_sha256(), nullptr) == 1;
+  }
+
+  void compute(const uint8_t* data, size_t length, uint8_t out[32]) {
+    unsigned int outLength = 32;
+    HMAC_Init_ex(ctx, nullptr, 0, nullptr, nullptr);
+    HMAC_Update(ctx, data, length);
+    HMAC_Final(ctx, out, &outLength);
+  }
+};
+
+static bool parseHexKey(const char* hex, uint8_t key[32]) {
+  if (strlen(hex) != 64) return false;
+  for (int i = 0; i < 32; i++) {
+    unsigned int byte;
+    if (sscanf(hex + 2 * i, "%2x", &byte) != 1) return false;
+    key[i] = (uint8_t)byte;
+  }
+  return true;
+}
+
+// =============================================================================
+// Protocol Checks
+// =============================================================================
+
+// The phone's key for keyId, as the backend derives it
+static void userKey(const uint8_t lanKey[32], uint32_t keyId, uint8_t out[32]) {
+  KeyedHmac lanMac(lanKey);
+  deriveLanUserKey(lanMac, keyId, out);
+}
+
+// decide() and the firmware's runCommand() without sockets
+static void checkProtocol() {
+  const uint32_t id = 0x0a, otherId = 0x0b, removedId = 0x0c;
+  uint8_t lanKey[32], key[32], otherKey[32], removedKey[32], forgedKey[32];
+  for (int i = 0; i < 32; i++) {
+    lanKey[i] = (uint8_t)(i * 7 + 1);
+    forgedKey[i] = (uint8_t)(i * 7 + 2);
+  }
+  userKey(lanKey, id, key);
+  userKey(lanKey, otherId, otherKey);
+  userKey(lanKey, removedId, removedKey);
+  KeyedHmac lanMac(lanKey);
+  KeyedHmac mac(key);
+  KeyedHmac other(otherKey);
+  KeyedHmac removed(removedKey);
+  KeyedHmac forger(forgedKey);
+
+  static CommandLog log;
+  commandLogReset(log);
+  CommandDelivery delivery;
+  delivery.begin(log);
+  LanCommandServer<KeyedHmac> server;
+  server.begin(delivery);
+
+  const uint32_t now = 1780000000;
+  uint32_t ms = 0;
+  uint8_t in[LAN_DATAGRAM_LEN], out[LAN_DATAGRAM_LEN];
+  LanRequest request;
+  LanReply reply;
+
+  // The pipeline; true if the command ran
+  auto run = [&](LanRequest& r) {
+    CommandVerdict verdict = delivery.accept(r.gate, r.commandId, r.sentAt, now);
+    r.status = verdict.status;
+    r.duplicate = verdict.duplicate;
+    delivery.record(r.gate, r.commandId, verdict, r.status);
+    return verdict.run;
+  };
+  auto decide = [&](const uint8_t* datagram, size_t length, uint32_t epoch) {
+    return server.decide(datagram, length, epoch, ms++, GATES, request);
+  };
+
+  encodeLanCommand(mac, id, 0, GATE_CMD_OPEN, 100, 7, 1, now, in);
+  expect(decide(in, sizeof(in), now) == LAN_DROP, "datagram before the key is dropped");
+  server.setMac(&lanMac);
+  expect(decide(in, sizeof(in), now) == LAN_DROP && !server.ready(),
+         "datagram before the key ids is dropped");
+  const uint32_t allowed[] = {otherId, id, removedId};
+  server.allow(allowed, 3);
+  expect(decide(in, sizeof(in), now) == LAN_RUN && request.gate == 0 &&
+         request.command == GATE_CMD_OPEN && request.percentage == 100 && request.keyId == id &&
+         strcmp(request.commandId, "lan-0000000a-00000007-00000001") == 0, "command decoded");
+  expect(run(request), "first datagram runs");
+  server.reply(request, GATE_OPENING, 0, now, out);
+  expect(parseLanReply(mac, out, sizeof(out), reply) && reply.status == CMD_ACK_EXECUTED &&
+         !reply.duplicate && reply.keyId == id && reply.client == 7 && reply.counter == 1 &&
+         reply.state == GATE_OPENING && reply.deviceTime == now, "reply round trip");
+  expect(!parseLanReply(forger, out, sizeof(out), reply), "reply with another key rejected");
+  expect(!parseLanReply(other, out, sizeof(out), reply), "reply with another user's key rejected");
+  expect(decide(out, sizeof(out), now) == LAN_DROP, "reply reflected to the device dropped");
+  out[6] ^= 0x01;
+  expect(!parseLanReply(mac, out, sizeof(out), reply), "altered reply rejected");
+
+  expect(decide(in, sizeof(in), now) == LAN_ANSWER && request.duplicate &&
+         request.status == CMD_ACK_EXECUTED, "retransmission answered from the log");
+
+  uint8_t bad[LAN_DATAGRAM_LEN];
+  memcpy(bad, in, sizeof(bad));
+  bad[4] = GATE_CMD_CLOSE;
+  expect(decide(bad, sizeof(bad), now) == LAN_DROP, "altered command dropped");
+  expect(decide(in, sizeof(in) - 1, now) == LAN_DROP, "short datagram dropped");
+  encodeLanCommand(forger, id, 0, GATE_CMD_OPEN, 100, 7, 2, now, bad);
+  expect(decide(bad, sizeof(bad), now) == LAN_DROP, "command with another key dropped");
+  encodeLanCommand(other, id, 0, GATE_CMD_OPEN, 100, 7, 2, now, bad);
+  expect(decide(bad, sizeof(bad), now) == LAN_DROP, "another user's key for this key id dropped");
+  encodeLanCommand(forger, 0x0d, 0, GATE_CMD_OPEN, 100, 7, 2, now, bad);
+  expect(decide(bad, sizeof(bad), now) == LAN_DROP, "unlisted key id dropped");
+
+  // Same client and counter under another key id: a window of its own
+  encodeLanCommand(other, otherId, 0, GATE_CMD_OPEN, 100, 7, 1, now, bad);
+  expect(decide(bad, sizeof(bad), now) == LAN_RUN && run(request) &&
+         strcmp(request.commandId, "lan-0000000b-00000007-00000001") == 0,
+         "another user's counters are their own");
+
+  // The backend drops removedId from the list: its key is locked out
+  encodeLanCommand(removed, removedId, 1, GATE_CMD_OPEN, 100, 9, 1, now, bad);
+  expect(decide(bad, sizeof(bad), now) == LAN_RUN && run(request), "listed key id runs");
+  uint32_t unknownBefore = server.stats().unknownKeys;
+  server.allow(allowed, 2);
+  encodeLanCommand(removed, removedId, 1, GATE_CMD_OPEN, 100, 9, 2, now, bad);
+  expect(decide(bad, sizeof(bad), now) == LAN_DROP &&
+         server.stats().unknownKeys == unknownBefore + 1, "removed key id dropped");
+
+  encodeLanCommand(mac, id, 0, GATE_CMD_OPEN, 100, 7, 2, now - LAN_MAX_SKEW_S - 1, in);
+  expect(decide(in, sizeof(in), now) == LAN_ANSWER && request.status == LAN_STATUS_STALE,
+         "old sentAt refused as stale");
+  encodeLanCommand(mac, id, 0, GATE_CMD_OPEN, 100, 7, 2, now + LAN_MAX_SKEW_S + 1, in);
+  expect(decide(in, sizeof(in), now) == LAN_ANSWER && request.status == LAN_STATUS_STALE,
+         "future sentAt refused as stale");
+  expect(decide(in, sizeof(in), 0) == LAN_RUN, "without a clock only the window protects");
+
+  encodeLanCommand(mac, id, 5, GATE_CMD_OPEN, 100, 7, 3, now, in);
+  expect(decide(in, sizeof(in), now) == LAN_ANSWER &&
+         request.status == LAN_STATUS_UNKNOWN_GATE, "unknown gate refused");
+  encodeLanCommand(mac, id, 1, GATE_CMD_PARTIAL, 150, 7, 3, now, in);
+  expect(decide(in, sizeof(in), now) == LAN_RUN && request.percentage == 100,
+         "refused counter stays usable, percentage clamped");
+  run(request);
+
+  // Counter 1 falls out of the log, but not out of the window
+  uint8_t first[LAN_DATAGRAM_LEN];
+  encodeLanCommand(mac, id, 0, GATE_CMD_OPEN, 100, 7, 1, now, first);
+  for (uint32_t counter = 10; counter < 10 + COMMAND_LOG_SIZE; counter++) {
+    encodeLanCommand(mac, id, 0, GATE_CMD_STOP, 0, 7, counter, now, in);
+    if (decide(in, sizeof(in), now) == LAN_RUN) run(request);
+  }
+  expect(decide(first, sizeof(first), now) == LAN_ANSWER &&
+         request.status == LAN_STATUS_REPLAY && !request.duplicate,
+         "replay after the log evicted it refused");
+
+  encodeLanCommand(mac, id, 0, GATE_CMD_CLOSE, 0, 7, 200, now, in);
+  expect(decide(in, sizeof(in), now) == LAN_RUN && run(request), "counter jump runs");
+  uint8_t latest[LAN_DATAGRAM_LEN];
+  memcpy(latest, in, sizeof(latest));
+  encodeLanCommand(mac, id, 0, GATE_CMD_STOP, 0, 7, 200 - LAN_WINDOW, now, in);
+  expect(decide(in, sizeof(in), now) == LAN_ANSWER && request.status == LAN_STATUS_REPLAY,
+         "counter behind the window refused");
+  encodeLanCommand(mac, id, 0, GATE_CMD_STOP, 0, 7, 199, now, in);
+  expect(decide(in, sizeof(in), now) == LAN_RUN, "late counter inside the window runs");
+  run(request);
+
+  // LAN_CLIENTS other clients push client 7 out of the windows
+  for (uint32_t client = 100; client < 100 + LAN_CLIENTS; client++) {
+    encodeLanCommand(mac, id, 1, GATE_CMD_STOP, 0, client, 1, now, in);
+    if (decide(in, sizeof(in), now) == LAN_RUN) run(request);
+  }
+  expect(decide(latest, sizeof(latest), now) == LAN_RUN && !run(request) && request.duplicate,
+         "evicted client's command found in the log, not run again");
+
+  const LanStats& stats = server.stats();
+  printf("Protocol: %u datagrams, %u dropped, %u unknown key(s), %u run, %u duplicate(s), "
+         "%u replay(s), %u stale\n", stats.received, stats.dropped, stats.unknownKeys, stats.run,
+         stats.duplicates, stats.replays, stats.stale);
+}
+
+// =============================================================================
+// Device
+// =============================================================================
+
+// main.cpp's MQTT and LAN command paths, one pass per PASS_US
+class DeviceModel {
+private:
+  int mqttFd = -1;
+  std::string buffer;
+  int udpFd = -1;
+  CommandLog rtcLog;
+  CommandDelivery delivery;
+  KeyedHmac mac;
+  LanCommandServer<KeyedHmac> lan;
+  GateState states[GATES] = {GATE_CLOSED, GATE_CLOSED};
+  std::string gateIds[GATES];
+  std::string commandTopics[GATES];
+
+  uint8_t runCommand(uint8_t gate, GateCommand command, const char* id, uint32_t sentAt,
+                     bool& duplicate) {
+    CommandVerdict verdict = delivery.accept(gate, id, sentAt, (uint32_t)time(nullptr));
+    uint8_t status = verdict.status;
+    if (verdict.run) {
+      status = command == GATE_CMD_NONE ? CMD_ACK_REJECTED : CMD_ACK_EXECUTED;
+      if (status == CMD_ACK_EXECUTED) {
+        actuations[id]++;
+        states[gate] = command == GATE_CMD_CLOSE ? GATE_CLOSING :
+                       command == GATE_CMD_STOP ? GATE_STOPPED : GATE_OPENING;
+      }
+    }
+    delivery.record(gate, id, verdict, status);
+    duplicate = verdict.duplicate;
+    return status;
+  }
+
+  void flushAcks() {
+    delivery.flush((uint32_t)nowMs(), [this](const CommandAck& ack, uint32_t latencyMs) {
+      char payload[320];
+      formatCommandAck(payload, sizeof(payload), gateIds[ack.gate].c_str(), ack,
+                       states[ack.gate], 0, latencyMs);
+      std::string out;
+      mqtt::publish(out, MQTT_TOPIC_PREFIX + gateIds[ack.gate] + MQTT_TOPIC_ACKS, payload);
+      return sendAll(mqttFd, out);
+    });
+  }
+
+  void serviceMqtt() {
+    char chunk[4096];
+    ssize_t n;
+    while ((n = recv(mqttFd, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) {
+      buffer.append(chunk, (size_t)n);
+    }
+    for (uint8_t i = 0; i < MQTT_PACKETS_PER_PASS; i++) {
+      mqtt::Packet packet;
+      if (mqtt::parse(buffer, packet) <= 0) break;
+      if (packet.type == mqtt::SUBACK) subscribed = true;
+      if (packet.type != mqtt::PUBLISH) continue;
+      uint8_t gate = packet.topic == commandTopics[0] ? 0 : 1;
+      std::string id = mqtt::jsonString(packet.payload, "commandId");
+      GateCommand command = parseGateCommand(mqtt::jsonString(packet.payload, "command").c_str());
+      uint32_t sentAt = (uint32_t)mqtt::jsonNumber(packet.payload, "sentAt", 0);
+      bool duplicate = false;
+      uint8_t status = runCommand(gate, command, id.c_str(), sentAt, duplicate);
+      delivery.queueAck(gate, id.c_str(), duplicate, status, (uint32_t)nowMs());
+      flushAcks();
+      std::string out;
+      mqtt::puback(out, packet.packetId);
+      sendAll(mqttFd, out);
+    }
+  }
+
+  void serviceLan() {
+    for (uint8_t i = 0; i < LAN_PACKETS_PER_PASS; i++) {
+      uint8_t in[64];
+      sockaddr_in from = {};
+      socklen_t fromLength = sizeof(from);
+      ssize_t length = recvfrom(udpFd, in, sizeof(in), MSG_DONTWAIT, (sockaddr*)&from,
+                                &fromLength);
+      if (length <= 0) return;
+      datagrams++;
+
+      uint32_t now = (uint32_t)time(nullptr);
+      LanRequest request;
+      LanDecision decision = lan.decide(in, (size_t)length, now, (uint32_t)nowMs(), GATES,
+                                        request);
+      if (decision == LAN_DROP) continue;
+      if (decision == LAN_RUN) {
+        request.status = runCommand(request.gate, (GateCommand)request.command,
+                                    request.commandId, request.sentAt, request.duplicate);
+      }
+      uint8_t gate = request.gate < GATES ? request.gate : 0;
+      uint8_t out[LAN_DATAGRAM_LEN];
+      lan.reply(request, states[gate], 0, now, out);
+      sendto(udpFd, out, sizeof(out), 0, (sockaddr*)&from, fromLength);
+      replies++;
+    }
+  }
+
+public:
+  std::map<std::string, uint32_t> actuations;
+  std::atomic<uint32_t> datagrams{0};
+  std::atomic<uint32_t> replies{0};
+  std::atomic<bool> subscribed{false};
+  std::atomic<bool> running{true};
+  uint16_t udpPort = 0;
+
+  DeviceModel(const uint8_t* lanKey, uint32_t keyId) : mac(lanKey) {
+    commandLogReset(rtcLog);
+    delivery.begin(rtcLog);
+    lan.begin(delivery);
+    lan.setMac(&mac);
+    lan.allow(&keyId, 1);
+    for (uint8_t i = 0; i < GATES; i++) {
+      gateIds[i] = std::string("lan-bench-") + (char)('a' + i);
+      commandTopics[i] = MQTT_TOPIC_PREFIX + gateIds[i] + MQTT_TOPIC_COMMANDS;
+    }
+  }
+
+  const std::string& gateId(uint8_t gate) const { return gateIds[gate]; }
+
+  bool begin(uint16_t brokerPort) {
+    udpFd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(udpFd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        getsockname(udpFd, (sockaddr*)&addr, &length) != 0) {
+      return false;
+    }
+    udpPort = ntohs(addr.sin_port);
+
+    mqttFd = mqttConnect("127.0.0.1", brokerPort, "gatemate-lan-bench", true, buffer);
+    if (mqttFd < 0) return false;
+    std::string out;
+    for (uint8_t i = 0; i < GATES; i++) mqtt::subscribe(out, i + 1, commandTopics[i], 1);
+    return sendAll(mqttFd, out);
+  }
+
+  void run() {
+    while (running) {
+      serviceMqtt();
+      serviceLan();
+      std::this_thread::sleep_for(std::chrono::microseconds(PASS_US));
+    }
+    close(mqttFd);
+    close(udpFd);
+  }
+};
+
+// =============================================================================
+// Clients
+// =============================================================================
+
+// The phone on the LAN
+class LanClient {
+private:
+  int fd;
+  sockaddr_in device = {};
+  KeyedHmac& mac;
+  uint32_t keyId;
+  uint32_t client;
+  uint32_t counter = 0;
+  std::mt19937& rng;
+
+  bool lost(double rate) { return std::uniform_real_distribution<double>(0, 1)(rng) < rate; }
+
+public:
+  uint32_t lostReplies = 0;
+
+  LanClient(const char* host, uint16_t port, KeyedHmac& mac, uint32_t keyId, std::mt19937& rng)
+      : fd(socket(AF_INET, SOCK_DGRAM, 0)), mac(mac), keyId(keyId), client((uint32_t)rng()),
+        rng(rng) {
+    device.sin_family = AF_INET;
+    device.sin_port = htons(port);
+    inet_pton(AF_INET, host, &device.sin_addr);
+  }
+  ~LanClient() { close(fd); }
+
+  void send(const uint8_t* datagram) {
+    sendto(fd, datagram, LAN_DATAGRAM_LEN, 0, (sockaddr*)&device, sizeof(device));
+  }
+
+  // A verified reply to client/counter within waitMs
+  bool receive(uint32_t counterOf, uint32_t waitMs, LanReply& reply) {
+    uint64_t deadline = nowUs() + waitMs * 1000ull;
+    for (;;) {
+      int64_t left = (int64_t)(deadline - nowUs());
+      if (left <= 0) return false;
+      pollfd p = {fd, POLLIN, 0};
+      if (poll(&p, 1, (int)((left + 999) / 1000)) <= 0) continue;
+      uint8_t in[64];
+      ssize_t n = recv(fd, in, sizeof(in), 0);
+      if (n > 0 && parseLanReply(mac, in, (size_t)n, reply) && reply.keyId == keyId &&
+          reply.client == client && reply.counter == counterOf) {
+        return true;
+      }
+    }
+  }
+
+  // Next counter; every send of a retry is the same datagram
+  void encode(uint8_t gate, GateCommand command, uint8_t percentage, uint32_t sentAt,
+              uint8_t out[LAN_DATAGRAM_LEN]) {
+    encodeLanCommand(mac, keyId, gate, command, percentage, client, ++counter, sentAt, out);
+  }
+
+  // Sends until a reply arrives; loss drops requests and replies alike
+  bool command(uint8_t gate, GateCommand command, double loss, LanReply& reply,
+               uint32_t& sends, std::string& commandId) {
+    uint8_t datagram[LAN_DATAGRAM_LEN];
+    encode(gate, command, 0, (uint32_t)time(nullptr), datagram);
+    char id[32];
+    snprintf(id, sizeof(id), "lan-%08lx-%08lx-%08lx", (unsigned long)keyId,
+             (unsigned long)client, (unsigned long)counter);
+    commandId = id;
+    for (sends = 1; sends <= RETRIES_MAX; sends++) {
+      if (!lost(loss)) send(datagram);
+      if (receive(counter, RETRANSMIT_MS, reply)) {
+        if (!lost(loss)) return true;
+        lostReplies++;
+      }
+    }
+    return false;
+  }
+};
+
+// mqtt.service.ts: a command with an id, waiting for its ack
+class BackendClient {
+private:
+  int fd = -1;
+  std::string buffer;
+  uint16_t nextId = 0;
+
+public:
+  bool begin(uint16_t brokerPort) {
+    fd = mqttConnect("127.0.0.1", brokerPort, "gatemate-lan-bench-backend", true, buffer);
+    if (fd < 0) return false;
+    std::string out;
+    mqtt::subscribe(out, 1, std::string(MQTT_TOPIC_PREFIX) + "+" + MQTT_TOPIC_ACKS, 1);
+    return sendAll(fd, out);
+  }
+  ~BackendClient() {
+    if (fd >= 0) close(fd);
+  }
+
+  // The ack's status, empty on timeout
+  std::string command(const std::string& gateId, const char* command, const std::string& id) {
+    std::string payload = std::string("{\"command\":\"") + command + "\",\"commandId\":\"" + id +
+                          "\",\"sentAt\":" + std::to_string(time(nullptr)) + "}";
+    std::string out;
+    if (++nextId == 0) nextId = 1;
+    mqtt::publish(out, MQTT_TOPIC_PREFIX + gateId + MQTT_TOPIC_COMMANDS, payload, false, 1,
+                  nextId);
+    if (!sendAll(fd, out)) return "";
+
+    uint32_t deadline = nowMs() + ACK_TIMEOUT_MS;
+    while (nowMs() < deadline) {
+      mqtt::Packet packet;
+      while (mqtt::parse(buffer, packet) > 0) {
+        if (packet.type == mqtt::PUBLISH &&
+            mqtt::jsonString(packet.payload, "commandId") == id) {
+          return mqtt::jsonString(packet.payload, "status");
+        }
+      }
+      pollfd p = {fd, POLLIN, 0};
+      if (poll(&p, 1, 10) <= 0) continue;
+      char chunk[4096];
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) return "";
+      buffer.append(chunk, (size_t)n);
+    }
+    return "";
+  }
+};
+
+// =============================================================================
+// Benchmark
+// =============================================================================
+
+struct Latency {
+  std::vector<double> ms;
+
+  double percentile(double p) {
+    if (ms.empty()) return 0;
+    std::sort(ms.begin(), ms.end());
+    size_t index = std::min(ms.size() - 1, (size_t)(p / 100.0 * ms.size()));
+    return ms[index];
+  }
+
+  void print(const char* name, double addMs) {
+    printf("  %-12s n=%-5zu p50 %7.2f  p95 %7.2f  p99 %7.2f  max %7.2f ms\n", name, ms.size(),
+           percentile(50) + addMs, percentile(95) + addMs, percentile(99) + addMs,
+           percentile(100) + addMs);
+  }
+};
+
+static const char* commandNames[] = {"open", "close", "stop"};
+static const GateCommand commandValues[] = {GATE_CMD_OPEN, GATE_CMD_CLOSE, GATE_CMD_STOP};
+
+static void runBench(uint32_t commands, double loss, double wanMs, uint32_t seed) {
+  uint8_t lanKey[32], key[32];
+  std::mt19937 rng(seed);
+  for (uint8_t& byte : lanKey) byte = (uint8_t)rng();
+  const uint32_t keyId = (uint32_t)rng();
+  userKey(lanKey, keyId, key);
+  KeyedHmac mac(key);
+
+  Broker broker;
+  if (!broker.start()) {
+    expect(false, "broker listens");
+    return;
+  }
+  DeviceModel device(lanKey, keyId);
+  if (!device.begin(broker.port())) {
+    expect(false, "device connects");
+    broker.stop();
+    return;
+  }
+  std::thread deviceThread([&device] { device.run(); });
+  BackendClient backend;
+  bool online = backend.begin(broker.port());
+  for (uint32_t waited = 0; !device.subscribed && waited < 2000; waited++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  expect(online && device.subscribed, "device and backend on the broker");
+
+  std::vector<std::string> lanIds, mqttIds;
+  Latency lanPath, mqttPath;
+  LanClient phone("127.0.0.1", device.udpPort, mac, keyId, rng);
+
+  // One command in flight at a time, alternating the paths
+  uint32_t lanAnswered = 0, mqttAcked = 0, singleDatagram = 0;
+  uint32_t repliesBefore = device.replies;
+  for (uint32_t i = 0; i < commands; i++) {
+    uint8_t c = i % 3;
+    uint8_t gate = (i / 3) % GATES;
+
+    LanReply reply;
+    uint32_t sends = 0;
+    std::string id;
+    std::this_thread::sleep_for(std::chrono::microseconds(rng() % PASS_US));
+    uint64_t start = nowUs();
+    if (phone.command(gate, commandValues[c], 0, reply, sends, id)) {
+      lanPath.ms.push_back((nowUs() - start) / 1000.0);
+      lanIds.push_back(id);
+      if (reply.status == CMD_ACK_EXECUTED && !reply.duplicate) lanAnswered++;
+      if (sends == 1) singleDatagram++;
+    }
+
+    id = "mqtt-" + std::to_string(seed) + "-" + std::to_string(i);
+    std::this_thread::sleep_for(std::chrono::microseconds(rng() % PASS_US));
+    start = nowUs();
+    std::string status = backend.command(device.gateId(gate), commandNames[c], id);
+    if (!status.empty()) {
+      mqttPath.ms.push_back((nowUs() - start) / 1000.0);
+      mqttIds.push_back(id);
+      if (status == "executed") mqttAcked++;
+    }
+  }
+  expect(lanAnswered == commands, "every LAN command answered executed");
+  expect(singleDatagram == commands && device.replies - repliesBefore == commands,
+         "one datagram each way per LAN command");
+  expect(mqttAcked == commands, "every MQTT command acked executed");
+
+  printf("Latency, loopback (%u commands per path, %u us passes):\n", commands, PASS_US);
+  lanPath.print("LAN", 0);
+  mqttPath.print("MQTT", 0);
+  if (wanMs > 0) {
+    printf("With %.0f ms per cloud hop (4 hops on the MQTT path):\n", wanMs);
+    lanPath.print("LAN", 0);
+    mqttPath.print("MQTT", 4 * wanMs);
+  }
+  expect(lanPath.percentile(95) <= 2 * PASS_US / 1000.0 + SLACK_MS,
+         "LAN p95 within two passes plus slack");
+
+  // Lost requests and replies: retransmissions, one actuation each
+  uint32_t lossCommands = commands / 2, lossAnswered = 0, retransmitted = 0, duplicates = 0;
+  for (uint32_t i = 0; i < lossCommands; i++) {
+    LanReply reply;
+    uint32_t sends = 0;
+    std::string id;
+    if (!phone.command(i % GATES, commandValues[i % 3], loss, reply, sends, id)) continue;
+    lanIds.push_back(id);
+    lossAnswered++;
+    if (sends > 1) retransmitted++;
+    if (reply.duplicate) duplicates++;
+    if (reply.status != CMD_ACK_EXECUTED) expect(false, "lossy command answered executed");
+  }
+  printf("Loss %.0f%%: %u/%u answered, %u retransmitted, %u lost repl%s, "
+         "%u answered as duplicate\n", loss * 100, lossAnswered, lossCommands, retransmitted,
+         phone.lostReplies, phone.lostReplies == 1 ? "y" : "ies", duplicates);
+  expect(lossAnswered == lossCommands, "every lossy command answered");
+  expect(phone.lostReplies == 0 || duplicates > 0, "lost replies answered as duplicate");
+
+  // A captured datagram, sent again once the window has moved on
+  uint8_t captured[LAN_DATAGRAM_LEN];
+  phone.encode(0, GATE_CMD_OPEN, 0, (uint32_t)time(nullptr), captured);
+  uint32_t capturedCounter = readLe32(captured + 16);
+  phone.send(captured);
+  LanReply reply;
+  expect(phone.receive(capturedCounter, ACK_TIMEOUT_MS, reply) &&
+         reply.status == CMD_ACK_EXECUTED, "captured datagram ran once");
+  for (uint32_t i = 0; i < LAN_WINDOW + 1; i++) {
+    uint8_t datagram[LAN_DATAGRAM_LEN];
+    phone.encode(1, GATE_CMD_STOP, 0, (uint32_t)time(nullptr), datagram);
+    phone.send(datagram);
+    phone.receive(readLe32(datagram + 16), ACK_TIMEOUT_MS, reply);
+  }
+  phone.send(captured);
+  expect(phone.receive(capturedCounter, ACK_TIMEOUT_MS, reply) &&
+         reply.status == LAN_STATUS_REPLAY, "captured datagram replayed later refused");
+
+  uint8_t tampered[LAN_DATAGRAM_LEN];
+  phone.encode(0, GATE_CMD_OPEN, 0, (uint32_t)time(nullptr), tampered);
+  tampered[3] = 1;
+  phone.send(tampered);
+  expect(!phone.receive(readLe32(tampered + 16), SILENCE_MS, reply), "tampered datagram unanswered");
+
+  uint8_t stale[LAN_DATAGRAM_LEN];
+  phone.encode(0, GATE_CMD_OPEN, 0, (uint32_t)time(nullptr) - 120, stale);
+  phone.send(stale);
+  expect(phone.receive(readLe32(stale + 16), ACK_TIMEOUT_MS, reply) &&
+         reply.status == LAN_STATUS_STALE, "stale datagram refused");
+
+  uint8_t unknown[LAN_DATAGRAM_LEN];
+  phone.encode(GATES, GATE_CMD_OPEN, 0, (uint32_t)time(nullptr), unknown);
+  phone.send(unknown);
+  expect(phone.receive(readLe32(unknown + 16), ACK_TIMEOUT_MS, reply) &&
+         reply.status == LAN_STATUS_UNKNOWN_GATE, "unknown gate refused");
+
+  device.running = false;
+  deviceThread.join();
+  broker.stop();
+
+  uint32_t twice = 0, missing = 0;
+  for (const auto& ids : {lanIds, mqttIds}) {
+    for (const std::string& id : ids) {
+      auto it = device.actuations.find(id);
+      if (it == device.actuations.end()) missing++;
+      else if (it->second > 1) twice++;
+    }
+  }
+  printf("Actuations: %zu command(s), %u twice, %u missing\n", lanIds.size() + mqttIds.size(),
+         twice, missing);
+  expect(twice == 0, "no command actuated twice");
+  expect(missing == 0, "every answered command actuated");
+}
+
+// One command to a real device
+static int sendOne(const char* host, uint32_t keyId, const char* keyHex, const char* command,
+                   uint8_t gate, uint8_t percentage) {
+  uint8_t key[32];
+  if (!parseHexKey(keyHex, key)) {
+    printf("--key must be 64 hex digits\n");
+    return 1;
+  }
+  GateCommand value = parseGateCommand(command);
+  if (value == GATE_CMD_NONE) {
+    printf("Unknown command %s\n", command);
+    return 1;
+  }
+  KeyedHmac mac(key);
+  std::mt19937 rng((uint32_t)time(nullptr) ^ (uint32_t)getpid());
+  LanClient phone(host, LAN_UDP_PORT, mac, keyId, rng);
+  uint8_t datagram[LAN_DATAGRAM_LEN];
+  phone.encode(gate, value, percentage, (uint32_t)time(nullptr), datagram);
+  uint32_t counter = readLe32(datagram + 16);
+
+  LanReply reply;
+  for (uint32_t tries = 1; tries <= 5; tries++) {
+    uint64_t start = nowUs();
+    phone.send(datagram);
+    if (!phone.receive(counter, 200, reply)) continue;
+    printf("%s%s: gate %u %s at %u%%, %.1f ms, try %u\n", lanStatusName(reply.status),
+           reply.duplicate ? " (duplicate)" : "", reply.gate, gateStateName(reply.state),
+           reply.percentage, (nowUs() - start) / 1000.0, tries);
+    return reply.status == CMD_ACK_EXECUTED ? 0 : 1;
+  }
+  printf("No reply from %s:%u\n", host, LAN_UDP_PORT);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  uint32_t commands = 500;
+  double loss = 0.2;
+  double wanMs = 40;
+  uint32_t seed = 1;
+  const char* send = nullptr;
+  const char* host = nullptr;
+  const char* key = nullptr;
+  const char* keyId = nullptr;
+  uint8_t gate = 0;
+  uint8_t percentage = 50;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--commands") commands = (uint32_t)atoi(argv[i + 1]);
+    else if (arg == "--loss") loss = atof(argv[i + 1]);
+    else if (arg == "--wan-ms") wanMs = atof(argv[i + 1]);
+    else if (arg == "--seed") seed = (uint32_t)atoi(argv[i + 1]);
+    else if (arg == "--send") send = argv[i + 1];
+    else if (arg == "--device") host = argv[i + 1];
+    else if (arg == "--key") key = argv[i + 1];
+    else if (arg == "--key-id") keyId = argv[i + 1];
+    else if (arg == "--gate") gate = (uint8_t)atoi(argv[i + 1]);
+    else if (arg == "--percentage") percentage = (uint8_t)atoi(argv[i + 1]);
+  }
+  if (send) {
+    if (!host || !key || !keyId) {
+      printf("--send needs --device, --key-id and --key\n");
+      return 1;
+    }
+    return sendOne(host, (uint32_t)strtoul(keyId, nullptr, 10), key, send, gate, percentage);
+  }
+  if (commands < 3 || loss < 0 || loss > 0.5) {
+    printf("--commands must be at least 3, --loss 0..0.5\n");
+    return 1;
+  }
+
+  checkProtocol();
+  runBench(commands, loss, wanMs, seed);
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
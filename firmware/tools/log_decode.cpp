@@ -0,0 +1,429 @@
+// =============================================================================
+// GATEMATE Host Tool - Event Log Decoder
+// =============================================================================
+//
+// Turns binary event logs (src/event_log.h) back into text with the same
+// message table and formatter the firmware uses for Serial:
+//
+//   - the LittleFS log from GET /log/file (/log.bin, /log.1.bin), which
+//     gets a new header at every boot
+//   - MQTT batches from gatemate/devices/<id>/log, e.g. captured with
+//     mosquitto_sub -t 'gatemate/devices/+/log' -N > batches.bin
+//     (missing batches are reported from the header sequence numbers)
+//
+// Without arguments it checks itself instead: formatting against
+// snprintf, truncation, compile-time format checks, stream decoding across
+// headers and the 32-bit time wrap, ring overflow accounting, several
+// producer threads on one ring, and the cost of one LOG_EVENT next to
+// formatting the same line and sending it at 115200 baud.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -pthread -Isrc tools/log_decode.cpp -o log_decode
+//
+// Usage:
+//   ./log_decode log.bin log.1.bin
+//   ./log_decode - < batches.bin
+//   ./log_decode                         (self-check)
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "event_log.h"
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+uint32_t logNowUs() {
+  auto elapsed = std::chrono::steady_clock::now() - startTime;
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+EventLog eventLog;
+
+// =============================================================================
+// Decoding
+// =============================================================================
+
+struct DecodeStats {
+  uint32_t records = 0;
+  uint32_t headers = 0;
+  uint32_t notes = 0;       // Anything that did not decode cleanly
+};
+
+// Calls emit(line) for every record and header; lines starting with "#"
+// describe the stream rather than a record
+template <typename F>
+DecodeStats decodeLog(const uint8_t* data, size_t size, F emit) {
+  DecodeStats stats;
+  LogClock clock;
+  bool haveHeader = false;
+  bool batch = false;       // Inside a header with a record count
+  uint32_t remaining = 0;
+  uint32_t lastSequence = 0;
+  char line[192];
+
+  auto note = [&](const char* text) {
+    stats.notes++;
+    emit(text);
+  };
+
+  size_t pos = 0;
+  while (pos + sizeof(LogRecord) <= size) {
+    const uint8_t* p = data + pos;
+
+    if (p[offsetof(LogRecord, id)] == LOG_HEADER_ID) {
+      LogHeader header;
+      if (pos + sizeof(header) > size) {
+        note("# truncated header at the end");
+        pos = size;
+        break;
+      }
+      memcpy(&header, p, sizeof(header));
+      if (header.magic != LOG_MAGIC || header.version != LOG_VERSION ||
+          header.recordSize != sizeof(LogRecord)) {
+        snprintf(line, sizeof(line), "# not a log header at offset %zu, skipped", pos);
+        note(line);
+        pos += sizeof(LogRecord);
+        continue;
+      }
+      header.deviceId[sizeof(header.deviceId) - 1] = '\0';
+
+      if (batch && remaining > 0) {
+        snprintf(line, sizeof(line), "# previous batch cut short, %u records missing", remaining);
+        note(line);
+      }
+      // Sequence numbers restart at 0 after a reboot
+      if (header.records > 0 && batch && header.sequence > lastSequence + 1) {
+        snprintf(line, sizeof(line), "# %u batches missing", header.sequence - lastSequence - 1);
+        note(line);
+      }
+      if (header.tableHash != LOG_TABLE_HASH) {
+        note("# message table differs from this build, text may be wrong");
+      }
+
+      snprintf(line, sizeof(line), "# %s at %llu.%06llu s, %u dropped before",
+               header.deviceId, (unsigned long long)(header.uptimeUs / 1000000),
+               (unsigned long long)(header.uptimeUs % 1000000), header.dropped);
+      if (header.records > 0) {
+        size_t n = strlen(line);
+        snprintf(line + n, sizeof(line) - n, ", batch %u of %u records", header.sequence,
+                 header.records);
+      }
+      emit(line);
+
+      stats.headers++;
+      clock.sync(header.uptimeUs);
+      haveHeader = true;
+      batch = header.records > 0;
+      remaining = header.records;
+      lastSequence = header.sequence;
+      pos += sizeof(header);
+      continue;
+    }
+
+    if (!haveHeader) {
+      note("# records before the first header, times relative to the first one");
+      LogRecord first;
+      memcpy(&first, p, sizeof(first));
+      clock.sync(first.timeUs);
+      haveHeader = true;
+    }
+
+    LogRecord record;
+    memcpy(&record, p, sizeof(record));
+    formatLogLine(line, sizeof(line), record, clock.uptimeUs(record.timeUs));
+    emit(line);
+    stats.records++;
+    if (remaining > 0) remaining--;
+    pos += sizeof(LogRecord);
+  }
+
+  if (batch && remaining > 0) {
+    snprintf(line, sizeof(line), "# last batch cut short, %u records missing", remaining);
+    note(line);
+  }
+  if (pos < size) {
+    snprintf(line, sizeof(line), "# %zu trailing bytes", size - pos);
+    note(line);
+  }
+  return stats;
+}
+
+static bool readAll(const char* path, std::vector<uint8_t>& out) {
+  FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) out.insert(out.end(), buffer, buffer + n);
+  if (f != stdin) fclose(f);
+  return true;
+}
+
+// =============================================================================
+// Self-Check
+// =============================================================================
+
+template <LogId ID, typename... Args>
+static std::string format(const Args&... args) {
+  LogRecord record;
+  logEncodeRecord<ID>(record, 0, args...);
+  char text[128];
+  formatLogMessage(text, sizeof(text), record);
+  return text;
+}
+
+static void expectText(const std::string& got, const std::string& want) {
+  if (got != want) {
+    printf("FAIL: \"%s\"\n      expected \"%s\"\n", got.c_str(), want.c_str());
+    failures++;
+  }
+}
+
+// Formats are checked where LOG_EVENT is compiled
+static_assert(logArgsMatch<const char*, StopReason, int>("Gate %s stopped: %R at %u%%"),
+              "string, enum and number");
+static_assert(logArgsMatch<>("100%% done"), "no conversions");
+static_assert(!logArgsMatch<int>("%s"), "number for a string");
+static_assert(!logArgsMatch<float>("%u"), "float for a number");
+static_assert(!logArgsMatch<int, int>("%u"), "too many arguments");
+static_assert(logConversionCount("%-8s %5.1f %%") == 2, "flags, width and precision");
+
+static void checkFormatting() {
+  char want[128];
+
+  expectText(format<LOG_GATE_STOPPED>("GATEMATE-001", STOP_OBSTACLE, 35),
+             "Gate GATEMATE-001 stopped: obstacle at 35%");
+  expectText(format<LOG_GATE_STARTED>("GATEMATE-001-b", GATE_CLOSING, 100),
+             "Gate GATEMATE-001-b closing from 100%");
+  expectText(format<LOG_GROUP_DELAYED>(GATE_CMD_OPEN, "GATEMATE-001", 1750u),
+             "Group open on GATEMATE-001 in 1750 ms");
+  expectText(format<LOG_SAFE_MODE>(), "Safety: entering SAFE MODE");
+
+  snprintf(want, sizeof(want), "Safety: temperature high (%.1f C)", 71.25f);
+  expectText(format<LOG_SAFETY_TEMPERATURE>(71.25f), want);
+  snprintf(want, sizeof(want), "%u log records dropped", 4000000000u);
+  expectText(format<LOG_DROPPED>(4000000000u), want);
+
+  // Strings get what the other arguments leave of the payload
+  expectText(format<LOG_CONFIG_REJECTED>("maxOperationTime must be between 5 and 120 s"),
+             "Config update rejected: maxOperationTime must be …");
+  expectText(format<LOG_MQTT_RECEIVED>(LogTail("gatemate/devices/GATEMATE-001/commands"), 42),
+             "MQTT …GATEMATE-001/commands (42 bytes)");
+  expectText(format<LOG_MQTT_RECEIVED>(LogTail("gatemate/broadcast"), 7),
+             "MQTT gatemate/broadcast (7 bytes)");
+  expectText(format<LOG_SAFETY_STOP>((const char*)nullptr), "Safety: EMERGENCY STOP: ");
+
+  // A damaged record must not read past the payload
+  LogRecord record;
+  logEncodeRecord<LOG_GUEST_DENIED>(record, 0, "expired");
+  record.payload[0] = 0x3F;
+  char text[128];
+  formatLogMessage(text, sizeof(text), record);
+  record.id = 200;
+  formatLogMessage(text, sizeof(text), record);
+  expectText(text, "unknown message 200");
+
+  // Output buffer smaller than the line
+  logEncodeRecord<LOG_GATE_STOPPED>(record, 0, "GATEMATE-001", STOP_TIMEOUT, 80);
+  size_t n = formatLogMessage(text, 12, record);
+  expect(n == 11 && strcmp(text, "Gate GATEMA") == 0, "output cut to the buffer");
+}
+
+static void checkStream() {
+  std::vector<uint8_t> stream;
+  auto put = [&](const void* p, size_t n) {
+    stream.insert(stream.end(), (const uint8_t*)p, (const uint8_t*)p + n);
+  };
+
+  // Boot 1: uptime past the 32-bit µs wrap (71.6 min), records around it
+  const uint64_t base = 4294967296ull - 1500;
+  LogHeader header;
+  initLogHeader(header, "GATEMATE-001", base, 0, 0, 0);
+  put(&header, sizeof(header));
+  LogRecord record;
+  for (uint32_t i = 0; i < 3; i++) {
+    logEncodeRecord<LOG_GATE_STOPPED>(record, (uint32_t)(base + i * 1000), "GATEMATE-001",
+                                      STOP_COMPLETED, 100);
+    put(&record, sizeof(record));
+  }
+  // Boot 2 appended to the same file
+  initLogHeader(header, "GATEMATE-001", 2500000, 12, 0, 0);
+  put(&header, sizeof(header));
+  logEncodeRecord<LOG_SAFE_MODE_EXIT>(record, 2500250);
+  put(&record, sizeof(record));
+
+  // MQTT batches 0 and 2 (1 lost), the second cut short
+  initLogHeader(header, "GATEMATE-001", 9000000, 12, 0, 1);
+  put(&header, sizeof(header));
+  logEncodeRecord<LOG_GUEST_KEYS_UPDATED>(record, 9000000);
+  put(&record, sizeof(record));
+  initLogHeader(header, "GATEMATE-001", 9100000, 12, 2, 2);
+  put(&header, sizeof(header));
+  logEncodeRecord<LOG_GUEST_KEYS_UPDATED>(record, 9100000);
+  put(&record, sizeof(record));
+
+  std::vector<std::string> lines;
+  DecodeStats stats = decodeLog(stream.data(), stream.size(),
+                                [&](const char* line) { lines.push_back(line); });
+
+  expect(stats.records == 6 && stats.headers == 4, "records and headers decoded");
+  expect(stats.notes == 2, "one missing batch and one short batch noted");
+  for (const std::string& line : lines) printf("  %s\n", line.c_str());
+  expect(lines.size() > 3 && lines[3] == "  4294.967796 I Gate GATEMATE-001 stopped: completed at 100%",
+         "time continues past the 32-bit wrap");
+  expect(lines.size() > 5 && lines[5] == "     2.500250 I Safety: exited safe mode",
+         "second boot starts a new time base");
+
+  // Mismatched table and a stray byte at the end
+  header.records = 0;
+  header.tableHash ^= 1;
+  std::vector<uint8_t> other((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+  other.push_back(0);
+  stats = decodeLog(other.data(), other.size(), [](const char*) {});
+  expect(stats.notes == 2, "table mismatch and trailing bytes noted");
+}
+
+static void checkRing() {
+  LogRing<16> ring;
+  uint32_t accepted = 0;
+  for (uint32_t i = 0; i < 20; i++) accepted += ring.write<LOG_DROPPED>(i, i);
+  expect(accepted == 16 && ring.getDropped() == 4, "full ring drops and counts");
+
+  LogRecord record;
+  uint32_t next = 0;
+  bool ordered = true;
+  while (ring.pop(record)) {
+    uint32_t value;
+    memcpy(&value, record.payload, sizeof(value));
+    ordered &= value == next++ && record.timeUs == value;
+  }
+  expect(ordered && next == 16, "records come out in order");
+  expect(ring.write<LOG_DROPPED>(0, 0u) && ring.pop(record) && !ring.pop(record),
+         "ring usable after overflow");
+}
+
+// Producers tag each record with their index and a sequence number and
+// retry what the full ring refuses; the consumer checks nothing is lost,
+// duplicated or reordered per producer, and that every refusal was counted
+static void checkProducers() {
+  static LogRing<256> ring;
+  const uint32_t producers = 4;
+  const uint32_t perProducer = 200000;
+  std::atomic<uint32_t> running{producers};
+  std::atomic<uint32_t> refused{0};
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < producers; t++) {
+    threads.emplace_back([&, t] {
+      for (uint32_t i = 0; i < perProducer; i++) {
+        while (!ring.write<LOG_DROPPED>(t, t << 24 | i)) {
+          refused++;
+          std::this_thread::yield();
+        }
+      }
+      running--;
+    });
+  }
+
+  uint32_t received = 0;
+  int32_t last[producers];
+  for (int32_t& l : last) l = -1;
+  bool ordered = true;
+  LogRecord record;
+  for (;;) {
+    bool done = running.load() == 0;
+    while (ring.pop(record)) {
+      uint32_t value;
+      memcpy(&value, record.payload, sizeof(value));
+      uint32_t t = value >> 24;
+      int32_t seq = value & 0xFFFFFF;
+      ordered &= t < producers && record.timeUs == t && seq == last[t] + 1;
+      if (t < producers) last[t] = seq;
+      received++;
+    }
+    if (done) break;
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  printf("producers: %u x %u records, %u delivered, %u refused while full\n", producers,
+         perProducer, received, ring.getDropped());
+  expect(ordered && received == producers * perProducer, "every record once, in order per producer");
+  expect(refused.load() == ring.getDropped(), "every refusal counted as dropped");
+}
+
+static void measure() {
+  static LogRing<256> ring;
+  const int rounds = 4000;
+  const int batch = 128;
+  LogRecord record;
+
+  double logNs = 0;
+  for (int r = 0; r < rounds; r++) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < batch; i++) {
+      ring.write<LOG_GATE_SAFETY_STOP>(logNowUs(), "GATEMATE-001", STOP_OBSTACLE, 35);
+    }
+    logNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    while (ring.pop(record)) {}
+  }
+
+  // What the drain task does with it, and what Serial.printf did inline
+  char line[128];
+  int length = 0;
+  volatile int sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds * batch / 16; r++) {
+    length = snprintf(line, sizeof(line), "Gate %s safety stop: %s at %u%%\n", "GATEMATE-001",
+                      stopReasonName(STOP_OBSTACLE), 35u);
+    sink = sink + line[r % length];
+  }
+  double formatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+
+  printf("LOG_EVENT: %.0f ns per entry (host; the device reports its own in GET /log)\n",
+         logNs / (rounds * batch));
+  printf("snprintf of the same line: %.0f ns; at 115200 baud its %d bytes take %.0f us\n",
+         formatNs / (rounds * batch / 16), length, length * 10 * 1e6 / 115200);
+  expect(logNs / (rounds * batch) < 1000, "entry under a microsecond");
+}
+
+static int selfCheck() {
+  checkFormatting();
+  checkStream();
+  checkRing();
+  checkProducers();
+  measure();
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(int argc, char** argv) {
+  if (argc < 2) return selfCheck();
+
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    std::vector<uint8_t> data;
+    if (!readAll(argv[i], data)) {
+      fprintf(stderr, "%s: cannot read\n", argv[i]);
+      status = 1;
+      continue;
+    }
+    if (argc > 2) printf("# %s\n", argv[i]);
+    DecodeStats stats = decodeLog(data.data(), data.size(), [](const char* line) {
+      printf("%s\n", line);
+    });
+    fprintf(stderr, "%s: %u records, %u headers, %u notes\n", argv[i], stats.records,
+            stats.headers, stats.notes);
+  }
+  return status;
+}
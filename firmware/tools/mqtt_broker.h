@@ -0,0 +1,349 @@
+// =============================================================================
+// GATEMATE Host Tools - Test Broker
+// =============================================================================
+//
+// A small MQTT 3.1.1 broker on loopback for the host tools, behaving like
+// mosquitto with docker/mosquitto/config: persistent sessions, at most
+// BROKER_INFLIGHT QoS 1 messages in flight per client, redelivery with DUP
+// on reconnect. Plus the blocking client helpers the tools share. Uses
+// mqtt_wire.h; POSIX sockets only.
+//
+
+#ifndef MQTT_BROKER_H
+#define MQTT_BROKER_H
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mqtt_wire.h"
+
+#ifndef BROKER_INFLIGHT
+#define BROKER_INFLIGHT     20      // mosquitto's max_inflight_messages
+#endif
+
+// =============================================================================
+// Client Helpers
+// =============================================================================
+
+// Milliseconds since the first call
+inline uint32_t nowMs() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+inline bool sendAll(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    sent += (size_t)n;
+  }
+  return true;
+}
+
+inline int connectTo(const char* host, uint16_t port) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = nullptr;
+  if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &result) != 0) return -1;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+// Connects and waits for the CONNACK; bytes after it stay in buffer
+inline int mqttConnect(const char* host, uint16_t port, const std::string& clientId, bool clean,
+                       std::string& buffer) {
+  int fd = connectTo(host, port);
+  if (fd < 0) return -1;
+  std::string out;
+  mqtt::connect(out, clientId, 60, clean);
+  if (!sendAll(fd, out)) {
+    close(fd);
+    return -1;
+  }
+  buffer.clear();
+  uint32_t deadline = nowMs() + 2000;
+  while (nowMs() < deadline) {
+    pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, 10) <= 0) continue;
+    char chunk[4096];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) break;
+    buffer.append(chunk, (size_t)n);
+    mqtt::Packet packet;
+    if (mqtt::parse(buffer, packet) == 1 && packet.type == mqtt::CONNACK) {
+      if (packet.returnCode == 0) return fd;
+      break;
+    }
+  }
+  close(fd);
+  return -1;
+}
+
+// Drops the persistent session of a client id
+inline void discardSession(const char* host, uint16_t port, const std::string& clientId) {
+  std::string buffer;
+  int fd = mqttConnect(host, port, clientId, true, buffer);
+  if (fd < 0) return;
+  std::string out;
+  mqtt::disconnect(out);
+  sendAll(fd, out);
+  close(fd);
+}
+
+// =============================================================================
+// Broker
+// =============================================================================
+
+class Broker {
+private:
+  struct Message {
+    uint16_t id;
+    std::string topic;
+    std::string payload;
+  };
+
+  struct Session {
+    bool clean = true;
+    int fd = -1;                  // -1 while the client is away
+    std::vector<std::pair<std::string, uint8_t>> filters;
+    std::deque<Message> inflight; // Sent, waiting for the PUBACK
+    std::deque<Message> queued;
+    uint16_t nextId = 0;
+  };
+
+  int listenFd = -1;
+  uint16_t listenPort = 0;
+  std::map<std::string, Session> sessions;
+  std::map<int, std::string> buffers;
+  std::map<int, std::string> clients;     // fd -> client id
+  std::atomic<bool> running{false};
+  std::thread thread;
+
+  static bool matches(const std::string& filter, const std::string& topic) {
+    size_t f = 0, t = 0;
+    while (f < filter.size()) {
+      if (filter[f] == '#') return true;
+      if (filter[f] == '+') {
+        while (t < topic.size() && topic[t] != '/') t++;
+        f++;
+        continue;
+      }
+      if (t >= topic.size() || filter[f] != topic[t]) return false;
+      f++;
+      t++;
+    }
+    return t == topic.size();
+  }
+
+  void send(Session& session, const Message& message, bool dup) {
+    std::string out;
+    mqtt::publish(out, message.topic, message.payload, false, 1, message.id, dup);
+    sendAll(session.fd, out);
+  }
+
+  void pump(Session& session) {
+    while (session.fd >= 0 && session.inflight.size() < BROKER_INFLIGHT &&
+           !session.queued.empty()) {
+      session.inflight.push_back(session.queued.front());
+      session.queued.pop_front();
+      send(session, session.inflight.back(), false);
+    }
+  }
+
+  void route(const std::string& topic, const std::string& payload, uint8_t qos) {
+    for (auto& entry : sessions) {
+      Session& session = entry.second;
+      int granted = -1;
+      for (const auto& filter : session.filters) {
+        if (matches(filter.first, topic)) granted = std::max<int>(granted, filter.second);
+      }
+      if (granted < 0) continue;
+      if (std::min<int>(qos, granted) == 0) {
+        if (session.fd < 0) continue;
+        std::string out;
+        mqtt::publish(out, topic, payload);
+        sendAll(session.fd, out);
+        continue;
+      }
+      if (session.fd < 0 && session.clean) continue;
+      if (++session.nextId == 0) session.nextId = 1;
+      session.queued.push_back({session.nextId, topic, payload});
+      pump(session);
+    }
+  }
+
+  void drop(int fd) {
+    auto client = clients.find(fd);
+    if (client != clients.end()) {
+      auto session = sessions.find(client->second);
+      if (session != sessions.end() && session->second.fd == fd) {
+        session->second.fd = -1;
+        if (session->second.clean) sessions.erase(session);
+      }
+      clients.erase(client);
+    }
+    buffers.erase(fd);
+    close(fd);
+  }
+
+  // Returns false when the connection is to be dropped
+  bool handle(int fd, const mqtt::Packet& packet) {
+    std::string out;
+    if (packet.type == mqtt::CONNECT) {
+      auto existing = sessions.find(packet.topic);
+      if (existing != sessions.end() && existing->second.fd >= 0) {
+        int old = existing->second.fd;
+        existing->second.fd = -1;
+        clients.erase(old);
+        buffers.erase(old);
+        close(old);
+      }
+      bool present = existing != sessions.end() && !packet.sessionFlag;
+      if (!present) sessions[packet.topic] = Session();
+      Session& session = sessions[packet.topic];
+      session.clean = packet.sessionFlag;
+      session.fd = fd;
+      clients[fd] = packet.topic;
+      mqtt::connack(out, present);
+      sendAll(fd, out);
+      for (const Message& message : session.inflight) {
+        send(session, message, true);
+        redelivered++;
+      }
+      pump(session);
+      return true;
+    }
+
+    auto client = clients.find(fd);
+    if (client == clients.end()) return false;
+    Session& session = sessions[client->second];
+    switch (packet.type) {
+      case mqtt::SUBSCRIBE: {
+        uint8_t qos = std::min<uint8_t>(packet.returnCode, 1);
+        session.filters.push_back({packet.topic, qos});
+        mqtt::suback(out, packet.packetId, qos);
+        sendAll(fd, out);
+        break;
+      }
+      case mqtt::PUBLISH: {
+        uint8_t qos = (packet.flags >> 1) & 0x03;
+        if (qos > 0) {
+          mqtt::puback(out, packet.packetId);
+          sendAll(fd, out);
+        }
+        route(packet.topic, packet.payload, qos);
+        break;
+      }
+      case mqtt::PUBACK:
+        for (auto it = session.inflight.begin(); it != session.inflight.end(); ++it) {
+          if (it->id == packet.packetId) {
+            session.inflight.erase(it);
+            break;
+          }
+        }
+        pump(session);
+        break;
+      case mqtt::PINGREQ:
+        out.push_back((char)(mqtt::PINGRESP << 4));
+        out.push_back(0);
+        sendAll(fd, out);
+        break;
+      case mqtt::DISCONNECT:
+        return false;
+      default:
+        break;
+    }
+    return true;
+  }
+
+  void run() {
+    while (running) {
+      std::vector<pollfd> fds = {{listenFd, POLLIN, 0}};
+      for (const auto& entry : buffers) fds.push_back({entry.first, POLLIN, 0});
+      if (poll(fds.data(), fds.size(), 5) <= 0) continue;
+
+      if (fds[0].revents & POLLIN) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd >= 0) {
+          int one = 1;
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          buffers[fd];
+        }
+      }
+      for (size_t i = 1; i < fds.size(); i++) {
+        if (!fds[i].revents) continue;
+        int fd = fds[i].fd;
+        if (!buffers.count(fd)) continue;     // Taken over by a reconnect
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+          drop(fd);
+          continue;
+        }
+        buffers[fd].append(chunk, (size_t)n);
+        mqtt::Packet packet;
+        int parsed;
+        bool keep = true;
+        while (keep && buffers.count(fd) && (parsed = mqtt::parse(buffers[fd], packet)) != 0) {
+          keep = parsed > 0 && handle(fd, packet);
+        }
+        if (!keep && buffers.count(fd)) drop(fd);
+      }
+    }
+  }
+
+public:
+  uint32_t redelivered = 0;
+
+  bool start() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 16) != 0 ||
+        getsockname(listenFd, (sockaddr*)&addr, &length) != 0) {
+      return false;
+    }
+    listenPort = ntohs(addr.sin_port);
+    running = true;
+    thread = std::thread([this] { run(); });
+    return true;
+  }
+
+  void stop() {
+    running = false;
+    thread.join();
+    for (const auto& entry : buffers) close(entry.first);
+    close(listenFd);
+  }
+
+  uint16_t port() const { return listenPort; }
+};
+
+#endif // MQTT_BROKER_H
@@ -0,0 +1,245 @@
+// =============================================================================
+// GATEMATE Host Tools - Minimal MQTT 3.1.1 Wire Codec
+// =============================================================================
+//
+// Just enough of MQTT 3.1.1 for the host tools to behave like PubSubClient
+// on the device and like the backend's mqtt.js client: CONNECT, PUBLISH
+// (QoS 0/1, DUP), PUBACK, SUBSCRIBE, PINGREQ and DISCONNECT, plus an
+// incremental frame parser for non-blocking sockets. CONNACK and SUBACK
+// encoding and CONNECT/SUBSCRIBE decoding let a tool play a small broker.
+// No dependencies beyond libstdc++.
+//
+
+#ifndef MQTT_WIRE_H
+#define MQTT_WIRE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+namespace mqtt {
+
+enum PacketType : uint8_t {
+  CONNECT = 1,
+  CONNACK = 2,
+  PUBLISH = 3,
+  PUBACK = 4,
+  SUBSCRIBE = 8,
+  SUBACK = 9,
+  PINGREQ = 12,
+  PINGRESP = 13,
+  DISCONNECT = 14,
+};
+
+// =============================================================================
+// Encoding
+// =============================================================================
+
+inline void putRemainingLength(std::string& out, size_t length) {
+  do {
+    uint8_t byte = length % 128;
+    length /= 128;
+    if (length > 0) byte |= 0x80;
+    out.push_back((char)byte);
+  } while (length > 0);
+}
+
+inline void putU16(std::string& out, uint16_t value) {
+  out.push_back((char)(value >> 8));
+  out.push_back((char)(value & 0xFF));
+}
+
+inline void putString(std::string& out, const std::string& value) {
+  putU16(out, (uint16_t)value.size());
+  out += value;
+}
+
+inline void frame(std::string& out, uint8_t header, const std::string& body) {
+  out.push_back((char)header);
+  putRemainingLength(out, body.size());
+  out += body;
+}
+
+inline void connect(std::string& out, const std::string& clientId, uint16_t keepAlive,
+                    bool cleanSession = true) {
+  std::string body;
+  putString(body, "MQTT");
+  body.push_back(4);                              // Protocol level 3.1.1
+  body.push_back(cleanSession ? 0x02 : 0x00);     // Connect flags
+  putU16(body, keepAlive);
+  putString(body, clientId);
+  frame(out, CONNECT << 4, body);
+}
+
+inline void connack(std::string& out, bool sessionPresent, uint8_t returnCode = 0) {
+  std::string body;
+  body.push_back(sessionPresent ? 1 : 0);
+  body.push_back((char)returnCode);
+  frame(out, CONNACK << 4, body);
+}
+
+// dup: a QoS 1 redelivery
+inline void publish(std::string& out, const std::string& topic, const std::string& payload,
+                    bool retain = false, uint8_t qos = 0, uint16_t packetId = 0,
+                    bool dup = false) {
+  std::string body;
+  putString(body, topic);
+  if (qos > 0) putU16(body, packetId);
+  body += payload;
+  frame(out, (PUBLISH << 4) | (dup ? 0x08 : 0) | (qos << 1) | (retain ? 1 : 0), body);
+}
+
+inline void puback(std::string& out, uint16_t packetId) {
+  std::string body;
+  putU16(body, packetId);
+  frame(out, PUBACK << 4, body);
+}
+
+inline void subscribe(std::string& out, uint16_t packetId, const std::string& filter,
+                      uint8_t qos = 0) {
+  std::string body;
+  putU16(body, packetId);
+  putString(body, filter);
+  body.push_back((char)qos);
+  frame(out, (SUBSCRIBE << 4) | 0x02, body);
+}
+
+inline void suback(std::string& out, uint16_t packetId, uint8_t grantedQos) {
+  std::string body;
+  putU16(body, packetId);
+  body.push_back((char)grantedQos);
+  frame(out, SUBACK << 4, body);
+}
+
+inline void pingreq(std::string& out) {
+  out.push_back((char)(PINGREQ << 4));
+  out.push_back(0);
+}
+
+inline void disconnect(std::string& out) {
+  out.push_back((char)(DISCONNECT << 4));
+  out.push_back(0);
+}
+
+// =============================================================================
+// Decoding
+// =============================================================================
+
+struct Packet {
+  uint8_t type;
+  uint8_t flags;
+  uint16_t packetId;
+  uint8_t returnCode;     // CONNACK; requested QoS of SUBSCRIBE
+  bool sessionFlag;       // CONNACK session present; CONNECT clean session
+  std::string topic;      // PUBLISH; client id of CONNECT; filter of SUBSCRIBE
+  std::string payload;    // PUBLISH
+};
+
+// Extracts one complete packet from the front of buffer. Returns 1 when a
+// packet was consumed, 0 when more bytes are needed, -1 on malformed input.
+inline int parse(std::string& buffer, Packet& packet) {
+  if (buffer.size() < 2) return 0;
+
+  size_t length = 0;
+  size_t multiplier = 1;
+  size_t pos = 1;
+  for (;;) {
+    if (pos >= buffer.size()) return 0;
+    if (pos > 4) return -1;
+    uint8_t byte = (uint8_t)buffer[pos++];
+    length += (byte & 0x7F) * multiplier;
+    multiplier *= 128;
+    if (!(byte & 0x80)) break;
+  }
+  if (buffer.size() < pos + length) return 0;
+
+  const uint8_t* body = (const uint8_t*)buffer.data() + pos;
+  uint8_t header = (uint8_t)buffer[0];
+  packet.type = header >> 4;
+  packet.flags = header & 0x0F;
+  packet.packetId = 0;
+  packet.returnCode = 0;
+  packet.sessionFlag = false;
+  packet.topic.clear();
+  packet.payload.clear();
+
+  switch (packet.type) {
+    case CONNECT: {
+      // "MQTT", level, flags, keep-alive, client id; will and login ignored
+      if (length < 12) return -1;
+      size_t nameLength = (body[0] << 8) | body[1];
+      size_t offset = 2 + nameLength + 4;
+      if (offset + 2 > length) return -1;
+      packet.sessionFlag = body[2 + nameLength + 1] & 0x02;
+      size_t idLength = (body[offset] << 8) | body[offset + 1];
+      if (offset + 2 + idLength > length) return -1;
+      packet.topic.assign((const char*)body + offset + 2, idLength);
+      break;
+    }
+    case CONNACK:
+      if (length < 2) return -1;
+      packet.sessionFlag = body[0] & 0x01;
+      packet.returnCode = body[1];
+      break;
+    case PUBLISH: {
+      if (length < 2) return -1;
+      size_t topicLength = (body[0] << 8) | body[1];
+      size_t offset = 2 + topicLength;
+      uint8_t qos = (packet.flags >> 1) & 0x03;
+      if (qos > 0) offset += 2;
+      if (offset > length) return -1;
+      packet.topic.assign((const char*)body + 2, topicLength);
+      if (qos > 0) packet.packetId = (body[2 + topicLength] << 8) | body[3 + topicLength];
+      packet.payload.assign((const char*)body + offset, length - offset);
+      break;
+    }
+    case PUBACK:
+    case SUBACK:
+      if (length < 2) return -1;
+      packet.packetId = (body[0] << 8) | body[1];
+      break;
+    case SUBSCRIBE: {
+      // First filter only
+      if (length < 5) return -1;
+      packet.packetId = (body[0] << 8) | body[1];
+      size_t filterLength = (body[2] << 8) | body[3];
+      if (4 + filterLength + 1 > length) return -1;
+      packet.topic.assign((const char*)body + 4, filterLength);
+      packet.returnCode = body[4 + filterLength];
+      break;
+    }
+    default:
+      break;
+  }
+
+  buffer.erase(0, pos + length);
+  return 1;
+}
+
+// Value of a top-level string field in a flat JSON payload ("" if absent)
+inline std::string jsonString(const std::string& json, const char* key) {
+  std::string needle = std::string("\"") + key + "\"";
+  size_t pos = json.find(needle);
+  if (pos == std::string::npos) return "";
+  pos = json.find(':', pos + needle.size());
+  if (pos == std::string::npos) return "";
+  pos = json.find('"', pos);
+  if (pos == std::string::npos) return "";
+  size_t end = json.find('"', pos + 1);
+  if (end == std::string::npos) return "";
+  return json.substr(pos + 1, end - pos - 1);
+}
+
+// Value of a top-level numeric field in a flat JSON payload
+inline long jsonNumber(const std::string& json, const char* key, long fallback) {
+  std::string needle = std::string("\"") + key + "\"";
+  size_t pos = json.find(needle);
+  if (pos == std::string::npos) return fallback;
+  pos = json.find(':', pos + needle.size());
+  if (pos == std::string::npos) return fallback;
+  return strtol(json.c_str() + pos + 1, nullptr, 10);
+}
+
+} // namespace mqtt
+
+#endif // MQTT_WIRE_H
@@ -0,0 +1,724 @@
+// =============================================================================
+// GATEMATE Host Tool - OTA Delta
+// =============================================================================
+//
+// Builds the patches applied by src/ota_patch.h: a binary delta from the
+// firmware a gate runs to a new build, or a compressed full image for gates
+// on an unknown build. Also applies a patch to files with the same
+// OtaPatcher the device runs, with OpenSSL standing in for mbedTLS.
+//
+// The delta matches 8-byte seeds of the new image in the old one, extends
+// each match while old and new mostly agree, and encodes the stretch as
+// COPY where equal and ADD elsewhere; what matches nowhere is INSERTed.
+//
+// Without arguments, links a synthetic firmware image (functions with
+// literal pools of absolute call targets, and strings), makes a new
+// release of it - code inserted early on so everything behind it moves,
+// constants and strings changed, a function appended - and checks that
+//   - delta and full patches rebuild the new image, fed in uneven chunks
+//     with a small write budget per call, as the HTTP and MQTT paths do
+//   - a wrong base, a corrupt or truncated patch, trailing bytes, a window
+//     larger than the device accepts and an oversize image are refused,
+//     and the base is refused before anything is written
+//   - no corrupted patch is ever accepted
+// and reports patch sizes, transfer time on a slow link and apply cost.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/ota_delta.cpp -o ota_delta -lcrypto
+//
+// Usage:
+//   ./ota_delta
+//   ./ota_delta diff old.bin new.bin patch.gmop [--window BITS]
+//   ./ota_delta pack new.bin patch.gmop [--window BITS]
+//   ./ota_delta apply old.bin patch.gmop out.bin     (old.bin "-" for a full patch)
+//   ./ota_delta info patch.gmop
+//
+// Upload a patch with  curl -F file=@patch.gmop http://<gate>/ota
+//
+
+#include <openssl/evp.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "ota_patch.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+#define DEFAULT_WINDOW_BITS   14          // Device default, OTA_PATCH_WINDOW_BITS
+#define SLOT_BYTES            0x1E0000    // min_spiffs.csv app slot
+
+// =============================================================================
+// Host Backends
+// =============================================================================
+
+class OpenSslSha256 {
+private:
+  EVP_MD_CTX* ctx;
+
+public:
+  OpenSslSha256() : ctx(EVP_MD_CTX_new()) {}
+  ~OpenSslSha256() { EVP_MD_CTX_free(ctx); }
+
+  void begin() { EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr); }
+  void update(const uint8_t* data, size_t length) { EVP_DigestUpdate(ctx, data, length); }
+  void finish(uint8_t out[32]) { EVP_DigestFinal_ex(ctx, out, nullptr); }
+};
+
+static void sha256(const Bytes& data, uint8_t out[32]) {
+  OpenSslSha256 sha;
+  sha.begin();
+  sha.update(data.data(), data.size());
+  sha.finish(out);
+}
+
+// The running image in memory, the slot as a vector
+struct MemoryFlash {
+  const Bytes* base = nullptr;
+  Bytes slot;
+  uint32_t slotBytes = SLOT_BYTES;
+  uint32_t baseReads = 0;
+  bool started = false;
+
+  bool start(uint32_t size) {
+    if (size > slotBytes) return false;
+    slot.clear();
+    slot.reserve(size);
+    started = true;
+    return true;
+  }
+
+  bool readBase(uint32_t offset, uint8_t* out, size_t length) {
+    if (!base || offset + length > base->size()) return false;
+    memcpy(out, base->data() + offset, length);
+    baseReads += length;
+    return true;
+  }
+
+  bool write(const uint8_t* data, size_t length) {
+    slot.insert(slot.end(), data, data + length);
+    return true;
+  }
+};
+
+typedef OtaPatcher<MemoryFlash, OpenSslSha256> Patcher;
+
+// =============================================================================
+// Op Stream
+// =============================================================================
+
+static void putVarint(Bytes& out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+static void putOp(Bytes& out, OtaOp op, uint32_t argument) {
+  out.push_back(op);
+  putVarint(out, argument);
+}
+
+static void putInsert(Bytes& ops, const uint8_t* data, size_t length) {
+  if (length == 0) return;
+  putOp(ops, OTA_OP_INSERT, (uint32_t)length);
+  ops.insert(ops.end(), data, data + length);
+}
+
+// Old and new agree at o and p for as long as twice the equal bytes exceed
+// the length (the bsdiff rule); gives up 64 bytes past the best point
+static size_t extendMatch(const Bytes& oldImage, size_t o, const Bytes& newImage, size_t p,
+                          long& bestScore) {
+  long score = 0;
+  bestScore = 0;
+  size_t best = 0;
+  for (size_t i = 0; o + i < oldImage.size() && p + i < newImage.size(); i++) {
+    score += oldImage[o + i] == newImage[p + i] ? 1 : -1;
+    if (score > bestScore) {
+      bestScore = score;
+      best = i + 1;
+    } else if (i - best > 64) {
+      break;
+    }
+  }
+  return best;
+}
+
+// COPY the equal runs of a matched stretch, ADD the rest
+static void putStretch(Bytes& ops, const Bytes& oldImage, size_t o, const Bytes& newImage,
+                       size_t p, size_t length) {
+  const size_t minCopy = 8;
+  size_t i = 0;
+  while (i < length) {
+    size_t equal = 0;
+    while (i + equal < length && oldImage[o + i + equal] == newImage[p + i + equal]) equal++;
+    if (equal >= minCopy || i + equal == length) {
+      if (equal) putOp(ops, OTA_OP_COPY, (uint32_t)equal);
+      i += equal;
+      continue;
+    }
+    // ADD up to the next equal run worth a COPY
+    size_t end = i + equal;
+    while (end < length) {
+      size_t run = 0;
+      while (end + run < length && run < minCopy &&
+             oldImage[o + end + run] == newImage[p + end + run]) run++;
+      if (run >= minCopy) break;
+      end += run ? run : 1;
+    }
+    putOp(ops, OTA_OP_ADD, (uint32_t)(end - i));
+    for (size_t k = i; k < end; k++) ops.push_back((uint8_t)(newImage[p + k] - oldImage[o + k]));
+    i = end;
+  }
+}
+
+static Bytes diffOps(const Bytes& oldImage, const Bytes& newImage) {
+  const size_t seed = 8;
+  const uint32_t bits = 20;
+  const uint32_t none = UINT32_MAX;
+  auto hash = [&](const uint8_t* at) {
+    uint64_t v;
+    memcpy(&v, at, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+  };
+
+  std::vector<uint32_t> head(1u << bits, none);
+  std::vector<uint32_t> next(oldImage.size(), none);
+  for (size_t i = 0; i + seed <= oldImage.size(); i++) {
+    uint32_t h = hash(&oldImage[i]);
+    next[i] = head[h];
+    head[h] = (uint32_t)i;
+  }
+
+  Bytes ops;
+  size_t p = 0;
+  size_t literalStart = 0;
+  size_t cursor = 0;
+  long shift = 0;                         // Old minus new position of the last match
+  while (p < newImage.size()) {
+    size_t bestAt = 0;
+    size_t bestLength = 0;
+    long bestScore = 0;
+
+    // Exact seeds first, the previous alignment as a fallback
+    if (p + seed <= newImage.size()) {
+      uint32_t candidate = head[hash(&newImage[p])];
+      for (int depth = 0; candidate != none && depth < 32; depth++, candidate = next[candidate]) {
+        size_t exact = 0;
+        while (candidate + exact < oldImage.size() && p + exact < newImage.size() &&
+               oldImage[candidate + exact] == newImage[p + exact]) exact++;
+        if (exact > bestLength) {
+          bestLength = exact;
+          bestAt = candidate;
+        }
+      }
+    }
+    size_t length = 0;
+    if (bestLength >= 12) {
+      length = extendMatch(oldImage, bestAt, newImage, p, bestScore);
+    } else {
+      long aligned = (long)p + shift;
+      if (aligned >= 0 && (size_t)aligned < oldImage.size()) {
+        length = extendMatch(oldImage, (size_t)aligned, newImage, p, bestScore);
+        bestAt = (size_t)aligned;
+      }
+      if (bestScore < 16) length = 0;
+    }
+
+    if (length == 0) {
+      p++;
+      continue;
+    }
+
+    putInsert(ops, &newImage[literalStart], p - literalStart);
+    if (bestAt != cursor) {
+      long delta = (long)bestAt - (long)cursor;
+      putOp(ops, OTA_OP_SEEK, delta < 0 ? (uint32_t)(-delta - 1) * 2 + 1 : (uint32_t)delta * 2);
+    }
+    putStretch(ops, oldImage, bestAt, newImage, p, length);
+    shift = (long)bestAt - (long)p;
+    cursor = bestAt + length;
+    p += length;
+    literalStart = p;
+  }
+  putInsert(ops, &newImage[literalStart], p - literalStart);
+  return ops;
+}
+
+// =============================================================================
+// Compression
+// =============================================================================
+
+static void putLength(Bytes& out, uint32_t length) {
+  while (length >= 255) {
+    out.push_back(255);
+    length -= 255;
+  }
+  out.push_back((uint8_t)length);
+}
+
+static void putSequence(Bytes& out, const uint8_t* literals, uint32_t literalCount,
+                        uint32_t offset, uint32_t matchLength) {
+  uint32_t extra = matchLength ? matchLength - OTA_PATCH_MIN_MATCH : 0;
+  out.push_back((uint8_t)((literalCount < 15 ? literalCount : 15) << 4 | (extra < 15 ? extra : 15)));
+  if (literalCount >= 15) putLength(out, literalCount - 15);
+  out.insert(out.end(), literals, literals + literalCount);
+  if (!matchLength) return;
+  out.push_back((uint8_t)offset);
+  out.push_back((uint8_t)(offset >> 8));
+  if (extra >= 15) putLength(out, extra - 15);
+}
+
+// Hash-chained LZ77 with one step of lazy matching
+static Bytes compress(const Bytes& in, uint8_t windowBits) {
+  const uint32_t bits = 16;
+  const uint32_t none = UINT32_MAX;
+  const uint32_t maxOffset = std::min<uint32_t>(1u << windowBits, 0xFFFF);
+  const size_t n = in.size();
+  auto hash = [&](size_t at) {
+    uint32_t v;
+    memcpy(&v, &in[at], sizeof(v));
+    return (v * 2654435761u) >> (32 - bits);
+  };
+
+  std::vector<uint32_t> head(1u << bits, none);
+  std::vector<uint32_t> chain(n, none);
+  auto insert = [&](size_t at) {
+    if (at + OTA_PATCH_MIN_MATCH > n) return;
+    uint32_t h = hash(at);
+    chain[at] = head[h];
+    head[h] = (uint32_t)at;
+  };
+  auto find = [&](size_t at, uint32_t& offset) {
+    uint32_t best = 0;
+    if (at + OTA_PATCH_MIN_MATCH > n) return best;
+    uint32_t candidate = head[hash(at)];
+    for (int depth = 0; candidate != none && depth < 48; depth++, candidate = chain[candidate]) {
+      if (at - candidate > maxOffset) break;
+      uint32_t length = 0;
+      while (at + length < n && in[candidate + length] == in[at + length]) length++;
+      if (length > best) {
+        best = length;
+        offset = (uint32_t)(at - candidate);
+      }
+    }
+    return best >= OTA_PATCH_MIN_MATCH ? best : 0;
+  };
+
+  Bytes out;
+  size_t literalStart = 0;
+  size_t p = 0;
+  while (p < n) {
+    uint32_t offset = 0;
+    uint32_t length = find(p, offset);
+    if (length) {
+      insert(p);
+      uint32_t nextOffset = 0;
+      if (find(p + 1, nextOffset) > length + 1) {
+        p++;
+        continue;
+      }
+      putSequence(out, &in[literalStart], (uint32_t)(p - literalStart), offset, length);
+      for (size_t k = p + 1; k < p + length; k++) insert(k);
+      p += length;
+      literalStart = p;
+    } else {
+      insert(p);
+      p++;
+    }
+  }
+  if (literalStart < n) putSequence(out, &in[literalStart], (uint32_t)(n - literalStart), 0, 0);
+  return out;
+}
+
+// =============================================================================
+// Patches
+// =============================================================================
+
+static Bytes makePatch(const Bytes* oldImage, const Bytes& newImage, uint8_t windowBits) {
+  OtaPatchHeader header = {};
+  header.magic = OTA_PATCH_MAGIC;
+  header.version = OTA_PATCH_VERSION;
+  header.kind = oldImage ? OTA_PATCH_DELTA : OTA_PATCH_FULL;
+  header.windowBits = windowBits;
+  header.targetSize = (uint32_t)newImage.size();
+  sha256(newImage, header.targetSha256);
+
+  Bytes ops;
+  if (oldImage) {
+    header.baseSize = (uint32_t)oldImage->size();
+    sha256(*oldImage, header.baseSha256);
+    ops = diffOps(*oldImage, newImage);
+  } else {
+    putInsert(ops, newImage.data(), newImage.size());
+  }
+
+  Bytes patch((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+  Bytes body = compress(ops, windowBits);
+  patch.insert(patch.end(), body.begin(), body.end());
+  return patch;
+}
+
+// Feeds the patch in chunks of up to chunk bytes with a write budget per
+// call, the way the device does; chunk 0 = all at once
+static OtaPatchResult applyPatch(MemoryFlash& flash, const Bytes& patch, size_t chunk = 0,
+                                 uint32_t budget = UINT32_MAX, uint8_t windowLimit = 16,
+                                 std::mt19937* rng = nullptr) {
+  static Patcher patcher;
+  patcher.begin(flash, windowLimit);
+  size_t at = 0;
+  while (at < patch.size() && !patcher.failed()) {
+    size_t n = patch.size() - at;
+    if (chunk && rng) n = std::min(n, (size_t)(*rng)() % chunk + 1);
+    else if (chunk) n = std::min(n, chunk);
+    size_t used = 0;
+    while (used < n && !patcher.failed()) used += patcher.feed(&patch[at + used], n - used, budget);
+    at += n;
+  }
+  while (patcher.pending()) patcher.feed(nullptr, 0, budget);
+  return patcher.finish();
+}
+
+static bool readAll(const char* path, Bytes& out) {
+  FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) out.insert(out.end(), buffer, buffer + n);
+  if (f != stdin) fclose(f);
+  return true;
+}
+
+static bool writeAll(const char* path, const Bytes& data) {
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ok;
+}
+
+// =============================================================================
+// Synthetic Firmware
+// =============================================================================
+
+// Functions are code followed by a literal pool of absolute call targets,
+// as the Xtensa toolchain lays them out; strings follow the code
+struct Firmware {
+  struct Function {
+    Bytes code;
+    std::vector<uint32_t> calls;          // Function indices
+  };
+  std::vector<Function> functions;
+  std::vector<std::string> strings;
+
+  Bytes link() const {
+    const uint32_t textBase = 0x400D0020;
+    std::vector<uint32_t> address(functions.size());
+    uint32_t at = 0;
+    for (size_t i = 0; i < functions.size(); i++) {
+      address[i] = textBase + at;
+      at += (uint32_t)(functions[i].code.size() + 4 * functions[i].calls.size() + 3) & ~3u;
+    }
+
+    Bytes image = {0xE9, 0x06, 0x02, 0x20};
+    for (size_t i = 0; i < functions.size(); i++) {
+      const Function& f = functions[i];
+      image.insert(image.end(), f.code.begin(), f.code.end());
+      for (uint32_t call : f.calls) {
+        for (int b = 0; b < 4; b++) image.push_back((uint8_t)(address[call] >> (8 * b)));
+      }
+      while ((image.size() - 4) % 4) image.push_back(0);
+    }
+    for (const std::string& s : strings) image.insert(image.end(), s.begin(), s.end() + 1);
+    return image;
+  }
+};
+
+// Compresses about as well as real Xtensa code: a prologue and epilogue,
+// 2- and 3-byte instructions on a few registers, small immediates, and
+// idioms repeated across functions
+static Bytes randomCode(std::mt19937& rng, size_t length) {
+  static const uint8_t opcodes[] = {0x0C, 0x1C, 0x22, 0x32, 0x42, 0x52, 0x62, 0x81, 0x91,
+                                    0xA0, 0xC0, 0xE5, 0xF0, 0x0D, 0x1D, 0x2D};
+  static Bytes idioms;
+  std::geometric_distribution<int> small(0.3);
+  Bytes code = {0x36, 0x41, 0x00};
+  while (code.size() < length) {
+    if (idioms.size() > 64 && rng() % 2 == 0) {
+      size_t at = rng() % (idioms.size() - 24);
+      code.insert(code.end(), idioms.begin() + at, idioms.begin() + at + 6 + rng() % 18);
+      continue;
+    }
+    size_t start = code.size();
+    code.push_back(opcodes[small(rng) % sizeof(opcodes)]);
+    code.push_back((uint8_t)((small(rng) % 8) << 4 | (small(rng) % 8)));
+    if (rng() % 3) code.push_back((uint8_t)small(rng));
+    if (idioms.size() < 65536) idioms.insert(idioms.end(), code.begin() + start, code.end());
+  }
+  code.push_back(0x1D);
+  code.push_back(0xF0);
+  return code;
+}
+
+static Firmware makeFirmware(std::mt19937& rng, size_t functionCount) {
+  static const char* words[] = {"gate", "mqtt", "relay", "limit", "open", "close", "error",
+                                "timeout", "sensor", "current", "schedule", "guest", "config",
+                                "failed", "connected", "%s", "%u", "state", "obstacle", "wifi"};
+  Firmware fw;
+  fw.functions.resize(functionCount);
+  for (auto& f : fw.functions) {
+    f.code = randomCode(rng, 40 + rng() % 400);
+    for (uint32_t c = rng() % 6; c > 0; c--) f.calls.push_back(rng() % functionCount);
+  }
+  for (int i = 0; i < 3000; i++) {
+    std::string s;
+    for (uint32_t w = 2 + rng() % 5; w > 0; w--) s += std::string(words[rng() % 20]) + " ";
+    fw.strings.push_back(s);
+  }
+  return fw;
+}
+
+// A typical release: a fix early in the image, a few tweaks, a new feature
+static Firmware nextRelease(Firmware fw, std::mt19937& rng) {
+  size_t n = fw.functions.size();
+  Bytes fix = randomCode(rng, 180);
+  Bytes& early = fw.functions[n / 5].code;
+  early.insert(early.begin() + early.size() / 2, fix.begin(), fix.end());
+  for (int i = 0; i < 12; i++) {
+    Bytes& code = fw.functions[rng() % n].code;
+    code[rng() % code.size()] ^= 0x5A;
+  }
+  fw.strings[10] = "gate firmware v2 ";
+  fw.strings[2500] += "with a longer message ";
+  Firmware::Function feature;
+  feature.code = randomCode(rng, 2000);
+  feature.calls = {1, 2, 3};
+  fw.functions.push_back(feature);
+  fw.functions[n / 2].calls.push_back((uint32_t)n);
+  return fw;
+}
+
+// =============================================================================
+// Self-Check
+// =============================================================================
+
+static int selfCheck() {
+  std::mt19937 rng(39);
+  Firmware v1 = makeFirmware(rng, 4000);
+  Firmware v2 = nextRelease(v1, rng);
+  Bytes oldImage = v1.link();
+  Bytes newImage = v2.link();
+
+  auto t0 = std::chrono::steady_clock::now();
+  Bytes delta = makePatch(&oldImage, newImage, DEFAULT_WINDOW_BITS);
+  double diffMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  Bytes full = makePatch(nullptr, newImage, DEFAULT_WINDOW_BITS);
+
+  // ---------------------------------------------------------------------------
+  // Round trips
+  // ---------------------------------------------------------------------------
+
+  MemoryFlash flash;
+  flash.base = &oldImage;
+  t0 = std::chrono::steady_clock::now();
+  OtaPatchResult result = applyPatch(flash, delta);
+  double applyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  expect(result == OTA_PATCH_OK, "delta applies");
+  expect(flash.slot == newImage, "delta rebuilds the new image");
+
+  result = applyPatch(flash, full, 1436, 4096, DEFAULT_WINDOW_BITS, &rng);
+  expect(result == OTA_PATCH_OK && flash.slot == newImage, "full patch, uneven chunks, 4 KB budget");
+
+  result = applyPatch(flash, delta, 1436, 4096, DEFAULT_WINDOW_BITS, &rng);
+  expect(result == OTA_PATCH_OK && flash.slot == newImage, "delta, uneven chunks, 4 KB budget");
+
+  result = applyPatch(flash, delta, 1, 1, DEFAULT_WINDOW_BITS);
+  expect(result == OTA_PATCH_OK && flash.slot == newImage, "delta, one byte and one write at a time");
+
+  Bytes same = makePatch(&oldImage, oldImage, DEFAULT_WINDOW_BITS);
+  result = applyPatch(flash, same);
+  expect(result == OTA_PATCH_OK && flash.slot == oldImage, "delta to the same build");
+  expect(same.size() < 200, "unchanged build is a tiny patch");
+
+  Bytes wide = makePatch(&oldImage, newImage, 16);
+  result = applyPatch(flash, wide);
+  expect(result == OTA_PATCH_OK && flash.slot == newImage, "64 KB window");
+
+  // ---------------------------------------------------------------------------
+  // Refusals
+  // ---------------------------------------------------------------------------
+
+  Bytes otherBase = oldImage;
+  otherBase[otherBase.size() / 2] ^= 1;
+  MemoryFlash other;
+  other.base = &otherBase;
+  result = applyPatch(other, delta);
+  expect(result == OTA_PATCH_BASE_MISMATCH, "delta against another build refused");
+  expect(other.slot.empty(), "nothing written before the base is checked");
+
+  Bytes shorter(oldImage.begin(), oldImage.end() - 100);
+  other.base = &shorter;
+  expect(applyPatch(other, delta) == OTA_PATCH_READ_FAILED, "base shorter than the patch expects");
+
+  Bytes truncated(delta.begin(), delta.end() - 10);
+  expect(applyPatch(flash, truncated) == OTA_PATCH_TRUNCATED, "truncated patch refused");
+
+  Bytes trailing = delta;
+  trailing.push_back(0);
+  expect(applyPatch(flash, trailing) == OTA_PATCH_CORRUPT, "trailing bytes refused");
+
+  Bytes badMagic = delta;
+  badMagic[0] ^= 0xFF;
+  expect(applyPatch(flash, badMagic) == OTA_PATCH_BAD_HEADER, "bad magic refused");
+
+  expect(applyPatch(flash, wide, 0, UINT32_MAX, DEFAULT_WINDOW_BITS) == OTA_PATCH_UNSUPPORTED,
+         "window above the device limit refused");
+
+  MemoryFlash small;
+  small.base = &oldImage;
+  small.slotBytes = (uint32_t)newImage.size() - 1;
+  expect(applyPatch(small, delta) == OTA_PATCH_NO_SPACE, "image larger than the slot refused");
+
+  Bytes wrongTarget = full;
+  wrongTarget[offsetof(OtaPatchHeader, targetSha256)] ^= 1;
+  expect(applyPatch(flash, wrongTarget) == OTA_PATCH_HASH_MISMATCH, "target hash checked");
+
+  // Any corrupted body byte is refused, never applied
+  int accepted = 0;
+  for (int i = 0; i < 300; i++) {
+    Bytes bad = i % 2 ? delta : full;
+    size_t at = OTA_PATCH_HEADER_BYTES + rng() % (bad.size() - OTA_PATCH_HEADER_BYTES);
+    bad[at] ^= (uint8_t)(1 + rng() % 255);
+    if (applyPatch(flash, bad) == OTA_PATCH_OK) accepted++;
+  }
+  expect(accepted == 0, "corrupted patches refused");
+
+  // ---------------------------------------------------------------------------
+  // Report
+  // ---------------------------------------------------------------------------
+
+  const double linkBytesPerS = 20000;     // Weak site WiFi
+  printf("image          %8zu bytes  %6.1f s at 20 KB/s\n", newImage.size(),
+         newImage.size() / linkBytesPerS);
+  printf("full patch     %8zu bytes  %6.1f s  (%.0f%%)\n", full.size(), full.size() / linkBytesPerS,
+         100.0 * full.size() / newImage.size());
+  printf("delta patch    %8zu bytes  %6.1f s  (%.1f%%, %.0fx smaller)\n", delta.size(),
+         delta.size() / linkBytesPerS, 100.0 * delta.size() / newImage.size(),
+         (double)newImage.size() / delta.size());
+  printf("diff %.0f ms, apply %.1f ms on the host\n", diffMs, applyMs);
+  printf("device RAM: %zu byte patcher + %u byte window\n", sizeof(Patcher),
+         1u << DEFAULT_WINDOW_BITS);
+  expect(delta.size() * 10 <= newImage.size(), "delta an order of magnitude below the image");
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+static uint8_t windowOption(int argc, char** argv, int from) {
+  for (int i = from; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--window") == 0) return (uint8_t)atoi(argv[i + 1]);
+  }
+  return DEFAULT_WINDOW_BITS;
+}
+
+static void printHeader(const OtaPatchHeader& header, size_t patchSize) {
+  printf("%s patch v%u, window %u bits, %zu bytes\n",
+         header.kind == OTA_PATCH_DELTA ? "delta" : "full", header.version, header.windowBits,
+         patchSize);
+  if (header.kind == OTA_PATCH_DELTA) {
+    printf("  base   %8u bytes  sha256 ", header.baseSize);
+    for (uint8_t b : header.baseSha256) printf("%02x", b);
+    printf("\n");
+  }
+  printf("  target %8u bytes  sha256 ", header.targetSize);
+  for (uint8_t b : header.targetSha256) printf("%02x", b);
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) return selfCheck();
+  std::string command = argv[1];
+
+  if ((command == "diff" && argc >= 5) || (command == "pack" && argc >= 4)) {
+    bool diff = command == "diff";
+    Bytes oldImage, newImage;
+    if ((diff && !readAll(argv[2], oldImage)) || !readAll(argv[diff ? 3 : 2], newImage)) {
+      fprintf(stderr, "cannot read input\n");
+      return 1;
+    }
+    uint8_t windowBits = windowOption(argc, argv, diff ? 5 : 4);
+    if (windowBits < OTA_PATCH_WINDOW_BITS_MIN || windowBits > OTA_PATCH_WINDOW_BITS_MAX) {
+      fprintf(stderr, "window must be %u..%u bits\n", OTA_PATCH_WINDOW_BITS_MIN,
+              OTA_PATCH_WINDOW_BITS_MAX);
+      return 1;
+    }
+    Bytes patch = makePatch(diff ? &oldImage : nullptr, newImage, windowBits);
+
+    // Never ship a patch that does not apply
+    MemoryFlash flash;
+    flash.base = &oldImage;
+    flash.slotBytes = UINT32_MAX;
+    if (applyPatch(flash, patch) != OTA_PATCH_OK || flash.slot != newImage) {
+      fprintf(stderr, "patch does not rebuild the image\n");
+      return 1;
+    }
+    if (!writeAll(argv[diff ? 4 : 3], patch)) {
+      fprintf(stderr, "cannot write %s\n", argv[diff ? 4 : 3]);
+      return 1;
+    }
+    printHeader(*(const OtaPatchHeader*)patch.data(), patch.size());
+    return 0;
+  }
+
+  if (command == "apply" && argc >= 5) {
+    Bytes oldImage, patch;
+    if ((strcmp(argv[2], "-") != 0 && !readAll(argv[2], oldImage)) || !readAll(argv[3], patch)) {
+      fprintf(stderr, "cannot read input\n");
+      return 1;
+    }
+    MemoryFlash flash;
+    flash.base = &oldImage;
+    flash.slotBytes = UINT32_MAX;
+    OtaPatchResult result = applyPatch(flash, patch);
+    if (result != OTA_PATCH_OK) {
+      fprintf(stderr, "apply failed: %s\n", otaPatchResultName(result));
+      return 1;
+    }
+    if (!writeAll(argv[4], flash.slot)) {
+      fprintf(stderr, "cannot write %s\n", argv[4]);
+      return 1;
+    }
+    printf("%zu bytes written\n", flash.slot.size());
+    return 0;
+  }
+
+  if (command == "info" && argc >= 3) {
+    Bytes patch;
+    if (!readAll(argv[2], patch) || patch.size() < OTA_PATCH_HEADER_BYTES) {
+      fprintf(stderr, "cannot read a patch from %s\n", argv[2]);
+      return 1;
+    }
+    const OtaPatchHeader& header = *(const OtaPatchHeader*)patch.data();
+    if (header.magic != OTA_PATCH_MAGIC) {
+      fprintf(stderr, "%s: not a patch\n", argv[2]);
+      return 1;
+    }
+    printHeader(header, patch.size());
+    return 0;
+  }
+
+  fprintf(stderr, "usage: ota_delta [diff old new patch | pack new patch] [--window BITS]\n"
+                  "       ota_delta apply old|- patch out\n"
+                  "       ota_delta info patch\n");
+  return 2;
+}
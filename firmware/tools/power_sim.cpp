@@ -0,0 +1,282 @@
+// =============================================================================
+// GATEMATE Host Tool - Power Simulation
+// =============================================================================
+//
+// Runs the idle mode of src/power_policy.h through a simulated day at a
+// solar site: MQTT commands and button presses at random times, each moving
+// the gate for one full travel, loop() passes of random cost up to
+// POWER_PASS_BUDGET_MS, and a wake cost of up to POWER_WAKE_BUDGET_MS after
+// every idle wait. Network traffic reaches the station only at a beacon it
+// listens to: every beacon while active, every POWER_LISTEN_INTERVAL-th
+// while idle. Checks that
+//   - no pass runs idle while a gate moves
+//   - every MQTT command is handled within POWER_WORST_COMMAND_MS, and that
+//     within POWER_COMMAND_LATENCY_MS
+//   - every button press is handled within POWER_WORST_WAKE_MS
+//   - PowerMeter reports no late gap, and matches known input exactly
+// and reports the duty cycle, wake latency and an estimate of the mean
+// supply current against a loop() spinning at full clock, from the ESP32
+// datasheet figures below. Also times the per-pass policy and meter cost.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/power_sim.cpp -o power_sim
+//
+// Usage:
+//   ./power_sim [hours] [commands per hour]
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+
+#include "check.h"
+#include "gate_motion.h"
+#include "power_policy.h"
+
+// Supply current estimates (mA), ESP32 datasheet ranges
+static const double MA_ACTIVE = 50.0;         // Modem sleep, 240 MHz running (30-68)
+static const double MA_IDLE_PASS = 25.0;      // Modem sleep, 80 MHz running (20-31)
+static const double MA_LIGHT_SLEEP = 0.8;
+static const double MA_RX = 100.0;            // Radio listening to a beacon
+static const double BEACON_RX_MS = 2.0;
+
+static const uint64_t BEACON_US = 102400;
+static const uint64_t TRAVEL_US = 100 / GATE_STEP_PERCENT * GATE_STEP_MS * 1000ull;
+
+template <typename F>
+static double nsPerCall(int rounds, F body) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) body(i);
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+}
+
+static uint32_t ms(uint64_t us) { return (uint32_t)(us / 1000); }
+
+// =============================================================================
+// Policy and Meter
+// =============================================================================
+
+static void checkPolicy() {
+  PowerInputs in = {100000, 100000 - POWER_ACTIVE_HOLD_MS, false, false};
+  expect(powerModeFor(in) == POWER_IDLE, "idle once the hold has passed");
+  in.lastActivityMs++;
+  expect(powerModeFor(in) == POWER_ACTIVE, "active within the hold");
+  in.lastActivityMs = 0;
+  in.moving = true;
+  expect(powerModeFor(in) == POWER_ACTIVE, "active while moving");
+  in.moving = false;
+  in.busy = true;
+  expect(powerModeFor(in) == POWER_ACTIVE, "active while busy");
+
+  // millis() wrapping between the activity and now
+  PowerInputs wrap = {1000, 0xFFFFFFFFu - 1000, false, false};
+  expect(powerModeFor(wrap) == POWER_ACTIVE, "hold across the millis() wrap");
+}
+
+static void checkMeter() {
+  // One 10 s window: 2 s active, then idle passes 100 ms apart, each with a
+  // 99 ms wait; every tenth ended by a pin after 200 us
+  PowerMeter meter;
+  uint32_t now = 0xFFFFF000u;               // Across the micros() wrap
+  meter.pass(now, POWER_ACTIVE);
+  now += 2000000;
+  uint32_t waits = 0;
+  for (int i = 0; i < 80; i++) {
+    expect(!meter.pass(now, POWER_IDLE), "no late gap in the meter window");
+    meter.waited(now + 1000, now + 100000, i % 10 == 0, 200);
+    waits++;
+    now += 100000;
+  }
+  meter.pass(now, POWER_ACTIVE);
+  const PowerStats& stats = meter.stats();
+  expect(stats.dutyPermille == 1000 - 80 * 99 / 10, "duty cycle");
+  expect(stats.idlePermille == 800, "idle share");
+  expect(stats.wakes == waits && stats.pinWakes == 8, "wake counts");
+  expect(stats.wakeAvgUs == 200 && stats.wakeMaxUs == 200, "wake latency");
+  expect(stats.maxGapMs == 100, "longest gap");
+
+  // A gap over the bound is counted and reported
+  meter.pass(now, POWER_IDLE);
+  now += (POWER_IDLE_GAP_MS + 1) * 1000;
+  expect(meter.pass(now, POWER_IDLE), "late gap reported");
+  expect(meter.lateGaps() == 1 && meter.lastGapMs() == POWER_IDLE_GAP_MS + 1, "late gap counted");
+}
+
+// =============================================================================
+// Simulated Day
+// =============================================================================
+
+struct DayResult {
+  uint64_t totalUs = 0;
+  uint64_t activePassUs = 0;
+  uint64_t idlePassUs = 0;
+  uint64_t wakeUs = 0;
+  uint64_t sleepUs = 0;
+  uint64_t listenedBeacons = 0;
+  uint32_t commands = 0;
+  uint32_t presses = 0;
+  uint64_t commandMaxUs = 0;
+  uint64_t commandSumUs = 0;
+  uint64_t pressMaxUs = 0;
+  uint64_t pressSumUs = 0;
+  uint32_t idleWhileMoving = 0;
+  uint32_t lateGaps = 0;
+};
+
+static DayResult simulateDay(double hours, double commandsPerHour, uint32_t seed) {
+  std::mt19937_64 rng(seed);
+  std::exponential_distribution<double> commandGap(commandsPerHour / 3600e6);
+  std::exponential_distribution<double> pressGap(commandsPerHour / 4 / 3600e6);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  // Pass cost: mostly short, one in a hundred up to the budget; 3x at 80 MHz
+  auto passCost = [&](PowerMode mode) {
+    uint64_t us = unit(rng) < 0.01 ? (uint64_t)(unit(rng) * POWER_PASS_BUDGET_MS * 1000 / 3)
+                                   : 150 + (uint64_t)(unit(rng) * 450);
+    return mode == POWER_IDLE ? us * 3 : us;
+  };
+  auto wakeCost = [&]() { return 300 + (uint64_t)(unit(rng) * (POWER_WAKE_BUDGET_MS * 1000 - 300)); };
+
+  // Delivery: the first beacon at or after the arrival that the station hears
+  auto delivery = [](uint64_t arrival, PowerMode mode) {
+    uint64_t every = mode == POWER_IDLE ? BEACON_US * POWER_LISTEN_INTERVAL : BEACON_US;
+    return (arrival + every - 1) / every * every;
+  };
+
+  DayResult r;
+  const uint64_t end = (uint64_t)(hours * 3600e6);
+  uint64_t t = 0;
+  uint64_t movingUntil = 0;
+  uint32_t lastActivityMs = 0;
+  PowerMode mode = POWER_ACTIVE;
+  PowerMeter meter;
+  std::deque<uint64_t> commands;
+  std::deque<uint64_t> presses;
+  uint64_t nextCommand = (uint64_t)commandGap(rng);
+  uint64_t nextPress = (uint64_t)pressGap(rng);
+  uint64_t lastBeacon = 0;
+
+  while (t < end) {
+    while (nextCommand <= t) {
+      commands.push_back(nextCommand);
+      nextCommand += (uint64_t)commandGap(rng) + 1;
+    }
+    while (nextPress <= t) {
+      presses.push_back(nextPress);
+      nextPress += (uint64_t)pressGap(rng) + 1;
+    }
+
+    // One pass: handles what has arrived, then the policy runs
+    uint64_t cost = passCost(mode);
+    uint64_t done = t + cost;
+    auto start = [&]() {
+      movingUntil = done + TRAVEL_US;
+      lastActivityMs = ms(done);
+    };
+    while (!commands.empty() && delivery(commands.front(), mode) <= t) {
+      uint64_t latency = done - commands.front();
+      r.commands++;
+      r.commandSumUs += latency;
+      if (latency > r.commandMaxUs) r.commandMaxUs = latency;
+      commands.pop_front();
+      start();
+    }
+    while (!presses.empty() && presses.front() <= t) {
+      uint64_t latency = done - presses.front();
+      r.presses++;
+      r.pressSumUs += latency;
+      if (latency > r.pressMaxUs) r.pressMaxUs = latency;
+      presses.pop_front();
+      start();
+    }
+    (mode == POWER_IDLE ? r.idlePassUs : r.activePassUs) += cost;
+    t = done;
+
+    // Step events keep the activity fresh while moving
+    bool moving = t < movingUntil;
+    if (moving) lastActivityMs = ms(t);
+    PowerInputs in = {ms(t), lastActivityMs, moving, false};
+    mode = powerModeFor(in);
+    if (moving && mode == POWER_IDLE) r.idleWhileMoving++;
+    if (meter.pass((uint32_t)t, mode)) r.lateGaps++;
+
+    // Beacons the radio listened to since the last pass
+    for (uint64_t b = (lastBeacon / BEACON_US + 1) * BEACON_US; b <= t; b += BEACON_US) {
+      if (mode == POWER_ACTIVE || (b / BEACON_US) % POWER_LISTEN_INTERVAL == 0) r.listenedBeacons++;
+    }
+    lastBeacon = t;
+
+    if (mode == POWER_ACTIVE) continue;
+
+    // Idle wait; a press during the pass ends it at once
+    if (nextPress <= t) {
+      lastActivityMs = ms(t);
+      continue;
+    }
+    uint64_t wake = t + POWER_IDLE_SLICE_MS * 1000;
+    bool pin = nextPress < wake;
+    if (pin) wake = nextPress;
+    uint64_t ramp = wakeCost();
+    meter.waited((uint32_t)t, (uint32_t)(wake + ramp), pin, (uint32_t)ramp);
+    r.sleepUs += wake - t;
+    r.wakeUs += ramp;
+    t = wake + ramp;
+    if (pin) lastActivityMs = ms(t);
+  }
+
+  r.totalUs = t;
+  return r;
+}
+
+int main(int argc, char** argv) {
+  double hours = argc > 1 ? atof(argv[1]) : 24.0;
+  double perHour = argc > 2 ? atof(argv[2]) : 4.0;
+
+  checkPolicy();
+  checkMeter();
+
+  printf("latency bound %u ms: worst MQTT command %u ms, worst wake pin %u ms\n",
+         POWER_COMMAND_LATENCY_MS, POWER_WORST_COMMAND_MS, POWER_WORST_WAKE_MS);
+
+  DayResult r = simulateDay(hours, perHour, 43);
+  double total = (double)r.totalUs;
+  double awake = r.activePassUs + r.idlePassUs + r.wakeUs;
+  printf("%.0f h, %u MQTT commands, %u button presses\n", hours, r.commands, r.presses);
+  printf("active %.2f %%, duty cycle %.3f %% (%.3f %% while idle)\n",
+         100.0 * r.activePassUs / total, 100.0 * awake / total,
+         100.0 * (r.idlePassUs + r.wakeUs) / (total - r.activePassUs));
+  printf("MQTT command latency: avg %.1f ms, max %.1f ms\n",
+         r.commands ? r.commandSumUs / 1000.0 / r.commands : 0.0, r.commandMaxUs / 1000.0);
+  printf("button latency:       avg %.2f ms, max %.2f ms\n",
+         r.presses ? r.pressSumUs / 1000.0 / r.presses : 0.0, r.pressMaxUs / 1000.0);
+
+  expect(r.commands > 0 && r.presses > 0, "the day had commands and presses");
+  expect(r.idleWhileMoving == 0, "never idle while a gate moves");
+  expect(r.commandMaxUs <= POWER_WORST_COMMAND_MS * 1000ull, "MQTT commands within the worst case");
+  expect(r.commandMaxUs <= POWER_COMMAND_LATENCY_MS * 1000ull, "MQTT commands within the bound");
+  expect(r.pressMaxUs <= POWER_WORST_WAKE_MS * 1000ull, "button presses within the worst case");
+  expect(r.lateGaps == 0, "no idle gap over the bound");
+
+  // Mean supply current, managed against spinning at 240 MHz on DTIM 1
+  double hourMs = total / 1000.0;
+  double rxMs = r.listenedBeacons * BEACON_RX_MS;
+  double managed = (MA_ACTIVE * r.activePassUs / 1000.0 + MA_IDLE_PASS * (r.idlePassUs + r.wakeUs) / 1000.0 +
+                    MA_LIGHT_SLEEP * r.sleepUs / 1000.0 + MA_RX * rxMs) / hourMs;
+  double spinning = MA_ACTIVE + MA_RX * BEACON_RX_MS / (BEACON_US / 1000.0);
+  printf("mean current (estimate): %.1f mA spinning, %.1f mA managed\n", spinning, managed);
+
+  // Per pass: policy and meter
+  PowerMeter meter;
+  uint32_t sink = 0;
+  double passNs = nsPerCall(1 << 24, [&](int i) {
+    PowerInputs in = {(uint32_t)i, (uint32_t)i - (i & 0x1FFF), (i & 0x7000) == 0, false};
+    PowerMode mode = powerModeFor(in);
+    sink += meter.pass((uint32_t)i * 64, mode) + mode;
+  });
+  printf("policy + meter per pass: %.2f ns (%u)\n", passNs, sink & 1);
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
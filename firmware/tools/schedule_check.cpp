@@ -0,0 +1,193 @@
+// =============================================================================
+// GATEMATE Host Tool - Schedule Check
+// =============================================================================
+//
+// Runs the on-device schedule engine (src/schedule.h, src/timer_wheel.h)
+// over a simulated year in several time zones, with and without DST, and
+// compares every firing against a brute-force expectation: each entry
+// once per matching local calendar day, at the first instant that shows
+// its wall time. The loop is ticked at 1 to 10 second steps to cover the
+// catch-up path. Fails on a missed, duplicated or early firing. Also
+// reports the cost per tick and per arm.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/schedule_check.cpp -o schedule_check
+//
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "schedule.h"
+
+typedef std::pair<uint8_t, time_t> Firing;   // Entry index, due time
+
+static const time_t START = 1767225600;          // 2026-01-01 00:00 UTC
+static const time_t END = START + 400 * 86400;
+
+static ScheduleSet makeSet(std::mt19937& rng) {
+  ScheduleSet set = {};
+  set.version = 1;
+
+  // Fixed edge cases: midnight, inside the EU/US spring-forward gap, inside
+  // the fall-back overlap, last second of the day
+  const uint8_t fixed[][3] = {{0, 0, 0}, {2, 30, 0}, {1, 30, 0}, {2, 15, 30}, {23, 59, 59}};
+  for (const auto& t : fixed) {
+    ScheduleEntry& e = set.entries[set.count];
+    snprintf(e.id, sizeof(e.id), "fixed-%u", set.count);
+    e.action = 1;
+    e.hour = t[0];
+    e.minute = t[1];
+    e.second = t[2];
+    e.days = 0x7F;
+    e.flags = SCHEDULE_ENABLED;
+    set.count++;
+  }
+
+  while (set.count < SCHEDULE_MAX) {
+    ScheduleEntry& e = set.entries[set.count];
+    snprintf(e.id, sizeof(e.id), "random-%u", set.count);
+    e.action = 1 + rng() % 2;
+    e.hour = rng() % 24;
+    e.minute = rng() % 60;
+    e.second = rng() % 60;
+    e.days = rng() % 0x80;
+    e.flags = rng() % 8 ? SCHEDULE_ENABLED : 0;
+    set.count++;
+  }
+  return set;
+}
+
+// One firing per entry per matching local date
+static std::vector<Firing> expected(const ScheduleSet& set, time_t from, time_t to) {
+  std::vector<Firing> out;
+  struct tm first;
+  localtime_r(&from, &first);
+  for (int day = -1; day < (to - from) / 86400 + 2; day++) {
+    struct tm date = {};
+    date.tm_year = first.tm_year;
+    date.tm_mon = first.tm_mon;
+    date.tm_mday = first.tm_mday + day;
+    date.tm_hour = 12;
+    date.tm_isdst = -1;
+    mktime(&date);
+
+    for (uint8_t i = 0; i < set.count; i++) {
+      const ScheduleEntry& e = set.entries[i];
+      if (!(e.flags & SCHEDULE_ENABLED) || !(e.days & (1 << date.tm_wday))) continue;
+      // Earliest instant showing this wall time, by trying every UTC
+      // offset in 15 minute steps
+      struct tm wall = date;
+      wall.tm_hour = e.hour;
+      wall.tm_min = e.minute;
+      wall.tm_sec = e.second;
+      time_t asUtc = timegm(&wall);
+      time_t t = 0;
+      for (int offset = 15 * 3600; offset >= -15 * 3600 && t == 0; offset -= 900) {
+        time_t probe = asUtc - offset;
+        struct tm check;
+        localtime_r(&probe, &check);
+        if (check.tm_mday == date.tm_mday && check.tm_hour == e.hour &&
+            check.tm_min == e.minute && check.tm_sec == e.second) {
+          t = probe;
+        }
+      }
+      if (t == 0) {
+        // Skipped by a spring-forward change: the C library's shifted time
+        wall.tm_isdst = -1;
+        t = mktime(&wall);
+      }
+      if (t > from && t <= to) out.push_back(Firing(i, t));
+    }
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+static int runZone(const char* tz, uint32_t seed) {
+  setenv("TZ", tz, 1);
+  tzset();
+
+  std::mt19937 rng(seed);
+  ScheduleSet set = makeSet(rng);
+  strncpy(set.tz, tz, sizeof(set.tz) - 1);
+
+  ScheduleEngine engine;
+  engine.load(set);
+
+  std::vector<Firing> fired;
+  uint32_t early = 0;
+  uint64_t ticks = 0;
+  auto begin = std::chrono::steady_clock::now();
+
+  time_t now = START;
+  engine.loop(now, [](const ScheduleEntry&, time_t) {});   // Arms
+  while (now < END) {
+    // Mostly 1 s ticks, sometimes a blocked loop
+    now += rng() % 50 ? 1 : 1 + rng() % 10;
+    engine.loop(now, [&](const ScheduleEntry& entry, time_t due) {
+      fired.push_back(Firing((uint8_t)(&entry - engine.get().entries), due));
+      if (due > now) early++;
+    });
+    ticks++;
+  }
+  double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+  std::vector<Firing> want = expected(set, START, now);
+  std::sort(fired.begin(), fired.end());
+
+  std::vector<Firing> missing, extra;
+  std::set_difference(want.begin(), want.end(), fired.begin(), fired.end(),
+                      std::back_inserter(missing));
+  std::set_difference(fired.begin(), fired.end(), want.begin(), want.end(),
+                      std::back_inserter(extra));
+
+  printf("%-32s %6zu firings, %zu missing, %zu extra, %u early | %.0f ns/tick\n",
+         tz, fired.size(), missing.size(), extra.size(), early, totalMs * 1e6 / ticks);
+
+  for (size_t i = 0; i < missing.size() && i < 5; i++) {
+    printf("  missing %s at %ld\n", set.entries[missing[i].first].id, (long)missing[i].second);
+  }
+  for (size_t i = 0; i < extra.size() && i < 5; i++) {
+    printf("  extra %s at %ld\n", set.entries[extra[i].first].id, (long)extra[i].second);
+  }
+  return missing.empty() && extra.empty() && early == 0 ? 0 : 1;
+}
+
+// Re-arm cost at full capacity
+static void benchArm() {
+  TimerWheel<SCHEDULE_MAX> wheel;
+  wheel.reset((uint32_t)START);
+  std::mt19937 rng(3);
+  const int rounds = 2000000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    wheel.arm(i % SCHEDULE_MAX, (uint32_t)START + 1 + rng() % (14 * 86400));
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+  printf("arm: %.1f ns (includes rng)\n", ns / rounds);
+}
+
+int main() {
+  const char* zones[] = {
+    "WIB-7",                          // No DST
+    "CET-1CEST,M3.5.0,M10.5.0/3",     // EU rules
+    "EST5EDT,M3.2.0,M11.1.0",         // US rules
+    "ACST-9:30ACDT,M10.1.0,M4.1.0/3", // Southern hemisphere, half-hour offset
+  };
+
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++) {
+    failures += runZone(zones[i], 11 + (uint32_t)i);
+  }
+  benchArm();
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
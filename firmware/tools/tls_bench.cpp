@@ -0,0 +1,648 @@
+// =============================================================================
+// GATEMATE Host Tool - TLS Session Resumption Benchmark
+// =============================================================================
+//
+// Connects to a TLS MQTT broker the way TlsClient in src/tls_transport.h
+// does - TLS 1.2, ECDHE-ECDSA-AES128-GCM-SHA256 on P-256, 2048-byte
+// fragments, the session kept in a TlsSessionSlot from src/tls_session.h -
+// drops the connection without a close_notify (a WiFi blip), reconnects
+// and reports, per handshake kind:
+//   full      - no session offered: key exchange and certificate check
+//   ticket    - resumed from the broker's session ticket
+//   id        - resumed by session id from the broker's cache
+// the handshake time, the time to CONNACK, the crypto heap it peaks at and
+// still holds once connected, and the bytes on the wire.
+//
+// Also checks that every reconnect resumes, that a resumed session keeps
+// the offered master secret (how TlsClient tells a resumption), that the
+// slot is not offered to another peer or when corrupted or expired, and
+// that a broker which lost its keys falls back to a full handshake.
+//
+// By default the broker is in-process, on loopback, with a fresh P-256
+// certificate. On a PC P-256 costs a fraction of a millisecond and the
+// per-connection overhead is most of what remains, so the ratios shown are
+// a floor: on the ESP32 the key exchange and certificate check that a
+// resumption skips are most of a full handshake. The wire bytes carry over
+// as they are. The device's own figures are under "tls" in GET /config.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/tls_bench.cpp -o tls_bench -pthread -lssl -lcrypto
+//
+// Usage:
+//   ./tls_bench [--reconnects N] [--broker HOST:PORT --ca FILE]
+//
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "tls_session.h"
+#include "mqtt_wire.h"
+
+#define BENCH_HOST      "localhost"
+#define BENCH_CIPHERS   "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256"
+#define BENCH_EPOCH     1760000000u
+
+static double nowMs() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The client's own crypto work, without the broker's or the kernel's waits
+static double cpuMs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// =============================================================================
+// Crypto Heap
+// =============================================================================
+
+// OpenSSL's allocations on the calling thread, so the broker's do not count
+static thread_local long heapLive = 0;
+static thread_local long heapPeak = 0;
+
+static void* heapMalloc(size_t size, const char*, int) {
+  size_t* block = (size_t*)malloc(size + sizeof(max_align_t));
+  if (!block) return nullptr;
+  *block = size;
+  heapLive += size;
+  heapPeak = std::max(heapPeak, heapLive);
+  return (char*)block + sizeof(max_align_t);
+}
+
+static void heapFree(void* p, const char*, int) {
+  if (!p) return;
+  size_t* block = (size_t*)((char*)p - sizeof(max_align_t));
+  heapLive -= *block;
+  free(block);
+}
+
+static void* heapRealloc(void* p, size_t size, const char* file, int line) {
+  if (!p) return heapMalloc(size, file, line);
+  if (size == 0) {
+    heapFree(p, file, line);
+    return nullptr;
+  }
+  size_t* block = (size_t*)((char*)p - sizeof(max_align_t));
+  size_t old = *block;
+  block = (size_t*)realloc(block, size + sizeof(max_align_t));
+  if (!block) return nullptr;
+  *block = size;
+  heapLive += (long)size - (long)old;
+  heapPeak = std::max(heapPeak, heapLive);
+  return (char*)block + sizeof(max_align_t);
+}
+
+// =============================================================================
+// Wire Bytes
+// =============================================================================
+
+static thread_local size_t wireBytes = 0;
+
+static long countBytes(BIO*, int oper, const char*, size_t, int, long, int ret, size_t* done) {
+  if ((oper == (BIO_CB_READ | BIO_CB_RETURN) || oper == (BIO_CB_WRITE | BIO_CB_RETURN)) &&
+      ret > 0 && done) {
+    wireBytes += *done;
+  }
+  return ret;
+}
+
+// =============================================================================
+// Broker
+// =============================================================================
+
+struct Credentials {
+  EVP_PKEY* key = nullptr;
+  X509* cert = nullptr;
+};
+
+static Credentials makeCredentials() {
+  Credentials out;
+  out.key = EVP_EC_gen("P-256");
+  out.cert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(out.cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(out.cert), -3600);
+  X509_gmtime_adj(X509_getm_notAfter(out.cert), 86400);
+  X509_NAME* name = X509_get_subject_name(out.cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)BENCH_HOST, -1, -1,
+                             0);
+  X509_set_issuer_name(out.cert, name);
+  X509_set_pubkey(out.cert, out.key);
+  X509_sign(out.cert, out.key, EVP_sha256());
+  return out;
+}
+
+// Fresh contexts have fresh ticket keys and an empty session cache
+static SSL_CTX* brokerContext(const Credentials& credentials) {
+  SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_cipher_list(ctx, BENCH_CIPHERS);
+  SSL_CTX_set1_groups_list(ctx, "P-256");
+  SSL_CTX_use_certificate(ctx, credentials.cert);
+  SSL_CTX_use_PrivateKey(ctx, credentials.key);
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"gatemate", 8);
+  SSL_CTX_set_timeout(ctx, TLS_SESSION_LIFETIME_S);
+  // A dropped client stays resumable, as in mbedtls' cache; OpenSSL would
+  // otherwise take the missing close_notify as fatal and evict the session
+  // (see also Broker::run)
+  SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+  return ctx;
+}
+
+// CONNECT -> CONNACK, PINGREQ -> PINGRESP, until the client goes away
+static void serveMqtt(SSL* ssl) {
+  std::string buffer;
+  for (;;) {
+    char chunk[2048];
+    int n = SSL_read(ssl, chunk, sizeof(chunk));
+    if (n <= 0) return;
+    buffer.append(chunk, n);
+    mqtt::Packet packet;
+    int rc;
+    while ((rc = mqtt::parse(buffer, packet)) == 1) {
+      if (packet.type == mqtt::CONNECT) {
+        static const char connack[] = {0x20, 0x02, 0x00, 0x00};
+        SSL_write(ssl, connack, sizeof(connack));
+      } else if (packet.type == mqtt::PINGREQ) {
+        static const char pingresp[] = {(char)0xD0, 0x00};
+        SSL_write(ssl, pingresp, sizeof(pingresp));
+      } else if (packet.type == mqtt::DISCONNECT) {
+        return;
+      }
+    }
+    if (rc < 0) return;
+  }
+}
+
+struct Broker {
+  int listener = -1;
+  uint16_t port = 0;
+  std::atomic<SSL_CTX*> ctx{nullptr};
+  std::atomic<bool> stop{false};
+  std::thread thread;
+
+  void run() {
+    while (!stop) {
+      int fd = accept(listener, nullptr, nullptr);
+      if (fd < 0 || stop) {
+        if (fd >= 0) close(fd);
+        continue;
+      }
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      SSL* ssl = SSL_new(ctx.load());
+      SSL_set_fd(ssl, fd);
+      if (SSL_accept(ssl) == 1) serveMqtt(ssl);
+      SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+      SSL_free(ssl);
+      close(fd);
+    }
+  }
+
+  bool start(SSL_CTX* initial) {
+    ctx = initial;
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLength = sizeof(addr);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0 ||
+        getsockname(listener, (sockaddr*)&addr, &addrLength) != 0) {
+      return false;
+    }
+    port = ntohs(addr.sin_port);
+    thread = std::thread(&Broker::run, this);
+    return true;
+  }
+
+  void shutdown() {
+    stop = true;
+    // Wake accept() with a last connection
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    connect(fd, (sockaddr*)&addr, sizeof(addr));
+    close(fd);
+    thread.join();
+    close(listener);
+  }
+};
+
+// =============================================================================
+// Client (as TlsClient)
+// =============================================================================
+
+static SSL_CTX* clientContext(X509_STORE* trust, bool tickets) {
+  SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_cipher_list(ctx, BENCH_CIPHERS);
+  SSL_CTX_set1_groups_list(ctx, "P-256");
+  X509_STORE_up_ref(trust);
+  SSL_CTX_set_cert_store(ctx, trust);
+  SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+  if (!tickets) SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  return ctx;
+}
+
+struct Handshake {
+  bool ok = false;
+  bool offered = false;
+  bool resumed = false;       // SSL_session_reused()
+  bool sameMaster = false;    // TlsClient's test
+  double handshakeMs = 0;
+  double cpuMs = 0;
+  double connackMs = 0;
+  long peakHeap = 0;
+  long heldHeap = 0;
+  size_t wire = 0;
+};
+
+struct Connection {
+  int fd = -1;
+  SSL* ssl = nullptr;
+
+  // Without close_notify, like a WiFi drop
+  void drop() {
+    if (ssl) SSL_free(ssl);
+    if (fd >= 0) close(fd);
+    ssl = nullptr;
+    fd = -1;
+  }
+};
+
+static int dial(const char* host, uint16_t port) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* found;
+  char service[6];
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &found) != 0) return -1;
+  int fd = socket(found->ai_family, found->ai_socktype, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, found->ai_addr, found->ai_addrlen) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(found);
+  return fd;
+}
+
+// Offers the slot's session, handshakes, keeps the new session in the slot
+// and sends an MQTT CONNECT
+static Handshake connectBroker(SSL_CTX* ctx, TlsSessionSlot& slot, const char* host,
+                               uint16_t port, uint32_t epoch, Connection& conn) {
+  Handshake result;
+  uint32_t peer = tlsPeerHash(host, port);
+  long base = heapLive;
+  heapPeak = heapLive;
+  wireBytes = 0;
+  double start = nowMs();
+  double startCpu = cpuMs();
+
+  conn.fd = dial(host, port);
+  if (conn.fd < 0) return result;
+  conn.ssl = SSL_new(ctx);
+  SSL_set_fd(conn.ssl, conn.fd);
+  BIO_set_callback_ex(SSL_get_rbio(conn.ssl), countBytes);
+  SSL_set_tlsext_host_name(conn.ssl, host);
+  SSL_set1_host(conn.ssl, host);
+  SSL_set_tlsext_max_fragment_length(conn.ssl, TLSEXT_max_fragment_length_2048);
+
+  SSL_SESSION* offered = nullptr;
+  const uint8_t* data;
+  size_t length = tlsSessionLoad(slot, peer, epoch, data);
+  if (length) {
+    const unsigned char* p = data;
+    offered = d2i_SSL_SESSION(nullptr, &p, (long)length);
+    result.offered = offered && SSL_set_session(conn.ssl, offered) == 1;
+  }
+
+  if (SSL_connect(conn.ssl) != 1) {
+    if (result.offered) tlsSessionForget(slot);
+    SSL_SESSION_free(offered);
+    conn.drop();
+    return result;
+  }
+  result.handshakeMs = nowMs() - start;
+  result.cpuMs = cpuMs() - startCpu;
+  result.resumed = SSL_session_reused(conn.ssl);
+
+  SSL_SESSION* fresh = SSL_get1_session(conn.ssl);
+  if (offered) {
+    uint8_t a[SSL_MAX_MASTER_KEY_LENGTH], b[SSL_MAX_MASTER_KEY_LENGTH];
+    size_t la = SSL_SESSION_get_master_key(offered, a, sizeof(a));
+    size_t lb = SSL_SESSION_get_master_key(fresh, b, sizeof(b));
+    result.sameMaster = la == lb && memcmp(a, b, la) == 0;
+  }
+  uint8_t buffer[TLS_SESSION_MAX];
+  int saved = i2d_SSL_SESSION(fresh, nullptr);
+  unsigned char* out = buffer;
+  if (saved <= 0 || saved > (int)sizeof(buffer) || i2d_SSL_SESSION(fresh, &out) != saved ||
+      !tlsSessionStore(slot, peer, buffer, saved, epoch)) {
+    tlsSessionForget(slot);
+  }
+  SSL_SESSION_free(fresh);
+  SSL_SESSION_free(offered);
+
+  std::string packet;
+  mqtt::connect(packet, "tls-bench", 60);
+  SSL_write(conn.ssl, packet.data(), (int)packet.size());
+  std::string received;
+  mqtt::Packet connack;
+  int rc = 0;
+  while (rc == 0) {
+    char chunk[64];
+    int n = SSL_read(conn.ssl, chunk, sizeof(chunk));
+    if (n <= 0) break;
+    received.append(chunk, n);
+    rc = mqtt::parse(received, connack);
+  }
+  result.connackMs = nowMs() - start;
+  result.ok = rc == 1 && connack.type == mqtt::CONNACK && connack.returnCode == 0;
+  result.peakHeap = heapPeak - base;
+  result.heldHeap = heapLive - base;
+  result.wire = wireBytes;
+  return result;
+}
+
+// =============================================================================
+// Scenarios
+// =============================================================================
+
+struct Summary {
+  const char* name;
+  std::vector<Handshake> runs;
+};
+
+static double median(std::vector<double> values) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+static void report(const Summary& s) {
+  std::vector<double> hs, cpu, ready;
+  long peak = 0, held = 0;
+  size_t wire = 0;
+  for (const Handshake& h : s.runs) {
+    hs.push_back(h.handshakeMs);
+    cpu.push_back(h.cpuMs);
+    ready.push_back(h.connackMs);
+    peak = std::max(peak, h.peakHeap);
+    held = std::max(held, h.heldHeap);
+    wire = std::max(wire, h.wire);
+  }
+  printf("  %-7s %4zu  %9.3f  %9.3f  %8.3f  %8.3f  %7ld  %7ld  %6zu\n", s.name,
+         s.runs.size(), median(hs), *std::max_element(hs.begin(), hs.end()), median(cpu),
+         median(ready), peak, held, wire);
+}
+
+static double medianOf(const Summary& s, double Handshake::*field) {
+  std::vector<double> values;
+  for (const Handshake& h : s.runs) values.push_back(h.*field);
+  return median(values);
+}
+
+static size_t maxWire(const Summary& s) {
+  size_t wire = 0;
+  for (const Handshake& h : s.runs) wire = std::max(wire, h.wire);
+  return wire;
+}
+
+static size_t minWire(const Summary& s) {
+  size_t wire = SIZE_MAX;
+  for (const Handshake& h : s.runs) wire = std::min(wire, h.wire);
+  return wire;
+}
+
+// One full handshake, then reconnects after a drop that must all resume
+static void runResumed(SSL_CTX* ctx, const char* host, uint16_t port, int reconnects,
+                       Summary& full, Summary& resumed) {
+  TlsSessionSlot slot = {};
+  Connection conn;
+  for (int i = 0; i <= reconnects; i++) {
+    Handshake h = connectBroker(ctx, slot, host, port, BENCH_EPOCH + i, conn);
+    conn.drop();
+    expect(h.ok, "reconnect reaches CONNACK");
+    expect(h.sameMaster == h.resumed, "master secret comparison agrees with the library");
+    if (i == 0) {
+      expect(!h.offered && !h.resumed, "first connect is a full handshake");
+      full.runs.push_back(h);
+    } else {
+      expect(h.offered && h.resumed, "reconnect after a drop resumes");
+      resumed.runs.push_back(h);
+    }
+  }
+}
+
+static void runFull(SSL_CTX* ctx, const char* host, uint16_t port, int count, Summary& full) {
+  Connection conn;
+  for (int i = 0; i < count; i++) {
+    TlsSessionSlot slot = {};
+    Handshake h = connectBroker(ctx, slot, host, port, BENCH_EPOCH, conn);
+    conn.drop();
+    expect(h.ok && !h.resumed, "connect without a session is a full handshake");
+    full.runs.push_back(h);
+  }
+}
+
+// The slot only offers what it should
+static void checkSlot(SSL_CTX* ctx, const char* host, uint16_t port) {
+  TlsSessionSlot slot = {};
+  Connection conn;
+  Handshake h = connectBroker(ctx, slot, host, port, BENCH_EPOCH, conn);
+  conn.drop();
+  expect(h.ok && slot.magic == TLS_SESSION_MAGIC, "session stored after the handshake");
+  expect(slot.length > 0 && slot.length <= TLS_SESSION_MAX, "session fits the slot");
+
+  const uint8_t* data;
+  uint32_t peer = tlsPeerHash(host, port);
+  expect(tlsSessionLoad(slot, peer, BENCH_EPOCH, data) == slot.length, "slot offered to its peer");
+  expect(tlsSessionLoad(slot, tlsPeerHash(host, port + 1), BENCH_EPOCH, data) == 0,
+         "slot not offered to another port");
+  expect(tlsSessionLoad(slot, tlsPeerHash("broker.example", port), BENCH_EPOCH, data) == 0,
+         "slot not offered to another host");
+  expect(tlsSessionLoad(slot, peer, BENCH_EPOCH + TLS_SESSION_LIFETIME_S + 1, data) == 0,
+         "expired slot not offered");
+  expect(tlsSessionLoad(slot, peer, 1000, data) == slot.length,
+         "age not checked while the clock is not set");
+
+  TlsSessionSlot corrupt = slot;
+  corrupt.data[corrupt.length / 2] ^= 0x40;
+  expect(tlsSessionLoad(corrupt, peer, BENCH_EPOCH, data) == 0, "corrupted slot not offered");
+  corrupt = slot;
+  corrupt.length = TLS_SESSION_MAX + 1;
+  expect(tlsSessionLoad(corrupt, peer, BENCH_EPOCH, data) == 0, "oversized length not offered");
+
+  TlsSessionSlot unset = {};
+  expect(tlsSessionStore(unset, peer, slot.data, slot.length, 1000) && unset.savedAt == 0,
+         "store before the clock is set keeps no age");
+  uint8_t big[TLS_SESSION_MAX + 1] = {};
+  expect(!tlsSessionStore(unset, peer, big, sizeof(big), BENCH_EPOCH) &&
+             unset.magic != TLS_SESSION_MAGIC,
+         "oversized session clears the slot");
+}
+
+// A broker restart loses ticket keys and cache: one full handshake, then
+// the new session resumes
+static void checkBrokerRestart(Broker& broker, const Credentials& credentials, SSL_CTX* ctx) {
+  TlsSessionSlot slot = {};
+  Connection conn;
+  connectBroker(ctx, slot, BENCH_HOST, broker.port, BENCH_EPOCH, conn);
+  conn.drop();
+
+  SSL_CTX* old = broker.ctx.exchange(brokerContext(credentials));
+  Handshake h = connectBroker(ctx, slot, BENCH_HOST, broker.port, BENCH_EPOCH, conn);
+  conn.drop();
+  expect(h.ok && h.offered && !h.resumed, "rejected session falls back to a full handshake");
+  expect(!h.sameMaster, "fallback not taken for a resumption");
+  h = connectBroker(ctx, slot, BENCH_HOST, broker.port, BENCH_EPOCH, conn);
+  conn.drop();
+  expect(h.ok && h.resumed, "session from the fallback resumes");
+  SSL_CTX_free(old);
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(int argc, char** argv) {
+  // Before OpenSSL allocates anything
+  CRYPTO_set_mem_functions(heapMalloc, heapRealloc, heapFree);
+
+  int reconnects = 50;
+  std::string brokerHost;
+  uint16_t brokerPort = MQTT_TLS_PORT;
+  const char* caFile = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--reconnects") == 0 && i + 1 < argc) {
+      reconnects = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--broker") == 0 && i + 1 < argc) {
+      brokerHost = argv[++i];
+      size_t colon = brokerHost.rfind(':');
+      if (colon != std::string::npos) {
+        brokerPort = (uint16_t)atoi(brokerHost.c_str() + colon + 1);
+        brokerHost.resize(colon);
+      }
+    } else if (strcmp(argv[i], "--ca") == 0 && i + 1 < argc) {
+      caFile = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--reconnects N] [--broker HOST:PORT --ca FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!brokerHost.empty() && !caFile) {
+    fprintf(stderr, "--broker needs --ca\n");
+    return 2;
+  }
+
+  Credentials credentials;
+  Broker broker;
+  X509_STORE* trust = X509_STORE_new();
+  const char* host = BENCH_HOST;
+  uint16_t port;
+  if (brokerHost.empty()) {
+    credentials = makeCredentials();
+    X509_STORE_add_cert(trust, credentials.cert);
+    if (!broker.start(brokerContext(credentials))) {
+      perror("listen");
+      return 1;
+    }
+    port = broker.port;
+  } else {
+    if (X509_STORE_load_file(trust, caFile) != 1) {
+      fprintf(stderr, "cannot load %s\n", caFile);
+      return 1;
+    }
+    host = brokerHost.c_str();
+    port = brokerPort;
+  }
+
+  SSL_CTX* tickets = clientContext(trust, true);
+  SSL_CTX* ids = clientContext(trust, false);
+
+  // Library initialization is not part of a handshake
+  {
+    TlsSessionSlot slot = {};
+    Connection conn;
+    Handshake h = connectBroker(tickets, slot, host, port, BENCH_EPOCH, conn);
+    conn.drop();
+    if (!h.ok) {
+      ERR_print_errors_fp(stderr);
+      fprintf(stderr, "cannot connect to %s:%u\n", host, port);
+      return 1;
+    }
+  }
+
+  Summary full = {"full", {}};
+  Summary ticket = {"ticket", {}};
+  Summary id = {"id", {}};
+  runFull(tickets, host, port, reconnects, full);
+  runResumed(tickets, host, port, reconnects, full, ticket);
+  runResumed(ids, host, port, reconnects, full, id);
+  checkSlot(tickets, host, port);
+  if (brokerHost.empty()) checkBrokerRestart(broker, credentials, tickets);
+
+  printf("%s:%u, TLS 1.2, %d reconnects after a drop\n", host, port, reconnects);
+  printf("  kind       n  hs med ms  hs max ms    cpu ms  ready ms   peak B   held B  wire B\n");
+  report(full);
+  report(ticket);
+  report(id);
+
+  double fullMs = medianOf(full, &Handshake::handshakeMs);
+  double fullCpu = medianOf(full, &Handshake::cpuMs);
+  printf("  resumed vs full: ticket %.0f%% time, %.0f%% cpu; id %.0f%% time, %.0f%% cpu\n",
+         100 * medianOf(ticket, &Handshake::handshakeMs) / fullMs,
+         100 * medianOf(ticket, &Handshake::cpuMs) / fullCpu,
+         100 * medianOf(id, &Handshake::handshakeMs) / fullMs,
+         100 * medianOf(id, &Handshake::cpuMs) / fullCpu);
+  expect(medianOf(ticket, &Handshake::handshakeMs) < fullMs, "ticket resumption is faster");
+  expect(medianOf(id, &Handshake::handshakeMs) < fullMs, "session id resumption is faster");
+  expect(medianOf(ticket, &Handshake::cpuMs) < fullCpu * 3 / 4,
+         "ticket resumption saves a quarter of the cpu");
+  expect(medianOf(id, &Handshake::cpuMs) < fullCpu * 3 / 4,
+         "session id resumption saves a quarter of the cpu");
+  expect(maxWire(ticket) < minWire(full), "ticket resumption moves fewer bytes");
+  expect(maxWire(id) < minWire(full), "session id resumption moves fewer bytes");
+
+  if (brokerHost.empty()) broker.shutdown();
+  SSL_CTX_free(tickets);
+  SSL_CTX_free(ids);
+  X509_STORE_free(trust);
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
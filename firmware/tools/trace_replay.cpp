@@ -0,0 +1,590 @@
+// =============================================================================
+// GATEMATE Host Tool - Trace Replay
+// =============================================================================
+//
+// Deterministic replay of traces recorded by the firmware (POST /trace/start,
+// see src/trace.h) through a host build of the gate logic: the same sensor
+// chain (src/sensor_chain.h), safety rules (src/safety_rules.h) and movement
+// steps (src/gate_motion.h), ticked at 1 ms of trace time as fast as the
+// host allows.
+//
+// For every trace the replayed stop decisions are compared with the ones
+// the device recorded, and the reaction latency of each safety stop is
+// measured from the input that caused it (raw current or temperature
+// crossing the limit, obstacle or limit switch edge, timeout deadline).
+// Threshold overrides show how decisions would change on the same field
+// data before a new value is pushed to the fleet.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/trace_replay.cpp -o trace_replay
+//
+// Usage:
+//   ./trace_replay --check traces/*.bin
+//   ./trace_replay --max-current 6.5 --obstacle-debounce 30 traces/*.bin
+//   ./trace_replay --generate 200 --out traces      (synthetic traces)
+//
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "gate_controller.h"
+#include "gate_fsm.h"
+#include "gate_motion.h"
+#include "history.h"
+#include "safety_rules.h"
+#include "sensor_chain.h"
+#include "trace.h"
+
+// =============================================================================
+// Trace Files
+// =============================================================================
+
+struct Trace {
+  std::string path;
+  TraceHeader header;
+  std::vector<TraceRecord> records;
+};
+
+static bool loadTrace(const char* path, Trace& trace, std::string& error) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    error = "cannot open";
+    return false;
+  }
+  trace.path = path;
+  trace.records.clear();
+  bool ok = fread(&trace.header, sizeof(TraceHeader), 1, file) == 1;
+  if (!ok || trace.header.magic != TRACE_MAGIC) {
+    error = "not a GATEMATE trace";
+  } else if (trace.header.version < 1 || trace.header.version > TRACE_VERSION ||
+             trace.header.recordSize != sizeof(TraceRecord)) {
+    error = "unsupported trace version";
+    ok = false;
+  } else {
+    TraceRecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1) trace.records.push_back(record);
+  }
+  fclose(file);
+  return ok;
+}
+
+static bool saveTrace(const std::string& path, const TraceHeader& header,
+                      const std::vector<TraceRecord>& records) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) return false;
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(records.data(), sizeof(TraceRecord), records.size(), file);
+  return fclose(file) == 0;
+}
+
+// =============================================================================
+// Host Gate Model
+// =============================================================================
+
+struct StopEvent {
+  uint32_t timeMs;
+  uint8_t reason;
+  uint8_t percentage;
+  int32_t latencyMs;    // -1 when not a safety stop or no trigger seen
+};
+
+static inline bool reached(uint32_t now, uint32_t time) { return (int32_t)(now - time) >= 0; }
+
+// Mirrors GateController (src/gate_controller.h) for the first gate, the
+// one traces are recorded for
+class ReplayGate {
+private:
+  SafetyLimits limits;
+  SensorChain chain;
+  DebouncedInput obstacleInput;
+  GateState state = GATE_CLOSED;
+  uint8_t percentage = 0;
+  uint32_t operationStartMs = 0;
+  uint32_t lastStepMs = 0;
+  uint32_t blockedUntil = 0;
+  float current = 0.0f;
+  float temperature = 0.0f;
+  bool pins[64];
+
+  // Latency triggers
+  uint32_t pinEdgeMs[64] = {};
+  bool currentOver = false;
+  uint32_t currentOverMs = 0;
+  bool temperatureOver = false;
+  uint32_t temperatureOverMs = 0;
+
+  bool moving() const { return state == GATE_OPENING || state == GATE_CLOSING; }
+
+  int32_t latencyOf(StopReason reason, uint32_t now) const {
+    switch (reason) {
+      case STOP_TIMEOUT:
+        return (int32_t)(now - (operationStartMs + limits.maxOperationTime));
+      case STOP_OBSTACLE:
+        return (int32_t)(now - pinEdgeMs[OBSTACLE_SENSOR]);
+      case STOP_OVERCURRENT:
+        return currentOver ? (int32_t)(now - currentOverMs) : -1;
+      case STOP_OVERHEAT:
+        return temperatureOver ? (int32_t)(now - temperatureOverMs) : -1;
+      case STOP_LIMIT:
+        return (int32_t)(now - pinEdgeMs[percentage == 100 ? LIMIT_OPEN : LIMIT_CLOSE]);
+      default:
+        return -1;
+    }
+  }
+
+  // GateController::dispatch() on the same table, without the relays and
+  // the operation records
+  void dispatch(uint32_t now, GateInput input, StopReason reason) {
+    GateState from = state;
+    state = gateNextState(from, input, percentage);
+    if (state == from) return;
+
+    uint8_t actions = gateTransitionActions(from, state);
+    if (actions & GATE_ACT_AT_OPEN) percentage = 100;
+    if (actions & GATE_ACT_AT_CLOSED) percentage = 0;
+    if (actions & GATE_ACT_BEGIN_OPERATION) {
+      operationStartMs = now;
+      blockedUntil = now + GATE_INTERLOCK_MS;
+    }
+    if (actions & GATE_ACT_REPORT_STOP) {
+      stops.push_back({now, (uint8_t)reason, percentage, latencyOf(reason, now)});
+    }
+  }
+
+  void stop(uint32_t now, StopReason reason) { dispatch(now, gateInputFor(reason), reason); }
+
+public:
+  std::vector<StopEvent> stops;
+
+  void begin(const TraceHeader& header, const SafetyLimits& safetyLimits) {
+    limits = safetyLimits;
+    state = (GateState)header.state;
+    percentage = header.percentage;
+    lastStepMs = header.lastStepMs;
+    blockedUntil = header.startMs;
+    std::fill(pins, pins + 64, true);   // Pull-ups: inactive
+  }
+
+  GateState getState() const { return state; }
+
+  void apply(const TraceRecord& record) {
+    uint32_t now = record.timeMs;
+    switch (record.type) {
+      case TRACE_ADC: {
+        // Version 1 traces have every channel in every record
+        uint8_t channels = record.arg ? record.arg : (uint8_t)SENSOR_CH_ALL;
+        SensorReading reading =
+            chain.update(channels, record.value[0], record.value[1], record.value[2]);
+        current = reading.currentMa / 1000.0f;
+        temperature = reading.temperatureCc / 100.0f;
+
+        if (channels & SENSOR_CH_CURRENT) {
+          bool over = currentFromRaw(record.value[0]) / 1000.0f > limits.maxCurrent;
+          if (over && !currentOver) currentOverMs = now;
+          currentOver = over;
+        }
+        if (channels & SENSOR_CH_TEMPERATURE) {
+          bool over = SensorChain::ntc.toCentiCelsius(record.value[2]) / 100.0f >
+                      limits.maxTemperature;
+          if (over && !temperatureOver) temperatureOverMs = now;
+          temperatureOver = over;
+        }
+        break;
+      }
+      case TRACE_GPIO:
+        if (record.arg < 64) {
+          if (pins[record.arg] != (record.value[0] != 0)) pinEdgeMs[record.arg] = now;
+          pins[record.arg] = record.value[0] != 0;
+        }
+        break;
+      case TRACE_COMMAND:
+        switch ((GateCommand)record.arg) {
+          case GATE_CMD_OPEN:
+            dispatch(now, GATE_IN_OPEN, STOP_REVERSED);
+            break;
+          case GATE_CMD_CLOSE:
+            dispatch(now, GATE_IN_CLOSE, STOP_REVERSED);
+            break;
+          case GATE_CMD_STOP:
+            stop(now, STOP_MANUAL);
+            break;
+          case GATE_CMD_PARTIAL:
+            if (record.value[0] > percentage) {
+              dispatch(now, GATE_IN_OPEN, STOP_REVERSED);
+            } else if (record.value[0] < percentage) {
+              dispatch(now, GATE_IN_CLOSE, STOP_REVERSED);
+            }
+            break;
+          default:
+            break;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  // One pass of GateController::loop() at trace time now
+  void tick(uint32_t now) {
+    if (!reached(now, blockedUntil) || !moving()) return;
+
+    // Position step
+    if (now - lastStepMs >= GATE_STEP_MS) {
+      lastStepMs = now;
+      if (stepGatePosition(state, percentage)) {
+        stop(now, STOP_COMPLETED);
+        return;
+      }
+    }
+
+    // Safety rules
+    SafetyInputs in;
+    in.nowMs = now;
+    in.operationStartMs = operationStartMs;
+    in.state = state;
+    in.obstacle = obstacleInput.update(!pins[OBSTACLE_SENSOR], now, limits.obstacleDebounceMs);
+    in.limitOpen = !pins[LIMIT_OPEN];
+    in.limitClose = !pins[LIMIT_CLOSE];
+    in.current = current;
+    in.temperature = temperature;
+
+    StopReason reason;
+    if (evaluateSafety(limits, in, reason)) stop(now, reason);
+  }
+};
+
+// =============================================================================
+// Replay
+// =============================================================================
+
+struct ReplayResult {
+  std::vector<StopEvent> recorded;
+  std::vector<StopEvent> replayed;
+  uint32_t durationMs = 0;
+  uint32_t mismatches = 0;
+};
+
+static ReplayResult replay(const Trace& trace, const SafetyLimits& limits, uint32_t toleranceMs) {
+  ReplayResult result;
+  ReplayGate gate;
+  gate.begin(trace.header, limits);
+
+  uint32_t start = trace.header.startMs;
+  uint32_t end = trace.records.empty() ? start : trace.records.back().timeMs;
+  size_t next = 0;
+  for (uint32_t now = start;; now++) {
+    while (next < trace.records.size() && reached(now, trace.records[next].timeMs)) {
+      const TraceRecord& record = trace.records[next++];
+      if (record.type == TRACE_STOP) {
+        result.recorded.push_back({record.timeMs, record.arg, (uint8_t)record.value[0], -1});
+      } else {
+        gate.apply(record);
+      }
+    }
+    gate.tick(now);
+    if (now == end) break;
+  }
+
+  result.replayed = gate.stops;
+  result.durationMs = end - start;
+
+  size_t count = std::max(result.recorded.size(), result.replayed.size());
+  for (size_t i = 0; i < count; i++) {
+    if (i >= result.recorded.size() || i >= result.replayed.size()) {
+      result.mismatches++;
+      continue;
+    }
+    const StopEvent& a = result.recorded[i];
+    const StopEvent& b = result.replayed[i];
+    uint32_t dt = a.timeMs > b.timeMs ? a.timeMs - b.timeMs : b.timeMs - a.timeMs;
+    if (a.reason != b.reason || a.percentage != b.percentage || dt > toleranceMs) {
+      result.mismatches++;
+    }
+  }
+  return result;
+}
+
+static void printStop(const char* label, const StopEvent& stop, uint32_t startMs) {
+  printf("    %s %8.3f s  %-11s at %3u%%", label, (stop.timeMs - startMs) / 1000.0,
+         stopReasonName(stop.reason), stop.percentage);
+  if (stop.latencyMs >= 0) printf("  latency %d ms", stop.latencyMs);
+  printf("\n");
+}
+
+// =============================================================================
+// Synthetic Traces
+// =============================================================================
+
+// Inverse conversions for generated ADC readings
+static uint16_t rawFromMilliVolts(double mv) {
+  long raw = lround(mv * 4095.0 / 3300.0);
+  return (uint16_t)std::max(0L, std::min(4095L, raw));
+}
+
+static uint16_t rawFromCurrent(double amps) {
+  return rawFromMilliVolts(ACS712_ZERO_MV + amps * ACS712_MV_PER_A);
+}
+
+static uint16_t rawFromTemperature(double celsius) {
+  uint16_t best = 0;
+  int32_t bestError = INT32_MAX;
+  for (uint16_t raw = 0; raw < 4096; raw++) {
+    int32_t error = abs(SensorChain::ntc.toCentiCelsius(raw) - (int32_t)lround(celsius * 100.0));
+    if (error < bestError) {
+      bestError = error;
+      best = raw;
+    }
+  }
+  return best;
+}
+
+enum Scenario {
+  SCENARIO_FULL_OPEN = 0,
+  SCENARIO_STALL_CLOSE,
+  SCENARIO_OBSTACLE_CLOSE,
+  SCENARIO_LIMIT_OPEN,
+  SCENARIO_MANUAL_STOP,
+  SCENARIO_COUNT
+};
+
+// Runs a device model on the ReplayGate and records what the firmware's
+// recorder would: conversions at the ACQ_* channel rates, pin edges,
+// commands, stops.
+static void generateTrace(uint32_t seed, Scenario scenario, TraceHeader& header,
+                          std::vector<TraceRecord>& records) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0.0, 0.15);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  bool closing = scenario == SCENARIO_STALL_CLOSE || scenario == SCENARIO_OBSTACLE_CLOSE;
+  header = {};
+  header.magic = TRACE_MAGIC;
+  header.version = TRACE_VERSION;
+  header.recordSize = sizeof(TraceRecord);
+  header.startMs = 100000 + (rng() % 100000);
+  header.lastStepMs = header.startMs - (rng() % GATE_STEP_MS);
+  header.state = closing ? GATE_OPEN : GATE_CLOSED;
+  header.percentage = closing ? 100 : 0;
+  snprintf(header.deviceId, sizeof(header.deviceId), "synthetic-%u", seed);
+
+  SafetyLimits limits = {GATE_TIMEOUT_MS, (float)CURRENT_THRESHOLD_STALL,
+                         (float)TEMP_SHUTDOWN, OBSTACLE_DEBOUNCE_MS};
+  ReplayGate device;
+  device.begin(header, limits);
+  records.clear();
+
+  uint32_t t0 = header.startMs;
+  uint32_t commandAt = t0 + 200 + rng() % 300;
+  uint32_t eventAt = commandAt + 1500 + rng() % 3000;
+  uint32_t end = commandAt + 10000;
+  double temperature = 28.0 + unit(rng) * 10.0;
+  uint32_t movingSince = 0;
+  bool wasMoving = false;
+
+  auto emit = [&](TraceRecord record) {
+    records.push_back(record);
+    device.apply(record);
+  };
+
+  emit({t0, TRACE_GPIO, OBSTACLE_SENSOR, {1, 0, 0}});
+  emit({t0, TRACE_GPIO, LIMIT_OPEN, {1, 0, 0}});
+  emit({t0, TRACE_GPIO, LIMIT_CLOSE, {1, 0, 0}});
+
+  for (uint32_t now = t0; now != end; now++) {
+    size_t before = device.stops.size();
+    if (now == commandAt) {
+      if (scenario == SCENARIO_MANUAL_STOP || !closing) {
+        emit({now, TRACE_COMMAND, GATE_CMD_OPEN, {100, 0, 0}});
+      } else {
+        emit({now, TRACE_COMMAND, GATE_CMD_CLOSE, {0, 0, 0}});
+      }
+    }
+    if (now == eventAt) {
+      if (scenario == SCENARIO_OBSTACLE_CLOSE) emit({now, TRACE_GPIO, OBSTACLE_SENSOR, {0, 0, 0}});
+      if (scenario == SCENARIO_LIMIT_OPEN) emit({now, TRACE_GPIO, LIMIT_OPEN, {0, 0, 0}});
+      if (scenario == SCENARIO_MANUAL_STOP) emit({now, TRACE_COMMAND, GATE_CMD_STOP, {0, 0, 0}});
+    }
+    if (scenario == SCENARIO_OBSTACLE_CLOSE && now == eventAt + 2000) {
+      emit({now, TRACE_GPIO, OBSTACLE_SENSOR, {1, 0, 0}});
+    }
+
+    GateState state = device.getState();
+    bool moving = state == GATE_OPENING || state == GATE_CLOSING;
+    if (moving && !wasMoving) movingSince = now;
+    wasMoving = moving;
+
+    uint8_t channels = 0;
+    if ((now - t0) % ACQ_CURRENT_PERIOD_MS == 0) channels |= SENSOR_CH_CURRENT;
+    if ((now - t0) % ACQ_VOLTAGE_PERIOD_MS == 0) channels |= SENSOR_CH_VOLTAGE;
+    if ((now - t0) % ACQ_TEMP_PERIOD_MS == 0) channels |= SENSOR_CH_TEMPERATURE;
+    if (channels) {
+      double amps = 0.05 + noise(rng) * 0.2;
+      if (moving) {
+        double t = (now - movingSince) / 1000.0;
+        amps = 2.5 + 3.5 * exp(-t / 0.08) + noise(rng);
+        if (scenario == SCENARIO_STALL_CLOSE && reached(now, eventAt)) {
+          amps += std::min(6.5, (now - eventAt) / 400.0 * 6.5);
+        }
+        if (unit(rng) < 0.01) amps = 12.0;    // Commutation spike
+      }
+      temperature += moving ? 0.002 : -0.0005;
+      emit({now, TRACE_ADC, channels,
+            {rawFromCurrent(std::max(0.0, amps)), rawFromMilliVolts(24000.0 / VOLTAGE_DIVIDER_RATIO),
+             rawFromTemperature(temperature)}});
+    }
+
+    device.tick(now);
+    for (size_t i = before; i < device.stops.size(); i++) {
+      const StopEvent& stop = device.stops[i];
+      records.push_back({stop.timeMs, TRACE_STOP, stop.reason, {stop.percentage, 0, 0}});
+    }
+  }
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+    "Usage: %s [options] TRACE...\n"
+    "  --max-current A          Override maxCurrent (%.1f)\n"
+    "  --max-temp C             Override maxTemperature (%.1f)\n"
+    "  --max-time MS            Override maxOperationTime (%d)\n"
+    "  --obstacle-debounce MS   Obstacle debounce (%d)\n"
+    "  --check                  Fail when replayed stops differ from the recorded ones\n"
+    "  --tolerance MS           Stop time tolerance for --check (2)\n"
+    "  --max-latency MS         Fail when a safety stop reacts slower\n"
+    "  --verbose                Print every stop\n"
+    "  --generate N --out DIR   Write N synthetic traces\n",
+    argv0, CURRENT_THRESHOLD_STALL, TEMP_SHUTDOWN, GATE_TIMEOUT_MS, OBSTACLE_DEBOUNCE_MS);
+}
+
+int main(int argc, char** argv) {
+  SafetyLimits limits = {GATE_TIMEOUT_MS, (float)CURRENT_THRESHOLD_STALL,
+                         (float)TEMP_SHUTDOWN, OBSTACLE_DEBOUNCE_MS};
+  bool check = false;
+  bool verbose = false;
+  uint32_t toleranceMs = 2;
+  int32_t maxLatencyMs = -1;
+  int generate = 0;
+  std::string outDir;
+  std::vector<const char*> paths;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--max-current" && hasValue) limits.maxCurrent = (float)atof(argv[++i]);
+    else if (arg == "--max-temp" && hasValue) limits.maxTemperature = (float)atof(argv[++i]);
+    else if (arg == "--max-time" && hasValue) limits.maxOperationTime = (uint32_t)atol(argv[++i]);
+    else if (arg == "--obstacle-debounce" && hasValue) limits.obstacleDebounceMs = (uint32_t)atol(argv[++i]);
+    else if (arg == "--tolerance" && hasValue) toleranceMs = (uint32_t)atol(argv[++i]);
+    else if (arg == "--max-latency" && hasValue) maxLatencyMs = atoi(argv[++i]);
+    else if (arg == "--generate" && hasValue) generate = atoi(argv[++i]);
+    else if (arg == "--out" && hasValue) outDir = argv[++i];
+    else if (arg == "--check") check = true;
+    else if (arg == "--verbose") verbose = true;
+    else if (arg.rfind("--", 0) == 0) {
+      usage(argv[0]);
+      return 2;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+
+  if (generate > 0) {
+    if (outDir.empty()) outDir = ".";
+    mkdir(outDir.c_str(), 0755);
+    for (int i = 0; i < generate; i++) {
+      TraceHeader header;
+      std::vector<TraceRecord> records;
+      generateTrace((uint32_t)i + 1, (Scenario)(i % SCENARIO_COUNT), header, records);
+      char name[64];
+      snprintf(name, sizeof(name), "/trace-%04d.bin", i);
+      if (!saveTrace(outDir + name, header, records)) {
+        fprintf(stderr, "Cannot write %s%s\n", outDir.c_str(), name);
+        return 1;
+      }
+    }
+    printf("Wrote %d synthetic traces to %s\n", generate, outDir.c_str());
+    if (paths.empty()) return 0;
+  }
+
+  if (paths.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // Aggregates per stop reason
+  std::vector<int32_t> latencies[8];
+  uint64_t traceMs = 0;
+  uint32_t mismatches = 0;
+  uint32_t slow = 0;
+  uint32_t failed = 0;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (const char* path : paths) {
+    Trace trace;
+    std::string error;
+    if (!loadTrace(path, trace, error)) {
+      printf("%s: %s\n", path, error.c_str());
+      failed++;
+      continue;
+    }
+
+    ReplayResult result = replay(trace, limits, toleranceMs);
+    traceMs += result.durationMs;
+    mismatches += result.mismatches;
+
+    bool traceSlow = false;
+    for (const StopEvent& stop : result.replayed) {
+      if (stop.latencyMs < 0 || stop.reason >= 8) continue;
+      latencies[stop.reason].push_back(stop.latencyMs);
+      if (maxLatencyMs >= 0 && stop.latencyMs > maxLatencyMs) traceSlow = true;
+    }
+    slow += traceSlow;
+
+    bool flagged = (check && result.mismatches > 0) || traceSlow;
+    if (verbose || flagged) {
+      printf("%s  %s  %.1f s  %zu recorded / %zu replayed stops%s%s\n", path,
+             trace.header.deviceId, result.durationMs / 1000.0,
+             result.recorded.size(), result.replayed.size(),
+             result.mismatches ? "  MISMATCH" : "", traceSlow ? "  SLOW" : "");
+      for (const StopEvent& stop : result.recorded) printStop("device", stop, trace.header.startMs);
+      for (const StopEvent& stop : result.replayed) printStop("replay", stop, trace.header.startMs);
+    }
+  }
+
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printf("\n=== Replay: %zu traces, %.1f s of trace time in %.3f s (%.0fx real time) ===\n",
+         paths.size(), traceMs / 1000.0, wallS, wallS > 0 ? traceMs / 1000.0 / wallS : 0.0);
+  printf("Limits: maxCurrent %.2f A, maxTemperature %.1f C, maxOperationTime %u ms, obstacle debounce %u ms\n",
+         limits.maxCurrent, limits.maxTemperature, (unsigned)limits.maxOperationTime,
+         (unsigned)limits.obstacleDebounceMs);
+  printf("%-12s %6s %10s %10s %10s\n", "stop", "count", "p50 ms", "p99 ms", "max ms");
+  for (uint8_t reason = 0; reason < 8; reason++) {
+    std::vector<int32_t>& values = latencies[reason];
+    if (values.empty()) continue;
+    std::sort(values.begin(), values.end());
+    printf("%-12s %6zu %10d %10d %10d\n", stopReasonName(reason), values.size(),
+           values[values.size() / 2], values[(values.size() - 1) * 99 / 100], values.back());
+  }
+  printf("Stop mismatches vs device: %u\n", mismatches);
+  if (maxLatencyMs >= 0) printf("Traces over %d ms latency: %u\n", maxLatencyMs, slow);
+
+  if (failed > 0) return 1;
+  if (check && mismatches > 0) return 1;
+  if (slow > 0) return 1;
+  return 0;
+}
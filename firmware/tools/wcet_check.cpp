@@ -0,0 +1,162 @@
+// =============================================================================
+// GATEMATE Host Tool - Safety Path WCET Check
+// =============================================================================
+//
+// Runs the adversarial harness in src/safety_wcet.h on the host: the real
+// GateController loop() pass, driven through every safety branch the build
+// enables, timed on the steady clock. Reports per branch the number of
+// passes, p50/p99/p99.9 and the maximum, and checks that
+//   - every pass took the branch its inputs were set up for, and every
+//     enabled branch was taken
+//   - the safety path never allocates
+//   - no branch's maximum is over WCET_HOST_BUDGET_US
+//   - the histogram buckets and percentiles bound the samples they hold
+//
+// A PC is not the ESP32, so the host budget catches regressions in the
+// code - string building, allocation, a loop over the history - rather
+// than bounding the device; the device runs the same harness at boot with
+// GATEMATE_SAFETY_WCET and reports cycle-counter figures under "wcet" in
+// GET /config. The maximum of a branch is the lowest over --rounds runs,
+// so one preemption by the host OS does not fail the check.
+//
+// `pio run -t wcet` (tools/wcet_gate.py) runs this with the environment's
+// feature flags. Host timings are a regression check; the device figures
+// are the authority.
+//
+// Build (from firmware/):
+//   g++ -std=c++17 -O2 -Isrc tools/wcet_check.cpp -o wcet_check
+//
+// Usage:
+//   ./wcet_check [--samples N] [--rounds N] [--budget-us N]
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "check.h"
+#include "safety_wcet.h"
+
+// Heap allocations; the safety path must not make any
+static std::atomic<unsigned long> allocations{0};
+
+void* operator new(size_t size) {
+  allocations++;
+  if (void* p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+struct HostClock {
+  typedef std::chrono::steady_clock::time_point Ticks;
+  static Ticks now() { return std::chrono::steady_clock::now(); }
+  static uint32_t elapsedNs(Ticks from, Ticks to) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+  }
+};
+
+// =============================================================================
+// Histogram
+// =============================================================================
+
+static void checkHistogram() {
+  bool bounded = true;
+  bool ordered = true;
+  uint8_t previous = 0;
+  for (uint32_t ns = 0; ns < 3000000; ns += 1 + ns / 64) {
+    uint8_t b = WcetHistogram::bucketOf(ns);
+    if (b < WCET_BUCKETS - 1 && WcetHistogram::bucketTop(b) <= ns) bounded = false;
+    if (b > 0 && WcetHistogram::bucketTop(b - 1) > ns) bounded = false;
+    if (b < previous) ordered = false;
+    previous = b;
+  }
+  expect(bounded, "every sample lies within its bucket");
+  expect(ordered, "buckets grow with the sample");
+  expect(WcetHistogram::bucketTop(WCET_BUCKETS - 2) > 1000000, "buckets reach past 1 ms");
+
+  WcetHistogram h;
+  for (uint32_t i = 1; i <= 1000; i++) h.record(i * 100);
+  expect(h.count() == 1000 && h.max() == 100000, "count and maximum");
+  expect(h.percentile(500) >= 50000 && h.percentile(500) <= 50000 * 5 / 4,
+         "p50 within a quarter octave above");
+  expect(h.percentile(990) >= 99000 && h.percentile(990) <= h.max(), "p99 bounded by the max");
+  expect(h.percentile(1000) == h.max(), "p100 is the maximum");
+
+  WcetMeter meter(1);
+  expect(!meter.record(WCET_CLEAR, 1000) && meter.record(WCET_CLEAR, 1001), "budget is inclusive");
+  expect(meter.overBudget() == 1 && meter.worst() == WCET_CLEAR, "over-budget count, worst branch");
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(int argc, char** argv) {
+  int samples = 2000;
+  int rounds = 5;
+  uint32_t budgetUs = WCET_HOST_BUDGET_US;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      samples = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+      rounds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--budget-us") == 0 && i + 1 < argc) {
+      budgetUs = (uint32_t)atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--samples N] [--rounds N] [--budget-us N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (samples < 1 || rounds < 1) return 2;
+
+  checkHistogram();
+
+  // All passes for the percentiles; per round for the maximum
+  WcetMeter all(budgetUs);
+  uint32_t bestMax[WCET_BRANCH_COUNT];
+  for (uint32_t& ns : bestMax) ns = UINT32_MAX;
+  bool branchesOk = true;
+
+  for (int r = 0; r < rounds; r++) {
+    SafetyWcetHarness<HostClock> harness;
+    WcetMeter round(budgetUs);
+    unsigned long before = allocations;
+    branchesOk &= harness.run(round, (uint16_t)samples);
+    expect(allocations == before, "safety path does not allocate");
+    for (uint8_t b = 0; b < WCET_BRANCH_COUNT; b++) {
+      const WcetHistogram& h = round.branch((SafetyBranch)b);
+      if (h.max() < bestMax[b]) bestMax[b] = h.max();
+    }
+    harness.run(all, (uint16_t)samples);
+  }
+  expect(branchesOk, "every pass takes the branch it was set up for");
+
+  printf("Safety path, one gate loop() pass: %d rounds x %d passes per branch\n", rounds, samples);
+  printf("  branch          n    p50 ns    p99 ns  p99.9 ns    max ns\n");
+  uint32_t worst = 0;
+  for (uint8_t b = 0; b < WCET_BRANCH_COUNT; b++) {
+    SafetyBranch branch = (SafetyBranch)b;
+    const WcetHistogram& h = all.branch(branch);
+    if (!safetyBranchEnabled(branch)) {
+      printf("  %-11s  (disabled in this build)\n", safetyBranchName(branch));
+      continue;
+    }
+    printf("  %-11s %6u  %8u  %8u  %8u  %8u\n", safetyBranchName(branch), h.count(),
+           h.percentile(500), h.percentile(990), h.percentile(999), bestMax[b]);
+    char what[64];
+    snprintf(what, sizeof(what), "branch %s taken", safetyBranchName(branch));
+    expect(h.count() > 0, what);
+    snprintf(what, sizeof(what), "branch %s within %u us", safetyBranchName(branch), budgetUs);
+    expect(bestMax[b] <= budgetUs * 1000u, what);
+    if (bestMax[b] > worst) worst = bestMax[b];
+  }
+  printf("  worst %.2f us, budget %u us (device %u us)\n", worst / 1000.0, budgetUs,
+         WCET_SAFETY_BUDGET_US);
+
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+# =============================================================================
+# GATEMATE ESP32 Firmware - Safety Path WCET Gate
+# =============================================================================
+#
+# PlatformIO custom target "wcet": compiles tools/wcet_check.cpp with the
+# host compiler and the environment's GATEMATE_* flags, so it checks the
+# safety branches this build has, and fails if a branch is over
+# WCET_HOST_BUDGET_US, allocates or does not take the branch its inputs
+# were set up for. Host timings vary with the machine and its load, so this
+# is an opt-in check, not part of every build; the figures the device
+# measures on its own cycle counter (GATEMATE_SAFETY_WCET) are the
+# authority.
+#
+# Usage (platformio.ini):
+#   extra_scripts = tools/wcet_gate.py
+#
+#   pio run -e esp32 -t wcet
+#
+
+import os
+import shlex
+import shutil
+import subprocess
+
+Import("env")  # noqa: F821 - provided by PlatformIO
+
+
+def feature_flags():
+    flags = env.GetProjectOption("build_flags", "")  # noqa: F821
+    if isinstance(flags, list):
+        flags = " ".join(flags)
+    flags += " " + os.environ.get("PLATFORMIO_BUILD_FLAGS", "")
+    return [f for f in shlex.split(flags) if f.startswith("-DGATEMATE_")]
+
+
+def wcet_gate(*args, **kwargs):
+    compiler = shutil.which("g++") or shutil.which("clang++")
+    if not compiler:
+        print("No host C++ compiler (g++ or clang++) for the safety WCET check")
+        env.Exit(1)  # noqa: F821
+
+    project = env.subst("$PROJECT_DIR")  # noqa: F821
+    out = os.path.join(env.subst("$BUILD_DIR"), "wcet_check")  # noqa: F821
+    os.makedirs(os.path.dirname(out), exist_ok=True)
+    cmd = [compiler, "-std=c++17", "-O2", "-I" + os.path.join(project, "src")]
+    cmd += feature_flags()
+    cmd += [os.path.join(project, "tools", "wcet_check.cpp"), "-o", out]
+    if subprocess.run(cmd).returncode != 0:
+        print("Safety WCET check failed to compile")
+        env.Exit(1)  # noqa: F821
+
+    result = subprocess.run([out], capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stdout)
+        print("Safety path over its host WCET budget")
+        env.Exit(1)  # noqa: F821
+    print(result.stdout.strip().splitlines()[-2])
+
+
+env.AddCustomTarget(  # noqa: F821
+    name="wcet",
+    dependencies=None,
+    actions=[wcet_gate],
+    title="Safety WCET",
+    description="Host check of the safety path against WCET_HOST_BUDGET_US",
+)